@@ -36,6 +36,8 @@ static char *buffer = NULL;
 static char *current_buffer;
 static unsigned int pointer;
 static int cr_received = 0;
+/* Views decoding a protocol want the bytes as they came */
+static gboolean raw_display = FALSE;
 char overlapped;
 
 extern guint virt_col_pos;
@@ -86,86 +88,211 @@ unsigned int insert_timestamp(char *buffer)
   return size;
 }
 
-void put_chars(const char *chars, unsigned int size, gboolean crlf_auto, gboolean esc_clear_screen)
+/* Receive filter for the ESC clear screen option */
+#define ESC_PENDING_MAX 16
+
+enum
 {
-	// buffer must still be valid after cr conversion or adding timestamp
-	// only pointer is copied below
-	char out_buffer[(BUFFER_RECEPTION*2) + TIMESTAMP_SIZE];
-	const char *characters;
+	ESC_STATE_NONE,
+	ESC_STATE_ESC,		/* ESC received */
+	ESC_STATE_CSI		/* ESC [ received, reading parameters */
+};
 
-	/* If the auto CR LF mode on, read the buffer to add \r before \n */
-	if(crlf_auto || timestamp_on || esc_clear_screen)
+enum
+{
+	ESC_PASS,		/* not part of a sequence */
+	ESC_HOLD,		/* kept back until the sequence is complete */
+	ESC_CLEAR,		/* clear screen sequence completed */
+	ESC_FLUSH,		/* another sequence, pass the held bytes */
+	ESC_FLUSH_PASS		/* not a sequence, pass the held bytes then this one */
+};
+
+static int esc_state = ESC_STATE_NONE;
+static char esc_pending[ESC_PENDING_MAX];
+static unsigned int esc_pending_len = 0;
+
+/*
+ * Recognize ESC c, CSI 2 J and CSI 3 J, even when split between two reads.
+ * Any other escape sequence is passed through untouched.
+ */
+static int esc_filter(char c)
+{
+	switch(esc_state)
 	{
-		int i, out_size = 0;
+	case ESC_STATE_NONE:
+		if(c != '\x1b')
+			return ESC_PASS;
+		esc_pending[0] = c;
+		esc_pending_len = 1;
+		esc_state = ESC_STATE_ESC;
+		return ESC_HOLD;
+
+	case ESC_STATE_ESC:
+		if(c == 'c')
+		{
+			esc_state = ESC_STATE_NONE;
+			esc_pending_len = 0;
+			return ESC_CLEAR;
+		}
+		if(c == '[')
+		{
+			esc_pending[esc_pending_len++] = c;
+			esc_state = ESC_STATE_CSI;
+			return ESC_HOLD;
+		}
+		break;
+
+	case ESC_STATE_CSI:
+		/* Parameter and intermediate bytes */
+		if(c >= 0x20 && c <= 0x3F)
+		{
+			if(esc_pending_len >= ESC_PENDING_MAX)
+				break;
+			esc_pending[esc_pending_len++] = c;
+			return ESC_HOLD;
+		}
+		if(c == 'J' && esc_pending_len == 3 &&
+		   (esc_pending[2] == '2' || esc_pending[2] == '3'))
+		{
+			esc_state = ESC_STATE_NONE;
+			esc_pending_len = 0;
+			return ESC_CLEAR;
+		}
+		/* Final byte of some other sequence, if there is room for it */
+		if(c >= 0x40 && c <= 0x7E && esc_pending_len < ESC_PENDING_MAX)
+		{
+			esc_pending[esc_pending_len++] = c;
+			esc_state = ESC_STATE_NONE;
+			return ESC_FLUSH;
+		}
+		break;
+	}
+
+	esc_state = ESC_STATE_NONE;
+	return ESC_FLUSH_PASS;
+}
+
+/*
+ * Length of the escape sequence at the start of text, ESC included, 0
+ * while more data is needed to tell. Strings (OSC, DCS...) end with BEL or ST.
+ */
+gsize escape_sequence_length(const gchar *text, gsize size)
+{
+	const guchar *c = (const guchar *)text;
+	gsize i;
+
+	if(size < 2)
+		return 0;
+
+	switch(c[1])
+	{
+	case '[':
+		for(i = 2; i < size; i++)
+		{
+			if(c[i] >= 0x40 && c[i] <= 0x7E)
+				return i + 1;
+			/* Neither a parameter nor an intermediate byte: broken */
+			if(c[i] < 0x20 || c[i] > 0x3F)
+				return i;
+		}
+		break;
+
+	case ']':
+	case 'P':
+	case 'X':
+	case '^':
+	case '_':
+		for(i = 2; i < size; i++)
+		{
+			if(c[i] == '\a')
+				return i + 1;
+			if(c[i] == 0x1B && i + 1 < size)
+				return c[i + 1] == '\\' ? i + 2 : i;
+		}
+		break;
+
+	default:
+		/* Intermediate bytes, then the final one */
+		for(i = 1; i < size; i++)
+		{
+			if(c[i] < 0x20 || c[i] > 0x2F)
+				return i + 1;
+		}
+		break;
+	}
+
+	return 0;
+}
+
+/* CR LF conversion and timestamps for one received char */
+static unsigned int line_discipline(char c, char *out, gboolean crlf_auto)
+{
+	unsigned int out_size = 0;
 
-		for (i=0; i<size; i++)
+	if(crlf_auto)
+	{
+		if (c == '\r')
 		{
-			if(esc_clear_screen && chars[i] == '\x1b')
+			/* If the previous character was a CR too, insert a newline */
+			if (cr_received)
 			{
-				clear_buffer();
-				continue;
+				out[out_size] = '\n';
+				out_size++;
+				need_to_write_timestamp = 1;
 			}
-			if(crlf_auto)
+			cr_received = 1;
+		}
+		else
+		{
+			if (c == '\n')
 			{
-				if (chars[i] == '\r')
+				/* If we get a newline without a CR first, insert a CR */
+				if (!cr_received)
 				{
-					/* If the previous character was a CR too, insert a newline */
-					if (cr_received)
-					{
-						out_buffer[out_size] = '\n';
-						out_size++;
-						need_to_write_timestamp = 1;
-					}
-					cr_received = 1;
+					out[out_size] = '\r';
+					out_size++;
 				}
-				else
+			}
+			else
+			{
+				/* If we receive a normal char, and the previous one was a
+				   CR insert a newline */
+				if (cr_received)
 				{
-					if (chars[i] == '\n')
-					{
-						/* If we get a newline without a CR first, insert a CR */
-						if (!cr_received)
-						{
-							out_buffer[out_size] = '\r';
-							out_size++;
-						}
-					}
-					else
-					{
-						/* If we receive a normal char, and the previous one was a
-						   CR insert a newline */
-						if (cr_received)
-						{
-							out_buffer[out_size] = '\n';
-							out_size++;
-							need_to_write_timestamp = 1;
-						}
-					}
-					cr_received = 0;
+					out[out_size] = '\n';
+					out_size++;
+					need_to_write_timestamp = 1;
 				}
-			} //if crlf_auto
-
-			if(need_to_write_timestamp)
-			{
-				out_size += insert_timestamp(&out_buffer[out_size]);
-				need_to_write_timestamp = 0;
 			}
+			cr_received = 0;
+		}
+	} //if crlf_auto
 
-			if(chars[i] == '\n' )
-			{
-				need_to_write_timestamp = 1; //remember until we have a new character to print
-			}
+	if(need_to_write_timestamp)
+	{
+		out_size += insert_timestamp(&out[out_size]);
+		need_to_write_timestamp = 0;
+	}
 
-			//copy each character to new buffer
-			out_buffer[out_size] = chars[i];
-			out_size++; // increment for each stored character
+	if(c == '\n' )
+	{
+		need_to_write_timestamp = 1; //remember until we have a new character to print
+	}
+
+	//copy each character to new buffer
+	out[out_size] = c;
+	out_size++; // increment for each stored character
 
-		} // for
+	return out_size;
+}
 
-		// set "incoming" data pointer to new buffer containing all normal and
-		// converted newline characters
-		chars = out_buffer;
-		size = out_size;
-	} // if(crlf_auto || timestamp_on || esc_clear_screen)
+/* Store chars in the buffer and display them */
+static void store_chars(const char *chars, unsigned int size)
+{
+	const char *characters;
+
+	if(size == 0)
+		return;
 
 	if(buffer == NULL)
 	{
@@ -203,6 +330,70 @@ void put_chars(const char *chars, unsigned int size, gboolean crlf_auto, gboolea
 		write_func(characters, size);
 }
 
+void put_chars(const char *chars, unsigned int size, gboolean crlf_auto, gboolean esc_clear_screen)
+{
+	char out_buffer[(BUFFER_RECEPTION*2) + TIMESTAMP_SIZE];
+	/* Room needed to convert one more char, or to pass a held sequence */
+	const unsigned int out_margin = (ESC_PENDING_MAX + 1) * (TIMESTAMP_SIZE + 2);
+	unsigned int j;
+	int i, action, out_size = 0;
+
+	/* Option switched off in the middle of a sequence */
+	if((!esc_clear_screen || raw_display) && esc_state != ESC_STATE_NONE)
+	{
+		store_chars(esc_pending, esc_pending_len);
+		esc_state = ESC_STATE_NONE;
+		esc_pending_len = 0;
+	}
+
+	if(raw_display || (!crlf_auto && !timestamp_on && !esc_clear_screen))
+	{
+		store_chars(chars, size);
+		return;
+	}
+
+	/* If the auto CR LF mode on, read the buffer to add \r before \n */
+	for (i=0; i<size; i++)
+	{
+		if(out_size + out_margin > sizeof(out_buffer))
+		{
+			store_chars(out_buffer, out_size);
+			out_size = 0;
+		}
+
+		if(esc_clear_screen)
+		{
+			action = esc_filter(chars[i]);
+			switch(action)
+			{
+			case ESC_HOLD:
+				continue;
+			case ESC_CLEAR:
+				/* Show what came before the sequence, then clear */
+				store_chars(out_buffer, out_size);
+				out_size = 0;
+				clear_buffer();
+				continue;
+			case ESC_FLUSH:
+			case ESC_FLUSH_PASS:
+				for(j = 0; j < esc_pending_len; j++)
+					out_size += line_discipline(esc_pending[j], &out_buffer[out_size], crlf_auto);
+				esc_pending_len = 0;
+				/* Look at this char again, it may start a sequence */
+				if(action == ESC_FLUSH_PASS)
+					i--;
+				continue;
+			default:
+				break;
+			}
+		}
+
+		out_size += line_discipline(chars[i], &out_buffer[out_size], crlf_auto);
+	} // for
+
+	store_chars(out_buffer, out_size);
+}
+
 void write_buffer(void)
 {
 	if(write_func == NULL)
@@ -217,6 +408,76 @@ void write_buffer(void)
 	}
 }
 
+/* Char at an offset from the oldest one kept */
+static char buffer_at(unsigned int offset)
+{
+	if(overlapped == 0)
+		return buffer[offset];
+	return buffer[(pointer + offset) % BUFFER_SIZE];
+}
+
+/*
+ * Offset from the oldest char kept where the last lines start, a line
+ * ending on \n or after width chars. Without text, lines are width
+ * chars and start on a multiple of width, as on the first display.
+ */
+unsigned int buffer_tail_start(unsigned int lines, unsigned int width, gboolean text)
+{
+	unsigned int length, start, column = 0;
+	char c;
+
+	length = overlapped ? BUFFER_SIZE : pointer;
+	if(lines == 0 || width == 0)
+		return length;
+
+	if(!text)
+	{
+		start = length > lines * width ? length - lines * width : 0;
+		return start - start % width;
+	}
+
+	for(start = length; start > 0; start--)
+	{
+		c = buffer_at(start - 1);
+		if(c == '\n' || column == width)
+		{
+			if(--lines == 0)
+				break;
+			column = 0;
+		}
+		if(c != '\n')
+			column++;
+	}
+
+	return start;
+}
+
+/* Display from an offset given by buffer_tail_start() */
+void write_buffer_from(unsigned int start)
+{
+	unsigned int first;
+
+	if(write_func == NULL)
+		return;
+
+	if(overlapped == 0)
+	{
+		if(start < pointer)
+			write_func(buffer + start, pointer - start);
+		return;
+	}
+
+	first = pointer + start;
+	if(first < BUFFER_SIZE)
+	{
+		write_func(buffer + first, BUFFER_SIZE - first);
+		if(pointer > 0)
+			write_func(buffer, pointer);
+	}
+	else if(first - BUFFER_SIZE < pointer)
+		write_func(buffer + first - BUFFER_SIZE, pointer - (first - BUFFER_SIZE));
+}
+
 void write_buffer_with_func(void (*func)(const char *, unsigned int))
 {
 	void (*write_func_backup)(const char *, unsigned int);
@@ -235,8 +496,8 @@ void clear_buffer(void)
 	if(buffer == NULL)
 		return;
 
+	/* Only the indices matter, the old data is never read again */
 	overlapped = 0;
-	memset(buffer, 0, BUFFER_SIZE);
 	current_buffer = buffer;
 	pointer = 0;
 	cr_received = 0;
@@ -259,6 +520,11 @@ void set_display_func(void (*func)(const char *, unsigned int))
 	write_func = func;
 }
 
+void set_raw_display(gboolean raw)
+{
+	raw_display = raw;
+}
+
 void unset_display_func(void (*func)(const char *, unsigned int))
 {
 	write_func = NULL;
@@ -26,10 +26,14 @@ void delete_buffer(void);
 void put_chars(const char *, unsigned int, gboolean, gboolean);
 void clear_buffer(void);
 void write_buffer(void);
+unsigned int buffer_tail_start(unsigned int, unsigned int, gboolean);
+void write_buffer_from(unsigned int);
 void set_display_func(void (*func)(const char *, unsigned int));
 void unset_display_func(void (*func)(const char *, unsigned int));
 void set_clear_func(void (*func)(void));
 void unset_clear_func(void (*func)(void));
 void write_buffer_with_func(void (*func)(const char *, unsigned int));
+void set_raw_display(gboolean);
+gsize escape_sequence_length(const gchar *, gsize);
 
 #endif
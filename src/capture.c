@@ -0,0 +1,388 @@
+/***********************************************************************/
+/* capture.c                                                           */
+/* ---------                                                           */
+/*                           GTKTerm Software                          */
+/*                                 (c)                                 */
+/*                                                                     */
+/* ------------------------------------------------------------------- */
+/*                                                                     */
+/*   Purpose                                                           */
+/*      Capture of the received data to a file                         */
+/*      - While capturing, the data does not reach the display         */
+/*      - Stops on a byte count, an idle time or an end marker         */
+/*                                                                     */
+/***********************************************************************/
+
+#include <gtk/gtk.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "interface.h"
+#include "serial.h"
+#include "capture.h"
+
+#include <config.h>
+#include <glib/gi18n.h>
+
+#define CAPTURE_BUFFER (1 << 20)
+#define CAPTURE_MAX_MARKER 64
+#define CAPTURE_REFRESH 500	/* ms */
+
+extern GtkWidget *Fenetre;
+
+static FILE *capture_file = NULL;
+static gchar *capture_name = NULL;
+static GtkToggleAction *capture_action = NULL;
+static guint capture_timer = 0;
+
+/* Stop conditions, kept for the next capture */
+static gdouble capture_limit = 0;	/* bytes, 0 for none */
+static gint capture_idle = 0;		/* seconds, 0 for none */
+static gchar *capture_marker_text = NULL;
+
+static guchar marker[CAPTURE_MAX_MARKER];
+static guint marker_len = 0;
+static guint marker_fail[CAPTURE_MAX_MARKER];
+static guint marker_matched = 0;
+
+static guint64 captured;
+static gint64 capture_start, capture_last_rx;
+static guint32 capture_crc;
+static GChecksum *capture_sha256 = NULL;
+
+static guint32 crc32_table[256];
+
+static void crc32_init(void)
+{
+	guint32 c;
+	guint i, j;
+
+	for(i = 0; i < 256; i++)
+	{
+		c = i;
+		for(j = 0; j < 8; j++)
+			c = (c & 1) ? (c >> 1) ^ 0xEDB88320 : c >> 1;
+		crc32_table[i] = c;
+	}
+}
+
+/* "0D 0A" or "0d0a", FALSE if it cannot be parsed */
+static gboolean marker_parse(const gchar *text)
+{
+	gchar *compact, *end;
+	gchar digits[3] = {0, 0, 0};
+	guint i, k, n = 0;
+
+	marker_len = 0;
+	if(text == NULL || *text == 0)
+		return TRUE;
+
+	compact = g_strdup(text);
+	for(i = 0, k = 0; compact[i]; i++)
+		if(!g_ascii_isspace(compact[i]))
+			compact[k++] = compact[i];
+	compact[k] = 0;
+
+	if(k % 2 || k / 2 > CAPTURE_MAX_MARKER)
+	{
+		g_free(compact);
+		return FALSE;
+	}
+
+	for(i = 0; i < k; i += 2)
+	{
+		digits[0] = compact[i];
+		digits[1] = compact[i + 1];
+		marker[n++] = strtoul(digits, &end, 16);
+		if(*end != 0)
+		{
+			g_free(compact);
+			return FALSE;
+		}
+	}
+	g_free(compact);
+
+	/* Failure table, a marker like "AAB" is found in "AAAB" */
+	marker_fail[0] = 0;
+	for(i = 1, k = 0; i < n; i++)
+	{
+		while(k > 0 && marker[i] != marker[k])
+			k = marker_fail[k - 1];
+		if(marker[i] == marker[k])
+			k++;
+		marker_fail[i] = k;
+	}
+	marker_len = n;
+
+	return TRUE;
+}
+
+gboolean capture_active(void)
+{
+	return capture_file != NULL;
+}
+
+static gchar *capture_progress_string(void)
+{
+	gdouble seconds;
+	gchar *size, *rate, *msg;
+
+	seconds = (g_get_monotonic_time() - capture_start) / (gdouble)G_USEC_PER_SEC;
+	size = g_format_size_full(captured, G_FORMAT_SIZE_IEC_UNITS);
+	rate = g_format_size_full(seconds > 0 ? captured / seconds : 0, G_FORMAT_SIZE_IEC_UNITS);
+	msg = g_strdup_printf(_("Capturing to %s: %s, %s/s"), capture_name, size, rate);
+	g_free(size);
+	g_free(rate);
+
+	return msg;
+}
+
+static void make_selectable(GtkWidget *widget, gpointer data)
+{
+	if(GTK_IS_LABEL(widget))
+		gtk_label_set_selectable(GTK_LABEL(widget), TRUE);
+}
+
+static void capture_finish(const gchar *reason)
+{
+	GtkWidget *dialog;
+	gchar *msg, *size, *port;
+	gint error = 0;
+
+	if(capture_file == NULL)
+		return;
+
+	if(capture_timer)
+		g_source_remove(capture_timer);
+	capture_timer = 0;
+
+	if(fclose(capture_file) != 0)
+		error = errno;
+	capture_file = NULL;
+
+	port = get_port_string();
+	Set_status_message(port);
+	g_free(port);
+
+	if(error)
+	{
+		msg = g_strdup_printf(_("Cannot write file %s: %s\n"), capture_name, strerror(error));
+		show_message(msg, MSG_ERR);
+		g_free(msg);
+	}
+
+	/* Not run modal, the capture may end from the port callback */
+	size = g_format_size_full(captured, G_FORMAT_SIZE_IEC_UNITS | G_FORMAT_SIZE_LONG_FORMAT);
+	dialog = gtk_message_dialog_new(GTK_WINDOW(Fenetre),
+	                                GTK_DIALOG_DESTROY_WITH_PARENT,
+	                                GTK_MESSAGE_INFO,
+	                                GTK_BUTTONS_OK,
+	                                _("Capture to %s stopped: %s"), capture_name, reason);
+	gtk_message_dialog_format_secondary_text(GTK_MESSAGE_DIALOG(dialog),
+	        _("Received %s\nCRC32: %08x\nSHA-256: %s"),
+	        size, capture_crc ^ 0xFFFFFFFF, g_checksum_get_string(capture_sha256));
+	gtk_container_foreach(GTK_CONTAINER(gtk_message_dialog_get_message_area(GTK_MESSAGE_DIALOG(dialog))),
+	                      make_selectable, NULL);
+	g_signal_connect(dialog, "response", G_CALLBACK(gtk_widget_destroy), NULL);
+	gtk_widget_show_all(dialog);
+	g_free(size);
+
+	g_checksum_free(capture_sha256);
+	capture_sha256 = NULL;
+	g_free(capture_name);
+	capture_name = NULL;
+
+	if(capture_action != NULL)
+		gtk_toggle_action_set_active(capture_action, FALSE);
+}
+
+static void capture_write(const gchar *data, guint size)
+{
+	guint32 crc = capture_crc;
+	guint i;
+
+	if(fwrite(data, 1, size, capture_file) != size)
+	{
+		capture_finish(_("write error"));
+		return;
+	}
+
+	for(i = 0; i < size; i++)
+		crc = (crc >> 8) ^ crc32_table[(crc ^ (guchar)data[i]) & 0xFF];
+	capture_crc = crc;
+	g_checksum_update(capture_sha256, (const guchar *)data, size);
+	captured += size;
+}
+
+guint capture_chars(const gchar *data, guint size)
+{
+	guint keep = size, i;
+	const gchar *reason = NULL;
+
+	capture_last_rx = g_get_monotonic_time();
+
+	/* The byte count ends the capture at the exact byte */
+	if(capture_limit > 0 && captured + keep >= (guint64)capture_limit)
+	{
+		keep = (guint64)capture_limit - captured;
+		reason = _("byte count reached");
+	}
+
+	for(i = 0; i < keep && marker_len > 0; i++)
+	{
+		while(marker_matched > 0 && (guchar)data[i] != marker[marker_matched])
+			marker_matched = marker_fail[marker_matched - 1];
+		if((guchar)data[i] == marker[marker_matched])
+			marker_matched++;
+		if(marker_matched == marker_len)
+		{
+			/* The marker is kept in the file */
+			keep = i + 1;
+			reason = _("end marker received");
+			break;
+		}
+	}
+
+	capture_write(data, keep);
+	if(reason != NULL)
+		capture_finish(reason);
+
+	/* What follows the end goes to the display */
+	return keep;
+}
+
+static gboolean capture_refresh(gpointer data)
+{
+	gchar *msg;
+
+	/* The idle time only counts once the data has started */
+	if(capture_idle > 0 && captured > 0 &&
+	   g_get_monotonic_time() - capture_last_rx > (gint64)capture_idle * G_USEC_PER_SEC)
+	{
+		capture_timer = 0;
+		capture_finish(_("line idle"));
+		return FALSE;
+	}
+
+	msg = capture_progress_string();
+	Set_status_message(msg);
+	g_free(msg);
+
+	return TRUE;
+}
+
+static GtkWidget *capture_options(GtkWidget **limit, GtkWidget **idle, GtkWidget **end)
+{
+	GtkWidget *grid, *label;
+
+	grid = gtk_grid_new();
+	gtk_grid_set_row_spacing(GTK_GRID(grid), 5);
+	gtk_grid_set_column_spacing(GTK_GRID(grid), 10);
+
+	label = gtk_label_new(_("Stop after (bytes, 0 for no limit):"));
+	gtk_widget_set_halign(label, GTK_ALIGN_START);
+	gtk_grid_attach(GTK_GRID(grid), label, 0, 0, 1, 1);
+	*limit = gtk_spin_button_new_with_range(0, 1e12, 1);
+	gtk_spin_button_set_value(GTK_SPIN_BUTTON(*limit), capture_limit);
+	gtk_grid_attach(GTK_GRID(grid), *limit, 1, 0, 1, 1);
+
+	label = gtk_label_new(_("Stop when idle for (s, 0 for never):"));
+	gtk_widget_set_halign(label, GTK_ALIGN_START);
+	gtk_grid_attach(GTK_GRID(grid), label, 0, 1, 1, 1);
+	*idle = gtk_spin_button_new_with_range(0, 3600, 1);
+	gtk_spin_button_set_value(GTK_SPIN_BUTTON(*idle), capture_idle);
+	gtk_grid_attach(GTK_GRID(grid), *idle, 1, 1, 1, 1);
+
+	label = gtk_label_new(_("Stop on end marker (hex, e.g. 0D 0A):"));
+	gtk_widget_set_halign(label, GTK_ALIGN_START);
+	gtk_grid_attach(GTK_GRID(grid), label, 0, 2, 1, 1);
+	*end = gtk_entry_new();
+	if(capture_marker_text != NULL)
+		gtk_entry_set_text(GTK_ENTRY(*end), capture_marker_text);
+	gtk_grid_attach(GTK_GRID(grid), *end, 1, 2, 1, 1);
+
+	gtk_widget_show_all(grid);
+
+	return grid;
+}
+
+static gboolean capture_start_dialog(void)
+{
+	GtkWidget *file_select, *limit, *idle, *end;
+	gchar *fileName = NULL;
+	gchar *msg;
+
+	file_select = gtk_file_chooser_dialog_new(_("Capture to file"),
+	              GTK_WINDOW(Fenetre),
+	              GTK_FILE_CHOOSER_ACTION_SAVE,
+	              GTK_STOCK_CANCEL, GTK_RESPONSE_CANCEL,
+	              GTK_STOCK_SAVE, GTK_RESPONSE_ACCEPT,
+	              NULL);
+	gtk_file_chooser_set_do_overwrite_confirmation(GTK_FILE_CHOOSER(file_select), TRUE);
+	gtk_file_chooser_set_extra_widget(GTK_FILE_CHOOSER(file_select), capture_options(&limit, &idle, &end));
+
+	while(gtk_dialog_run(GTK_DIALOG(file_select)) == GTK_RESPONSE_ACCEPT)
+	{
+		if(!marker_parse(gtk_entry_get_text(GTK_ENTRY(end))))
+		{
+			show_dialog_message(file_select, _("The end marker must be hexadecimal bytes"), MSG_ERR);
+			continue;
+		}
+		fileName = gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(file_select));
+		break;
+	}
+
+	capture_limit = gtk_spin_button_get_value(GTK_SPIN_BUTTON(limit));
+	capture_idle = gtk_spin_button_get_value_as_int(GTK_SPIN_BUTTON(idle));
+	g_free(capture_marker_text);
+	capture_marker_text = g_strdup(gtk_entry_get_text(GTK_ENTRY(end)));
+	gtk_widget_destroy(file_select);
+
+	if(fileName == NULL)
+		return FALSE;
+
+	capture_file = fopen(fileName, "wb");
+	if(capture_file == NULL)
+	{
+		msg = g_strdup_printf(_("Cannot open file %s: %s\n"), fileName, strerror(errno));
+		show_message(msg, MSG_ERR);
+		g_free(msg);
+		g_free(fileName);
+		return FALSE;
+	}
+
+	/* Large writes, a flash dump can arrive at several Mbit/s */
+	setvbuf(capture_file, NULL, _IOFBF, CAPTURE_BUFFER);
+
+	capture_name = g_path_get_basename(fileName);
+	g_free(fileName);
+
+	if(crc32_table[1] == 0)
+		crc32_init();
+	capture_crc = 0xFFFFFFFF;
+	capture_sha256 = g_checksum_new(G_CHECKSUM_SHA256);
+	captured = 0;
+	marker_matched = 0;
+	capture_start = capture_last_rx = g_get_monotonic_time();
+
+	capture_refresh(NULL);
+	capture_timer = g_timeout_add(CAPTURE_REFRESH, capture_refresh, NULL);
+
+	return TRUE;
+}
+
+void capture_callback(GtkAction *action, gpointer data)
+{
+	capture_action = GTK_TOGGLE_ACTION(action);
+
+	if(gtk_toggle_action_get_active(capture_action))
+	{
+		if(capture_file == NULL && !capture_start_dialog())
+			gtk_toggle_action_set_active(capture_action, FALSE);
+		return;
+	}
+
+	capture_finish(_("stopped by the user"));
+}
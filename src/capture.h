@@ -0,0 +1,22 @@
+/***********************************************************************/
+/* capture.h                                                           */
+/* ---------                                                           */
+/*                           GTKTerm Software                          */
+/*                                 (c)                                 */
+/*                                                                     */
+/* ------------------------------------------------------------------- */
+/*                                                                     */
+/*   Purpose                                                           */
+/*      Capture of the received data to a file                         */
+/*      - Header file -                                                */
+/*                                                                     */
+/***********************************************************************/
+
+#ifndef CAPTURE_H_
+#define CAPTURE_H_
+
+gboolean capture_active(void);
+guint capture_chars(const gchar *, guint);
+void capture_callback(GtkAction *, gpointer);
+
+#endif
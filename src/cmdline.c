@@ -26,6 +26,7 @@
 #include "files.h"
 #include "auto_config.h"
 #include "i18n.h"
+#include "control.h"
 
 #include <config.h>
 #include <glib/gi18n.h>
@@ -55,6 +56,11 @@ void display_help(void)
 	i18n_printf(_("--echo or -e: switch on local echo\n"));
 	i18n_printf(_("--disable-port-lock or -L: does not lock serial port. Allows to send to serial port from different terminals\n"));
 	i18n_printf(_("                      Note: incoming data are displayed randomly on only one terminal\n"));
+	i18n_printf(_("--share <port> or -S: share the port with local clients on this TCP port (any local user can connect)\n"));
+	i18n_printf(_("--share-socket <path> or -U: share the port with local clients on this Unix socket (only you can connect)\n"));
+	i18n_printf(_("--rfc2217 or -R: shared port clients use RFC 2217 instead of raw data\n"));
+	i18n_printf(_("--low-latency or -l: driver and USB adapter tuned for the lowest latency\n"));
+	i18n_printf(_("--control <path> or -C: accept automation commands on this Unix socket\n"));
 	i18n_printf("\n");
 }
 
@@ -80,6 +86,11 @@ int read_command_line(int argc, char **argv, gchar *configuration_to_read)
 		{"rts_time_before", 1, 0, 'x'},
 		{"rts_time_after", 1, 0, 'y'},
 		{"config", 1, 0, 'c'},
+		{"share", 1, 0, 'S'},
+		{"share-socket", 1, 0, 'U'},
+		{"rfc2217", 0, 0, 'R'},
+		{"low-latency", 0, 0, 'l'},
+		{"control", 1, 0, 'C'},
 		{0, 0, 0, 0}
 	};
 
@@ -88,7 +99,7 @@ int read_command_line(int argc, char **argv, gchar *configuration_to_read)
 
 	while(1)
 	{
-		c = getopt_long (argc, argv, "s:a:t:b:f:p:w:d:r:heLc:x:y:", long_options, &option_index);
+		c = getopt_long (argc, argv, "s:a:t:b:f:p:w:d:r:heLc:x:y:S:U:RlC:", long_options, &option_index);
 
 		if(c == -1)
 			break;
@@ -159,6 +170,26 @@ int read_command_line(int argc, char **argv, gchar *configuration_to_read)
 			config.rs485_rts_time_after_transmit = atoi(optarg);
 			break;
 
+		case 'S':
+			config.share_port = atoi(optarg);
+			break;
+
+		case 'U':
+			g_strlcpy(config.share_socket, optarg, sizeof(config.share_socket));
+			break;
+
+		case 'R':
+			config.share_rfc2217 = TRUE;
+			break;
+
+		case 'l':
+			config.low_latency = TRUE;
+			break;
+
+		case 'C':
+			control_start(optarg);
+			break;
+
 		case 'h':
 			display_help();
 			return -1;
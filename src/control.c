@@ -0,0 +1,783 @@
+/***********************************************************************/
+/* control.c                                                           */
+/* ---------                                                           */
+/*                           GTKTerm Software                          */
+/*                                 (c)                                 */
+/*                                                                     */
+/* ------------------------------------------------------------------- */
+/*                                                                     */
+/*   Purpose                                                           */
+/*      Control socket for automation                                  */
+/*      - One JSON object per line, one JSON answer per line           */
+/*      - Commands of a client are run in order, "expect" waits for    */
+/*        the received data before the next one runs                   */
+/*                                                                     */
+/***********************************************************************/
+
+#include <gtk/gtk.h>
+#include <gio/gio.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "term_config.h"
+#include "serial.h"
+#include "interface.h"
+#include "logging.h"
+#include "control.h"
+#include "transfer.h"
+#include "sniffer.h"
+
+#include <config.h>
+#include <glib/gi18n.h>
+
+#define CONTROL_MAX_LINE (64 * 1024)
+#define CONTROL_MAX_RX (1 << 20)	/* received data kept for "expect" */
+#define CONTROL_TIMEOUT 5000		/* ms, default "expect" timeout */
+#define CONTROL_TIMEOUT_MAX 3600000	/* ms, longest "expect" timeout */
+
+typedef struct {
+	GSocketConnection *connection;
+	GSocket *socket;
+	GSource *in_source;
+	GSource *out_source;
+	GString *input;		/* lines not run yet */
+	GString *output;	/* answers not sent yet */
+	GByteArray *rx;		/* received since the last match */
+	gboolean gone;
+
+	/* Pending "expect" */
+	GByteArray *pattern;
+	guint searched;		/* rx already searched */
+	guint timer;
+} control_client_t;
+
+extern struct configuration_port config;
+
+static GSocketService *service = NULL;
+static gchar *service_path = NULL;
+static GList *clients = NULL;
+
+static gboolean client_readable(GSocket *, GIOCondition, gpointer);
+static gboolean client_writable(GSocket *, GIOCondition, gpointer);
+static void client_run(control_client_t *);
+
+/*
+ * JSON: only flat objects are used. Members are kept as byte strings,
+ * "\u00XX" escapes stand for the byte XX so binary data goes through.
+ */
+
+static const gchar *json_space(const gchar *p)
+{
+	while(*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')
+		p++;
+	return p;
+}
+
+static GString *json_string(const gchar **text)
+{
+	const gchar *p = *text;
+	GString *value;
+	gunichar c;
+	gchar *end, hex[5] = {0, 0, 0, 0, 0};
+
+	if(*p++ != '"')
+		return NULL;
+
+	value = g_string_new(NULL);
+	while(*p != '"')
+	{
+		if(*p == 0)
+			goto error;
+		if(*p != '\\')
+		{
+			g_string_append_c(value, *p++);
+			continue;
+		}
+
+		p++;
+		switch(*p++)
+		{
+		case '"':
+			g_string_append_c(value, '"');
+			break;
+		case '\\':
+			g_string_append_c(value, '\\');
+			break;
+		case '/':
+			g_string_append_c(value, '/');
+			break;
+		case 'b':
+			g_string_append_c(value, '\b');
+			break;
+		case 'f':
+			g_string_append_c(value, '\f');
+			break;
+		case 'n':
+			g_string_append_c(value, '\n');
+			break;
+		case 'r':
+			g_string_append_c(value, '\r');
+			break;
+		case 't':
+			g_string_append_c(value, '\t');
+			break;
+		case 'u':
+			if(strlen(p) < 4)
+				goto error;
+			memcpy(hex, p, 4);
+			c = strtoul(hex, &end, 16);
+			if(*end != 0)
+				goto error;
+			p += 4;
+			if(c < 0x100)
+				g_string_append_c(value, c);
+			else
+				g_string_append_unichar(value, c);
+			break;
+		default:
+			goto error;
+		}
+	}
+
+	*text = p + 1;
+	return value;
+
+error:
+	g_string_free(value, TRUE);
+	return NULL;
+}
+
+static gboolean json_parse(const gchar *line, GHashTable *members)
+{
+	const gchar *p = json_space(line);
+	const gchar *start;
+	GString *name, *value;
+
+	if(*p++ != '{')
+		return FALSE;
+	p = json_space(p);
+	if(*p == '}')
+		return *json_space(p + 1) == 0;
+
+	for(;;)
+	{
+		if((name = json_string(&p)) == NULL)
+			return FALSE;
+		p = json_space(p);
+		if(*p++ != ':')
+		{
+			g_string_free(name, TRUE);
+			return FALSE;
+		}
+		p = json_space(p);
+
+		/* Numbers, true, false and null are kept as written */
+		if(*p == '"')
+			value = json_string(&p);
+		else
+		{
+			start = p;
+			while(g_ascii_isalnum(*p) || *p == '-' || *p == '+' || *p == '.')
+				p++;
+			value = (p > start) ? g_string_new_len(start, p - start) : NULL;
+		}
+		if(value == NULL)
+		{
+			g_string_free(name, TRUE);
+			return FALSE;
+		}
+		g_hash_table_replace(members, g_string_free(name, FALSE), value);
+
+		p = json_space(p);
+		if(*p == ',')
+		{
+			p = json_space(p + 1);
+			continue;
+		}
+		if(*p == '}')
+			return *json_space(p + 1) == 0;
+		return FALSE;
+	}
+}
+
+static void json_append_string(GString *out, const gchar *data, gsize len)
+{
+	gsize i;
+	guchar c;
+
+	g_string_append_c(out, '"');
+	for(i = 0; i < len; i++)
+	{
+		c = data[i];
+		if(c == '"' || c == '\\')
+		{
+			g_string_append_c(out, '\\');
+			g_string_append_c(out, c);
+		}
+		else if(c >= 0x20 && c < 0x7F)
+			g_string_append_c(out, c);
+		else if(c == '\n')
+			g_string_append(out, "\\n");
+		else if(c == '\r')
+			g_string_append(out, "\\r");
+		else
+			g_string_append_printf(out, "\\u%04x", c);
+	}
+	g_string_append_c(out, '"');
+}
+
+/* An integer from min to max, result is left as is when name is missing */
+static gboolean json_int(GHashTable *members, const gchar *name, gint min, gint max, gint *result)
+{
+	GString *value = g_hash_table_lookup(members, name);
+	gchar *end;
+	gint64 number;
+
+	if(value == NULL)
+		return TRUE;
+
+	number = g_ascii_strtoll(value->str, &end, 10);
+	if(end == value->str || *end != 0 || number < min || number > max)
+		return FALSE;
+
+	*result = number;
+	return TRUE;
+}
+
+/* TRUE, FALSE or -1 when absent */
+static gint json_bool(GHashTable *members, const gchar *name)
+{
+	GString *value = g_hash_table_lookup(members, name);
+
+	if(value == NULL)
+		return -1;
+	return !strcmp(value->str, "true") || !strcmp(value->str, "1");
+}
+
+/* Bytes of "hex" (like "0d0a") or of "name", NULL if neither is there */
+static GByteArray *json_bytes(GHashTable *members, const gchar *name, const gchar **error)
+{
+	GString *value;
+	GByteArray *bytes;
+	gchar digits[3] = {0, 0, 0}, *end;
+	gsize i;
+	guint8 c;
+
+	value = g_hash_table_lookup(members, "hex");
+	if(value == NULL)
+	{
+		value = g_hash_table_lookup(members, name);
+		if(value == NULL)
+		{
+			*error = "missing data";
+			return NULL;
+		}
+		return g_byte_array_append(g_byte_array_new(), (const guint8 *)value->str, value->len);
+	}
+
+	bytes = g_byte_array_new();
+	for(i = 0; i < value->len; i++)
+	{
+		if(g_ascii_isspace(value->str[i]))
+			continue;
+		if(i + 1 >= value->len)
+			break;
+		digits[0] = value->str[i];
+		digits[1] = value->str[++i];
+		c = strtoul(digits, &end, 16);
+		if(*end != 0)
+			break;
+		g_byte_array_append(bytes, &c, 1);
+	}
+	if(i < value->len)
+	{
+		g_byte_array_free(bytes, TRUE);
+		*error = "bad hex";
+		return NULL;
+	}
+
+	return bytes;
+}
+
+/*
+ * Clients
+ */
+
+static void client_free(control_client_t *client)
+{
+	clients = g_list_remove(clients, client);
+
+	if(client->in_source != NULL)
+	{
+		g_source_destroy(client->in_source);
+		g_source_unref(client->in_source);
+	}
+	if(client->out_source != NULL)
+	{
+		g_source_destroy(client->out_source);
+		g_source_unref(client->out_source);
+	}
+	if(client->timer)
+		g_source_remove(client->timer);
+	if(client->pattern != NULL)
+		g_byte_array_free(client->pattern, TRUE);
+
+	g_string_free(client->input, TRUE);
+	g_string_free(client->output, TRUE);
+	g_byte_array_free(client->rx, TRUE);
+	g_io_stream_close(G_IO_STREAM(client->connection), NULL, NULL);
+	g_object_unref(client->connection);
+	g_free(client);
+}
+
+static void client_flush(control_client_t *client)
+{
+	GError *error = NULL;
+	gssize written;
+
+	while(client->output->len > 0)
+	{
+		written = g_socket_send(client->socket, client->output->str, client->output->len, NULL, &error);
+		if(written < 0)
+		{
+			if(!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK))
+				client->gone = TRUE;
+			else if(client->out_source == NULL)
+			{
+				client->out_source = g_socket_create_source(client->socket, G_IO_OUT, NULL);
+				g_source_set_callback(client->out_source, (GSourceFunc)client_writable, client, NULL);
+				g_source_attach(client->out_source, NULL);
+			}
+			g_error_free(error);
+			return;
+		}
+		g_string_erase(client->output, 0, written);
+	}
+}
+
+static void reply_error(control_client_t *client, const gchar *error)
+{
+	g_string_append(client->output, "{\"ok\":false,\"error\":");
+	json_append_string(client->output, error, strlen(error));
+	g_string_append(client->output, "}\n");
+}
+
+static void reply_ok(control_client_t *client, const gchar *members)
+{
+	g_string_append_printf(client->output, "{\"ok\":true%s%s}\n", members ? "," : "", members ? members : "");
+}
+
+/* Answer an "expect" with what was received up to the end of the match */
+static void expect_done(control_client_t *client, gint end)
+{
+	GString *members;
+
+	if(client->timer)
+		g_source_remove(client->timer);
+	client->timer = 0;
+	g_byte_array_free(client->pattern, TRUE);
+	client->pattern = NULL;
+
+	if(end < 0)
+		reply_error(client, "timeout");
+	else
+	{
+		members = g_string_new("\"data\":");
+		json_append_string(members, (const gchar *)client->rx->data, end);
+		reply_ok(client, members->str);
+		g_string_free(members, TRUE);
+		g_byte_array_remove_range(client->rx, 0, end);
+	}
+	client->searched = 0;
+}
+
+/* End of the match in rx, or -1 */
+static gint expect_search(control_client_t *client)
+{
+	guint8 *found;
+	guint from = client->searched;
+
+	if(client->rx->len < client->pattern->len)
+		return -1;
+
+	found = memmem(client->rx->data + from, client->rx->len - from,
+	               client->pattern->data, client->pattern->len);
+	if(found != NULL)
+		return found - client->rx->data + client->pattern->len;
+
+	/* A match can still start in the last bytes */
+	client->searched = client->rx->len - client->pattern->len + 1;
+	return -1;
+}
+
+static gboolean expect_timeout(gpointer data)
+{
+	control_client_t *client = data;
+
+	client->timer = 0;
+	expect_done(client, -1);
+	client_run(client);
+
+	return FALSE;
+}
+
+static gboolean set_line(gint line, gint state)
+{
+	gint current;
+
+	if(serial_port_fd == -1 || ioctl(serial_port_fd, TIOCMGET, &current) == -1)
+		return FALSE;
+
+	/* Set_signals() toggles the line */
+	if(state != -1 && state != ((current & line) != 0))
+		Set_signals(line == TIOCM_DTR ? 0 : 1);
+
+	return TRUE;
+}
+
+static void command_stats(control_client_t *client)
+{
+	GString *members;
+	gchar *text;
+	guint64 sent, received;
+
+	get_port_counters(&sent, &received);
+	text = get_port_statistics_string();
+
+	members = g_string_new(NULL);
+	g_string_append_printf(members, "\"open\":%s,\"port\":", serial_port_fd != -1 ? "true" : "false");
+	json_append_string(members, config.port, strlen(config.port));
+	g_string_append_printf(members, ",\"speed\":%u,\"sent\":%" G_GUINT64_FORMAT
+	                       ",\"received\":%" G_GUINT64_FORMAT ",\"pending\":%u,\"text\":",
+	                       config.vitesse, sent, received, Send_chars_pending());
+	json_append_string(members, text, strlen(text));
+	reply_ok(client, members->str);
+
+	g_string_free(members, TRUE);
+	g_free(text);
+}
+
+static void command_run(control_client_t *client, GHashTable *members)
+{
+	GString *cmd, *value;
+	GByteArray *bytes;
+	const gchar *error = NULL;
+	gchar *answer;
+	gint end, state, timeout, speed;
+
+	cmd = g_hash_table_lookup(members, "cmd");
+	if(cmd == NULL)
+	{
+		reply_error(client, "missing cmd");
+		return;
+	}
+
+	if(!strcmp(cmd->str, "send"))
+	{
+		if((bytes = json_bytes(members, "data", &error)) == NULL)
+			reply_error(client, error);
+		else if(serial_port_fd == -1)
+			reply_error(client, "port closed");
+		else if(transfer_running())
+			reply_error(client, "transfer running");
+		else if(Send_chars((gchar *)bytes->data, bytes->len) < 0)
+			reply_error(client, "write error");
+		else
+		{
+			answer = g_strdup_printf("\"sent\":%u", bytes->len);
+			reply_ok(client, answer);
+			g_free(answer);
+		}
+		if(bytes != NULL)
+			g_byte_array_free(bytes, TRUE);
+	}
+	else if(!strcmp(cmd->str, "expect"))
+	{
+		if((bytes = json_bytes(members, "pattern", &error)) == NULL || bytes->len == 0)
+		{
+			reply_error(client, error ? error : "empty pattern");
+			if(bytes != NULL)
+				g_byte_array_free(bytes, TRUE);
+			return;
+		}
+		timeout = CONTROL_TIMEOUT;
+		if(!json_int(members, "timeout", 0, CONTROL_TIMEOUT_MAX, &timeout))
+		{
+			reply_error(client, "bad timeout");
+			g_byte_array_free(bytes, TRUE);
+			return;
+		}
+		client->pattern = bytes;
+		client->searched = 0;
+		if((end = expect_search(client)) >= 0)
+			expect_done(client, end);
+		else
+			client->timer = g_timeout_add(timeout, expect_timeout, client);
+	}
+	else if(!strcmp(cmd->str, "clear"))
+	{
+		/* Forget what was received, the next "expect" only sees new data */
+		g_byte_array_set_size(client->rx, 0);
+		reply_ok(client, NULL);
+	}
+	else if(!strcmp(cmd->str, "dtr") || !strcmp(cmd->str, "rts"))
+	{
+		state = json_bool(members, "state");
+		if(set_line(cmd->str[0] == 'd' ? TIOCM_DTR : TIOCM_RTS, state))
+			reply_ok(client, NULL);
+		else
+			reply_error(client, "port closed");
+	}
+	else if(!strcmp(cmd->str, "break"))
+	{
+		sendbreak();
+		reply_ok(client, NULL);
+	}
+	else if(!strcmp(cmd->str, "open"))
+	{
+		speed = config.vitesse;
+		if(!json_int(members, "speed", 1, G_MAXINT, &speed))
+		{
+			reply_error(client, "bad speed");
+			return;
+		}
+		if(transfer_running())
+		{
+			reply_error(client, "transfer running");
+			return;
+		}
+		if(sniffer_running())
+		{
+			reply_error(client, "sniffer running");
+			return;
+		}
+		if((value = g_hash_table_lookup(members, "port")) != NULL)
+			g_strlcpy(config.port, value->str, sizeof(config.port));
+		config.vitesse = speed;
+		Verify_configuration();
+		interface_open_port();
+		if(serial_port_fd != -1)
+			reply_ok(client, NULL);
+		else
+			reply_error(client, "cannot open the port");
+	}
+	else if(!strcmp(cmd->str, "close"))
+	{
+		interface_close_port();
+		reply_ok(client, NULL);
+	}
+	else if(!strcmp(cmd->str, "log_start"))
+	{
+		if((value = g_hash_table_lookup(members, "file")) == NULL)
+			reply_error(client, "missing file");
+		else if(logging_start_file(value->str))
+			reply_ok(client, NULL);
+		else
+			reply_error(client, "cannot open the log file");
+	}
+	else if(!strcmp(cmd->str, "log_stop"))
+	{
+		logging_stop();
+		reply_ok(client, NULL);
+	}
+	else if(!strcmp(cmd->str, "stats"))
+		command_stats(client);
+	else
+		reply_error(client, "unknown cmd");
+}
+
+static void member_free(gpointer value)
+{
+	g_string_free(value, TRUE);
+}
+
+/* Run the complete lines, up to an "expect" still waiting */
+static void client_run(control_client_t *client)
+{
+	GHashTable *members;
+	gchar *newline;
+	gsize len;
+
+	while(client->pattern == NULL && !client->gone &&
+	      (newline = memchr(client->input->str, '\n', client->input->len)) != NULL)
+	{
+		*newline = 0;
+		len = newline - client->input->str + 1;
+
+		members = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, member_free);
+		if(json_parse(client->input->str, members))
+			command_run(client, members);
+		else if(*json_space(client->input->str) != 0)
+			reply_error(client, "bad json");
+		g_hash_table_destroy(members);
+
+		g_string_erase(client->input, 0, len);
+	}
+
+	client_flush(client);
+	if(client->gone)
+		client_free(client);
+}
+
+static gboolean client_readable(GSocket *socket, GIOCondition condition, gpointer data)
+{
+	control_client_t *client = data;
+	gchar buf[4096];
+	gssize len;
+
+	len = g_socket_receive(socket, buf, sizeof(buf), NULL, NULL);
+	if(len <= 0 || client->input->len + len > CONTROL_MAX_LINE)
+	{
+		client_free(client);
+		return FALSE;
+	}
+
+	g_string_append_len(client->input, buf, len);
+	client_run(client);
+
+	return TRUE;
+}
+
+static gboolean client_writable(GSocket *socket, GIOCondition condition, gpointer data)
+{
+	control_client_t *client = data;
+
+	g_source_unref(client->out_source);
+	client->out_source = NULL;
+
+	client_flush(client);
+	if(client->gone)
+		client_free(client);
+
+	return FALSE;
+}
+
+static gboolean control_incoming(GSocketService *source, GSocketConnection *connection,
+                                 GObject *source_object, gpointer data)
+{
+	control_client_t *client;
+
+	client = g_new0(control_client_t, 1);
+	client->connection = g_object_ref(connection);
+	client->socket = g_socket_connection_get_socket(connection);
+	client->input = g_string_new(NULL);
+	client->output = g_string_new(NULL);
+	client->rx = g_byte_array_new();
+	g_socket_set_blocking(client->socket, FALSE);
+
+	client->in_source = g_socket_create_source(client->socket, G_IO_IN, NULL);
+	g_source_set_callback(client->in_source, (GSourceFunc)client_readable, client, NULL);
+	g_source_attach(client->in_source, NULL);
+
+	clients = g_list_prepend(clients, client);
+
+	return TRUE;
+}
+
+void control_chars(const gchar *data, guint size)
+{
+	GList *l, *next;
+	control_client_t *client;
+	guint drop;
+	gint end;
+
+	for(l = clients; l != NULL; l = next)
+	{
+		next = l->next;
+		client = l->data;
+
+		g_byte_array_append(client->rx, (const guint8 *)data, size);
+		if(client->rx->len > CONTROL_MAX_RX)
+		{
+			drop = client->rx->len - CONTROL_MAX_RX;
+			g_byte_array_remove_range(client->rx, 0, drop);
+			client->searched = client->searched > drop ? client->searched - drop : 0;
+		}
+
+		/* Answered from the port callback, no extra wake up */
+		if(client->pattern != NULL && (end = expect_search(client)) >= 0)
+		{
+			expect_done(client, end);
+			client_run(client);
+		}
+	}
+}
+
+gboolean control_start(const gchar *path)
+{
+	struct sockaddr_un sun;
+	struct stat st;
+	GSocketAddress *address;
+	GError *error = NULL;
+	gboolean added;
+	mode_t mask;
+	gchar *msg;
+
+	if(strlen(path) >= sizeof(sun.sun_path))
+	{
+		msg = g_strdup_printf(_("Control socket path too long: %s\n"), path);
+		show_message(msg, MSG_ERR);
+		g_free(msg);
+		return FALSE;
+	}
+
+	/* Only a socket left by a previous run is replaced */
+	if(lstat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+		unlink(path);
+
+	memset(&sun, 0, sizeof(sun));
+	sun.sun_family = AF_UNIX;
+	g_strlcpy(sun.sun_path, path, sizeof(sun.sun_path));
+	address = g_socket_address_new_from_native(&sun, sizeof(sun));
+
+	/* Only the user can drive the terminal, from the moment it exists */
+	mask = umask(S_IRWXG | S_IRWXO);
+	service = g_socket_service_new();
+	added = g_socket_listener_add_address(G_SOCKET_LISTENER(service), address, G_SOCKET_TYPE_STREAM,
+	                                      G_SOCKET_PROTOCOL_DEFAULT, NULL, NULL, &error);
+	umask(mask);
+	if(!added)
+	{
+		msg = g_strdup_printf(_("Cannot create the control socket: %s\n"), error->message);
+		show_message(msg, MSG_ERR);
+		g_free(msg);
+		g_error_free(error);
+		g_object_unref(address);
+		g_object_unref(service);
+		service = NULL;
+		return FALSE;
+	}
+	g_object_unref(address);
+
+	chmod(path, S_IRUSR | S_IWUSR);
+	service_path = g_strdup(path);
+
+	g_signal_connect(service, "incoming", G_CALLBACK(control_incoming), NULL);
+	g_socket_service_start(service);
+
+	return TRUE;
+}
+
+void control_stop(void)
+{
+	while(clients != NULL)
+		client_free(clients->data);
+
+	if(service == NULL)
+		return;
+
+	g_socket_service_stop(service);
+	g_socket_listener_close(G_SOCKET_LISTENER(service));
+	g_object_unref(service);
+	service = NULL;
+
+	unlink(service_path);
+	g_free(service_path);
+	service_path = NULL;
+}
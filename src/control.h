@@ -0,0 +1,22 @@
+/***********************************************************************/
+/* control.h                                                           */
+/* ---------                                                           */
+/*                           GTKTerm Software                          */
+/*                                 (c)                                 */
+/*                                                                     */
+/* ------------------------------------------------------------------- */
+/*                                                                     */
+/*   Purpose                                                           */
+/*      Control socket for automation                                  */
+/*      - Header file -                                                */
+/*                                                                     */
+/***********************************************************************/
+
+#ifndef CONTROL_H_
+#define CONTROL_H_
+
+gboolean control_start(const gchar *);
+void control_stop(void);
+void control_chars(const gchar *, guint);
+
+#endif
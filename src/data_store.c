@@ -0,0 +1,581 @@
+/***********************************************************************/
+/* data_store.c                                                        */
+/* ------------                                                        */
+/*                           GTKTerm Software                          */
+/*                                 (c)                                 */
+/*                                                                     */
+/* ------------------------------------------------------------------- */
+/*                                                                     */
+/*   Purpose                                                           */
+/*      Store of the data exchanged on the port, for the data view     */
+/*      - Bytes kept in blocks, full blocks are compressed             */
+/*      - The oldest blocks go when over the memory budget             */
+/*      - Every read or echo is recorded with its time and direction   */
+/*      - Every LINE_MARK_INTERVAL lines, where the line starts        */
+/*      - Bytes can be read from another thread                        */
+/*                                                                     */
+/***********************************************************************/
+
+#include <gio/gio.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "data_store.h"
+
+#include <config.h>
+#include <glib/gi18n.h>
+
+#define BLOCK_SIZE (1 << 20)
+#define RECORD_MERGE 1000		/* µs, reads closer than this share a record */
+#define COMPRESS_LEVEL 1		/* fast, the history is written far more than read */
+#define CACHE_BLOCKS 2			/* blocks kept decompressed for the view */
+#define LINE_MARK_INTERVAL 1024		/* lines between two marks */
+#define LINE_SCAN_CHUNK 4096
+
+typedef struct {
+	guint64 line;			/* counted from 0 since the store was cleared */
+	guint64 offset;			/* of its first byte */
+} line_mark_t;
+
+typedef struct {
+	guchar *data;
+	gsize size;			/* in memory, BLOCK_SIZE until compressed */
+	gboolean compressed;
+} store_block_t;
+
+static GPtrArray *blocks = NULL;	/* of store_block_t, the last one filling */
+static guint64 first = 0;		/* offset of the first byte of blocks[0] */
+static guint64 length = 0;		/* offset after the last byte */
+static GArray *records = NULL;		/* of data_record_t, by offset */
+static GArray *line_marks = NULL;	/* of line_mark_t, by line */
+static guint64 lines = 0;		/* ends of line stored */
+static gboolean has_tx = FALSE;
+static gint64 real_offset;		/* real time less monotonic time */
+static gsize budget = 64 << 20;
+static gsize block_memory = 0;		/* sum of the blocks sizes */
+
+static struct {
+	store_block_t *block;
+	guchar *data;
+} cache[CACHE_BLOCKS];
+static guint cache_next = 0;
+
+static void (*notify_func)(void) = NULL;
+
+/* Blocks, cache and offsets: written by the main thread only */
+G_LOCK_DEFINE_STATIC(store);
+
+static void block_free(gpointer data)
+{
+	store_block_t *block = data;
+	guint i;
+
+	for(i = 0; i < CACHE_BLOCKS; i++)
+	{
+		if(cache[i].block == block)
+			cache[i].block = NULL;
+	}
+	block_memory -= block->size;
+	g_free(block->data);
+	g_free(block);
+}
+
+static void store_init(void)
+{
+	blocks = g_ptr_array_new_with_free_func(block_free);
+	records = g_array_new(FALSE, FALSE, sizeof(data_record_t));
+	line_marks = g_array_new(FALSE, TRUE, sizeof(line_mark_t));
+	g_array_set_size(line_marks, 1);
+	real_offset = g_get_real_time() - g_get_monotonic_time();
+}
+
+/* A full block is not written again: kept compressed when worth it */
+static void compress_block(store_block_t *block)
+{
+	GConverter *compressor;
+	GConverterResult result;
+	guchar *out;
+	gsize read, written;
+
+	compressor = G_CONVERTER(g_zlib_compressor_new(G_ZLIB_COMPRESSOR_FORMAT_RAW, COMPRESS_LEVEL));
+	out = g_malloc(BLOCK_SIZE);
+	result = g_converter_convert(compressor, block->data, BLOCK_SIZE, out, BLOCK_SIZE,
+	                             G_CONVERTER_INPUT_AT_END, &read, &written, NULL);
+	g_object_unref(compressor);
+
+	/* Bigger than the data itself: kept as it is */
+	if(result != G_CONVERTER_FINISHED || read != BLOCK_SIZE)
+	{
+		g_free(out);
+		return;
+	}
+
+	g_free(block->data);
+	block->data = g_realloc(out, written);
+	block_memory -= block->size;
+	block->size = written;
+	block_memory += block->size;
+	block->compressed = TRUE;
+}
+
+/* The bytes of a block, decompressed in the cache if needed */
+static const guchar *block_bytes(store_block_t *block)
+{
+	GConverter *decompressor;
+	GConverterResult result;
+	gsize read, written = 0;
+	guint i;
+
+	if(!block->compressed)
+		return block->data;
+
+	for(i = 0; i < CACHE_BLOCKS; i++)
+	{
+		if(cache[i].block == block)
+			return cache[i].data;
+	}
+
+	i = cache_next;
+	cache_next = (cache_next + 1) % CACHE_BLOCKS;
+	if(cache[i].data == NULL)
+		cache[i].data = g_malloc(BLOCK_SIZE);
+
+	decompressor = G_CONVERTER(g_zlib_decompressor_new(G_ZLIB_COMPRESSOR_FORMAT_RAW));
+	result = g_converter_convert(decompressor, block->data, block->size, cache[i].data, BLOCK_SIZE,
+	                             G_CONVERTER_INPUT_AT_END, &read, &written, NULL);
+	g_object_unref(decompressor);
+	if(result != G_CONVERTER_FINISHED || written != BLOCK_SIZE)
+	{
+		g_warning("History block damaged");
+		memset(cache[i].data + written, 0, BLOCK_SIZE - written);
+	}
+	cache[i].block = block;
+
+	return cache[i].data;
+}
+
+/* After the next end of line from offset, FALSE at the end of the data.
+   The store is locked. */
+static gboolean next_line(guint64 *offset)
+{
+	const guchar *block, *end;
+	gsize in_block, n;
+
+	if(*offset < first)
+		return FALSE;
+
+	while(*offset < length)
+	{
+		block = block_bytes(g_ptr_array_index(blocks, (*offset - first) / BLOCK_SIZE));
+		in_block = *offset % BLOCK_SIZE;
+		n = MIN(length - *offset, BLOCK_SIZE - in_block);
+		end = memchr(block + in_block, '\n', n);
+		if(end != NULL)
+		{
+			*offset += end - (block + in_block) + 1;
+			return TRUE;
+		}
+		*offset += n;
+	}
+
+	return FALSE;
+}
+
+/* The first line starting at or after the first byte kept gets a mark,
+   the lines before the next mark would be out of reach otherwise */
+static void mark_first_line(guint64 kept)
+{
+	line_mark_t mark;
+	guint i;
+
+	for(i = 0; i < line_marks->len; i++)
+	{
+		if(g_array_index(line_marks, line_mark_t, i).offset >= kept)
+			break;
+	}
+	if(i == 0)
+		return;
+
+	mark = g_array_index(line_marks, line_mark_t, i - 1);
+	g_array_remove_range(line_marks, 0, i);
+
+	/* No end of line yet: the next one stored gets the mark */
+	do
+	{
+		if(!next_line(&mark.offset))
+			return;
+		mark.line++;
+	}
+	while(mark.offset < kept);
+
+	if(line_marks->len == 0 || g_array_index(line_marks, line_mark_t, 0).offset != mark.offset)
+		g_array_prepend_val(line_marks, mark);
+}
+
+/* The oldest block goes, with the records that end in it */
+static void drop_first_block(void)
+{
+	data_record_t *record;
+	guint i;
+
+	mark_first_line(first + BLOCK_SIZE);
+	g_ptr_array_remove_index(blocks, 0);
+	first += BLOCK_SIZE;
+
+	/* The last record starting before the new first byte stays */
+	for(i = 0; i + 1 < records->len; i++)
+	{
+		record = &g_array_index(records, data_record_t, i + 1);
+		if(record->offset > first)
+			break;
+	}
+	if(i > 0)
+		g_array_remove_range(records, 0, i);
+}
+
+/* Marks the lines starting in data, stored at offset */
+static void mark_lines(const gchar *data, gsize size, guint64 offset)
+{
+	const gchar *end = data + size, *next;
+	line_mark_t mark;
+
+	for(next = data; (next = memchr(next, '\n', end - next)) != NULL; )
+	{
+		next++;
+		lines++;
+		if(lines % LINE_MARK_INTERVAL == 0 || line_marks->len == 0)
+		{
+			mark.line = lines;
+			mark.offset = offset + (next - data);
+			g_array_append_val(line_marks, mark);
+		}
+	}
+}
+
+static gsize store_memory(void)
+{
+	return block_memory + records->len * sizeof(data_record_t);
+}
+
+/* The block being filled always stays */
+static void trim_to_budget(void)
+{
+	while(blocks->len > 1 && store_memory() > budget)
+		drop_first_block();
+}
+
+void data_store_append(const gchar *data, gsize size, gint64 time, guint direction)
+{
+	data_record_t *last, record;
+	store_block_t *block;
+	const gchar *start = data;
+	guint64 offset;
+	gsize used, n, stored = size;
+
+	if(size == 0)
+		return;
+
+	G_LOCK(store);
+	if(blocks == NULL)
+		store_init();
+	offset = length;
+
+	/* Time of the read, real time for the display */
+	time = (time ? time : g_get_monotonic_time()) + real_offset;
+
+	last = records->len ? &g_array_index(records, data_record_t, records->len - 1) : NULL;
+	if(last == NULL || last->direction != direction || time - last->time >= RECORD_MERGE)
+	{
+		record.offset = length;
+		record.time = time;
+		record.direction = direction;
+		g_array_append_val(records, record);
+	}
+	if(direction == DATA_TX)
+		has_tx = TRUE;
+
+	while(size > 0)
+	{
+		used = length % BLOCK_SIZE;
+		if(used == 0)
+		{
+			if(blocks->len > 0)
+				compress_block(g_ptr_array_index(blocks, blocks->len - 1));
+			block = g_new0(store_block_t, 1);
+			block->data = g_malloc(BLOCK_SIZE);
+			block->size = BLOCK_SIZE;
+			block_memory += block->size;
+			g_ptr_array_add(blocks, block);
+			trim_to_budget();
+		}
+		block = g_ptr_array_index(blocks, blocks->len - 1);
+		n = MIN(size, BLOCK_SIZE - used);
+		memcpy(block->data + used, data, n);
+		data += n;
+		size -= n;
+		length += n;
+	}
+	/* Once stored: a block dropped meanwhile may leave no mark */
+	mark_lines(start, stored, offset);
+	G_UNLOCK(store);
+
+	if(notify_func != NULL)
+		notify_func();
+}
+
+/* Copy what is kept of [offset, offset + size), returns the bytes copied */
+gsize data_store_read(guint64 offset, guchar *out, gsize size)
+{
+	const guchar *block;
+	gsize done = 0, n, in_block;
+
+	G_LOCK(store);
+	if(blocks == NULL || offset < first || offset >= length)
+	{
+		G_UNLOCK(store);
+		return 0;
+	}
+	size = MIN(size, length - offset);
+
+	while(done < size)
+	{
+		block = block_bytes(g_ptr_array_index(blocks, (offset - first) / BLOCK_SIZE));
+		in_block = offset % BLOCK_SIZE;
+		n = MIN(size - done, BLOCK_SIZE - in_block);
+		memcpy(out + done, block + in_block, n);
+		done += n;
+		offset += n;
+	}
+	G_UNLOCK(store);
+
+	return done;
+}
+
+guint64 data_store_first(void)
+{
+	guint64 offset;
+
+	G_LOCK(store);
+	offset = first;
+	G_UNLOCK(store);
+
+	return offset;
+}
+
+guint64 data_store_length(void)
+{
+	guint64 offset;
+
+	G_LOCK(store);
+	offset = length;
+	G_UNLOCK(store);
+
+	return offset;
+}
+
+gboolean data_store_has_tx(void)
+{
+	return has_tx;
+}
+
+/* Index of the record the byte at offset belongs to */
+guint data_store_find(guint64 offset)
+{
+	guint low = 0, high, middle;
+
+	if(records == NULL || records->len == 0)
+		return 0;
+
+	high = records->len - 1;
+	while(low < high)
+	{
+		middle = (low + high + 1) / 2;
+		if(g_array_index(records, data_record_t, middle).offset <= offset)
+			low = middle;
+		else
+			high = middle - 1;
+	}
+
+	return low;
+}
+
+/* Index of the first record at or after time, past the last one if none */
+guint data_store_find_time(gint64 time)
+{
+	guint low = 0, high, middle;
+
+	if(records == NULL)
+		return 0;
+
+	high = records->len;
+	while(low < high)
+	{
+		middle = (low + high) / 2;
+		if(g_array_index(records, data_record_t, middle).time < time)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+
+	return low;
+}
+
+/* After the next end of line from offset, FALSE at the end of the data */
+static gboolean skip_line(guint64 *offset)
+{
+	guchar chunk[LINE_SCAN_CHUNK];
+	guchar *end;
+	gsize size;
+
+	while((size = data_store_read(*offset, chunk, sizeof(chunk))) > 0)
+	{
+		end = memchr(chunk, '\n', size);
+		if(end != NULL)
+		{
+			*offset += end - chunk + 1;
+			return TRUE;
+		}
+		*offset += size;
+	}
+
+	return FALSE;
+}
+
+/*
+ * Offsets of the first and last bytes of a line, from 0. A line no
+ * longer kept gives the first one that is.
+ */
+gboolean data_store_find_line(guint64 line, guint64 *start, guint64 *end)
+{
+	const line_mark_t *mark;
+	guint low = 0, high, middle;
+	guint64 offset, n;
+
+	if(line_marks == NULL || line_marks->len == 0)
+		return FALSE;
+
+	high = line_marks->len - 1;
+	while(low < high)
+	{
+		middle = (low + high + 1) / 2;
+		if(g_array_index(line_marks, line_mark_t, middle).line <= line)
+			low = middle;
+		else
+			high = middle - 1;
+	}
+	mark = &g_array_index(line_marks, line_mark_t, low);
+	offset = mark->offset;
+
+	/* At most LINE_MARK_INTERVAL lines to go through */
+	for(n = mark->line; n < line; n++)
+	{
+		if(!skip_line(&offset))
+			return FALSE;
+	}
+	if(offset >= length)
+		return FALSE;
+
+	*start = offset;
+	if(!skip_line(&offset))
+		offset = length;
+	*end = offset - 1;
+
+	return TRUE;
+}
+
+guint64 data_store_lines(void)
+{
+	return lines;
+}
+
+/*
+ * Time of the last occurrence of a time of day ("14:32", "14:32:05" or
+ * "14:32:05.250") not after the last data stored.
+ */
+gboolean data_store_parse_time(const gchar *text, gint64 *time)
+{
+	GDateTime *last, *day, *at;
+	gint hours, minutes;
+	gdouble seconds = 0;
+	gint64 reference;
+
+	if(sscanf(text, "%d:%d:%lf", &hours, &minutes, &seconds) < 2 ||
+	   hours < 0 || hours > 23 || minutes < 0 || minutes > 59 || seconds < 0 || seconds >= 60)
+		return FALSE;
+
+	reference = (records != NULL && records->len > 0) ?
+	            g_array_index(records, data_record_t, records->len - 1).time : g_get_real_time();
+	last = g_date_time_new_from_unix_local(reference / G_USEC_PER_SEC);
+	day = g_date_time_new_local(g_date_time_get_year(last), g_date_time_get_month(last),
+	                            g_date_time_get_day_of_month(last), 0, 0, 0);
+	at = g_date_time_add_full(day, 0, 0, 0, hours, minutes, seconds);
+	*time = g_date_time_to_unix(at) * G_USEC_PER_SEC + g_date_time_get_microsecond(at);
+	if(*time > reference + G_USEC_PER_SEC)
+		*time -= G_USEC_PER_SEC * (gint64)(24 * 3600);
+
+	g_date_time_unref(at);
+	g_date_time_unref(day);
+	g_date_time_unref(last);
+
+	return TRUE;
+}
+
+/* NULL past the last record */
+const data_record_t *data_store_record(guint index)
+{
+	if(records == NULL || index >= records->len)
+		return NULL;
+
+	return &g_array_index(records, data_record_t, index);
+}
+
+void data_store_clear(void)
+{
+	if(blocks == NULL)
+		return;
+
+	G_LOCK(store);
+	g_ptr_array_set_size(blocks, 0);
+	g_array_set_size(records, 0);
+	g_array_set_size(line_marks, 0);
+	g_array_set_size(line_marks, 1);
+	first = length = lines = 0;
+	has_tx = FALSE;
+	G_UNLOCK(store);
+
+	if(notify_func != NULL)
+		notify_func();
+}
+
+/* Bytes of memory the history may use, records included */
+void data_store_set_budget(gsize bytes)
+{
+	G_LOCK(store);
+	budget = bytes;
+	if(blocks != NULL)
+		trim_to_budget();
+	G_UNLOCK(store);
+}
+
+gchar *data_store_statistics(void)
+{
+	gchar *kept, *used, *limit, *text;
+
+	if(blocks == NULL)
+		return g_strdup("");
+
+	kept = g_format_size(length - first);
+	used = g_format_size(store_memory());
+	limit = g_format_size(budget);
+	text = g_strdup_printf(_("History: %s kept in %s of memory (budget %s)\n"), kept, used, limit);
+	g_free(limit);
+	g_free(used);
+	g_free(kept);
+
+	return text;
+}
+
+void data_store_set_notify(void (*func)(void))
+{
+	notify_func = func;
+}
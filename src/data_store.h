@@ -0,0 +1,43 @@
+/***********************************************************************/
+/* data_store.h                                                        */
+/* ------------                                                        */
+/*                           GTKTerm Software                          */
+/*                                 (c)                                 */
+/*                                                                     */
+/* ------------------------------------------------------------------- */
+/*                                                                     */
+/*   Purpose                                                           */
+/*      Store of the data exchanged on the port, for the data view     */
+/*      - Header file -                                                */
+/*                                                                     */
+/***********************************************************************/
+
+#ifndef DATA_STORE_H_
+#define DATA_STORE_H_
+
+#define DATA_RX 0
+#define DATA_TX 1	/* local echo */
+
+typedef struct {
+	guint64 offset;		/* of its first byte */
+	gint64 time;		/* real time, µs */
+	guint direction;
+} data_record_t;
+
+void data_store_append(const gchar *, gsize, gint64, guint);
+gsize data_store_read(guint64, guchar *, gsize);
+guint64 data_store_first(void);
+guint64 data_store_length(void);
+gboolean data_store_has_tx(void);
+guint data_store_find(guint64);
+const data_record_t *data_store_record(guint);
+guint data_store_find_time(gint64);
+gboolean data_store_find_line(guint64, guint64 *, guint64 *);
+guint64 data_store_lines(void);
+gboolean data_store_parse_time(const gchar *, gint64 *);
+void data_store_clear(void);
+void data_store_set_budget(gsize);
+gchar *data_store_statistics(void);
+void data_store_set_notify(void (*func)(void));
+
+#endif
@@ -0,0 +1,626 @@
+/***********************************************************************/
+/* data_view.c                                                         */
+/* -----------                                                         */
+/*                           GTKTerm Software                          */
+/*                                 (c)                                 */
+/*                                                                     */
+/* ------------------------------------------------------------------- */
+/*                                                                     */
+/*   Purpose                                                           */
+/*      Hexadecimal view drawn from the data store                     */
+/*      - Only the rows on screen are drawn, whatever the size kept    */
+/*      - Offset, time and direction columns, hex and ASCII            */
+/*      - Selection copied as hexadecimal, C array or text             */
+/*                                                                     */
+/***********************************************************************/
+
+#include <gtk/gtk.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "term_config.h"
+#include "interface.h"
+#include "data_store.h"
+#include "data_view.h"
+
+#include <config.h>
+#include <glib/gi18n.h>
+
+#define MAX_PER_LINE 64
+#define MAX_COPY (4 << 20)	/* bytes, the hexadecimal is three times this */
+#define WHEEL_ROWS 3
+
+extern display_config_t term_conf;
+
+static GtkWidget *view_box = NULL;
+static GtkWidget *area;
+static GtkAdjustment *adjustment;
+static GtkWidget *popup = NULL;
+
+static guint per_line = 16;
+static gboolean show_offset = FALSE;
+static gboolean show_time = FALSE;
+
+/* Selection, offsets of the first and last bytes, -1 for none */
+static gint64 sel_anchor = -1, sel_end = -1;
+static gboolean selecting = FALSE;
+
+/* Font metrics, done again when the font changes */
+static gchar *font_name = NULL;
+static PangoFontDescription *font = NULL;
+static gint char_width = 8, line_height = 16;
+
+/* Where the columns start, in chars */
+static guint hex_column, ascii_column;
+
+static void layout_columns(void)
+{
+	hex_column = 0;
+	if(show_offset)
+		hex_column += 12;	/* 0000001F00 + 2 */
+	if(show_time)
+		hex_column += 13;	/* 12:34:56.789 + 1 */
+	if(data_store_has_tx())
+		hex_column += 2;
+	ascii_column = hex_column + per_line * 3 + 2;
+}
+
+static void update_font(void)
+{
+	PangoLayout *layout;
+
+	if(font != NULL && !g_strcmp0(font_name, term_conf.font))
+		return;
+
+	g_free(font_name);
+	font_name = g_strdup(term_conf.font ? term_conf.font : DEFAULT_FONT);
+	if(font != NULL)
+		pango_font_description_free(font);
+	font = pango_font_description_from_string(font_name);
+
+	layout = gtk_widget_create_pango_layout(area, "0");
+	pango_layout_set_font_description(layout, font);
+	pango_layout_get_pixel_size(layout, &char_width, &line_height);
+	g_object_unref(layout);
+	if(char_width < 1)
+		char_width = 1;
+	if(line_height < 1)
+		line_height = 1;
+}
+
+static guint hex_position(guint i)
+{
+	return hex_column + i * 3 + (i >= per_line / 2 ? 1 : 0);
+}
+
+static void add_colour(PangoAttrList *attributes, gboolean background, const GdkRGBA *colour,
+                       guint start, guint end)
+{
+	PangoAttribute *attribute;
+
+	if(background)
+		attribute = pango_attr_background_new(colour->red * 65535, colour->green * 65535, colour->blue * 65535);
+	else
+		attribute = pango_attr_foreground_new(colour->red * 65535, colour->green * 65535, colour->blue * 65535);
+	attribute->start_index = start;
+	attribute->end_index = end;
+	pango_attr_list_insert(attributes, attribute);
+}
+
+static void draw_row(cairo_t *cr, PangoLayout *layout, guint64 offset, gint y)
+{
+	static const GdkRGBA tx_colour = {0.35, 0.65, 1.0, 1.0};
+	guchar data[MAX_PER_LINE];
+	gchar line[512], *p;
+	const data_record_t *record, *next;
+	PangoAttrList *attributes;
+	GdkRGBA selected;
+	gint64 low, high;
+	struct tm tm;
+	time_t seconds;
+	guint i, n, index;
+	gsize size;
+
+	size = data_store_read(offset, data, per_line);
+	if(size == 0)
+		return;
+
+	index = data_store_find(offset);
+	record = data_store_record(index);
+
+	memset(line, ' ', sizeof(line));
+	p = line;
+	if(show_offset)
+		p += sprintf(p, "%010" G_GINT64_MODIFIER "X  ", offset);
+	if(show_time && record != NULL)
+	{
+		seconds = record->time / G_USEC_PER_SEC;
+		localtime_r(&seconds, &tm);
+		p += sprintf(p, "%02d:%02d:%02d.%03d ", tm.tm_hour, tm.tm_min, tm.tm_sec,
+		             (gint)(record->time / 1000 % 1000));
+	}
+	if(data_store_has_tx())
+		p += sprintf(p, "%c ", record != NULL && record->direction == DATA_TX ? '>' : '<');
+	*p = ' ';
+
+	for(i = 0; i < size; i++)
+	{
+		sprintf(line + hex_position(i), "%02X", data[i]);
+		line[hex_position(i) + 2] = ' ';
+		line[ascii_column + i] = (data[i] > 0x1F && data[i] < 0x7F) ? data[i] : '.';
+	}
+	n = ascii_column + size;
+	line[n] = 0;
+
+	attributes = pango_attr_list_new();
+
+	/* Sent bytes in their own colour */
+	next = data_store_record(index + 1);
+	for(i = 0; i < size; i++)
+	{
+		while(next != NULL && next->offset <= offset + i)
+		{
+			record = next;
+			next = data_store_record(++index + 1);
+		}
+		if(record != NULL && record->direction == DATA_TX)
+		{
+			add_colour(attributes, FALSE, &tx_colour, hex_position(i), hex_position(i) + 2);
+			add_colour(attributes, FALSE, &tx_colour, ascii_column + i, ascii_column + i + 1);
+		}
+	}
+
+	if(sel_anchor != -1)
+	{
+		low = MIN(sel_anchor, sel_end);
+		high = MAX(sel_anchor, sel_end);
+		selected = term_conf.foreground_color;
+		selected.alpha = 1;
+		for(i = 0; i < size; i++)
+		{
+			if((gint64)(offset + i) < low || (gint64)(offset + i) > high)
+				continue;
+			/* The space between two selected bytes is selected too */
+			add_colour(attributes, TRUE, &selected, hex_position(i),
+			           hex_position(i) + ((gint64)(offset + i) < high && i + 1 < size ? 3 : 2));
+			add_colour(attributes, FALSE, &term_conf.background_color, hex_position(i), hex_position(i) + 2);
+			add_colour(attributes, TRUE, &selected, ascii_column + i, ascii_column + i + 1);
+			add_colour(attributes, FALSE, &term_conf.background_color, ascii_column + i, ascii_column + i + 1);
+		}
+	}
+
+	pango_layout_set_text(layout, line, n);
+	pango_layout_set_attributes(layout, attributes);
+	pango_attr_list_unref(attributes);
+
+	cairo_move_to(cr, 0, y);
+	pango_cairo_show_layout(cr, layout);
+}
+
+static gboolean view_draw(GtkWidget *widget, cairo_t *cr, gpointer data)
+{
+	PangoLayout *layout;
+	guint64 row, rows;
+	gint y, height;
+
+	update_font();
+	layout_columns();
+
+	gdk_cairo_set_source_rgba(cr, &term_conf.background_color);
+	cairo_paint(cr);
+
+	layout = gtk_widget_create_pango_layout(widget, NULL);
+	pango_layout_set_font_description(layout, font);
+	gdk_cairo_set_source_rgba(cr, &term_conf.foreground_color);
+
+	height = gtk_widget_get_allocated_height(widget);
+	row = gtk_adjustment_get_value(adjustment);
+	rows = gtk_adjustment_get_upper(adjustment);
+	for(y = 0; y < height && row < rows; y += line_height, row++)
+		draw_row(cr, layout, row * per_line, y);
+
+	g_object_unref(layout);
+
+	return TRUE;
+}
+
+/* Rows of the data kept, the screen follows the end when it was there */
+static void update_rows(void)
+{
+	gdouble lower, upper, page, value;
+	gboolean follow;
+
+	lower = (data_store_first() + per_line - 1) / per_line;
+	upper = (data_store_length() + per_line - 1) / per_line;
+	page = MAX(1, gtk_widget_get_allocated_height(area) / line_height);
+
+	value = gtk_adjustment_get_value(adjustment);
+	follow = value + gtk_adjustment_get_page_size(adjustment) >= gtk_adjustment_get_upper(adjustment);
+	if(follow)
+		value = upper - page;
+
+	gtk_adjustment_configure(adjustment, MAX(lower, MIN(value, upper - page)), lower, MAX(upper, lower + page),
+	                         1, MAX(1, page - 1), page);
+	gtk_widget_queue_draw(area);
+}
+
+static void view_changed(void)
+{
+	if(view_box == NULL)
+		return;
+
+	/* Cleared */
+	if(data_store_length() == 0)
+		sel_anchor = sel_end = -1;
+	update_rows();
+}
+
+static void view_size_allocate(GtkWidget *widget, GdkRectangle *allocation, gpointer data)
+{
+	update_font();
+	update_rows();
+}
+
+static void value_changed(GtkAdjustment *adj, gpointer data)
+{
+	gtk_widget_queue_draw(area);
+}
+
+/* Byte under a point, clamped to the data kept */
+static gint64 hit_offset(gdouble x, gdouble y)
+{
+	gint64 row, offset, first, length;
+	gint column, i;
+
+	row = (gint64)gtk_adjustment_get_value(adjustment) + (gint64)(y / line_height);
+	column = x / char_width;
+
+	if(column >= (gint)ascii_column)
+		i = column - ascii_column;
+	else if(column >= (gint)hex_column + (gint)per_line / 2 * 3)
+		i = (column - hex_column - 1) / 3;
+	else
+		i = ((gint)column - (gint)hex_column) / 3;
+	i = CLAMP(i, 0, (gint)per_line - 1);
+
+	offset = row * per_line + i;
+	first = data_store_first();
+	length = data_store_length();
+	if(length == 0)
+		return -1;
+	return CLAMP(offset, first, length - 1);
+}
+
+static GString *selection_bytes(void)
+{
+	GString *bytes;
+	gint64 low, high;
+	gsize size;
+
+	if(sel_anchor == -1)
+		return NULL;
+
+	low = MAX(MIN(sel_anchor, sel_end), (gint64)data_store_first());
+	high = MIN(MAX(sel_anchor, sel_end), (gint64)data_store_length() - 1);
+	if(high < low)
+		return NULL;
+
+	size = MIN(high - low + 1, MAX_COPY);
+	if(size < (gsize)(high - low + 1))
+		Put_temp_message(_("Selection too large, only the beginning is copied"), 3000);
+
+	bytes = g_string_sized_new(size);
+	g_string_set_size(bytes, size);
+	g_string_set_size(bytes, data_store_read(low, (guchar *)bytes->str, size));
+
+	return bytes;
+}
+
+enum { COPY_HEX, COPY_C, COPY_TEXT };
+
+static void copy_selection(gint format)
+{
+	GString *bytes, *text;
+	guchar c;
+	gsize i;
+
+	bytes = selection_bytes();
+	if(bytes == NULL)
+		return;
+
+	text = g_string_sized_new(bytes->len * 6 + 64);
+	if(format == COPY_C)
+		g_string_append_printf(text, "const unsigned char data[%" G_GSIZE_FORMAT "] = {\n", bytes->len);
+	for(i = 0; i < bytes->len; i++)
+	{
+		c = bytes->str[i];
+		switch(format)
+		{
+		case COPY_HEX:
+			g_string_append_printf(text, "%02X", c);
+			if(i + 1 < bytes->len)
+				g_string_append_c(text, (i + 1) % per_line ? ' ' : '\n');
+			break;
+		case COPY_C:
+			if(i % per_line == 0)
+				g_string_append_c(text, '\t');
+			g_string_append_printf(text, "0x%02X%s", c, i + 1 < bytes->len ? "," : "");
+			g_string_append_c(text, (i + 1) % per_line && i + 1 < bytes->len ? ' ' : '\n');
+			break;
+		default:
+			g_string_append_c(text, (c > 0x1F && c < 0x7F) || c == '\n' || c == '\r' || c == '\t' ? c : '.');
+		}
+	}
+	if(format == COPY_C)
+		g_string_append(text, "};\n");
+
+	gtk_clipboard_set_text(gtk_widget_get_clipboard(area, GDK_SELECTION_CLIPBOARD), text->str, text->len);
+
+	g_string_free(text, TRUE);
+	g_string_free(bytes, TRUE);
+}
+
+static void copy_activated(GtkMenuItem *item, gpointer format)
+{
+	copy_selection(GPOINTER_TO_INT(format));
+}
+
+static void select_all_activated(GtkMenuItem *item, gpointer data)
+{
+	data_view_select_all();
+}
+
+static void show_popup(GdkEventButton *event)
+{
+	static const struct {
+		const gchar *label;
+		gint format;
+	} items[] = {
+		{N_("Copy as _hexadecimal"), COPY_HEX},
+		{N_("Copy as _C array"), COPY_C},
+		{N_("Copy as _text"), COPY_TEXT}
+	};
+	GtkWidget *item;
+	guint i;
+
+	if(popup == NULL)
+	{
+		popup = gtk_menu_new();
+		for(i = 0; i < G_N_ELEMENTS(items); i++)
+		{
+			item = gtk_menu_item_new_with_mnemonic(_(items[i].label));
+			g_signal_connect(item, "activate", G_CALLBACK(copy_activated), GINT_TO_POINTER(items[i].format));
+			gtk_menu_shell_append(GTK_MENU_SHELL(popup), item);
+		}
+		gtk_menu_shell_append(GTK_MENU_SHELL(popup), gtk_separator_menu_item_new());
+		item = gtk_menu_item_new_with_mnemonic(_("Select _all"));
+		g_signal_connect(item, "activate", G_CALLBACK(select_all_activated), NULL);
+		gtk_menu_shell_append(GTK_MENU_SHELL(popup), item);
+		gtk_menu_attach_to_widget(GTK_MENU(popup), area, NULL);
+		gtk_widget_show_all(popup);
+	}
+
+	gtk_menu_popup(GTK_MENU(popup), NULL, NULL, NULL, NULL,
+	               event ? event->button : 0, event ? event->time : gtk_get_current_event_time());
+}
+
+static gboolean view_button_press(GtkWidget *widget, GdkEventButton *event, gpointer data)
+{
+	gint64 offset;
+
+	gtk_widget_grab_focus(widget);
+
+	if(event->button == 3)
+	{
+		show_popup(event);
+		return TRUE;
+	}
+	if(event->button != 1 || event->type != GDK_BUTTON_PRESS)
+		return FALSE;
+
+	offset = hit_offset(event->x, event->y);
+	if(offset == -1)
+		return TRUE;
+
+	if((event->state & GDK_SHIFT_MASK) && sel_anchor != -1)
+		sel_end = offset;
+	else
+		sel_anchor = sel_end = offset;
+	selecting = TRUE;
+	gtk_widget_queue_draw(widget);
+
+	return TRUE;
+}
+
+static gboolean view_motion(GtkWidget *widget, GdkEventMotion *event, gpointer data)
+{
+	gdouble value = gtk_adjustment_get_value(adjustment);
+	gint64 offset;
+
+	if(!selecting)
+		return FALSE;
+
+	/* Dragging out of the view scrolls it */
+	if(event->y < 0)
+		gtk_adjustment_set_value(adjustment, value - 1);
+	else if(event->y >= gtk_widget_get_allocated_height(widget))
+		gtk_adjustment_set_value(adjustment, value + 1);
+
+	offset = hit_offset(event->x, CLAMP(event->y, 0, gtk_widget_get_allocated_height(widget) - 1));
+	if(offset != -1 && offset != sel_end)
+	{
+		sel_end = offset;
+		gtk_widget_queue_draw(widget);
+	}
+
+	return TRUE;
+}
+
+static gboolean view_button_release(GtkWidget *widget, GdkEventButton *event, gpointer data)
+{
+	if(event->button == 1)
+		selecting = FALSE;
+
+	return FALSE;
+}
+
+static gboolean view_scroll(GtkWidget *widget, GdkEventScroll *event, gpointer data)
+{
+	gdouble value = gtk_adjustment_get_value(adjustment);
+	gdouble dx, dy;
+
+	switch(event->direction)
+	{
+	case GDK_SCROLL_UP:
+		value -= WHEEL_ROWS;
+		break;
+	case GDK_SCROLL_DOWN:
+		value += WHEEL_ROWS;
+		break;
+	case GDK_SCROLL_SMOOTH:
+		gdk_event_get_scroll_deltas((GdkEvent *)event, &dx, &dy);
+		value += dy * WHEEL_ROWS;
+		break;
+	default:
+		return FALSE;
+	}
+
+	gtk_adjustment_set_value(adjustment, MIN(value, gtk_adjustment_get_upper(adjustment) -
+	                                         gtk_adjustment_get_page_size(adjustment)));
+	return TRUE;
+}
+
+static gboolean view_key_press(GtkWidget *widget, GdkEventKey *event, gpointer data)
+{
+	gdouble value = gtk_adjustment_get_value(adjustment);
+	gdouble page = gtk_adjustment_get_page_size(adjustment);
+
+	if(event->state & GDK_CONTROL_MASK)
+	{
+		switch(event->keyval)
+		{
+		case GDK_KEY_Home:
+			gtk_adjustment_set_value(adjustment, gtk_adjustment_get_lower(adjustment));
+			return TRUE;
+		case GDK_KEY_End:
+			gtk_adjustment_set_value(adjustment, gtk_adjustment_get_upper(adjustment) - page);
+			return TRUE;
+		}
+	}
+
+	switch(event->keyval)
+	{
+	case GDK_KEY_Page_Up:
+		gtk_adjustment_set_value(adjustment, value - MAX(1, page - 1));
+		return TRUE;
+	case GDK_KEY_Page_Down:
+		gtk_adjustment_set_value(adjustment, MIN(value + MAX(1, page - 1),
+		                                         gtk_adjustment_get_upper(adjustment) - page));
+		return TRUE;
+	case GDK_KEY_Menu:
+		show_popup(NULL);
+		return TRUE;
+	}
+
+	/* Typing goes to the port, as in the terminal */
+	if(event->length > 0)
+	{
+		send_serial(event->string, event->length);
+		return TRUE;
+	}
+
+	return FALSE;
+}
+
+GtkWidget *data_view_new(void)
+{
+	GtkWidget *scrollbar;
+
+	adjustment = gtk_adjustment_new(0, 0, 1, 1, 1, 1);
+	g_signal_connect(adjustment, "value-changed", G_CALLBACK(value_changed), NULL);
+
+	area = gtk_drawing_area_new();
+	gtk_widget_set_can_focus(area, TRUE);
+	gtk_widget_add_events(area, GDK_BUTTON_PRESS_MASK | GDK_BUTTON_RELEASE_MASK | GDK_POINTER_MOTION_MASK |
+	                      GDK_SCROLL_MASK | GDK_SMOOTH_SCROLL_MASK | GDK_KEY_PRESS_MASK);
+	g_signal_connect(area, "draw", G_CALLBACK(view_draw), NULL);
+	g_signal_connect(area, "size-allocate", G_CALLBACK(view_size_allocate), NULL);
+	g_signal_connect(area, "button-press-event", G_CALLBACK(view_button_press), NULL);
+	g_signal_connect(area, "button-release-event", G_CALLBACK(view_button_release), NULL);
+	g_signal_connect(area, "motion-notify-event", G_CALLBACK(view_motion), NULL);
+	g_signal_connect(area, "scroll-event", G_CALLBACK(view_scroll), NULL);
+	g_signal_connect(area, "key-press-event", G_CALLBACK(view_key_press), NULL);
+
+	scrollbar = gtk_scrollbar_new(GTK_ORIENTATION_VERTICAL, adjustment);
+
+	view_box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 0);
+	gtk_box_pack_start(GTK_BOX(view_box), area, TRUE, TRUE, 0);
+	gtk_box_pack_start(GTK_BOX(view_box), scrollbar, FALSE, FALSE, 0);
+
+	data_store_set_notify(view_changed);
+
+	return view_box;
+}
+
+void data_view_set_bytes_per_line(guint bytes)
+{
+	gdouble value;
+
+	if(bytes == 0 || bytes > MAX_PER_LINE || bytes == per_line)
+		return;
+
+	/* Keep the same bytes on screen */
+	value = gtk_adjustment_get_value(adjustment) * per_line / bytes;
+	per_line = bytes;
+	gtk_adjustment_set_value(adjustment, value);
+	update_rows();
+}
+
+void data_view_set_columns(gboolean offset, gboolean time)
+{
+	show_offset = offset;
+	show_time = time;
+	gtk_widget_queue_draw(area);
+}
+
+void data_view_focus(void)
+{
+	update_rows();
+	gtk_widget_grab_focus(area);
+}
+
+gboolean data_view_has_selection(void)
+{
+	return sel_anchor != -1;
+}
+
+void data_view_copy(void)
+{
+	copy_selection(COPY_HEX);
+}
+
+/* Selects [start, end] and scrolls to it */
+void data_view_goto(guint64 start, guint64 end)
+{
+	gdouble row;
+
+	sel_anchor = start;
+	sel_end = end;
+
+	/* A couple of rows before it, for context */
+	row = start / per_line;
+	gtk_adjustment_set_value(adjustment, MAX(gtk_adjustment_get_lower(adjustment), row - 2));
+	gtk_widget_queue_draw(area);
+	gtk_widget_grab_focus(area);
+}
+
+void data_view_select_all(void)
+{
+	if(data_store_length() == 0)
+		return;
+
+	sel_anchor = data_store_first();
+	sel_end = data_store_length() - 1;
+	gtk_widget_queue_draw(area);
+}
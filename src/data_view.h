@@ -0,0 +1,27 @@
+/***********************************************************************/
+/* data_view.h                                                         */
+/* -----------                                                         */
+/*                           GTKTerm Software                          */
+/*                                 (c)                                 */
+/*                                                                     */
+/* ------------------------------------------------------------------- */
+/*                                                                     */
+/*   Purpose                                                           */
+/*      Hexadecimal view drawn from the data store                     */
+/*      - Header file -                                                */
+/*                                                                     */
+/***********************************************************************/
+
+#ifndef DATA_VIEW_H_
+#define DATA_VIEW_H_
+
+GtkWidget *data_view_new(void);
+void data_view_set_bytes_per_line(guint);
+void data_view_set_columns(gboolean, gboolean);
+void data_view_focus(void);
+gboolean data_view_has_selection(void);
+void data_view_copy(void);
+void data_view_select_all(void);
+void data_view_goto(guint64, guint64);
+
+#endif
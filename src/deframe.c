@@ -0,0 +1,358 @@
+/***********************************************************************/
+/* deframe.c                                                           */
+/* ---------                                                           */
+/*                           GTKTerm Software                          */
+/*                                 (c)                                 */
+/*                                                                     */
+/* ------------------------------------------------------------------- */
+/*                                                                     */
+/*   Purpose                                                           */
+/*      SLIP / COBS / HDLC decoding of the received stream             */
+/*      - Frames are decoded byte by byte in a single frame buffer     */
+/*      - Good frames can be exported to a pcap file                   */
+/*                                                                     */
+/***********************************************************************/
+
+#include <gtk/gtk.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include "interface.h"
+#include "deframe.h"
+
+#include <config.h>
+#include <glib/gi18n.h>
+
+#define SLIP_END 0xC0
+#define SLIP_ESC 0xDB
+#define SLIP_ESC_END 0xDC
+#define SLIP_ESC_ESC 0xDD
+
+#define HDLC_FLAG 0x7E
+#define HDLC_ESC 0x7D
+#define HDLC_GOOD_FCS 0xF0B8
+
+#define PCAP_LINKTYPE_USER0 147
+
+extern GtkWidget *Fenetre;
+
+/* A decoder eats one byte and tells when a frame is complete */
+typedef struct {
+	gboolean (*feed)(guchar);
+} deframer_t;
+
+static gboolean slip_feed(guchar);
+static gboolean cobs_feed(guchar);
+static gboolean hdlc_feed(guchar);
+
+static const deframer_t deframers[] = {
+	[DEFRAME_NONE] = {NULL},
+	[DEFRAME_SLIP] = {slip_feed},
+	[DEFRAME_COBS] = {cobs_feed},
+	[DEFRAME_HDLC] = {hdlc_feed},
+};
+
+static gint deframer = DEFRAME_NONE;
+
+/* Frame being decoded, shared by all the decoders */
+static guchar frame[DEFRAME_MAX_FRAME];
+static guint frame_len = 0;
+static const gchar *frame_error = NULL;	/* NULL while the frame is good */
+static gboolean frame_escape = FALSE;
+static guint cobs_code = 0;		/* code of the current block, 0 at start */
+static guint cobs_left = 0;		/* data bytes left in the block */
+
+static guint16 fcs_table[256];
+static gboolean fcs_table_ready = FALSE;
+
+static FILE *export_file = NULL;
+
+static struct {
+	guint frames;
+	guint errors;
+	guint exported;
+} deframe_stats;
+
+static void fcs_table_init(void)
+{
+	guint i, j;
+	guint16 fcs;
+
+	for(i = 0; i < 256; i++)
+	{
+		fcs = i;
+		for(j = 0; j < 8; j++)
+			fcs = (fcs & 1) ? (fcs >> 1) ^ 0x8408 : fcs >> 1;
+		fcs_table[i] = fcs;
+	}
+	fcs_table_ready = TRUE;
+}
+
+/* FCS-16 of RFC 1662, HDLC_GOOD_FCS over a frame and its FCS */
+static guint16 fcs16(const guchar *data, guint len)
+{
+	guint16 fcs = 0xFFFF;
+
+	while(len--)
+		fcs = (fcs >> 8) ^ fcs_table[(fcs ^ *data++) & 0xFF];
+
+	return fcs;
+}
+
+static void frame_add(guchar c)
+{
+	if(frame_len < DEFRAME_MAX_FRAME)
+		frame[frame_len++] = c;
+	else
+		frame_error = _("frame too long");
+}
+
+static gboolean slip_feed(guchar c)
+{
+	if(c == SLIP_END)
+	{
+		if(frame_escape)
+			frame_error = _("bad escape");
+		frame_escape = FALSE;
+		/* Back to back END bytes only resynchronise */
+		return frame_len > 0 || frame_error != NULL;
+	}
+
+	if(frame_escape)
+	{
+		frame_escape = FALSE;
+		if(c == SLIP_ESC_END)
+			c = SLIP_END;
+		else if(c == SLIP_ESC_ESC)
+			c = SLIP_ESC;
+		else
+			frame_error = _("bad escape");
+		frame_add(c);
+	}
+	else if(c == SLIP_ESC)
+		frame_escape = TRUE;
+	else
+		frame_add(c);
+
+	return FALSE;
+}
+
+/* The zero replaced by a code is only added once we know the frame goes on */
+static gboolean cobs_feed(guchar c)
+{
+	if(c == 0)
+	{
+		if(cobs_code == 0)
+			return frame_error != NULL;
+		if(cobs_left != 0)
+			frame_error = _("truncated block");
+		return TRUE;
+	}
+
+	if(cobs_left == 0)
+	{
+		if(cobs_code != 0 && cobs_code != 0xFF)
+			frame_add(0);
+		cobs_code = c;
+		cobs_left = c - 1;
+	}
+	else
+	{
+		frame_add(c);
+		cobs_left--;
+	}
+
+	return FALSE;
+}
+
+static gboolean hdlc_feed(guchar c)
+{
+	if(c == HDLC_FLAG)
+	{
+		if(frame_escape)
+			frame_error = _("aborted");
+		frame_escape = FALSE;
+
+		if(frame_len == 0 && frame_error == NULL)
+			return FALSE;
+
+		if(frame_error == NULL)
+		{
+			if(frame_len < 3)
+				frame_error = _("short frame");
+			else if(fcs16(frame, frame_len) != HDLC_GOOD_FCS)
+				frame_error = _("FCS error");
+			else
+				frame_len -= 2;
+		}
+		return TRUE;
+	}
+
+	if(frame_escape)
+	{
+		frame_escape = FALSE;
+		frame_add(c ^ 0x20);
+	}
+	else if(c == HDLC_ESC)
+		frame_escape = TRUE;
+	else
+		frame_add(c);
+
+	return FALSE;
+}
+
+static void export_frame(void)
+{
+	gint64 now = g_get_real_time();
+	guint32 record[4];
+
+	record[0] = now / G_USEC_PER_SEC;
+	record[1] = now % G_USEC_PER_SEC;
+	record[2] = frame_len;
+	record[3] = frame_len;
+
+	if(fwrite(record, sizeof(record), 1, export_file) != 1 ||
+	   fwrite(frame, 1, frame_len, export_file) != frame_len)
+	{
+		show_message(_("Cannot write the exported frames, export stopped\n"), MSG_ERR);
+		fclose(export_file);
+		export_file = NULL;
+		return;
+	}
+	deframe_stats.exported++;
+}
+
+static void frame_deliver(void)
+{
+	deframe_stats.frames++;
+	if(frame_error != NULL)
+		deframe_stats.errors++;
+
+	put_hexadecimal_frame(frame, frame_len, frame_error);
+
+	if(frame_error == NULL && export_file != NULL)
+		export_frame();
+
+	deframe_reset();
+}
+
+void put_deframed(const gchar *string, guint size)
+{
+	gboolean (*feed)(guchar) = deframers[deframer].feed;
+	guint i;
+
+	if(feed == NULL)
+		return;
+
+	for(i = 0; i < size; i++)
+		if(feed((guchar)string[i]))
+			frame_deliver();
+}
+
+void deframe_reset(void)
+{
+	frame_len = 0;
+	frame_error = NULL;
+	frame_escape = FALSE;
+	cobs_code = 0;
+	cobs_left = 0;
+}
+
+void deframe_set(gint type)
+{
+	if(type < DEFRAME_NONE || type > DEFRAME_HDLC)
+		type = DEFRAME_NONE;
+
+	if(!fcs_table_ready)
+		fcs_table_init();
+
+	deframer = type;
+	deframe_reset();
+}
+
+gint deframe_get(void)
+{
+	return deframer;
+}
+
+static gboolean export_start(void)
+{
+	GtkWidget *file_select;
+	gchar *fileName = NULL;
+	gchar *msg;
+	/* pcap file header, microsecond timestamps */
+	struct {
+		guint32 magic;
+		guint16 major, minor;
+		gint32 zone;
+		guint32 sigfigs, snaplen, linktype;
+	} header = {0xA1B2C3D4, 2, 4, 0, 0, DEFRAME_MAX_FRAME, PCAP_LINKTYPE_USER0};
+
+	file_select = gtk_file_chooser_dialog_new(_("Export frames"),
+	              GTK_WINDOW(Fenetre),
+	              GTK_FILE_CHOOSER_ACTION_SAVE,
+	              GTK_STOCK_CANCEL, GTK_RESPONSE_CANCEL,
+	              GTK_STOCK_SAVE, GTK_RESPONSE_ACCEPT,
+	              NULL);
+	gtk_file_chooser_set_do_overwrite_confirmation(GTK_FILE_CHOOSER(file_select), TRUE);
+	gtk_file_chooser_set_current_name(GTK_FILE_CHOOSER(file_select), "frames.pcap");
+
+	if(gtk_dialog_run(GTK_DIALOG(file_select)) == GTK_RESPONSE_ACCEPT)
+		fileName = gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(file_select));
+	gtk_widget_destroy(file_select);
+
+	if(fileName == NULL)
+		return FALSE;
+
+	export_file = fopen(fileName, "wb");
+	if(export_file == NULL)
+	{
+		msg = g_strdup_printf(_("Cannot open file %s: %s\n"), fileName, strerror(errno));
+		show_message(msg, MSG_ERR);
+		g_free(msg);
+		g_free(fileName);
+		return FALSE;
+	}
+	g_free(fileName);
+
+	/* Written in big blocks, the display is slower than the disk */
+	setvbuf(export_file, NULL, _IOFBF, 1 << 16);
+	fwrite(&header, sizeof(header), 1, export_file);
+	deframe_stats.exported = 0;
+
+	return TRUE;
+}
+
+void export_frames_callback(GtkAction *action, gpointer data)
+{
+	gchar *msg;
+
+	if(gtk_toggle_action_get_active(GTK_TOGGLE_ACTION(action)))
+	{
+		if(export_file == NULL && !export_start())
+			gtk_toggle_action_set_active(GTK_TOGGLE_ACTION(action), FALSE);
+		return;
+	}
+
+	if(export_file == NULL)
+		return;
+
+	if(fclose(export_file) != 0)
+		show_message(_("Cannot write the exported frames\n"), MSG_ERR);
+	export_file = NULL;
+
+	msg = g_strdup_printf(_("%u frames exported"), deframe_stats.exported);
+	Put_temp_message(msg, 3000);
+	g_free(msg);
+}
+
+gchar *deframe_statistics(void)
+{
+	if(deframe_stats.frames == 0)
+		return g_strdup("");
+
+	return g_strdup_printf(_("Frames: %u, with errors: %u, exported: %u\n"),
+	                       deframe_stats.frames, deframe_stats.errors,
+	                       deframe_stats.exported);
+}
@@ -0,0 +1,32 @@
+/***********************************************************************/
+/* deframe.h                                                           */
+/* ---------                                                           */
+/*                           GTKTerm Software                          */
+/*                                 (c)                                 */
+/*                                                                     */
+/* ------------------------------------------------------------------- */
+/*                                                                     */
+/*   Purpose                                                           */
+/*      SLIP / COBS / HDLC decoding of the received stream             */
+/*      - Header file -                                                */
+/*                                                                     */
+/***********************************************************************/
+
+#ifndef DEFRAME_H_
+#define DEFRAME_H_
+
+#define DEFRAME_NONE 0
+#define DEFRAME_SLIP 1
+#define DEFRAME_COBS 2
+#define DEFRAME_HDLC 3
+
+#define DEFRAME_MAX_FRAME 8192
+
+void deframe_set(gint);
+gint deframe_get(void);
+void deframe_reset(void);
+void put_deframed(const gchar *, guint);
+void export_frames_callback(GtkAction *, gpointer);
+gchar *deframe_statistics(void);
+
+#endif
@@ -8,6 +8,7 @@
 /*																	 */
 /*   Purpose														   */
 /*	  Monitor device to autoreconnect								*/
+/*	  Keep a registry of the serial devices present				  */
 /*   Written by Kevin Picot - picotk27@gmail.com					   */
 /*																	 */
 /***********************************************************************/
@@ -25,12 +26,228 @@
 #include <interface.h>
 #include <term_config.h>
 #include <gudev/gudev.h>
+#include <glib/gi18n.h>
 
 #include "serial.h"
 #include "interface.h"
 
 extern struct configuration_port config;
 
+/* Give up waiting for a reappeared device node to become usable */
+#define RECONNECT_TIMEOUT	2000	/* ms */
+#define RECONNECT_RETRY		10	/* ms */
+
+static GUdevClient *udev_client;
+static GPtrArray *registry;
+
+/* Device the open port belongs to, remembered while it is gone */
+static gchar *lost_identity;
+static gchar *lost_path;
+static gint64 lost_time;	/* monotonic, µs */
+static gint64 found_time;
+static guint reconnect_source;
+
+static struct {
+	guint reconnects;
+	gint64 last_latency;	/* device back -> port open, µs */
+	gint64 max_latency;
+	gint64 total_latency;
+	gint64 last_gap;	/* device gone -> port open, µs */
+	gint64 total_gap;
+} reconnect_stats;
+
+static void serial_device_free(gpointer data)
+{
+	serial_device_t *dev = data;
+
+	g_free(dev->path);
+	g_free(dev->by_id);
+	g_free(dev->identity);
+	g_free(dev->vendor);
+	g_free(dev->model);
+	g_free(dev->serial);
+	g_free(dev->driver);
+	g_free(dev);
+}
+
+static int registry_compare(gconstpointer a, gconstpointer b)
+{
+	const serial_device_t *da = a;
+	const serial_device_t *db = b;
+
+	return compare_seminum(da->path, db->path);
+}
+
+/* Position of path in the sorted registry, or where it would be inserted */
+static guint registry_position(const gchar *path, gboolean *found)
+{
+	guint low = 0, high = registry->len;
+	int cmp;
+
+	*found = FALSE;
+	while (low < high) {
+		guint mid = (low + high) / 2;
+		const serial_device_t *dev = g_ptr_array_index(registry, mid);
+
+		cmp = compare_seminum(path, dev->path);
+		if (cmp == 0) {
+			*found = TRUE;
+			return mid;
+		}
+		if (cmp < 0)
+			high = mid;
+		else
+			low = mid + 1;
+	}
+	return low;
+}
+
+static const gchar *device_property(GUdevDevice *device, const gchar *key, const gchar *fallback)
+{
+	const gchar *value = g_udev_device_get_property(device, key);
+
+	if (value == NULL && fallback != NULL)
+		value = g_udev_device_get_property(device, fallback);
+	return value;
+}
+
+static serial_device_t *serial_device_new(GUdevDevice *device)
+{
+	const gchar *file = g_udev_device_get_device_file(device);
+	const gchar *sysfs = g_udev_device_get_sysfs_path(device);
+	const gchar *const *links;
+	GUdevDevice *parent;
+	serial_device_t *dev;
+
+	if (file == NULL)
+		return NULL;
+
+	/* Consoles, ptys and other software ttys */
+	if (sysfs != NULL && strstr(sysfs, "/devices/virtual/") != NULL)
+		return NULL;
+
+	/* Legacy 8250 ports without hardware behind them (PORT_UNKNOWN) */
+	if (g_udev_device_has_sysfs_attr(device, "type") &&
+	    g_udev_device_get_sysfs_attr_as_int(device, "type") == 0)
+		return NULL;
+
+	dev = g_new0(serial_device_t, 1);
+	dev->path = g_strdup(file);
+	dev->accessible = (access(file, R_OK | W_OK) == 0);
+	dev->vendor = g_strdup(device_property(device, "ID_VENDOR_FROM_DATABASE", "ID_VENDOR"));
+	dev->model = g_strdup(device_property(device, "ID_MODEL_FROM_DATABASE", "ID_MODEL"));
+	dev->serial = g_strdup(device_property(device, "ID_SERIAL_SHORT", NULL));
+	/* ID_SERIAL is the same for all the units of a model without a serial
+	   number: the USB port they are plugged in tells them apart then */
+	if (dev->serial != NULL)
+		dev->identity = g_strdup(device_property(device, "ID_SERIAL", NULL));
+	else
+		dev->identity = g_strdup(device_property(device, "ID_PATH", NULL));
+	dev->driver = g_strdup(device_property(device, "ID_USB_DRIVER", NULL));
+
+	if (dev->driver == NULL && (parent = g_udev_device_get_parent(device)) != NULL) {
+		dev->driver = g_strdup(g_udev_device_get_driver(parent));
+		g_object_unref(parent);
+	}
+
+	links = g_udev_device_get_device_file_symlinks(device);
+	for (; links != NULL && *links != NULL; links++) {
+		if (dev->by_id == NULL && g_str_has_prefix(*links, "/dev/serial/by-id/"))
+			dev->by_id = g_strdup(*links);
+		else if (dev->identity == NULL && g_str_has_prefix(*links, "/dev/serial/by-path/"))
+			dev->identity = g_strdup(*links);
+	}
+
+	return dev;
+}
+
+static void registry_update(const gchar *action, GUdevDevice *device)
+{
+	const gchar *file = g_udev_device_get_device_file(device);
+	serial_device_t *dev;
+	gboolean found;
+	guint pos;
+
+	if (file == NULL)
+		return;
+
+	pos = registry_position(file, &found);
+
+	if (strcmp(action, "remove") == 0) {
+		if (found)
+			g_ptr_array_remove_index(registry, pos);
+		return;
+	}
+
+	dev = serial_device_new(device);
+	if (found) {
+		if (dev == NULL)
+			g_ptr_array_remove_index(registry, pos);
+		else {
+			serial_device_free(g_ptr_array_index(registry, pos));
+			g_ptr_array_index(registry, pos) = dev;
+		}
+	} else if (dev != NULL)
+		g_ptr_array_insert(registry, pos, dev);
+}
+
+static void device_registry_init(void)
+{
+	const gchar *const subsystems[] = {"tty", NULL};
+	GList *devices, *l;
+	serial_device_t *dev;
+
+	if (registry != NULL)
+		return;
+
+	registry = g_ptr_array_new_with_free_func(serial_device_free);
+	udev_client = g_udev_client_new(subsystems);
+
+	devices = g_udev_client_query_by_subsystem(udev_client, "tty");
+	for (l = devices; l != NULL; l = l->next) {
+		dev = serial_device_new(G_UDEV_DEVICE(l->data));
+		if (dev != NULL)
+			g_ptr_array_add(registry, dev);
+	}
+	g_list_free_full(devices, g_object_unref);
+
+	g_ptr_array_sort_values(registry, registry_compare);
+}
+
+/*
+ * Serial devices currently present, sorted by device path. The array is
+ * owned by the registry and is kept up to date from udev events.
+ */
+const GPtrArray *device_registry_get(void)
+{
+	device_registry_init();
+	return registry;
+}
+
+/* Look a device up by its /dev path or by one of its /dev/serial/by-id links */
+const serial_device_t *device_registry_lookup(const gchar *path)
+{
+	const serial_device_t *dev;
+	gboolean found;
+	guint i;
+
+	device_registry_init();
+
+	if (path == NULL || path[0] == '\0')
+		return NULL;
+
+	i = registry_position(path, &found);
+	if (found)
+		return g_ptr_array_index(registry, i);
+
+	for (i = 0; i < registry->len; i++) {
+		dev = g_ptr_array_index(registry, i);
+		if (dev->by_id != NULL && strcmp(dev->by_id, path) == 0)
+			return dev;
+	}
+	return NULL;
+}
+
 static inline void device_monitor_status(const bool connected)
 {
 	if (connected) {
@@ -40,38 +257,144 @@ static inline void device_monitor_status(const bool connected)
 		interface_close_port();
 }
 
-static inline void device_monitor_handle(const char *action)
+static void device_lost(const serial_device_t *dev)
 {
-	if (strcmp(action, "remove") == 0)
-		device_monitor_status(false);
-	else if (strcmp(action, "add") == 0)
-		device_monitor_status(true);
+	g_free(lost_identity);
+	g_free(lost_path);
+	lost_identity = g_strdup(dev ? dev->identity : NULL);
+	lost_path = g_strdup(dev ? dev->path : config.port);
+	lost_time = g_get_monotonic_time();
+
+	if (reconnect_source) {
+		g_source_remove(reconnect_source);
+		reconnect_source = 0;
+	}
+	device_monitor_status(false);
+}
+
+static gboolean device_reconnect(gpointer data)
+{
+	gint64 now = g_get_monotonic_time();
+	gchar *message;
+
+	/* udev may still be applying the permissions of the new node */
+	if (access(config.port, R_OK | W_OK) != 0) {
+		if (now - found_time < RECONNECT_TIMEOUT * 1000)
+			return G_SOURCE_CONTINUE;
+		reconnect_source = 0;
+		return G_SOURCE_REMOVE;
+	}
+	reconnect_source = 0;
+
+	device_monitor_status(true);
+	if (serial_port_fd == -1)
+		return G_SOURCE_REMOVE;
+
+	reconnect_stats.reconnects++;
+	reconnect_stats.last_latency = now - found_time;
+	reconnect_stats.total_latency += reconnect_stats.last_latency;
+	if (reconnect_stats.last_latency > reconnect_stats.max_latency)
+		reconnect_stats.max_latency = reconnect_stats.last_latency;
+	reconnect_stats.last_gap = lost_time ? now - lost_time : 0;
+	reconnect_stats.total_gap += reconnect_stats.last_gap;
+	lost_time = 0;
+	g_free(lost_identity);
+	lost_identity = NULL;
+
+	message = g_strdup_printf(_("Reconnected %s in %.1f ms (port closed for %.2f s)"),
+	                          config.port,
+	                          reconnect_stats.last_latency / 1000.0,
+	                          reconnect_stats.last_gap / 1000000.0);
+	Put_temp_message(message, 3000);
+	g_free(message);
+
+	return G_SOURCE_REMOVE;
+}
+
+static void device_found(const serial_device_t *dev)
+{
+	g_free(lost_path);
+	lost_path = NULL;
+
+	if (!config.autoreconnect_enabled)
+		return;
+
+	/* The node name may change when an USB adapter re-enumerates.
+	   Follow it, unless the port is configured by a stable link. */
+	if (dev != NULL && strcmp(config.port, dev->path) != 0 &&
+	    (dev->by_id == NULL || strcmp(config.port, dev->by_id) != 0))
+		g_strlcpy(config.port, dev->path, sizeof(config.port));
+
+	if (reconnect_source)
+		return;
+
+	found_time = g_get_monotonic_time();
+	if (device_reconnect(NULL))
+		reconnect_source = g_timeout_add(RECONNECT_RETRY, device_reconnect, NULL);
+}
+
+/* Is dev the device we were connected to? */
+static gboolean device_is_ours(const serial_device_t *dev, const gchar *path)
+{
+	if (lost_identity != NULL)
+		return dev != NULL && g_strcmp0(dev->identity, lost_identity) == 0;
+
+	return strcmp(path, lost_path ? lost_path : config.port) == 0 ||
+	       (dev != NULL && g_strcmp0(dev->by_id, config.port) == 0);
 }
 
 void event_udev(GUdevClient *client, const gchar *action, GUdevDevice *device)
 {
+	const serial_device_t *dev;
+	const gchar *file;
 
 	if (!device || !action)
 		return;
 
-	if (!g_udev_device_get_device_file(device))
+	file = g_udev_device_get_device_file(device);
+	if (!file)
 		return;
 
-	const gchar *name = config.port;
+	if (strcmp(action, "remove") == 0) {
+		/* Look the device up before it leaves the registry */
+		dev = device_registry_lookup(file);
+		if (strcmp(file, config.port) == 0 ||
+		    (dev != NULL && g_strcmp0(dev->by_id, config.port) == 0))
+			device_lost(dev);
+		registry_update(action, device);
+	} else if (strcmp(action, "add") == 0) {
+		registry_update(action, device);
+		dev = device_registry_lookup(file);
+		if (device_is_ours(dev, file))
+			device_found(dev);
+	} else
+		registry_update(action, device);
+}
+
+/* Reconnection figures, for the statistics dialog */
+gchar *device_monitor_statistics(void)
+{
+	if (reconnect_stats.reconnects == 0)
+		return g_strdup(_("Reconnections: none\n"));
 
-	if (strcmp(g_udev_device_get_device_file(device), name) == 0)
-		device_monitor_handle(action);
+	return g_strdup_printf(_("Reconnections: %u\n"
+	                         "Reconnect latency: last %.1f ms, average %.1f ms, max %.1f ms\n"
+	                         "Port closed: last %.2f s, total %.2f s\n"),
+	                       reconnect_stats.reconnects,
+	                       reconnect_stats.last_latency / 1000.0,
+	                       reconnect_stats.total_latency / 1000.0 / reconnect_stats.reconnects,
+	                       reconnect_stats.max_latency / 1000.0,
+	                       reconnect_stats.last_gap / 1000000.0,
+	                       reconnect_stats.total_gap / 1000000.0);
 }
 
 extern void device_monitor_start(void)
 {
-
-	const gchar *const subsystems[] = {NULL, NULL};
+	device_registry_init();
 
 	/* Initial check */
-	GUdevClient *udev_client = g_udev_client_new(subsystems);
-
-	if (g_udev_client_query_by_device_file(udev_client, config.port) == NULL) {
+	if (device_registry_lookup(config.port) == NULL &&
+	    access(config.port, F_OK) != 0) {
 		device_monitor_status(false);
 	} else {
 		device_monitor_status(true);
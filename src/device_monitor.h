@@ -8,6 +8,7 @@
 /*                                                                     */
 /*   Purpose                                                           */
 /*      Monitor device to autoreconnect                                */
+/*      Keep a registry of the serial devices present                  */
 /*   Written by Kevin Picot - picotk27@gmail.com                       */
 /*                                                                     */
 /***********************************************************************/
@@ -15,6 +16,22 @@
 #ifndef DEV_MON_H_
 #define DEV_MON_H_
 
+#include <glib.h>
+
+typedef struct {
+	gchar *path;		/* /dev/ttyUSB0 */
+	gchar *by_id;		/* /dev/serial/by-id/... link, or NULL */
+	gchar *vendor;
+	gchar *model;
+	gchar *serial;
+	gchar *identity;	/* udev ID_SERIAL, or ID_PATH without a serial number */
+	gchar *driver;
+	gboolean accessible;	/* readable and writable by us */
+} serial_device_t;
+
 extern void device_monitor_start(void);
+extern const GPtrArray *device_registry_get(void);
+extern const serial_device_t *device_registry_lookup(const gchar *path);
+extern gchar *device_monitor_statistics(void);
 
 #endif
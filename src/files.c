@@ -35,6 +35,7 @@
 #include "interface.h"
 #include "serial.h"
 #include "buffer.h"
+#include "data_store.h"
 
 #include <config.h>
 #include <glib/gi18n.h>
@@ -56,6 +57,13 @@ gboolean input_running = FALSE;
 gchar *str = NULL;
 FILE *Fic;
 
+/* Text sent from memory (paced paste) instead of Fichier */
+static gchar *memory_data = NULL;
+static gsize memory_length;
+static gsize memory_offset;
+/* Byte after which the delay or the wait for a char applies */
+static gchar line_end = LINE_FEED;
+
 /* Local functions prototype */
 gint Envoie_fichier(GtkFileChooser *FS);
 gint Sauve_fichier(GtkFileChooser *FS);
@@ -66,6 +74,8 @@ gboolean idle(gpointer pointer);
 void remove_input(void);
 void add_input(void);
 void write_file(const char *, unsigned int);
+static void open_transfer_window(const gchar *);
+static gint read_source(gchar *, gint);
 
 extern struct configuration_port config;
 
@@ -104,37 +114,18 @@ void send_raw_file(GtkAction *action, gpointer data)
 		Fichier = open(fileName, O_RDONLY);
 		if(Fichier != -1)
 		{
-			GtkWidget *Bouton_annuler, *Box;
-
 			fic_defaut = g_strdup(fileName);
 			msg = g_strdup_printf(_("%s: transfer in progress..."), fileName);
 
-			gtk_statusbar_push(GTK_STATUSBAR(StatusBar), id, msg);
 			car_written = 0;
 			current_buffer_position = 0;
 			bytes_read = 0;
 			nb_car = lseek(Fichier, 0L, SEEK_END);
 			lseek(Fichier, 0L, SEEK_SET);
+			line_end = LINE_FEED;
 
-			Window = gtk_dialog_new();
-			gtk_window_set_title(GTK_WINDOW(Window), msg);
+			open_transfer_window(msg);
 			g_free(msg);
-			Box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 10);
-			gtk_container_add(GTK_CONTAINER(gtk_dialog_get_content_area(GTK_DIALOG(Window))), Box);
-			ProgressBar = gtk_progress_bar_new();
-
-			gtk_box_pack_start(GTK_BOX(Box), ProgressBar, FALSE, FALSE, 5);
-
-			Bouton_annuler = gtk_button_new_with_label(_("Cancel"));
-			g_signal_connect(GTK_WIDGET(Bouton_annuler), "clicked", G_CALLBACK(close_all), NULL);
-
-			gtk_container_add(GTK_CONTAINER(gtk_dialog_get_action_area(GTK_DIALOG(Window))), Bouton_annuler);
-
-			g_signal_connect(GTK_WIDGET(Window), "delete_event", G_CALLBACK(close_all), NULL);
-
-			gtk_window_set_default_size(GTK_WINDOW(Window), 250, 100);
-			gtk_window_set_modal(GTK_WINDOW(Window), TRUE);
-			gtk_widget_show_all(Window);
 
 			add_input();
 		}
@@ -149,6 +140,94 @@ void send_raw_file(GtkAction *action, gpointer data)
 	gtk_widget_destroy(file_select);
 }
 
+static void open_transfer_window(const gchar *msg)
+{
+	GtkWidget *Bouton_annuler, *Box;
+
+	gtk_statusbar_push(GTK_STATUSBAR(StatusBar), id, msg);
+
+	Window = gtk_dialog_new();
+	gtk_window_set_title(GTK_WINDOW(Window), msg);
+	Box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 10);
+	gtk_container_add(GTK_CONTAINER(gtk_dialog_get_content_area(GTK_DIALOG(Window))), Box);
+	ProgressBar = gtk_progress_bar_new();
+
+	gtk_box_pack_start(GTK_BOX(Box), ProgressBar, FALSE, FALSE, 5);
+
+	Bouton_annuler = gtk_button_new_with_label(_("Cancel"));
+	g_signal_connect(GTK_WIDGET(Bouton_annuler), "clicked", G_CALLBACK(close_all), NULL);
+
+	gtk_container_add(GTK_CONTAINER(gtk_dialog_get_action_area(GTK_DIALOG(Window))), Bouton_annuler);
+
+	g_signal_connect(GTK_WIDGET(Window), "delete_event", G_CALLBACK(close_all), NULL);
+
+	gtk_window_set_default_size(GTK_WINDOW(Window), 250, 100);
+	gtk_window_set_modal(GTK_WINDOW(Window), TRUE);
+	gtk_widget_show_all(Window);
+}
+
+/*
+ * Send pasted text line by line, with the same end of line delay or
+ * wait for char as a file transfer. Lines end with a CR, as when the
+ * text is pasted in the terminal.
+ */
+void send_paced_text(const gchar *text, gsize length)
+{
+	gchar *p;
+
+	if(serial_port_fd == -1 || length == 0)
+		return;
+
+	if(Window != NULL)
+	{
+		Put_temp_message(_("A transfer is already in progress"), 1500);
+		return;
+	}
+
+	memory_data = g_malloc(length);
+	memory_length = 0;
+	for(p = (gchar *)text; p < text + length; p++)
+	{
+		if(*p == '\r' && p + 1 < text + length && p[1] == '\n')
+			continue;
+		memory_data[memory_length++] = (*p == '\n') ? '\r' : *p;
+	}
+
+	/* Nothing to pace: hand everything to the transmit queue */
+	if((config.delai == 0 && config.car == -1) ||
+	   memchr(memory_data, '\r', memory_length - 1) == NULL)
+	{
+		send_serial(memory_data, memory_length);
+		g_free(memory_data);
+		memory_data = NULL;
+		return;
+	}
+
+	memory_offset = 0;
+	car_written = 0;
+	current_buffer_position = 0;
+	bytes_read = 0;
+	nb_car = memory_length;
+	line_end = '\r';
+
+	open_transfer_window(_("Paste in progress..."));
+	add_input();
+}
+
+static gint read_source(gchar *buffer, gint size)
+{
+	gint length;
+
+	if(memory_data == NULL)
+		return read(Fichier, buffer, size);
+
+	length = MIN((gsize)size, memory_length - memory_offset);
+	memcpy(buffer, memory_data + memory_offset, length);
+	memory_offset += length;
+
+	return length;
+}
+
 void ecriture(gpointer data, gint source)
 {
 	static gchar buffer[BUFFER_EMISSION];
@@ -159,12 +238,16 @@ void ecriture(gpointer data, gint source)
 
 	gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(ProgressBar), (gfloat)car_written/(gfloat)nb_car );
 
+	/* Let the transmit queue drain before reading more of the file */
+	if(Send_chars_pending() > BUFFER_EMISSION)
+		return;
+
 	if(car_written < nb_car)
 	{
 		/* Read the file only if buffer totally sent or if buffer empty */
 		if(current_buffer_position == bytes_read)
 		{
-			bytes_read = read(Fichier, buffer, BUFFER_EMISSION);
+			bytes_read = read_source(buffer, BUFFER_EMISSION);
 
 			current_buffer_position = 0;
 			current_buffer = buffer;
@@ -187,12 +270,12 @@ void ecriture(gpointer data, gint source)
 		{
 			/* search for next LF */
 			bytes_to_write = current_buffer_position;
-			while(*car != LINE_FEED && bytes_to_write < bytes_read)
+			while(*car != line_end && bytes_to_write < bytes_read)
 			{
 				car++;
 				bytes_to_write++;
 			}
-			if(*car == LINE_FEED)
+			if(*car == line_end)
 				bytes_to_write++;
 		}
 
@@ -215,13 +298,13 @@ void ecriture(gpointer data, gint source)
 
 		gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(ProgressBar), (gfloat)car_written/(gfloat)nb_car );
 
-		if(config.delai != 0 && *car == LINE_FEED)
+		if(config.delai != 0 && *car == line_end)
 		{
 			remove_input();
 			g_timeout_add(config.delai, (GSourceFunc)timer, NULL);
 			waiting_for_timer = TRUE;
 		}
-		else if(config.car != -1 && *car == LINE_FEED)
+		else if(config.car != -1 && *car == line_end)
 		{
 			remove_input();
 			waiting_for_char = TRUE;
@@ -274,8 +357,15 @@ gint close_all(void)
 	waiting_for_char = FALSE;
 	waiting_for_timer = FALSE;
 	gtk_statusbar_pop(GTK_STATUSBAR(StatusBar), id);
-	close(Fichier);
+	if(memory_data != NULL)
+	{
+		g_free(memory_data);
+		memory_data = NULL;
+	}
+	else
+		close(Fichier);
 	gtk_widget_destroy(Window);
+	Window = NULL;
 
 	return FALSE;
 }
@@ -304,9 +394,98 @@ void write_ascii_file(const char *data, unsigned int size)
 
 
 
+/* From and to times below the file chooser, empty for the whole buffer */
+static GtkWidget *time_range_widget(GtkWidget **from, GtkWidget **to)
+{
+	GtkWidget *box, *label;
+
+	box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5);
+	label = gtk_label_new(_("Only what was received from (HH:MM:SS)"));
+	gtk_box_pack_start(GTK_BOX(box), label, FALSE, FALSE, 0);
+	*from = gtk_entry_new();
+	gtk_entry_set_width_chars(GTK_ENTRY(*from), 12);
+	gtk_box_pack_start(GTK_BOX(box), *from, FALSE, FALSE, 0);
+	label = gtk_label_new(_("to"));
+	gtk_box_pack_start(GTK_BOX(box), label, FALSE, FALSE, 0);
+	*to = gtk_entry_new();
+	gtk_entry_set_width_chars(GTK_ENTRY(*to), 12);
+	gtk_box_pack_start(GTK_BOX(box), *to, FALSE, FALSE, 0);
+	gtk_widget_show_all(box);
+
+	return box;
+}
+
+/*
+ * Part of the data store between two times of day, found in the time
+ * index. FALSE if a time is not understood.
+ */
+static gboolean time_range(const gchar *from, const gchar *to, guint64 *start, guint64 *end)
+{
+	const data_record_t *record;
+	gint64 time;
+
+	*start = data_store_first();
+	*end = data_store_length();
+
+	if(from[0] != 0)
+	{
+		if(!data_store_parse_time(from, &time))
+			return FALSE;
+		record = data_store_record(data_store_find_time(time));
+		*start = record != NULL ? MAX(record->offset, *start) : *end;
+	}
+	if(to[0] != 0)
+	{
+		if(!data_store_parse_time(to, &time))
+			return FALSE;
+		record = data_store_record(data_store_find_time(time + 1));
+		if(record != NULL)
+			*end = MAX(record->offset, *start);
+	}
+
+	return TRUE;
+}
+
+static void write_store_range(guint64 start, guint64 end, void (*func)(const char *, unsigned int))
+{
+	guchar chunk[BUFFER_RECEPTION];
+	gsize size;
+
+	while(start < end)
+	{
+		size = data_store_read(start, chunk, MIN(sizeof(chunk), end - start));
+		if(size == 0)
+			break;
+		func((const char *)chunk, size);
+		start += size;
+	}
+}
+
+/* 1 for a time range of the data store, 0 for the buffer, -1 if wrong */
+static gint file_range(GtkWidget *from_entry, GtkWidget *to_entry, guint64 *start, guint64 *end)
+{
+	const gchar *from, *to;
+
+	from = gtk_entry_get_text(GTK_ENTRY(from_entry));
+	to = gtk_entry_get_text(GTK_ENTRY(to_entry));
+	if(from[0] == 0 && to[0] == 0)
+		return 0;
+
+	if(!time_range(from, to, start, end))
+	{
+		show_message(_("Times are written as HH:MM or HH:MM:SS\n"), MSG_ERR);
+		return -1;
+	}
+
+	return 1;
+}
+
 void save_raw_file(GtkAction *action, gpointer data)
 {
 	GtkWidget *file_select;
+	GtkWidget *from_entry, *to_entry;
+	guint64 start, end;
+	gint range;
 
 	file_select = gtk_file_chooser_dialog_new(_("Save RAW File"),
 	              GTK_WINDOW(Fenetre),
@@ -315,6 +494,8 @@ void save_raw_file(GtkAction *action, gpointer data)
 	              GTK_STOCK_SAVE, GTK_RESPONSE_ACCEPT,
 	              NULL);
 	gtk_file_chooser_set_do_overwrite_confirmation(GTK_FILE_CHOOSER(file_select), TRUE);
+	gtk_file_chooser_set_extra_widget(GTK_FILE_CHOOSER(file_select),
+	                                  time_range_widget(&from_entry, &to_entry));
 
 	if(fic_defaut != NULL)
 		gtk_file_chooser_set_filename(GTK_FILE_CHOOSER(file_select), fic_defaut);
@@ -335,6 +516,14 @@ void save_raw_file(GtkAction *action, gpointer data)
 			return;
 		}
 
+		range = file_range(from_entry, to_entry, &start, &end);
+		if(range == -1)
+		{
+			g_free(fileName);
+			gtk_widget_destroy(file_select);
+			return;
+		}
+
 		Fic = fopen(fileName, "w");
 		if(Fic == NULL)
 		{
@@ -346,7 +535,10 @@ void save_raw_file(GtkAction *action, gpointer data)
 		{
 			fic_defaut = g_strdup(fileName);
 
-			write_buffer_with_func(write_file);
+			if(range == 1)
+				write_store_range(start, end, write_file);
+			else
+				write_buffer_with_func(write_file);
 
 			fclose(Fic);
 		}
@@ -358,6 +550,9 @@ void save_raw_file(GtkAction *action, gpointer data)
 void save_ascii_file(GtkAction *action, gpointer data)
 {
 	GtkWidget *file_select;
+	GtkWidget *from_entry, *to_entry;
+	guint64 start, end;
+	gint range;
 
 	file_select = gtk_file_chooser_dialog_new(_("Save ASCII File"),
 	              GTK_WINDOW(Fenetre),
@@ -366,6 +561,8 @@ void save_ascii_file(GtkAction *action, gpointer data)
 	              GTK_STOCK_SAVE, GTK_RESPONSE_ACCEPT,
 	              NULL);
 	gtk_file_chooser_set_do_overwrite_confirmation(GTK_FILE_CHOOSER(file_select), TRUE);
+	gtk_file_chooser_set_extra_widget(GTK_FILE_CHOOSER(file_select),
+	                                  time_range_widget(&from_entry, &to_entry));
 
 	if(fic_defaut != NULL)
 		gtk_file_chooser_set_filename(GTK_FILE_CHOOSER(file_select), fic_defaut);
@@ -386,6 +583,14 @@ void save_ascii_file(GtkAction *action, gpointer data)
 			return;
 		}
 
+		range = file_range(from_entry, to_entry, &start, &end);
+		if(range == -1)
+		{
+			g_free(fileName);
+			gtk_widget_destroy(file_select);
+			return;
+		}
+
 		Fic = fopen(fileName, "w");
 		if(Fic == NULL)
 		{
@@ -397,7 +602,10 @@ void save_ascii_file(GtkAction *action, gpointer data)
 		{
 			fic_defaut = g_strdup(fileName);
 
-			write_buffer_with_func(write_ascii_file);
+			if(range == 1)
+				write_store_range(start, end, write_ascii_file);
+			else
+				write_buffer_with_func(write_ascii_file);
 
 			fclose(Fic);
 		}
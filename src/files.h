@@ -19,6 +19,7 @@ void send_raw_file(GtkAction *action, gpointer data);
 void save_raw_file(GtkAction *action, gpointer data);
 void save_ascii_file(GtkAction *action, gpointer data);
 void add_input(void);
+void send_paced_text(const gchar *, gsize);
 
 extern gboolean waiting_for_char;
 extern gchar *fic_defaut;
@@ -0,0 +1,262 @@
+/***********************************************************************/
+/* filter.c                                                            */
+/* --------                                                            */
+/*                           GTKTerm Software                          */
+/*                                 (c)                                 */
+/*                                                                     */
+/* ------------------------------------------------------------------- */
+/*                                                                     */
+/*   Purpose                                                           */
+/*      Display of the received lines matching an expression           */
+/*      - Received lines are tested once complete                      */
+/*      - A new expression is run on the data store by a thread        */
+/*                                                                     */
+/***********************************************************************/
+
+#include <gtk/gtk.h>
+#include <string.h>
+
+#include "interface.h"
+#include "data_store.h"
+#include "filter.h"
+
+#include <config.h>
+#include <glib/gi18n.h>
+
+#define HISTORY_CHUNK (64 * 1024)
+#define HISTORY_KEPT (1024 * 1024)	/* matching history shown at most */
+#define LINE_MAX_SIZE (64 * 1024)	/* tested even without its end */
+
+typedef struct
+{
+	GRegex *regex;
+	gboolean invert;
+	guint64 from, to;		/* of the data store */
+	gint generation;
+	GString *result;		/* matching lines, terminal ready */
+	GString *line;			/* incomplete line at the end */
+	guint lines, matches;
+} filter_job_t;
+
+static GRegex *regex = NULL;
+static gboolean invert = FALSE;
+static GString *line = NULL;		/* received since the last end of line */
+static GString *held = NULL;		/* received while the history is read */
+static gboolean history_running = FALSE;
+static gint generation = 0;		/* a job of an older one is dropped */
+
+static void (*show_func)(const gchar *, guint) = NULL;
+static void (*clear_func)(void) = NULL;
+
+/* Where the lines shown go, and how the display is cleared */
+void filter_set_output(void (*show)(const gchar *, guint), void (*clear)(void))
+{
+	show_func = show;
+	clear_func = clear;
+}
+
+gboolean filter_active(void)
+{
+	return regex != NULL;
+}
+
+static gboolean line_matches(GRegex *expression, gboolean inverted, const gchar *text, gsize size)
+{
+	return g_regex_match_full(expression, text, size, 0, 0, NULL, NULL) != inverted;
+}
+
+/* Shows the complete lines that match, keeps the last incomplete one */
+static void filter_text(const gchar *string, gsize size)
+{
+	GString *out;
+	const gchar *end;
+	gsize n;
+
+	out = g_string_new(NULL);
+	while(size > 0)
+	{
+		end = memchr(string, '\n', size);
+		n = end ? (gsize)(end - string) + 1 : size;
+		g_string_append_len(line, string, n);
+		string += n;
+		size -= n;
+
+		if(end == NULL && line->len < LINE_MAX_SIZE)
+			break;
+		if(line_matches(regex, invert, line->str, line->len))
+			g_string_append_len(out, line->str, line->len);
+		g_string_truncate(line, 0);
+	}
+
+	if(out->len > 0)
+		show_func(out->str, out->len);
+	g_string_free(out, TRUE);
+}
+
+void filter_feed(const gchar *string, guint size)
+{
+	if(history_running)
+		g_string_append_len(held, string, size);
+	else
+		filter_text(string, size);
+}
+
+static void job_free(filter_job_t *job)
+{
+	g_regex_unref(job->regex);
+	g_string_free(job->result, TRUE);
+	g_string_free(job->line, TRUE);
+	g_free(job);
+}
+
+static void history_line(filter_job_t *job)
+{
+	gsize size = job->line->len;
+	gchar *cut;
+
+	job->lines++;
+	if(line_matches(job->regex, job->invert, job->line->str, size))
+	{
+		job->matches++;
+
+		/* As a terminal line, whatever the end of line stored */
+		while(size > 0 && (job->line->str[size - 1] == '\n' || job->line->str[size - 1] == '\r'))
+			size--;
+		g_string_append_len(job->result, job->line->str, size);
+		g_string_append(job->result, "\r\n");
+
+		/* Only the last matches are kept, from a line start */
+		if(job->result->len > 2 * HISTORY_KEPT)
+		{
+			cut = memchr(job->result->str + job->result->len - HISTORY_KEPT, '\n', HISTORY_KEPT);
+			if(cut != NULL)
+				g_string_erase(job->result, 0, cut - job->result->str + 1);
+		}
+	}
+	g_string_truncate(job->line, 0);
+}
+
+static gboolean history_done(gpointer data)
+{
+	filter_job_t *job = data;
+	gchar *message;
+
+	if(job->generation == g_atomic_int_get(&generation))
+	{
+		history_running = FALSE;
+		if(job->result->len > 0)
+			show_func(job->result->str, job->result->len);
+
+		/* The line cut by the end of the history goes on with what came since */
+		g_string_truncate(line, 0);
+		g_string_append_len(line, job->line->str, job->line->len);
+		filter_text(held->str, held->len);
+		g_string_truncate(held, 0);
+
+		message = g_strdup_printf(_("Filter: %u of %u lines received match"), job->matches, job->lines);
+		Put_temp_message(message, 2000);
+		g_free(message);
+	}
+	job_free(job);
+
+	return G_SOURCE_REMOVE;
+}
+
+static gpointer history_thread(gpointer data)
+{
+	filter_job_t *job = data;
+	guchar *chunk;
+	guint64 offset = job->from;
+	gsize size, i, start;
+
+	chunk = g_malloc(HISTORY_CHUNK);
+	while(offset < job->to && job->generation == g_atomic_int_get(&generation))
+	{
+		size = data_store_read(offset, chunk, MIN(HISTORY_CHUNK, job->to - offset));
+		if(size == 0)
+		{
+			/* Dropped from the store meanwhile, go on from what is left */
+			if(data_store_first() <= offset)
+				break;
+			offset = data_store_first();
+			g_string_truncate(job->line, 0);
+			continue;
+		}
+		offset += size;
+
+		for(start = 0, i = 0; i < size; i++)
+		{
+			if(chunk[i] != '\n')
+				continue;
+			g_string_append_len(job->line, (gchar *)chunk + start, i + 1 - start);
+			history_line(job);
+			start = i + 1;
+		}
+		g_string_append_len(job->line, (gchar *)chunk + start, size - start);
+		if(job->line->len >= LINE_MAX_SIZE)
+			history_line(job);
+	}
+	g_free(chunk);
+
+	g_idle_add(history_done, job);
+
+	return NULL;
+}
+
+/*
+ * Shows only the lines matching expression (or not matching it when
+ * inverted), starting with the history of the data store. A NULL or
+ * empty expression turns the filter off.
+ */
+gboolean filter_set(const gchar *expression, gboolean inverted, GError **error)
+{
+	GRegex *new_regex = NULL;
+	filter_job_t *job;
+
+	if(expression != NULL && expression[0] != 0)
+	{
+		new_regex = g_regex_new(expression, G_REGEX_RAW | G_REGEX_OPTIMIZE, 0, error);
+		if(new_regex == NULL)
+			return FALSE;
+	}
+
+	filter_reset();
+	if(regex != NULL)
+		g_regex_unref(regex);
+	regex = new_regex;
+	invert = inverted;
+	if(regex == NULL)
+		return TRUE;
+
+	if(clear_func != NULL)
+		clear_func();
+
+	job = g_new0(filter_job_t, 1);
+	job->regex = g_regex_ref(regex);
+	job->invert = invert;
+	job->from = data_store_first();
+	job->to = data_store_length();
+	job->generation = g_atomic_int_get(&generation);
+	job->result = g_string_new(NULL);
+	job->line = g_string_new(NULL);
+
+	history_running = TRUE;
+	g_thread_unref(g_thread_new("filter", history_thread, job));
+
+	return TRUE;
+}
+
+/* The display is cleared: the history being read is dropped */
+void filter_reset(void)
+{
+	g_atomic_int_inc(&generation);
+	history_running = FALSE;
+
+	if(line == NULL)
+	{
+		line = g_string_new(NULL);
+		held = g_string_new(NULL);
+	}
+	g_string_truncate(line, 0);
+	g_string_truncate(held, 0);
+}
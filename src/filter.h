@@ -0,0 +1,24 @@
+/***********************************************************************/
+/* filter.h                                                            */
+/* --------                                                            */
+/*                           GTKTerm Software                          */
+/*                                 (c)                                 */
+/*                                                                     */
+/* ------------------------------------------------------------------- */
+/*                                                                     */
+/*   Purpose                                                           */
+/*      Display of the received lines matching an expression           */
+/*      - Header file -                                                */
+/*                                                                     */
+/***********************************************************************/
+
+#ifndef FILTER_H_
+#define FILTER_H_
+
+void filter_set_output(void (*)(const gchar *, guint), void (*)(void));
+gboolean filter_set(const gchar *, gboolean, GError **);
+gboolean filter_active(void);
+void filter_feed(const gchar *, guint);
+void filter_reset(void);
+
+#endif
@@ -0,0 +1,235 @@
+/***********************************************************************/
+/* governor.c                                                          */
+/* ----------                                                          */
+/*                           GTKTerm Software                          */
+/*                                 (c)                                 */
+/*                                                                     */
+/* ------------------------------------------------------------------- */
+/*                                                                     */
+/*   Purpose                                                           */
+/*      Rendering skipped when the display can't keep up               */
+/*      - The time spent rendering and the main loop delay are         */
+/*        measured on each period                                      */
+/*      - Over budget, only the last screenful of each period is       */
+/*        rendered, after a note of what was skipped                   */
+/*      - The buffer and the log still get every byte                  */
+/*                                                                     */
+/***********************************************************************/
+
+#include <glib.h>
+#include <string.h>
+
+#include "buffer.h"
+#include "governor.h"
+
+#include <config.h>
+#include <glib/gi18n.h>
+
+#define GOVERNOR_PERIOD 250	/* ms between two checks */
+#define GOVERNOR_BUSY 50	/* % of the time rendering before skipping */
+#define GOVERNOR_TAIL_MIN 4096
+#define GOVERNOR_SEQUENCE_MAX 64	/* looked back for a cut escape sequence */
+
+static void (*render_func)(const gchar *, guint) = NULL;
+static void (*skipped_func)(guint64) = NULL;
+static gsize tail_size = GOVERNOR_TAIL_MIN;
+
+static gboolean skipping = FALSE;
+static GString *tail = NULL;		/* last bytes received while skipping */
+static guint64 skipped = 0;		/* since the last note */
+
+static guint timer = 0;
+static gint64 period_start;
+static gint64 render_time;		/* us spent rendering in the period */
+static guint64 period_bytes;		/* received in the period */
+static guint64 rendered_bytes;		/* rendered in the period */
+static gdouble byte_cost = 0;		/* us to render a byte, averaged */
+
+static guint64 skipped_total = 0;
+static guint skip_count = 0;
+
+/*
+ * Rendering goes to render, skipped(bytes) notes a gap in the view and
+ * tail is about what a screen shows.
+ */
+void governor_set_output(void (*render)(const gchar *, guint), void (*skipped_note)(guint64), gsize tail_bytes)
+{
+	governor_reset();
+	render_func = render;
+	skipped_func = skipped_note;
+	tail_size = MAX(tail_bytes, GOVERNOR_TAIL_MIN);
+}
+
+static void render(const gchar *string, guint size)
+{
+	gint64 start;
+
+	start = g_get_monotonic_time();
+	render_func(string, size);
+	render_time += g_get_monotonic_time() - start;
+	rendered_bytes += size;
+}
+
+/* After the escape sequence and the UTF-8 character cut points into */
+static gsize cut_boundary(gsize cut)
+{
+	gsize start, length;
+
+	start = cut > GOVERNOR_SEQUENCE_MAX ? cut - GOVERNOR_SEQUENCE_MAX : 0;
+	while(start < cut)
+	{
+		if(tail->str[start] == '\x1b')
+		{
+			length = escape_sequence_length(tail->str + start, tail->len - start);
+			if(length == 0)
+				return tail->len;
+			if(start + length > cut)
+				cut = start + length;
+			start += length;
+		}
+		else
+			start++;
+	}
+
+	while(cut < tail->len && ((guchar)tail->str[cut] & 0xC0) == 0x80)
+		cut++;
+
+	return cut;
+}
+
+/* The last size bytes at most, from a line start when there is one so
+   that the terminal is given neither half a sequence nor half a character */
+static void trim_tail(gsize size)
+{
+	const gchar *line;
+	gsize cut;
+
+	if(tail->len <= size)
+		return;
+
+	cut = tail->len - size;
+	line = memchr(tail->str + cut, '\n', size);
+	if(line != NULL)
+		cut = line - tail->str + 1;
+	else
+		cut = cut_boundary(cut);
+
+	skipped += cut;
+	g_string_erase(tail, 0, cut);
+}
+
+static void show_tail(void)
+{
+	trim_tail(tail_size);
+
+	if(skipped > 0)
+	{
+		if(skipped_func != NULL)
+			skipped_func(skipped);
+		skipped_total += skipped;
+		skipped = 0;
+	}
+	if(tail->len > 0)
+		render(tail->str, tail->len);
+	g_string_truncate(tail, 0);
+}
+
+static gboolean governor_check(gpointer data)
+{
+	gint64 now, elapsed, late, busy;
+	gdouble demand;
+
+	now = g_get_monotonic_time();
+	elapsed = now - period_start;
+	/* The main loop was busy elsewhere, drawing the view most often */
+	late = MAX(0, elapsed - GOVERNOR_PERIOD * 1000);
+	busy = render_time + late;
+
+	if(rendered_bytes > 0)
+		byte_cost = (byte_cost + (gdouble)busy / rendered_bytes) / 2;
+
+	if(skipping)
+	{
+		show_tail();
+
+		/* Catches up once all of it fits well within the budget */
+		demand = period_bytes * byte_cost + late;
+		if(demand * 100 < elapsed * GOVERNOR_BUSY / 2)
+			skipping = FALSE;
+	}
+	else if(busy * 100 > elapsed * GOVERNOR_BUSY)
+	{
+		skipping = TRUE;
+		skip_count++;
+	}
+
+	period_start = now;
+	render_time = 0;
+	rendered_bytes = 0;
+
+	if(period_bytes == 0 && !skipping)
+	{
+		timer = 0;
+		return G_SOURCE_REMOVE;
+	}
+	period_bytes = 0;
+
+	return G_SOURCE_CONTINUE;
+}
+
+void governor_feed(const gchar *string, guint size)
+{
+	if(render_func == NULL || size == 0)
+		return;
+
+	if(tail == NULL)
+		tail = g_string_new(NULL);
+
+	if(timer == 0)
+	{
+		period_start = g_get_monotonic_time();
+		render_time = 0;
+		rendered_bytes = 0;
+		period_bytes = 0;
+		timer = g_timeout_add(GOVERNOR_PERIOD, governor_check, NULL);
+	}
+	period_bytes += size;
+
+	if(!skipping)
+	{
+		render(string, size);
+		return;
+	}
+
+	g_string_append_len(tail, string, size);
+	if(tail->len > 2 * tail_size)
+		trim_tail(tail_size);
+}
+
+/* The view is cleared: what is held back is of no use any more */
+void governor_reset(void)
+{
+	if(timer != 0)
+	{
+		g_source_remove(timer);
+		timer = 0;
+	}
+	skipping = FALSE;
+	skipped = 0;
+	if(tail != NULL)
+		g_string_truncate(tail, 0);
+}
+
+gchar *governor_statistics(void)
+{
+	gchar *size, *text;
+
+	if(skip_count == 0)
+		return g_strdup("");
+
+	size = g_format_size(skipped_total);
+	text = g_strdup_printf(_("View: %s skipped, %u times\n"), size, skip_count);
+	g_free(size);
+
+	return text;
+}
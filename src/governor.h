@@ -0,0 +1,23 @@
+/***********************************************************************/
+/* governor.h                                                          */
+/* ----------                                                          */
+/*                           GTKTerm Software                          */
+/*                                 (c)                                 */
+/*                                                                     */
+/* ------------------------------------------------------------------- */
+/*                                                                     */
+/*   Purpose                                                           */
+/*      Rendering skipped when the display can't keep up               */
+/*      - Header file -                                                */
+/*                                                                     */
+/***********************************************************************/
+
+#ifndef GOVERNOR_H_
+#define GOVERNOR_H_
+
+void governor_set_output(void (*)(const gchar *, guint), void (*)(guint64), gsize);
+void governor_feed(const gchar *, guint);
+void governor_reset(void);
+gchar *governor_statistics(void);
+
+#endif
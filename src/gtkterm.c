@@ -30,6 +30,10 @@
 #include "auto_config.h"
 #include "device_monitor.h"
 #include "user_signals.h"
+#include "share.h"
+#include "control.h"
+#include "sniffer.h"
+#include "logging.h"
 
 #include <config.h>
 #include <glib/gi18n.h>
@@ -73,9 +77,17 @@ int main(int argc, char *argv[])
 
 	gtk_main();
 
+	sniffer_stop();
+
 	delete_buffer();
 
 	Close_port();
 
+	logging_shutdown();
+
+	share_stop();
+
+	control_stop();
+
 	return 0;
 }
@@ -0,0 +1,750 @@
+/***********************************************************************/
+/* highlight.c                                                         */
+/* -----------                                                         */
+/*                           GTKTerm Software                          */
+/*                                 (c)                                 */
+/*                                                                     */
+/* ------------------------------------------------------------------- */
+/*                                                                     */
+/*   Purpose                                                           */
+/*      Colouring of the received text by user rules                   */
+/*      - All the rules are one regular expression, one pass per chunk */
+/*      - A possible match at the end of a chunk waits for the next    */
+/*      - Colours are SGR sequences fed to the terminal                */
+/*      - Escape sequences of the device are never matched             */
+/*                                                                     */
+/***********************************************************************/
+
+#include <gtk/gtk.h>
+#include <vte/vte.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "interface.h"
+#include "buffer.h"
+#include "highlight.h"
+
+#include <config.h>
+#include <glib/gi18n.h>
+
+#define HOLD_DELAY 100		/* ms before held text is shown anyway */
+#define HOLD_MAX 4096		/* bytes held at most */
+#define SEQUENCE_MAX 256	/* unterminated sequence passed anyway */
+#define COLOUR_MAX 32
+
+enum
+{
+	COLUMN_PATTERN,
+	COLUMN_REGEX,
+	COLUMN_FOREGROUND,
+	COLUMN_BACKGROUND,
+	NUM_COLUMNS
+};
+
+extern GtkWidget *display;
+
+static highlight_rule_t *rules = NULL;
+static gint rules_count = 0;
+
+static GRegex *scanner = NULL;		/* alternation of all the rules */
+static gint *rule_group = NULL;		/* capture group of each rule */
+static gchar **rule_sgr = NULL;		/* sequence starting each colour */
+
+static GString *pending = NULL;		/* text held for a possible match */
+static gchar device_fg[COLOUR_MAX] = "";	/* SGR colours of the device, */
+static gchar device_bg[COLOUR_MAX] = "";	/* empty for the default ones */
+static guint hold_timer = 0;
+
+static GtkWidget *window = NULL;
+
+static void rules_free(void)
+{
+	gint i;
+
+	for(i = 0; i < rules_count; i++)
+	{
+		g_free(rules[i].pattern);
+		g_free(rules[i].foreground);
+		g_free(rules[i].background);
+	}
+	g_free(rules);
+	rules = NULL;
+	rules_count = 0;
+}
+
+static void scanner_free(void)
+{
+	if(scanner != NULL)
+		g_regex_unref(scanner);
+	scanner = NULL;
+	g_free(rule_group);
+	rule_group = NULL;
+	g_strfreev(rule_sgr);
+	rule_sgr = NULL;
+}
+
+static void append_sgr(GString *sgr, gint base, const gchar *colour)
+{
+	GdkRGBA rgba;
+
+	if(colour == NULL || !gdk_rgba_parse(&rgba, colour))
+		return;
+
+	g_string_append_printf(sgr, "\033[%d;2;%d;%d;%dm", base,
+	                       (gint)(rgba.red * 255 + 0.5),
+	                       (gint)(rgba.green * 255 + 0.5),
+	                       (gint)(rgba.blue * 255 + 0.5));
+}
+
+/* Numbered references would point at other groups once the rules are
+   put together, only named ones keep their meaning */
+static gboolean numbered_reference(const gchar *pattern)
+{
+	const gchar *p;
+	gboolean in_class = FALSE;
+
+	for(p = pattern; *p != 0; p++)
+	{
+		if(*p == '\\')
+		{
+			if(*++p == 0)
+				break;
+			/* Quoted text */
+			if(*p == 'Q')
+			{
+				p = strstr(p, "\\E");
+				if(p == NULL)
+					break;
+				p++;
+			}
+			else if(!in_class && ((*p >= '1' && *p <= '9') ||
+			        (*p == 'g' && (g_ascii_isdigit(p[1]) ||
+			                       (p[1] != 0 && strchr("{<'", p[1]) != NULL && g_ascii_isdigit(p[2]))))))
+				return TRUE;
+		}
+		else if(in_class)
+		{
+			/* [:alpha:] and the like */
+			if(*p == '[' && p[1] == ':')
+			{
+				p = strstr(p + 2, ":]");
+				if(p == NULL)
+					break;
+				p++;
+			}
+			else if(*p == ']')
+				in_class = FALSE;
+		}
+		else if(*p == '[')
+		{
+			in_class = TRUE;
+			if(p[1] == '^')
+				p++;
+			/* A leading ] is a character of the class */
+			if(p[1] == ']')
+				p++;
+		}
+		/* Recursions and conditions by number */
+		else if(*p == '(' && p[1] == '?' &&
+		        (g_ascii_isdigit(p[2]) || p[2] == 'R' ||
+		         (p[2] == '(' && (g_ascii_isdigit(p[3]) || p[3] == 'R'))))
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+/*
+ * All the rules in one alternation, each one in a capture group telling
+ * which rule matched. groups, when not NULL, gets the number of these
+ * groups: they follow from the groups of the rules before. Rules without
+ * a pattern are left out.
+ */
+static GRegex *scanner_build(const highlight_rule_t *list, gint size, gint *groups, GError **error)
+{
+	GString *pattern;
+	GRegex *regex;
+	gchar *source;
+	gint i, group = 1, captures;
+
+	pattern = g_string_new(NULL);
+	for(i = 0; i < size; i++)
+	{
+		if(groups != NULL)
+			groups[i] = -1;
+		if(list[i].pattern == NULL || list[i].pattern[0] == 0)
+			continue;
+
+		captures = 0;
+		if(list[i].regex)
+		{
+			if(numbered_reference(list[i].pattern))
+			{
+				g_set_error(error, G_REGEX_ERROR, G_REGEX_ERROR_COMPILE,
+				            _("Wrong regular expression \"%s\": refer to named groups, not to numbered ones"),
+				            list[i].pattern);
+				g_string_free(pattern, TRUE);
+				return NULL;
+			}
+			regex = g_regex_new(list[i].pattern, G_REGEX_RAW | G_REGEX_DUPNAMES, 0, error);
+			if(regex == NULL)
+			{
+				g_prefix_error(error, _("Wrong regular expression \"%s\": "), list[i].pattern);
+				g_string_free(pattern, TRUE);
+				return NULL;
+			}
+			captures = g_regex_get_capture_count(regex);
+			g_regex_unref(regex);
+			source = g_strdup(list[i].pattern);
+		}
+		else
+			source = g_regex_escape_string(list[i].pattern, -1);
+
+		if(pattern->len > 0)
+			g_string_append_c(pattern, '|');
+		g_string_append_printf(pattern, "(%s)", source);
+		g_free(source);
+
+		if(groups != NULL)
+			groups[i] = group;
+		group += 1 + captures;
+	}
+
+	regex = NULL;
+	if(pattern->len > 0)
+	{
+		/* The same group name may be used by several rules */
+		regex = g_regex_new(pattern->str, G_REGEX_RAW | G_REGEX_OPTIMIZE | G_REGEX_DUPNAMES, 0, error);
+		if(regex == NULL)
+			g_prefix_error(error, _("The highlighting rules don't work together: "));
+	}
+	g_string_free(pattern, TRUE);
+
+	return regex;
+}
+
+static void scanner_compile(void)
+{
+	GString *sgr;
+	GError *error = NULL;
+	gint i;
+
+	scanner_free();
+	if(rules_count == 0)
+		return;
+
+	rule_group = g_new(gint, rules_count);
+	scanner = scanner_build(rules, rules_count, rule_group, &error);
+	if(scanner == NULL)
+	{
+		/* Rules from the configuration file are only checked here */
+		if(error != NULL)
+		{
+			show_message(error->message, MSG_ERR);
+			g_error_free(error);
+		}
+		g_free(rule_group);
+		rule_group = NULL;
+		return;
+	}
+
+	rule_sgr = g_new0(gchar *, rules_count + 1);
+	for(i = 0; i < rules_count; i++)
+	{
+		sgr = g_string_new(NULL);
+		append_sgr(sgr, 38, rules[i].foreground);
+		append_sgr(sgr, 48, rules[i].background);
+		rule_sgr[i] = g_string_free(sgr, FALSE);
+	}
+}
+
+void highlight_set_rules(const highlight_rule_t *new_rules, gint size)
+{
+	gint i;
+
+	highlight_reset();
+	rules_free();
+
+	rules = g_new0(highlight_rule_t, size + 1);
+	for(i = 0; i < size; i++)
+	{
+		if(new_rules[i].pattern == NULL || new_rules[i].pattern[0] == 0)
+			continue;
+		rules[rules_count].pattern = g_strdup(new_rules[i].pattern);
+		rules[rules_count].regex = new_rules[i].regex;
+		rules[rules_count].foreground = g_strdup(new_rules[i].foreground);
+		rules[rules_count].background = g_strdup(new_rules[i].background);
+		rules_count++;
+	}
+
+	scanner_compile();
+}
+
+const highlight_rule_t *highlight_get_rules(gint *size)
+{
+	*size = rules_count;
+	return rules;
+}
+
+gboolean highlight_active(void)
+{
+	return scanner != NULL;
+}
+
+static gboolean hold_timeout(gpointer data);
+
+static void set_colour(gchar *colour, const gchar *value)
+{
+	if(strlen(value) < COLOUR_MAX)
+		strcpy(colour, value);
+}
+
+/* Follows the colours the device sets, they are restored after a match */
+static void track_sgr(const gchar *sequence, gsize size)
+{
+	gchar *text, **params, *colour;
+	guint i, count;
+	gint value;
+
+	if(size < 3 || sequence[1] != '[' || sequence[size - 1] != 'm')
+		return;
+	/* Only plain parameters: CSI > ... m and the like are no colours */
+	for(i = 2; i < size - 1; i++)
+	{
+		if(!g_ascii_isdigit(sequence[i]) && sequence[i] != ';' && sequence[i] != ':')
+			return;
+	}
+
+	text = g_strndup(sequence + 2, size - 3);
+	params = g_strsplit(text, ";", -1);
+	count = g_strv_length(params);
+	if(count == 0)
+		device_fg[0] = device_bg[0] = 0;
+
+	for(i = 0; i < count; i++)
+	{
+		value = atoi(params[i]);
+		if(value == 0)
+			device_fg[0] = device_bg[0] = 0;
+		else if((value >= 30 && value <= 37) || (value >= 90 && value <= 97))
+			set_colour(device_fg, params[i]);
+		else if(value == 39)
+			device_fg[0] = 0;
+		else if((value >= 40 && value <= 47) || (value >= 100 && value <= 107))
+			set_colour(device_bg, params[i]);
+		else if(value == 49)
+			device_bg[0] = 0;
+		else if(value == 38 || value == 48)
+		{
+			/* 38:5:n and 38:2::r:g:b are one parameter, 38;5;n are three
+			   and 38;2;r;g;b five */
+			if(strchr(params[i], ':') != NULL)
+				colour = g_strdup(params[i]);
+			else if(i + 2 < count && atoi(params[i + 1]) == 5)
+			{
+				colour = g_strjoin(";", params[i], params[i + 1], params[i + 2], NULL);
+				i += 2;
+			}
+			else if(i + 4 < count && atoi(params[i + 1]) == 2)
+			{
+				colour = g_strjoin(";", params[i], params[i + 1], params[i + 2],
+				                   params[i + 3], params[i + 4], NULL);
+				i += 4;
+			}
+			else
+				break;
+			set_colour(value == 38 ? device_fg : device_bg, colour);
+			g_free(colour);
+		}
+	}
+
+	g_strfreev(params);
+	g_free(text);
+}
+
+/* Colours the matches of a run of text and returns the length done: the
+   rest is the start of a match more data may complete */
+static gsize colour_run(GString *out, const gchar *text, gsize size, gboolean final)
+{
+	GMatchInfo *info;
+	gint start, end, group_start, i;
+	gsize done = 0, kept = size;
+
+	g_regex_match_full(scanner, text, size, 0,
+	                   final ? 0 : G_REGEX_MATCH_PARTIAL_HARD, &info, NULL);
+	while(TRUE)
+	{
+		if(g_match_info_is_partial_match(info))
+		{
+			g_match_info_fetch_pos(info, 0, &start, NULL);
+			kept = MAX((gsize)start, done);
+			break;
+		}
+		if(!g_match_info_matches(info))
+			break;
+
+		g_match_info_fetch_pos(info, 0, &start, &end);
+		if(end > start)
+		{
+			for(i = 0; i < rules_count; i++)
+			{
+				if(g_match_info_fetch_pos(info, rule_group[i], &group_start, NULL) && group_start != -1)
+					break;
+			}
+			g_string_append_len(out, text + done, start - done);
+			if(i < rules_count)
+				g_string_append(out, rule_sgr[i]);
+			g_string_append_len(out, text + start, end - start);
+			if(i < rules_count)
+				g_string_append_printf(out, "\033[%s;%sm",
+				                       device_fg[0] ? device_fg : "39",
+				                       device_bg[0] ? device_bg : "49");
+			done = end;
+		}
+		g_match_info_next(info, NULL);
+	}
+	g_match_info_free(info);
+
+	g_string_append_len(out, text + done, kept - done);
+
+	return kept;
+}
+
+/* Colours the matches of pending and feeds it, but for a partial match
+   or sequence at its end when more data may complete it */
+static void scan(gboolean final)
+{
+	GString *out;
+	const gchar *text = pending->str, *escape;
+	gsize size = pending->len, done = 0, length, kept;
+
+	out = g_string_sized_new(size + 64);
+	while(done < size)
+	{
+		/* The sequences of the device go through untouched */
+		if(text[done] == '\x1b')
+		{
+			length = escape_sequence_length(text + done, size - done);
+			/* Unterminated, or a string too long to hold */
+			if(length == 0)
+			{
+				if(!final && size - done <= SEQUENCE_MAX)
+					break;
+				length = size - done;
+			}
+			track_sgr(text + done, length);
+			g_string_append_len(out, text + done, length);
+			done += length;
+			continue;
+		}
+
+		/* Only what a sequence follows is complete */
+		escape = memchr(text + done, '\x1b', size - done);
+		length = escape != NULL ? (gsize)(escape - (text + done)) : size - done;
+		kept = colour_run(out, text + done, length, final || escape != NULL);
+		done += kept;
+		if(kept < length)
+			break;
+	}
+
+	g_string_erase(pending, 0, done);
+	if(out->len > 0)
+		vte_terminal_feed(VTE_TERMINAL(display), out->str, out->len);
+	g_string_free(out, TRUE);
+
+	if(pending->len > HOLD_MAX)
+		scan(TRUE);
+	else if(pending->len > 0)
+		hold_timer = g_timeout_add(HOLD_DELAY, hold_timeout, NULL);
+}
+
+static gboolean hold_timeout(gpointer data)
+{
+	hold_timer = 0;
+	scan(TRUE);
+
+	return G_SOURCE_REMOVE;
+}
+
+void highlight_feed(const gchar *string, guint size)
+{
+	if(pending == NULL)
+		pending = g_string_new(NULL);
+
+	if(hold_timer != 0)
+	{
+		g_source_remove(hold_timer);
+		hold_timer = 0;
+	}
+
+	g_string_append_len(pending, string, size);
+	scan(FALSE);
+}
+
+/* The display is cleared: held text is dropped, the colours are the
+   default ones again */
+void highlight_reset(void)
+{
+	device_fg[0] = device_bg[0] = 0;
+
+	if(hold_timer != 0)
+	{
+		g_source_remove(hold_timer);
+		hold_timer = 0;
+	}
+	if(pending != NULL)
+		g_string_truncate(pending, 0);
+}
+
+static GtkTreeModel *create_model(void)
+{
+	GtkListStore *store;
+	GtkTreeIter iter;
+	gint i;
+
+	store = gtk_list_store_new(NUM_COLUMNS,
+	                           G_TYPE_STRING,
+	                           G_TYPE_BOOLEAN,
+	                           G_TYPE_STRING,
+	                           G_TYPE_STRING);
+
+	for(i = 0; i < rules_count; i++)
+	{
+		gtk_list_store_append(store, &iter);
+		gtk_list_store_set(store, &iter,
+		                   COLUMN_PATTERN, rules[i].pattern,
+		                   COLUMN_REGEX, rules[i].regex,
+		                   COLUMN_FOREGROUND, rules[i].foreground,
+		                   COLUMN_BACKGROUND, rules[i].background,
+		                   -1);
+	}
+
+	return GTK_TREE_MODEL(store);
+}
+
+static void text_edited(GtkCellRendererText *cell, const gchar *path_string,
+                        const gchar *new_text, gpointer data)
+{
+	GtkTreeModel *model = (GtkTreeModel *)data;
+	GtkTreePath *path = gtk_tree_path_new_from_string(path_string);
+	gint column = GPOINTER_TO_INT(g_object_get_data(G_OBJECT(cell), "column"));
+	GtkTreeIter iter;
+	GdkRGBA rgba;
+
+	gtk_tree_model_get_iter(model, &iter, path);
+	gtk_tree_path_free(path);
+
+	/* A colour is either empty or understood by GDK */
+	if(column != COLUMN_PATTERN)
+	{
+		if(new_text[0] == 0)
+			new_text = NULL;
+		else if(!gdk_rgba_parse(&rgba, new_text))
+			return;
+	}
+
+	gtk_list_store_set(GTK_LIST_STORE(model), &iter, column, new_text, -1);
+}
+
+static void regex_toggled(GtkCellRendererToggle *cell, const gchar *path_string, gpointer data)
+{
+	GtkTreeModel *model = (GtkTreeModel *)data;
+	GtkTreePath *path = gtk_tree_path_new_from_string(path_string);
+	GtkTreeIter iter;
+	gboolean regex;
+
+	gtk_tree_model_get_iter(model, &iter, path);
+	gtk_tree_path_free(path);
+
+	gtk_tree_model_get(model, &iter, COLUMN_REGEX, &regex, -1);
+	gtk_list_store_set(GTK_LIST_STORE(model), &iter, COLUMN_REGEX, !regex, -1);
+}
+
+static void add_text_column(GtkTreeView *treeview, const gchar *title, gint column)
+{
+	GtkTreeModel *model = gtk_tree_view_get_model(treeview);
+	GtkCellRenderer *renderer;
+	GtkTreeViewColumn *view_column;
+
+	renderer = gtk_cell_renderer_text_new();
+	g_object_set(G_OBJECT(renderer), "editable", TRUE, NULL);
+	g_object_set_data(G_OBJECT(renderer), "column", GINT_TO_POINTER(column));
+	g_signal_connect(renderer, "edited", G_CALLBACK(text_edited), model);
+	view_column = gtk_tree_view_column_new_with_attributes(title, renderer, "text", column, NULL);
+
+	/* The pattern is shown in its colours */
+	if(column == COLUMN_PATTERN)
+	{
+		gtk_tree_view_column_add_attribute(view_column, renderer, "foreground", COLUMN_FOREGROUND);
+		gtk_tree_view_column_add_attribute(view_column, renderer, "background", COLUMN_BACKGROUND);
+		gtk_tree_view_column_set_expand(view_column, TRUE);
+	}
+	gtk_tree_view_append_column(treeview, view_column);
+}
+
+static void add_columns(GtkTreeView *treeview)
+{
+	GtkTreeModel *model = gtk_tree_view_get_model(treeview);
+	GtkCellRenderer *renderer;
+	GtkTreeViewColumn *column;
+
+	add_text_column(treeview, _("Text"), COLUMN_PATTERN);
+
+	renderer = gtk_cell_renderer_toggle_new();
+	g_signal_connect(renderer, "toggled", G_CALLBACK(regex_toggled), model);
+	column = gtk_tree_view_column_new_with_attributes(_("Regex"), renderer, "active", COLUMN_REGEX, NULL);
+	gtk_tree_view_append_column(treeview, column);
+
+	add_text_column(treeview, _("Text colour"), COLUMN_FOREGROUND);
+	add_text_column(treeview, _("Background"), COLUMN_BACKGROUND);
+}
+
+static gboolean Add_rule(GtkWidget *button, gpointer pointer)
+{
+	GtkTreeModel *model = (GtkTreeModel *)pointer;
+	GtkTreeIter iter;
+
+	gtk_list_store_append(GTK_LIST_STORE(model), &iter);
+	gtk_list_store_set(GTK_LIST_STORE(model), &iter,
+	                   COLUMN_PATTERN, "ERROR",
+	                   COLUMN_REGEX, FALSE,
+	                   COLUMN_FOREGROUND, "#ff5555",
+	                   -1);
+
+	return FALSE;
+}
+
+static gboolean Delete_rule(GtkWidget *button, gpointer pointer)
+{
+	GtkTreeView *treeview = (GtkTreeView *)pointer;
+	GtkTreeSelection *selection = gtk_tree_view_get_selection(treeview);
+	GtkTreeModel *model;
+	GtkTreeIter iter;
+
+	if(gtk_tree_selection_get_selected(selection, &model, &iter))
+		gtk_list_store_remove(GTK_LIST_STORE(model), &iter);
+
+	return FALSE;
+}
+
+static gboolean Save_rules(GtkWidget *button, gpointer pointer)
+{
+	GtkTreeView *treeview = (GtkTreeView *)pointer;
+	GtkTreeModel *model = gtk_tree_view_get_model(treeview);
+	GtkTreeIter iter;
+	GArray *list;
+	highlight_rule_t rule;
+	GRegex *regex;
+	GError *error = NULL;
+	guint i;
+
+	list = g_array_new(FALSE, TRUE, sizeof(highlight_rule_t));
+	if(gtk_tree_model_get_iter_first(model, &iter))
+	{
+		do
+		{
+			gtk_tree_model_get(model, &iter,
+			                   COLUMN_PATTERN, &rule.pattern,
+			                   COLUMN_REGEX, &rule.regex,
+			                   COLUMN_FOREGROUND, &rule.foreground,
+			                   COLUMN_BACKGROUND, &rule.background,
+			                   -1);
+			g_array_append_val(list, rule);
+		}
+		while(gtk_tree_model_iter_next(model, &iter));
+	}
+
+	/* A wrong expression is reported, the window stays open */
+	regex = scanner_build((highlight_rule_t *)list->data, list->len, NULL, &error);
+	if(error != NULL)
+	{
+		show_message(error->message, MSG_ERR);
+		g_clear_error(&error);
+	}
+	else
+	{
+		highlight_set_rules((highlight_rule_t *)list->data, list->len);
+		gtk_widget_destroy(window);
+	}
+	if(regex != NULL)
+		g_regex_unref(regex);
+
+	for(i = 0; i < list->len; i++)
+	{
+		rule = g_array_index(list, highlight_rule_t, i);
+		g_free(rule.pattern);
+		g_free(rule.foreground);
+		g_free(rule.background);
+	}
+	g_array_free(list, TRUE);
+
+	return FALSE;
+}
+
+void Config_highlights(GtkAction *action, gpointer data)
+{
+	GtkWidget *vbox, *hbox;
+	GtkWidget *sw;
+	GtkTreeModel *model;
+	GtkWidget *treeview;
+	GtkWidget *button;
+	GtkWidget *separator;
+
+	if(window != NULL)
+	{
+		gtk_window_present(GTK_WINDOW(window));
+		return;
+	}
+
+	window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
+	gtk_window_set_title(GTK_WINDOW(window), _("Highlighting"));
+	gtk_window_set_transient_for(GTK_WINDOW(window), GTK_WINDOW(Fenetre));
+
+	g_signal_connect(window, "destroy", G_CALLBACK(gtk_widget_destroyed), &window);
+	gtk_container_set_border_width(GTK_CONTAINER(window), 8);
+
+	vbox = gtk_box_new(GTK_ORIENTATION_VERTICAL, 8);
+	gtk_container_add(GTK_CONTAINER(window), vbox);
+
+	sw = gtk_scrolled_window_new(NULL, NULL);
+	gtk_scrolled_window_set_shadow_type(GTK_SCROLLED_WINDOW(sw), GTK_SHADOW_ETCHED_IN);
+	gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(sw), GTK_POLICY_NEVER, GTK_POLICY_AUTOMATIC);
+	gtk_box_pack_start(GTK_BOX(vbox), sw, TRUE, TRUE, 0);
+
+	model = create_model();
+	treeview = gtk_tree_view_new_with_model(model);
+	g_object_unref(model);
+	gtk_container_add(GTK_CONTAINER(sw), treeview);
+	add_columns(GTK_TREE_VIEW(treeview));
+
+	hbox = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 4);
+	gtk_box_set_homogeneous(GTK_BOX(hbox), TRUE);
+	gtk_box_pack_start(GTK_BOX(vbox), hbox, FALSE, FALSE, 0);
+
+	button = gtk_button_new_with_mnemonic(_("_Add"));
+	g_signal_connect(button, "clicked", G_CALLBACK(Add_rule), (gpointer)model);
+	gtk_box_pack_start(GTK_BOX(hbox), button, TRUE, TRUE, 0);
+
+	button = gtk_button_new_with_mnemonic(_("_Delete"));
+	g_signal_connect(button, "clicked", G_CALLBACK(Delete_rule), (gpointer)treeview);
+	gtk_box_pack_start(GTK_BOX(hbox), button, TRUE, TRUE, 0);
+
+	separator = gtk_separator_new(GTK_ORIENTATION_HORIZONTAL);
+	gtk_box_pack_start(GTK_BOX(vbox), separator, FALSE, TRUE, 0);
+
+	hbox = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 4);
+	gtk_box_set_homogeneous(GTK_BOX(hbox), TRUE);
+	gtk_box_pack_start(GTK_BOX(vbox), hbox, FALSE, FALSE, 0);
+
+	button = gtk_button_new_from_stock(GTK_STOCK_OK);
+	g_signal_connect(button, "clicked", G_CALLBACK(Save_rules), (gpointer)treeview);
+	gtk_box_pack_end(GTK_BOX(hbox), button, TRUE, TRUE, 0);
+
+	button = gtk_button_new_from_stock(GTK_STOCK_CANCEL);
+	g_signal_connect_swapped(button, "clicked", G_CALLBACK(gtk_widget_destroy), (gpointer)window);
+	gtk_box_pack_end(GTK_BOX(hbox), button, TRUE, TRUE, 0);
+
+	gtk_window_set_default_size(GTK_WINDOW(window), 420, 300);
+
+	gtk_widget_show_all(window);
+}
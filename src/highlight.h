@@ -0,0 +1,34 @@
+/***********************************************************************/
+/* highlight.h                                                         */
+/* -----------                                                         */
+/*                           GTKTerm Software                          */
+/*                                 (c)                                 */
+/*                                                                     */
+/* ------------------------------------------------------------------- */
+/*                                                                     */
+/*   Purpose                                                           */
+/*      Colouring of the received text by user rules                   */
+/*      - Header file -                                                */
+/*                                                                     */
+/***********************************************************************/
+
+#ifndef HIGHLIGHT_H_
+#define HIGHLIGHT_H_
+
+typedef struct
+{
+	gchar *pattern;
+	gboolean regex;		/* else a literal text */
+	gchar *foreground;	/* "#rrggbb", NULL to keep the colour */
+	gchar *background;
+}
+highlight_rule_t;
+
+void Config_highlights(GtkAction *action, gpointer data);
+void highlight_set_rules(const highlight_rule_t *, gint);
+const highlight_rule_t *highlight_get_rules(gint *);
+gboolean highlight_active(void);
+void highlight_feed(const gchar *, guint);
+void highlight_reset(void);
+
+#endif
@@ -77,6 +77,18 @@
 #include "auto_config.h"
 #include "logging.h"
 #include "device_monitor.h"
+#include "modbus.h"
+#include "deframe.h"
+#include "transfer.h"
+#include "capture.h"
+#include "share.h"
+#include "sniffer.h"
+#include "data_store.h"
+#include "data_view.h"
+#include "highlight.h"
+#include "filter.h"
+#include "message_bar.h"
+#include "governor.h"
 
 #include <glib/gprintf.h>
 #include <glib/gi18n.h>
@@ -87,9 +99,19 @@ gboolean autoreconnect_on;
 gboolean crlfauto_on;
 gboolean esc_clear_screen_on;
 gboolean timestamp_on = 0;
+gboolean paced_paste_on;
+gboolean line_mode_on;
 GtkWidget *StatusBar;
 GtkWidget *signals[6];
 static GtkWidget *Hex_Box;
+static GtkWidget *Line_Box;
+static GtkWidget *line_send_entry;
+static GtkWidget *Filter_Box;
+static GtkWidget *filter_entry;
+static GtkWidget *filter_invert;
+static guint filter_timer = 0;
+static GtkWidget *data_view;
+static gboolean data_view_on = FALSE;	/* hexadecimal view out of the data store */
 GtkWidget *searchBar;
 GtkWidget *scrolled_window;
 GtkWidget *Fenetre;
@@ -103,24 +125,44 @@ GtkWidget *Text;
 GtkTextBuffer *buffer;
 GtkTextIter iter;
 
-GList *hex_history = NULL;  // To store the history of entered texts
-GList *current_hex = NULL;  // Pointer to the current item in history
+/* History of an entry box, browsed with the Up/Down keys */
+typedef struct {
+	GList *items;    // To store the history of entered texts
+	GList *current;  // Pointer to the current item in history
+} entry_history_t;
+
+static entry_history_t hex_history = {NULL, NULL};
+static entry_history_t line_history = {NULL, NULL};
 
 extern struct configuration_port config;
+extern display_config_t term_conf;
+
+/* Lines of scrollback rendered again when the view changes */
+#define REPLAY_SCROLLBACK 1000
+/* ms without typing before a new filter is applied */
+#define FILTER_DELAY 300
 
 /* Variables for hexadecimal display */
 static gint bytes_per_line = 16;
 static gchar blank_data[128];
 static guint total_bytes;
+static GString *hex_pending = NULL;	/* fed to the terminal in one go */
 static gboolean show_index = FALSE;
 guint virt_col_pos = 0;
 
+/* Lines of the hexadecimal display following the frames received */
+static guint frame_bytes = 0;		/* bytes of the frame on screen */
+static gint64 frame_last_rx = 0;	/* monotonic µs, end of its last byte */
+static gint64 frame_silence;		/* idle time before it */
+static guint frame_timer = 0;
+
 /* Local functions prototype */
 void signals_send_break_callback(GtkAction *action, gpointer data);
 void signals_toggle_DTR_callback(GtkAction *action, gpointer data);
 void signals_toggle_RTS_callback(GtkAction *action, gpointer data);
 void signals_close_port(GtkAction *action, gpointer data);
 void signals_open_port(GtkAction *action, gpointer data);
+void signals_statistics_callback(GtkAction *action, gpointer data);
 void help_about_callback(GtkAction *action, gpointer data);
 gboolean Envoie_car(GtkWidget *, GdkEventKey *, gpointer);
 gboolean control_signals_read(void);
@@ -129,12 +171,26 @@ void Autoreconnect_toggled_callback(GtkAction *action, gpointer data);
 void CR_LF_auto_toggled_callback(GtkAction *action, gpointer data);
 void esc_clear_screen_toggled_callback(GtkAction *action, gpointer data);
 void timestamp_toggled_callback(GtkAction *action, gpointer data);
+void paced_paste_toggled_callback(GtkAction *action, gpointer data);
+void line_mode_toggled_callback(GtkAction *action, gpointer data);
 void view_radio_callback(GtkAction *action, gpointer data);
 void view_hexadecimal_chars_radio_callback(GtkAction* action, gpointer data);
+void view_hexadecimal_frames_radio_callback(GtkAction* action, gpointer data);
 void view_index_toggled_callback(GtkAction *action, gpointer data);
 void view_send_hex_toggled_callback(GtkAction *action, gpointer data);
+void view_filter_toggled_callback(GtkAction *action, gpointer data);
 void initialize_hexadecimal_display(void);
 gboolean Send_Hexadecimal(GtkWidget *, GdkEventKey *, gpointer);
+static void Send_Line(GtkWidget *, gpointer);
+static void paste_clipboard_callback(VteTerminal *, gpointer);
+static void filter_changed(GtkEditable *, gpointer);
+static void show_text(const gchar *, guint);
+static void reset_text(void);
+static void render_text(const gchar *, guint);
+static void text_skipped(guint64);
+static void show_hexadecimal(const gchar *, guint);
+static void hexadecimal_skipped(guint64);
+static void filter_activated(GtkWidget *, gpointer);
 gboolean pop_message(void);
 static gchar *translate_menu(const gchar *, gpointer);
 static void Got_Input(VteTerminal *, gchar *, guint, gpointer);
@@ -143,9 +199,10 @@ void update_copy_sensivity(VteTerminal *terminal, gpointer data);
 void edit_paste_callback(GtkAction *action, gpointer data);
 void edit_find_callback(GtkAction *action);
 void edit_select_all_callback(GtkAction *action, gpointer data);
+void edit_goto_callback(GtkAction *action, gpointer data);
 
-void set_saved_data(GtkWidget *widget, gboolean direction);
-void update_hex_history(GtkWidget *widget);
+void set_saved_data(GtkWidget *widget, gboolean direction, entry_history_t *history);
+void update_entry_history(GtkWidget *widget, entry_history_t *history);
 gboolean on_key_press(GtkWidget *widget, GdkEventKey *event, gpointer user_data);
 
 /* Menu */
@@ -159,21 +216,32 @@ const GtkActionEntry menu_entries[] =
 	{"Signals", NULL, N_("Control _signals")},
 	{"View", NULL, N_("_View")},
 	{"ViewHexadecimalChars", NULL, N_("Hexadecimal _chars")},
+	{"ViewHexadecimalFrames", NULL, N_("Hexadecimal _frames")},
+	{"SendProtocol", NULL, N_("Send _with protocol")},
+	{"ReceiveProtocol", NULL, N_("Recei_ve with protocol")},
 	{"Help", NULL, N_("_Help")},
 
 	/* File menu */
 	{"FileExit", GTK_STOCK_QUIT, NULL, "<shift><control>Q", NULL, gtk_main_quit},
 	{"ClearScreen", GTK_STOCK_CLEAR, N_("_Clear screen"), "<shift><control>L", NULL, G_CALLBACK(clear_buffer)},
 	{"ClearScrollback", GTK_STOCK_CLEAR, N_("_Clear scrollback"), "<shift><control>K", NULL, G_CALLBACK(clear_scrollback)},
+	{"ClearHistory", GTK_STOCK_CLEAR, N_("Clear _history"), NULL, NULL, G_CALLBACK(data_store_clear)},
 	{"SendFile", GTK_STOCK_JUMP_TO, N_("Send _RAW file"), "<shift><control>R", NULL, G_CALLBACK(send_raw_file)},
 	{"SaveFile", GTK_STOCK_SAVE_AS, N_("_Save RAW file"), "", NULL, G_CALLBACK(save_raw_file)},
         {"SaveAsciiFile", GTK_STOCK_SAVE_AS, N_("Save _ASCII file"), "", NULL, G_CALLBACK(save_ascii_file)},
+	{"SendXmodem", NULL, "_XMODEM", NULL, NULL, G_CALLBACK(transfer_send_callback)},
+	{"SendYmodem", NULL, "_YMODEM", NULL, NULL, G_CALLBACK(transfer_send_callback)},
+	{"SendZmodem", NULL, "_ZMODEM", NULL, NULL, G_CALLBACK(transfer_send_callback)},
+	{"ReceiveXmodem", NULL, "_XMODEM", NULL, NULL, G_CALLBACK(transfer_receive_callback)},
+	{"ReceiveYmodem", NULL, "_YMODEM", NULL, NULL, G_CALLBACK(transfer_receive_callback)},
+	{"ReceiveZmodem", NULL, "_ZMODEM", NULL, NULL, G_CALLBACK(transfer_receive_callback)},
 
 	/* Edit menu */
 	{"EditCopy", GTK_STOCK_COPY, NULL, "<shift><control>C", NULL, G_CALLBACK(edit_copy_callback)},
 	{"EditPaste", GTK_STOCK_PASTE, NULL, "<shift><control>V", NULL, G_CALLBACK(edit_paste_callback)},
 	{"EditFind", GTK_STOCK_FIND, NULL, "<shift><control>F", NULL, G_CALLBACK(edit_find_callback)},
 	{"EditSelectAll", GTK_STOCK_SELECT_ALL, NULL, "<shift><control>A", NULL, G_CALLBACK(edit_select_all_callback)},
+	{"EditGoto", GTK_STOCK_JUMP_TO, N_("_Go to..."), "<shift><control>J", NULL, G_CALLBACK(edit_goto_callback)},
 
 	/* Log Menu */
 	{"LogToFile", GTK_STOCK_MEDIA_RECORD, N_("To file..."), "", NULL, G_CALLBACK(logging_start)},
@@ -185,6 +253,7 @@ const GtkActionEntry menu_entries[] =
 	{"ConfigPort", GTK_STOCK_PROPERTIES, N_("_Port"), "<shift><control>S", NULL, G_CALLBACK(Config_Port_Fenetre)},
 	{"ConfigTerminal", GTK_STOCK_PREFERENCES, N_("_Main window"), "", NULL, G_CALLBACK(Config_Terminal)},
 	{"Macros", NULL, N_("_Macros"), NULL, NULL, G_CALLBACK(Config_macros)},
+	{"Highlights", NULL, N_("_Highlighting"), NULL, NULL, G_CALLBACK(Config_highlights)},
 	{"SelectConfig", GTK_STOCK_OPEN, N_("_Load configuration"), "", NULL, G_CALLBACK(select_config_callback)},
 	{"SaveConfig", GTK_STOCK_SAVE_AS, N_("_Save configuration"), "", NULL, G_CALLBACK(save_config_callback)},
 	{"DeleteConfig", GTK_STOCK_DELETE, N_("_Delete configuration"), "", NULL, G_CALLBACK(delete_config_callback)},
@@ -195,6 +264,7 @@ const GtkActionEntry menu_entries[] =
 	{"SignalsClosePort", GTK_STOCK_CLOSE, N_("_Close Port"), "F6", NULL, G_CALLBACK(signals_close_port)},
 	{"SignalsDTR", NULL, N_("Toggle DTR"), "F7", NULL, G_CALLBACK(signals_toggle_DTR_callback)},
 	{"SignalsRTS", NULL, N_("Toggle RTS"), "F8", NULL, G_CALLBACK(signals_toggle_RTS_callback)},
+	{"SignalsStatistics", NULL, N_("Port _statistics"), NULL, NULL, G_CALLBACK(signals_statistics_callback)},
 
 	/* About menu */
 	{"HelpAbout", GTK_STOCK_ABOUT, NULL, NULL, NULL, G_CALLBACK(help_about_callback)}
@@ -202,22 +272,31 @@ const GtkActionEntry menu_entries[] =
 
 const GtkToggleActionEntry menu_toggle_entries[] =
 {
+	/* File Menu */
+	{"ExportFrames", NULL, N_("E_xport frames"), NULL, NULL, G_CALLBACK(export_frames_callback), FALSE},
+	{"CaptureFile", NULL, N_("Ca_pture to file"), NULL, NULL, G_CALLBACK(capture_callback), FALSE},
+	{"SniffPorts", NULL, N_("S_niff two ports"), NULL, NULL, G_CALLBACK(sniffer_callback), FALSE},
+
 	/* Configuration Menu */
 	{"LocalEcho", NULL, N_("Local _echo"), NULL, NULL, G_CALLBACK(echo_toggled_callback), FALSE},
 	{"Autoreconnect", NULL, N_("Autoreconnect"), NULL, NULL, G_CALLBACK(Autoreconnect_toggled_callback), FALSE},
 	{"CRLFauto", NULL, N_("_CR LF auto"), NULL, NULL, G_CALLBACK(CR_LF_auto_toggled_callback), FALSE},
 	{"EscClearScreen", NULL, N_("ESC clear scree_n"), NULL, NULL, G_CALLBACK(esc_clear_screen_toggled_callback), FALSE},
 	{"Timestamp", NULL, N_("Timestamp"), NULL, NULL, G_CALLBACK(timestamp_toggled_callback), FALSE},
+	{"PacedPaste", NULL, N_("_Paced paste"), NULL, NULL, G_CALLBACK(paced_paste_toggled_callback), FALSE},
+	{"LineMode", NULL, N_("_Line edit mode"), NULL, NULL, G_CALLBACK(line_mode_toggled_callback), FALSE},
 
 	/* View Menu */
 	{"ViewIndex", NULL, N_("Show _index"), NULL, NULL, G_CALLBACK(view_index_toggled_callback), FALSE},
-	{"ViewSendHexData", NULL, N_("_Send hexadecimal data"), NULL, NULL, G_CALLBACK(view_send_hex_toggled_callback), FALSE}
+	{"ViewSendHexData", NULL, N_("_Send hexadecimal data"), NULL, NULL, G_CALLBACK(view_send_hex_toggled_callback), FALSE},
+	{"ViewFilter", GTK_STOCK_FIND, N_("_Filter lines"), "<shift><control>G", NULL, G_CALLBACK(view_filter_toggled_callback), FALSE}
 };
 
 const GtkRadioActionEntry menu_view_radio_entries[] =
 {
 	{"ViewASCII", NULL, N_("_ASCII"), NULL, NULL, ASCII_VIEW},
-	{"ViewHexadecimal", NULL, N_("_Hexadecimal"), NULL, NULL, HEXADECIMAL_VIEW}
+	{"ViewHexadecimal", NULL, N_("_Hexadecimal"), NULL, NULL, HEXADECIMAL_VIEW},
+	{"ViewModbus", NULL, N_("_Modbus RTU"), NULL, NULL, MODBUS_VIEW}
 };
 
 const GtkRadioActionEntry menu_hex_chars_length_radio_entries[] =
@@ -229,15 +308,37 @@ const GtkRadioActionEntry menu_hex_chars_length_radio_entries[] =
 	{"ViewHex32", NULL, "_32", NULL, NULL, 32}
 };
 
+const GtkRadioActionEntry menu_hex_frames_radio_entries[] =
+{
+	{"ViewFramesNone", NULL, N_("_None"), NULL, NULL, DEFRAME_NONE},
+	{"ViewFramesSLIP", NULL, "_SLIP", NULL, NULL, DEFRAME_SLIP},
+	{"ViewFramesCOBS", NULL, "_COBS", NULL, NULL, DEFRAME_COBS},
+	{"ViewFramesHDLC", NULL, "_HDLC", NULL, NULL, DEFRAME_HDLC}
+};
+
 static const char *ui_description =
     "<ui>"
     "  <menubar name='MenuBar'>"
     "    <menu action='File'>"
     "      <menuitem action='ClearScreen'/>"
     "      <menuitem action='ClearScrollback'/>"
+    "      <menuitem action='ClearHistory'/>"
     "      <menuitem action='SendFile'/>"
+    "      <menu action='SendProtocol'>"
+    "        <menuitem action='SendXmodem'/>"
+    "        <menuitem action='SendYmodem'/>"
+    "        <menuitem action='SendZmodem'/>"
+    "      </menu>"
+    "      <menu action='ReceiveProtocol'>"
+    "        <menuitem action='ReceiveXmodem'/>"
+    "        <menuitem action='ReceiveYmodem'/>"
+    "        <menuitem action='ReceiveZmodem'/>"
+    "      </menu>"
     "      <menuitem action='SaveFile'/>"
     "      <menuitem action='SaveAsciiFile'/>"
+    "      <menuitem action='ExportFrames'/>"
+    "      <menuitem action='CaptureFile'/>"
+    "      <menuitem action='SniffPorts'/>"
     "      <separator/>"
     "      <menuitem action='FileExit'/>"
     "    </menu>"
@@ -245,6 +346,7 @@ static const char *ui_description =
     "      <menuitem action='EditCopy'/>"
     "      <menuitem action='EditPaste'/>"
     "      <menuitem action='EditFind'/>"
+    "      <menuitem action='EditGoto'/>"
     "      <separator/>"
     "      <menuitem action='EditSelectAll'/>"
     "    </menu>"
@@ -262,7 +364,10 @@ static const char *ui_description =
     "      <menuitem action='CRLFauto'/>"
     "      <menuitem action='EscClearScreen'/>"
     "      <menuitem action='Timestamp'/>"
+    "      <menuitem action='PacedPaste'/>"
+    "      <menuitem action='LineMode'/>"
     "      <menuitem action='Macros'/>"
+    "      <menuitem action='Highlights'/>"
     "      <separator/>"
     "      <menuitem action='SelectConfig'/>"
     "      <menuitem action='SaveConfig'/>"
@@ -274,10 +379,13 @@ static const char *ui_description =
     "      <menuitem action='SignalsClosePort'/>"
     "      <menuitem action='SignalsDTR'/>"
     "      <menuitem action='SignalsRTS'/>"
+    "      <separator/>"
+    "      <menuitem action='SignalsStatistics'/>"
     "    </menu>"
     "    <menu action='View'>"
     "      <menuitem action='ViewASCII'/>"
     "      <menuitem action='ViewHexadecimal'/>"
+    "      <menuitem action='ViewModbus'/>"
     "      <menu action='ViewHexadecimalChars'>"
     "        <menuitem action='ViewHex8'/>"
     "        <menuitem action='ViewHex10'/>"
@@ -285,8 +393,15 @@ static const char *ui_description =
     "        <menuitem action='ViewHex24'/>"
     "        <menuitem action='ViewHex32'/>"
     "      </menu>"
+    "      <menu action='ViewHexadecimalFrames'>"
+    "        <menuitem action='ViewFramesNone'/>"
+    "        <menuitem action='ViewFramesSLIP'/>"
+    "        <menuitem action='ViewFramesCOBS'/>"
+    "        <menuitem action='ViewFramesHDLC'/>"
+    "      </menu>"
     "      <menuitem action='ViewIndex'/>"
     "      <separator/>"
+    "      <menuitem action='ViewFilter'/>"
     "      <menuitem action='ViewSendHexData'/>"
     "    </menu>"
     "    <menu action='Help'>"
@@ -330,17 +445,77 @@ void view_hexadecimal_chars_radio_callback(GtkAction* action, gpointer data)
 	set_view(HEXADECIMAL_VIEW);
 }
 
+void view_hexadecimal_frames_radio_callback(GtkAction* action, gpointer data)
+{
+	deframe_set(gtk_radio_action_get_current_value(GTK_RADIO_ACTION(action)));
+	set_view(HEXADECIMAL_VIEW);
+}
+
+/* The data view takes the place of the terminal */
+static void show_data_view(gboolean show)
+{
+	GtkAction *action;
+
+	data_view_on = show;
+	gtk_widget_set_visible(scrolled_window, !show);
+	gtk_widget_set_visible(data_view, show);
+	if(show)
+	{
+		data_view_set_bytes_per_line(bytes_per_line);
+		data_view_set_columns(show_index, timestamp_on);
+		data_view_focus();
+		action = gtk_action_group_get_action(action_group, "EditCopy");
+		gtk_action_set_sensitive(action, TRUE);
+	}
+	else
+		update_copy_sensivity(VTE_TERMINAL(display), NULL);
+}
+
+/* What the hexadecimal view logged when it drew the bytes itself */
+static void log_hexadecimal(const gchar *string, guint size)
+{
+	gchar data[3 * 256 + 1];
+	guint i, n = 0;
+
+	for(i = 0; i < size; i++)
+	{
+		sprintf(data + n, "%02X ", (guchar)string[i]);
+		n += 3;
+		if(n == sizeof(data) - 1 || i + 1 == size)
+		{
+			log_chars(data, n);
+			n = 0;
+		}
+	}
+}
+
 void set_view(guint type)
 {
 	GtkAction *action;
 	GtkAction *show_index_action;
 	GtkAction *hex_chars_action;
+	GtkAction *hex_frames_action;
+	guint lines, start;
 
 	show_index_action = gtk_action_group_get_action(action_group, "ViewIndex");
 	hex_chars_action = gtk_action_group_get_action(action_group, "ViewHexadecimalChars");
+	hex_frames_action = gtk_action_group_get_action(action_group, "ViewHexadecimalFrames");
+
+	/* Lines are filtered in the ASCII view only */
+	action = gtk_action_group_get_action(action_group, "ViewFilter");
+	if(type != ASCII_VIEW)
+		gtk_toggle_action_set_active(GTK_TOGGLE_ACTION(action), FALSE);
+	gtk_action_set_sensitive(action, type == ASCII_VIEW);
 
+	show_data_view(FALSE);
 	clear_display();
 	set_clear_func(clear_display);
+	set_raw_display(type == MODBUS_VIEW ||
+	                (type == HEXADECIMAL_VIEW && deframe_get() != DEFRAME_NONE));
+	modbus_reset();
+	deframe_reset();
+	frame_bytes = 0;
+	frame_last_rx = 0;
 	switch(type)
 	{
 	case ASCII_VIEW:
@@ -348,7 +523,11 @@ void set_view(guint type)
 		gtk_toggle_action_set_active(GTK_TOGGLE_ACTION(action), TRUE);
 		gtk_action_set_sensitive(show_index_action, FALSE);
 		gtk_action_set_sensitive(hex_chars_action, FALSE);
+		gtk_action_set_sensitive(hex_frames_action, FALSE);
 		total_bytes = 0;
+		governor_set_output(render_text, text_skipped,
+		                    vte_terminal_get_row_count(VTE_TERMINAL(display)) *
+		                    vte_terminal_get_column_count(VTE_TERMINAL(display)));
 		set_display_func(put_text);
 		break;
 	case HEXADECIMAL_VIEW:
@@ -356,14 +535,49 @@ void set_view(guint type)
 		gtk_toggle_action_set_active(GTK_TOGGLE_ACTION(action), TRUE);
 		gtk_action_set_sensitive(show_index_action, TRUE);
 		gtk_action_set_sensitive(hex_chars_action, TRUE);
+		gtk_action_set_sensitive(hex_frames_action, TRUE);
 		total_bytes = 0;
 		virt_col_pos = 0;
-		set_display_func(put_hexadecimal);
+		if(deframe_get() != DEFRAME_NONE)
+			set_display_func(put_deframed);
+		else if(config.frame_idle > 0 || config.frame_delimiter != -1)
+		{
+			governor_set_output(show_hexadecimal, hexadecimal_skipped,
+			                    vte_terminal_get_row_count(VTE_TERMINAL(display)) * bytes_per_line);
+			set_display_func(put_hexadecimal);
+		}
+		else
+		{
+			/* Plain bytes: drawn out of the data store, nothing to replay */
+			set_display_func(log_hexadecimal);
+			show_data_view(TRUE);
+			return;
+		}
 		break;
+	case MODBUS_VIEW:
+		action = gtk_action_group_get_action(action_group, "ViewModbus");
+		gtk_toggle_action_set_active(GTK_TOGGLE_ACTION(action), TRUE);
+		gtk_action_set_sensitive(show_index_action, FALSE);
+		gtk_action_set_sensitive(hex_chars_action, FALSE);
+		gtk_action_set_sensitive(hex_frames_action, FALSE);
+		set_display_func(put_modbus);
+		/* Frames need the time they arrived, the buffer has lost it */
+		return;
 	default:
 		set_display_func(NULL);
 	}
-	write_buffer();
+
+	/* Only what the terminal keeps: the screen and a bounded scrollback */
+	lines = vte_terminal_get_row_count(VTE_TERMINAL(display));
+	lines += term_conf.scrollback > 0 ? MIN(term_conf.scrollback, REPLAY_SCROLLBACK) : REPLAY_SCROLLBACK;
+	if(type == HEXADECIMAL_VIEW)
+	{
+		start = buffer_tail_start(lines, bytes_per_line, FALSE);
+		total_bytes = start;
+	}
+	else
+		start = buffer_tail_start(lines, vte_terminal_get_column_count(VTE_TERMINAL(display)), TRUE);
+	write_buffer_from(start);
 }
 
 void view_radio_callback(GtkAction *action, gpointer data)
@@ -457,6 +671,116 @@ void timestamp_toggled_callback(GtkAction *action, gpointer data)
 {
 	timestamp_on = gtk_toggle_action_get_active (GTK_TOGGLE_ACTION(action));
 	config.timestamp = timestamp_on ? TRUE : FALSE;
+	if(data_view_on)
+		data_view_set_columns(show_index, timestamp_on);
+}
+
+void Set_paced_paste(gboolean paced_paste)
+{
+	GtkAction *action;
+
+	paced_paste_on = paced_paste;
+
+	action = gtk_action_group_get_action(action_group, "PacedPaste");
+	if(action)
+		gtk_toggle_action_set_active(GTK_TOGGLE_ACTION(action), paced_paste_on);
+}
+
+void paced_paste_toggled_callback(GtkAction *action, gpointer data)
+{
+	paced_paste_on = gtk_toggle_action_get_active (GTK_TOGGLE_ACTION(action));
+	config.paced_paste = paced_paste_on ? TRUE : FALSE;
+}
+
+void Set_line_mode(gboolean line_mode)
+{
+	GtkAction *action;
+
+	line_mode_on = line_mode;
+
+	action = gtk_action_group_get_action(action_group, "LineMode");
+	if(action)
+		gtk_toggle_action_set_active(GTK_TOGGLE_ACTION(action), line_mode_on);
+}
+
+void line_mode_toggled_callback(GtkAction *action, gpointer data)
+{
+	line_mode_on = gtk_toggle_action_get_active (GTK_TOGGLE_ACTION(action));
+	config.line_mode = line_mode_on ? TRUE : FALSE;
+
+	if(line_mode_on)
+	{
+		gtk_widget_show(GTK_WIDGET(Line_Box));
+		gtk_widget_grab_focus(line_send_entry);
+	}
+	else
+		gtk_widget_hide(GTK_WIDGET(Line_Box));
+}
+
+static void filter_apply(void)
+{
+	GtkAction *action;
+	GError *error = NULL;
+	const gchar *expression = NULL;
+	gboolean was_active = filter_active();
+
+	if(filter_timer != 0)
+	{
+		g_source_remove(filter_timer);
+		filter_timer = 0;
+	}
+
+	if(gtk_widget_get_visible(Filter_Box))
+		expression = gtk_entry_get_text(GTK_ENTRY(filter_entry));
+
+	if(!filter_set(expression, gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(filter_invert)), &error))
+	{
+		gtk_style_context_add_class(gtk_widget_get_style_context(filter_entry), GTK_STYLE_CLASS_ERROR);
+		gtk_widget_set_tooltip_text(filter_entry, error->message);
+		g_clear_error(&error);
+		return;
+	}
+	gtk_style_context_remove_class(gtk_widget_get_style_context(filter_entry), GTK_STYLE_CLASS_ERROR);
+	gtk_widget_set_tooltip_text(filter_entry, NULL);
+
+	/* Back to the whole stream, if still in the ASCII view */
+	action = gtk_action_group_get_action(action_group, "ViewASCII");
+	if(was_active && !filter_active() &&
+	   gtk_radio_action_get_current_value(GTK_RADIO_ACTION(action)) == ASCII_VIEW)
+		set_view(ASCII_VIEW);
+}
+
+static gboolean filter_timeout(gpointer data)
+{
+	filter_timer = 0;
+	filter_apply();
+
+	return G_SOURCE_REMOVE;
+}
+
+/* Applied once the typing pauses */
+static void filter_changed(GtkEditable *editable, gpointer data)
+{
+	if(filter_timer != 0)
+		g_source_remove(filter_timer);
+	filter_timer = g_timeout_add(FILTER_DELAY, filter_timeout, NULL);
+}
+
+static void filter_activated(GtkWidget *widget, gpointer data)
+{
+	filter_apply();
+}
+
+void view_filter_toggled_callback(GtkAction *action, gpointer data)
+{
+	if(gtk_toggle_action_get_active(GTK_TOGGLE_ACTION(action)))
+	{
+		gtk_widget_show(GTK_WIDGET(Filter_Box));
+		gtk_widget_grab_focus(filter_entry);
+	}
+	else
+		gtk_widget_hide(GTK_WIDGET(Filter_Box));
+	filter_apply();
 }
 
 void toggle_logging_pause_resume(gboolean currentlyLogging)
@@ -558,6 +882,10 @@ void create_main_window(void)
 	                                   G_N_ELEMENTS (menu_hex_chars_length_radio_entries),
 	                                   16, G_CALLBACK(view_hexadecimal_chars_radio_callback),
 	                                   Fenetre);
+	gtk_action_group_add_radio_actions(action_group, menu_hex_frames_radio_entries,
+	                                   G_N_ELEMENTS (menu_hex_frames_radio_entries),
+	                                   DEFRAME_NONE, G_CALLBACK(view_hexadecimal_frames_radio_callback),
+	                                   Fenetre);
 
 	gtk_ui_manager_insert_action_group (ui_manager, action_group, 0);
 
@@ -573,6 +901,9 @@ void create_main_window(void)
 	menu = gtk_ui_manager_get_widget (ui_manager, "/MenuBar");
 	gtk_box_pack_start(GTK_BOX(main_vbox), menu, FALSE, TRUE, 0);
 
+	/* errors and warnings, hidden without any */
+	gtk_box_pack_start(GTK_BOX(main_vbox), message_bar_new(), FALSE, FALSE, 0);
+
 	/* create vte window */
 	display = vte_terminal_new();
 
@@ -602,6 +933,10 @@ void create_main_window(void)
 
 	gtk_box_pack_start(GTK_BOX(main_vbox), scrolled_window, TRUE, TRUE, 0);
 
+	/* hexadecimal view of the data store (hidden when not in use) */
+	data_view = data_view_new();
+	gtk_box_pack_start(GTK_BOX(main_vbox), data_view, TRUE, TRUE, 0);
+
 	g_signal_connect(G_OBJECT(display), "button-press-event",
 	                 G_CALLBACK(terminal_button_press_callback), NULL);
 
@@ -623,11 +958,35 @@ void create_main_window(void)
 	label = gtk_label_new(_("Hexadecimal data to send (separator: ';' or space): "));
 	gtk_box_pack_start(GTK_BOX(Hex_Box), label, FALSE, FALSE, 5);
 	hex_send_entry = gtk_entry_new();
-    g_signal_connect(GTK_WIDGET(hex_send_entry), "key-press-event", G_CALLBACK(on_key_press), NULL);
+    g_signal_connect(GTK_WIDGET(hex_send_entry), "key-press-event", G_CALLBACK(on_key_press), &hex_history);
 	g_signal_connect(GTK_WIDGET(hex_send_entry), "activate", (GCallback)Send_Hexadecimal, NULL);
 	gtk_box_pack_start(GTK_BOX(Hex_Box), hex_send_entry, TRUE, TRUE, 5);
 	gtk_box_pack_start(GTK_BOX(main_vbox), Hex_Box, FALSE, TRUE, 2);
 
+	/* line edit box, the line is sent when Enter is pressed */
+	Line_Box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 0);
+	label = gtk_label_new(_("Line to send: "));
+	gtk_box_pack_start(GTK_BOX(Line_Box), label, FALSE, FALSE, 5);
+	line_send_entry = gtk_entry_new();
+	g_signal_connect(GTK_WIDGET(line_send_entry), "key-press-event", G_CALLBACK(on_key_press), &line_history);
+	g_signal_connect(GTK_WIDGET(line_send_entry), "activate", G_CALLBACK(Send_Line), NULL);
+	gtk_box_pack_start(GTK_BOX(Line_Box), line_send_entry, TRUE, TRUE, 5);
+	gtk_box_pack_start(GTK_BOX(main_vbox), Line_Box, FALSE, TRUE, 2);
+
+	/* line filter box (hidden when not in use) */
+	Filter_Box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 0);
+	label = gtk_label_new(_("Show lines matching: "));
+	gtk_box_pack_start(GTK_BOX(Filter_Box), label, FALSE, FALSE, 5);
+	filter_entry = gtk_entry_new();
+	g_signal_connect(GTK_WIDGET(filter_entry), "changed", G_CALLBACK(filter_changed), NULL);
+	g_signal_connect(GTK_WIDGET(filter_entry), "activate", G_CALLBACK(filter_activated), NULL);
+	gtk_box_pack_start(GTK_BOX(Filter_Box), filter_entry, TRUE, TRUE, 5);
+	filter_invert = gtk_check_button_new_with_mnemonic(_("_Invert"));
+	g_signal_connect(GTK_WIDGET(filter_invert), "toggled", G_CALLBACK(filter_activated), NULL);
+	gtk_box_pack_start(GTK_BOX(Filter_Box), filter_invert, FALSE, FALSE, 5);
+	gtk_box_pack_start(GTK_BOX(main_vbox), Filter_Box, FALSE, TRUE, 2);
+	filter_set_output(show_text, reset_text);
+
 	/* status bar */
 	StatusBar = gtk_statusbar_new();
 	gtk_box_pack_start(GTK_BOX(main_vbox), StatusBar, FALSE, FALSE, 0);
@@ -659,6 +1018,7 @@ void create_main_window(void)
 	signals[5] = label;
 
 	g_signal_connect_after(GTK_WIDGET(display), "commit", G_CALLBACK(Got_Input), NULL);
+	g_signal_connect(GTK_WIDGET(display), "paste-clipboard", G_CALLBACK(paste_clipboard_callback), NULL);
 
 	g_timeout_add(POLL_DELAY, (GSourceFunc)control_signals_read, NULL);
 
@@ -666,6 +1026,10 @@ void create_main_window(void)
 	gtk_widget_show_all(Fenetre);
 	search_bar_hide(searchBar);
 	gtk_widget_hide(GTK_WIDGET(Hex_Box));
+	gtk_widget_hide(GTK_WIDGET(Filter_Box));
+	gtk_widget_hide(data_view);
+	if(!line_mode_on)
+		gtk_widget_hide(GTK_WIDGET(Line_Box));
 }
 
 void initialize_hexadecimal_display(void)
@@ -675,77 +1039,284 @@ void initialize_hexadecimal_display(void)
 	blank_data[bytes_per_line * 3 + 5] = 0;
 }
 
-void put_hexadecimal(const gchar *string, guint size)
+static void hexadecimal_feed(const gchar *data, gsize len)
+{
+	if(hex_pending == NULL)
+		hex_pending = g_string_sized_new(4096);
+	g_string_append_len(hex_pending, data, len);
+}
+
+static void hexadecimal_flush(void)
+{
+	if(hex_pending == NULL || hex_pending->len == 0)
+		return;
+
+	vte_terminal_feed(VTE_TERMINAL(display), hex_pending->str, hex_pending->len);
+	g_string_truncate(hex_pending, 0);
+}
+
+static void hexadecimal_new_line(void)
+{
+	hexadecimal_feed("\r\n", 2);
+	total_bytes += virt_col_pos;
+	virt_col_pos = 0;
+}
+
+static void hexadecimal_byte(guchar c)
+{
+	static gchar data[16];
+	gint avance=0;
+	gchar ascii[1];
+
+	if(show_index)
+	{
+		/* First byte on line */
+		if(virt_col_pos == 0)
+		{
+			sprintf(data, "%6d: ", total_bytes);
+			hexadecimal_feed(data, strlen(data));
+		}
+	}
+
+	sprintf(data, "%02X ", c);
+	hexadecimal_feed(data, 3);
+
+	avance = (bytes_per_line - virt_col_pos) * 3 + virt_col_pos + 2;
+	/* Move forward */
+	sprintf(data, "%c[%dC", 27, avance);
+	hexadecimal_feed(data, strlen(data));
+
+	/* Print ascii characters */
+	ascii[0] = (c > 0x1F && c < 0x80) ? c : '.';
+	hexadecimal_feed(ascii, 1);
+
+	/* Move backward */
+	sprintf(data, "%c[%dD", 27, avance + 1);
+	hexadecimal_feed(data, strlen(data));
+
+	if(virt_col_pos == bytes_per_line / 2 - 1)
+		hexadecimal_feed("- ", strlen("- "));
+
+	virt_col_pos++;
+}
+
+/* Note after the ascii column that ends the line of a frame */
+static void hexadecimal_trailer(const gchar *text)
+{
+	gchar data[16];
+	gint avance;
+
+	avance = bytes_per_line * 4 + 8 - virt_col_pos * 3;
+	if(virt_col_pos >= bytes_per_line / 2)
+		avance -= 2;
+	sprintf(data, "%c[%dC", 27, avance);
+	hexadecimal_feed(data, strlen(data));
+	hexadecimal_feed(text, strlen(text));
+
+	hexadecimal_new_line();
+}
+
+/* Close the frame on screen with its length and the silence before it */
+static void hexadecimal_frame_end(void)
+{
+	gchar data[64];
+
+	if(frame_bytes == 0)
+		return;
+
+	if(frame_silence > 0)
+		sprintf(data, _("[%u bytes, +%.3f ms]"), frame_bytes, frame_silence / 1000.0);
+	else
+		sprintf(data, _("[%u bytes]"), frame_bytes);
+	hexadecimal_trailer(data);
+
+	frame_bytes = 0;
+}
+
+static gboolean hexadecimal_frame_timeout(gpointer data)
+{
+	if(frame_bytes == 0 || config.frame_idle == 0)
+	{
+		frame_timer = 0;
+		return FALSE;
+	}
+
+	if(g_get_monotonic_time() - frame_last_rx < config.frame_idle * get_port_char_time())
+		return TRUE;
+
+	hexadecimal_frame_end();
+	hexadecimal_flush();
+	frame_timer = 0;
+	return FALSE;
+}
+
+static void show_hexadecimal(const gchar *string, guint size)
 {
-	static gchar data[128];
-	static gchar data_byte[6];
 	gint i = 0;
+	gboolean framing;
+	gint64 byte_time = 0, now = 0, first = 0;
 
 	if(size == 0)
 		return;
 
-	while(i < size)
+	framing = (config.frame_idle > 0 || config.frame_delimiter != -1);
+	if(framing)
 	{
-		while(gtk_events_pending()) gtk_main_iteration();
+		/* Silences are measured with the time Lis_port() read the data */
+		now = serial_rx_time ? serial_rx_time : g_get_monotonic_time();
+		byte_time = get_port_char_time();
+		first = now - size * byte_time;
+
+		if(config.frame_idle > 0 && first - frame_last_rx >= config.frame_idle * byte_time)
+			hexadecimal_frame_end();
+	}
+	else if(frame_bytes != 0)
+		hexadecimal_frame_end();
 
-		/* Print hexadecimal characters */
-		data[0] = 0;
+	while(i < size)
+	{
+		/* A full line is only ended once we know more bytes follow */
+		if(virt_col_pos == bytes_per_line)
+			hexadecimal_new_line();
 
 		while(virt_col_pos < bytes_per_line && i < size)
 		{
-			gint avance=0;
-			gchar ascii[1];
+			if(framing && frame_bytes == 0)
+				frame_silence = frame_last_rx ? first + i * byte_time - frame_last_rx : 0;
 
-			if(show_index)
+			hexadecimal_byte(string[i]);
+			i++;
+
+			if(framing)
 			{
-				/* First byte on line */
-				if(virt_col_pos == 0)
+				frame_bytes++;
+				if((guchar)string[i - 1] == config.frame_delimiter)
 				{
-					sprintf(data, "%6d: ", total_bytes);
-					vte_terminal_feed(VTE_TERMINAL(display), data, strlen(data));
+					hexadecimal_frame_end();
+					break;
 				}
 			}
+			/* End of line ? */
+			else if(virt_col_pos == bytes_per_line)
+				hexadecimal_new_line();
+		}
 
-			sprintf(data_byte, "%02X ", (guchar)string[i]);
-			log_chars(data_byte, 3);
-			vte_terminal_feed(VTE_TERMINAL(display), data_byte, 3);
+	}
 
-			avance = (bytes_per_line - virt_col_pos) * 3 + virt_col_pos + 2;
-			/* Move forward */
-			sprintf(data_byte, "%c[%dC", 27, avance);
-			vte_terminal_feed(VTE_TERMINAL(display), data_byte, strlen(data_byte));
+	hexadecimal_flush();
 
-			/* Print ascii characters */
-			ascii[0] = (string[i] > 0x1F) ? string[i] : '.';
-			vte_terminal_feed(VTE_TERMINAL(display), ascii, 1);
+	if(framing)
+	{
+		frame_last_rx = now;
+		if(frame_bytes != 0 && frame_timer == 0 && config.frame_idle > 0)
+			frame_timer = g_timeout_add(MAX(1, config.frame_idle * byte_time / 1000),
+			                            hexadecimal_frame_timeout, NULL);
+	}
+}
 
-			/* Move backward */
-			sprintf(data_byte, "%c[%dD", 27, avance + 1);
-			vte_terminal_feed(VTE_TERMINAL(display), data_byte, strlen(data_byte));
+/* On a line of its own, the index goes on after the bytes skipped */
+static void hexadecimal_skipped(guint64 bytes)
+{
+	gchar *size, *note;
+
+	hexadecimal_frame_end();
+	if(virt_col_pos != 0)
+		hexadecimal_new_line();
+
+	size = g_format_size(bytes);
+	note = g_strdup_printf(_("[%s skipped in view]"), size);
+	hexadecimal_feed("\033[7m", 4);
+	hexadecimal_feed(note, strlen(note));
+	hexadecimal_feed("\033[0m", 4);
+	hexadecimal_new_line();
+	hexadecimal_flush();
+	g_free(note);
+	g_free(size);
+
+	total_bytes += bytes;
+}
 
-			if(virt_col_pos == bytes_per_line / 2 - 1)
-				vte_terminal_feed(VTE_TERMINAL(display), "- ", strlen("- "));
+void put_hexadecimal(const gchar *string, guint size)
+{
+	log_hexadecimal(string, size);
+	governor_feed(string, size);
+}
 
-			virt_col_pos++;
-			i++;
+/* A frame decoded by a deframer, on lines of its own */
+void put_hexadecimal_frame(const guchar *data, guint size, const gchar *error)
+{
+	gchar *note, *text;
+	guint i;
 
-			/* End of line ? */
-			if(virt_col_pos == bytes_per_line)
-			{
-				vte_terminal_feed(VTE_TERMINAL(display), "\r\n", 2);
-				total_bytes += virt_col_pos;
-				virt_col_pos = 0;
-			}
+	log_hexadecimal((const gchar *)data, size);
+	if(virt_col_pos != 0)
+		hexadecimal_new_line();
 
-		}
+	for(i = 0; i < size; i++)
+	{
+		if(virt_col_pos == bytes_per_line)
+			hexadecimal_new_line();
+		hexadecimal_byte(data[i]);
+	}
 
+	if(error != NULL)
+	{
+		text = g_strdup_printf(_("[%u bytes, %s]"), size, error);
+		note = g_strconcat("\033[31m", text, "\033[0m", NULL);
+		g_free(text);
 	}
+	else
+		note = g_strdup_printf(_("[%u bytes]"), size);
+	hexadecimal_trailer(note);
+	hexadecimal_flush();
+	g_free(note);
+}
+
+static void render_text(const gchar *string, guint size)
+{
+	if(highlight_active())
+		highlight_feed(string, size);
+	else
+		vte_terminal_feed(VTE_TERMINAL(display), string, size);
+}
+
+/* What the filter lets through, as fast as the terminal can draw */
+static void show_text(const gchar *string, guint size)
+{
+	governor_feed(string, size);
+}
+
+static void text_skipped(guint64 bytes)
+{
+	gchar *size, *note, *text;
+
+	/* A held colour match is not completed by what comes next */
+	highlight_reset();
+
+	size = g_format_size(bytes);
+	note = g_strdup_printf(_("[%s skipped in view]"), size);
+	/* Colours set in what was skipped are lost: the default ones again */
+	text = g_strconcat("\r\n\033[0;7m", note, "\033[0m\r\n", NULL);
+	vte_terminal_feed(VTE_TERMINAL(display), text, strlen(text));
+	g_free(text);
+	g_free(note);
+	g_free(size);
+}
+
+/* The terminal only, the buffer keeps the whole stream */
+static void reset_text(void)
+{
+	highlight_reset();
+	vte_terminal_reset(VTE_TERMINAL(display), TRUE, TRUE);
 }
 
 void put_text(const gchar *string, guint size)
 {
 	log_chars(string, size);
-	vte_terminal_feed(VTE_TERMINAL(display), string, size);
+	if(filter_active())
+		filter_feed(string, size);
+	else
+		show_text(string, size);
 }
 
 gint send_serial(gchar *string, gint len)
@@ -756,7 +1327,10 @@ gint send_serial(gchar *string, gint len)
 	if(bytes_written > 0)
 	{
 		if(echo_on)
+		{
+			data_store_append(string, bytes_written, 0, DATA_TX);
 			put_chars(string, bytes_written, crlfauto_on, esc_clear_screen_on);
+		}
 	}
 
 	return bytes_written;
@@ -765,9 +1339,69 @@ gint send_serial(gchar *string, gint len)
 
 static void Got_Input(VteTerminal *widget, gchar *text, guint length, gpointer ptr)
 {
+	guint i;
+	gint position;
+
+	if(line_mode_on)
+	{
+		/* Enter sends the line being edited */
+		if(length == 1 && text[0] == '\r')
+		{
+			Send_Line(line_send_entry, NULL);
+			return;
+		}
+
+		/* Printable text is edited locally, control characters go out now */
+		for(i = 0; i < length; i++)
+		{
+			if((guchar)text[i] < 0x20 || text[i] == 0x7F)
+				break;
+		}
+		if(i == length)
+		{
+			position = -1;
+			gtk_editable_insert_text(GTK_EDITABLE(line_send_entry), text, length, &position);
+			gtk_widget_grab_focus(line_send_entry);
+			gtk_editable_set_position(GTK_EDITABLE(line_send_entry), -1);
+			return;
+		}
+	}
+
 	send_serial(text, length);
 }
 
+/* Send the whole line with a single write, ended like a typed line */
+static void Send_Line(GtkWidget *widget, gpointer data)
+{
+	const gchar *text;
+	gchar *line;
+
+	text = gtk_entry_get_text(GTK_ENTRY(widget));
+	line = g_strconcat(text, "\r", NULL);
+	send_serial(line, strlen(line));
+	g_free(line);
+
+	update_entry_history(widget, &line_history);
+	gtk_entry_set_text(GTK_ENTRY(widget), "");
+}
+
+static void paste_received(GtkClipboard *clipboard, const gchar *text, gpointer data)
+{
+	if(text != NULL)
+		send_paced_text(text, strlen(text));
+}
+
+static void paste_clipboard_callback(VteTerminal *terminal, gpointer data)
+{
+	if(!paced_paste_on)
+		return;
+
+	/* Bypass the terminal, which would send everything at once */
+	g_signal_stop_emission_by_name(terminal, "paste-clipboard");
+	gtk_clipboard_request_text(gtk_widget_get_clipboard(GTK_WIDGET(terminal), GDK_SELECTION_CLIPBOARD),
+	                           paste_received, NULL);
+}
+
 gboolean Envoie_car(GtkWidget *widget, GdkEventKey *event, gpointer pointer)
 {
 	if(g_utf8_validate(event->string, 1, NULL))
@@ -856,13 +1490,88 @@ void signals_open_port(GtkAction *action, gpointer data)
 	interface_open_port();
 }
 
+static GtkWidget *statistics_dialog = NULL;
+static guint statistics_timer;
+
+static gboolean statistics_refresh(gpointer label)
+{
+	gchar *port, *monitor, *modbus, *frames, *shared, *sniffed, *history, *messages, *view, *log, *text;
+
+	port = get_port_statistics_string();
+	monitor = device_monitor_statistics();
+	modbus = modbus_statistics();
+	frames = deframe_statistics();
+	shared = share_statistics();
+	sniffed = sniffer_statistics();
+	history = data_store_statistics();
+	messages = message_bar_statistics();
+	view = governor_statistics();
+	log = logging_statistics();
+	text = g_strconcat(port, log, monitor, modbus, frames, shared, sniffed, history, messages, view, NULL);
+	gtk_label_set_text(GTK_LABEL(label), text);
+	g_free(text);
+	g_free(log);
+	g_free(view);
+	g_free(messages);
+	g_free(history);
+	g_free(sniffed);
+	g_free(shared);
+	g_free(frames);
+	g_free(modbus);
+	g_free(monitor);
+	g_free(port);
+
+	return TRUE;
+}
+
+static void statistics_destroyed(GtkWidget *widget, gpointer data)
+{
+	g_source_remove(statistics_timer);
+	statistics_dialog = NULL;
+}
+
+void signals_statistics_callback(GtkAction *action, gpointer data)
+{
+	GtkWidget *label;
+
+	if(statistics_dialog != NULL)
+	{
+		gtk_window_present(GTK_WINDOW(statistics_dialog));
+		return;
+	}
+
+	statistics_dialog = gtk_dialog_new_with_buttons(_("Port statistics"),
+	                    GTK_WINDOW(Fenetre),
+	                    GTK_DIALOG_DESTROY_WITH_PARENT,
+	                    "_Close",
+	                    GTK_RESPONSE_CLOSE,
+	                    NULL);
+
+	label = gtk_label_new(NULL);
+	gtk_label_set_selectable(GTK_LABEL(label), TRUE);
+	gtk_label_set_xalign(GTK_LABEL(label), 0);
+	gtk_container_set_border_width(GTK_CONTAINER(gtk_dialog_get_content_area(GTK_DIALOG(statistics_dialog))), 10);
+	gtk_box_pack_start(GTK_BOX(gtk_dialog_get_content_area(GTK_DIALOG(statistics_dialog))), label, TRUE, TRUE, 0);
+
+	statistics_refresh(label);
+	statistics_timer = g_timeout_add(500, statistics_refresh, label);
+
+	g_signal_connect(statistics_dialog, "destroy", G_CALLBACK(statistics_destroyed), NULL);
+	g_signal_connect(statistics_dialog, "response", G_CALLBACK(gtk_widget_destroy), NULL);
+
+	gtk_widget_show_all(statistics_dialog);
+}
+
 gboolean control_signals_read(void)
 {
 	int state;
 
 	state = lis_sig();
 	if(state >= 0)
+	{
 		show_control_signals(state);
+		share_signals(state);
+	}
 
 	return TRUE;
 }
@@ -902,31 +1611,27 @@ void interface_close_port(void)
 	g_free(message);
 }
 
+/* Shown in the window without waiting: may come from the reception */
 void show_message(gchar *message, gint type_msg)
 {
-	GtkWidget *Fenetre_msg;
-
-	if(type_msg==MSG_ERR)
-	{
-		Fenetre_msg = gtk_message_dialog_new(GTK_WINDOW(Fenetre),
-		                                     GTK_DIALOG_DESTROY_WITH_PARENT,
-		                                     GTK_MESSAGE_ERROR,
-		                                     GTK_BUTTONS_OK,
-		                                     message, NULL);
-	}
-	else if(type_msg==MSG_WRN)
-	{
-		Fenetre_msg = gtk_message_dialog_new(GTK_WINDOW(Fenetre),
-		                                     GTK_DIALOG_DESTROY_WITH_PARENT,
-		                                     GTK_MESSAGE_WARNING,
-		                                     GTK_BUTTONS_OK,
-		                                     message, NULL);
-	}
-	else
+	if(type_msg != MSG_ERR && type_msg != MSG_WRN)
 		return;
 
-	gtk_dialog_run(GTK_DIALOG(Fenetre_msg));
-	gtk_widget_destroy(Fenetre_msg);
+	message_bar_show(message, type_msg);
+}
+
+/* Over a modal dialog, which the message bar would be hidden behind */
+void show_dialog_message(GtkWidget *parent, gchar *message, gint type_msg)
+{
+	GtkWidget *dialog;
+
+	dialog = gtk_message_dialog_new(GTK_WINDOW(parent),
+	                                GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT,
+	                                type_msg == MSG_ERR ? GTK_MESSAGE_ERROR : GTK_MESSAGE_WARNING,
+	                                GTK_BUTTONS_OK,
+	                                "%s", message);
+	gtk_dialog_run(GTK_DIALOG(dialog));
+	gtk_widget_destroy(dialog);
 }
 
 gboolean Send_Hexadecimal(GtkWidget *widget, GdkEventKey *event, gpointer pointer)
@@ -965,7 +1670,7 @@ gboolean Send_Hexadecimal(GtkWidget *widget, GdkEventKey *event, gpointer pointe
 	g_free(buff);
 
 	message = g_strdup_printf(_("%d byte(s) sent!"), i);
-    update_hex_history(widget);
+    update_entry_history(widget, &hex_history);
 	Put_temp_message(message, 2000);
 	gtk_entry_set_text(GTK_ENTRY(widget), "");
 	g_strfreev(tokens);
@@ -990,13 +1695,19 @@ gboolean pop_message(void)
 void clear_display(void)
 {
 	initialize_hexadecimal_display();
+	governor_reset();
+	filter_reset();
+	highlight_reset();
 	if(display)
 		vte_terminal_reset(VTE_TERMINAL(display), TRUE, TRUE);
 }
 
 void edit_copy_callback(GtkAction *action, gpointer data)
 {
-	vte_terminal_copy_clipboard(VTE_TERMINAL(display));
+	if(data_view_on)
+		data_view_copy();
+	else
+		vte_terminal_copy_clipboard(VTE_TERMINAL(display));
 }
 
 void update_copy_sensivity(VteTerminal *terminal, gpointer data)
@@ -1025,25 +1736,107 @@ void edit_find_callback(GtkAction *action)
 
 void edit_select_all_callback(GtkAction *action, gpointer data)
 {
-	vte_terminal_select_all(VTE_TERMINAL(display));
+	if(data_view_on)
+		data_view_select_all();
+	else
+		vte_terminal_select_all(VTE_TERMINAL(display));
+}
+
+/* Line or time of the data store, shown in the hexadecimal view */
+void edit_goto_callback(GtkAction *action, gpointer data)
+{
+	GtkWidget *dialog, *content, *label, *entry;
+	const data_record_t *record;
+	gchar *text, *message;
+	guint64 start, end;
+	gint64 time;
+	guint index;
+	gboolean found = FALSE;
+
+	dialog = gtk_dialog_new_with_buttons(_("Go to"), GTK_WINDOW(Fenetre),
+	                                     GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT,
+	                                     GTK_STOCK_CANCEL, GTK_RESPONSE_CANCEL,
+	                                     GTK_STOCK_JUMP_TO, GTK_RESPONSE_ACCEPT,
+	                                     NULL);
+	gtk_dialog_set_default_response(GTK_DIALOG(dialog), GTK_RESPONSE_ACCEPT);
+	content = gtk_dialog_get_content_area(GTK_DIALOG(dialog));
+
+	text = g_strdup_printf(_("Line (1 to %" G_GUINT64_FORMAT ") or time of day (HH:MM:SS):"),
+	                       data_store_lines() + 1);
+	label = gtk_label_new(text);
+	g_free(text);
+	gtk_box_pack_start(GTK_BOX(content), label, FALSE, FALSE, 5);
+	entry = gtk_entry_new();
+	gtk_entry_set_activates_default(GTK_ENTRY(entry), TRUE);
+	gtk_box_pack_start(GTK_BOX(content), entry, FALSE, FALSE, 5);
+	gtk_widget_show_all(dialog);
+
+	if(gtk_dialog_run(GTK_DIALOG(dialog)) != GTK_RESPONSE_ACCEPT)
+	{
+		gtk_widget_destroy(dialog);
+		return;
+	}
+	text = g_strstrip(g_strdup(gtk_entry_get_text(GTK_ENTRY(entry))));
+	gtk_widget_destroy(dialog);
+
+	if(strchr(text, ':') != NULL)
+	{
+		/* What came first at or after that time */
+		if(data_store_parse_time(text, &time))
+		{
+			index = data_store_find_time(time);
+			record = data_store_record(index);
+			if(record != NULL)
+			{
+				start = MAX(record->offset, data_store_first());
+				record = data_store_record(index + 1);
+				end = (record != NULL ? record->offset : data_store_length()) - 1;
+				found = TRUE;
+			}
+		}
+	}
+	else if(g_ascii_isdigit(text[0]) && g_ascii_strtoull(text, NULL, 10) > 0)
+		found = data_store_find_line(g_ascii_strtoull(text, NULL, 10) - 1, &start, &end);
+
+	if(!found)
+	{
+		message = g_strdup_printf(_("Nothing received at \"%s\""), text);
+		Put_temp_message(message, 1500);
+		g_free(message);
+		g_free(text);
+		return;
+	}
+	g_free(text);
+
+	if(!data_view_on)
+	{
+		action = gtk_action_group_get_action(action_group, "ViewHexadecimal");
+		gtk_toggle_action_set_active(GTK_TOGGLE_ACTION(action), TRUE);
+	}
+	if(!data_view_on)
+	{
+		Put_temp_message(_("Go to needs the hexadecimal view without frames"), 1500);
+		return;
+	}
+	data_view_goto(start, end);
 }
 
 // Callback for "key-press-event"
 gboolean on_key_press(GtkWidget *widget, GdkEventKey *event, gpointer user_data) {
     switch (event->keyval) {
     case GDK_KEY_Up:        
-        set_saved_data(widget, TRUE);  // TRUE for KEY_UP
+        set_saved_data(widget, TRUE, user_data);  // TRUE for KEY_UP
         return TRUE;  // Event handled
     case GDK_KEY_Down:        
-        set_saved_data(widget, FALSE);  // FALSE for KEY_DOWN
+        set_saved_data(widget, FALSE, user_data);  // FALSE for KEY_DOWN
         return TRUE;  // Event handled
     default:
         return FALSE;  // Event not handled, propagate further
     }
 }
 
-// Function to update the hex history when a new text is entered
-void update_hex_history(GtkWidget *widget) {
+// Function to update the history when a new text is entered
+void update_entry_history(GtkWidget *widget, entry_history_t *history) {
     const gchar *text = gtk_entry_get_text(GTK_ENTRY(widget));
 
     // Only add non-empty texts to history
@@ -1051,54 +1844,54 @@ void update_hex_history(GtkWidget *widget) {
         return;
     }
 
-    if (!current_hex) {
-        // If current_hex is NULL, add the text to the end of the history
-        hex_history = g_list_append(hex_history, g_strdup(text));
+    if (!history->current) {
+        // If current is NULL, add the text to the end of the history
+        history->items = g_list_append(history->items, g_strdup(text));
     } else {
-        const gchar *current_text = (const gchar *)current_hex->data;
+        const gchar *current_text = (const gchar *)history->current->data;
 
         if (g_strcmp0(current_text, text) == 0) {
-            // If the entered text matches the current_hex, move it to the end
-            hex_history = g_list_remove(hex_history, current_hex->data);
-            hex_history = g_list_append(hex_history, g_strdup(current_text));
+            // If the entered text matches the current item, move it to the end
+            history->items = g_list_remove(history->items, history->current->data);
+            history->items = g_list_append(history->items, g_strdup(current_text));
         } else {
             // If the text is different, add it as a new entry
-            hex_history = g_list_append(hex_history, g_strdup(text));
+            history->items = g_list_append(history->items, g_strdup(text));
         }
     }
 
-    // Reset current_hex to NULL after adding or moving an entry
-    current_hex = NULL;
+    // Reset current to NULL after adding or moving an entry
+    history->current = NULL;
 }
 
 // Function to get the previous/next item from the history
-void set_saved_data(GtkWidget *widget, gboolean direction) {
-    if (!hex_history) {
+void set_saved_data(GtkWidget *widget, gboolean direction, entry_history_t *history) {
+    if (!history->items) {
         return;
     }
 
     if (direction) {
         // KEY_UP pressed, go to the previous history item
-        if (!current_hex) {
-            current_hex = g_list_last(hex_history);
+        if (!history->current) {
+            history->current = g_list_last(history->items);
         }
-        else if (current_hex && current_hex->prev) {
-            current_hex = current_hex->prev;
+        else if (history->current && history->current->prev) {
+            history->current = history->current->prev;
         }
         else
             return;
-        const gchar *prev_text = (const gchar *)current_hex->data;
+        const gchar *prev_text = (const gchar *)history->current->data;
         gtk_entry_set_text(GTK_ENTRY(widget), prev_text);  // Set text in entry
     } else {
         // KEY_DOWN pressed, go to the next history item
-        if (current_hex && current_hex->next) {
-            current_hex = current_hex->next;
-            const gchar *next_text = (const gchar *)current_hex->data;
+        if (history->current && history->current->next) {
+            history->current = history->current->next;
+            const gchar *next_text = (const gchar *)history->current->data;
             gtk_entry_set_text(GTK_ENTRY(widget), next_text);  // Set text in entry
         } else {
             // If no further history, clear the entry
             gtk_entry_set_text(GTK_ENTRY(widget), "");
-            current_hex = NULL;  // Reset the pointer
+            history->current = NULL;  // Reset the pointer
         }
     }
 }
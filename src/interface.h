@@ -20,19 +20,24 @@
 
 #define ASCII_VIEW 0
 #define HEXADECIMAL_VIEW 1
+#define MODBUS_VIEW 2
 
 void create_main_window(void);
 void Set_status_message(gchar *);
 void put_text(const gchar *, guint);
 void put_hexadecimal(const gchar *, guint);
+void put_hexadecimal_frame(const guchar *, guint, const gchar *);
 void Set_local_echo(gboolean);
 void show_message(gchar *, gint);
+void show_dialog_message(GtkWidget *, gchar *, gint);
 void clear_display(void);
 void set_view(guint);
 void Set_crlfauto(gboolean crlfauto);
 void Set_autoreconnect_enabled(gboolean autoreconnect_enabled);
 void Set_esc_clear_screen(gboolean esc_clear_screen);
 void Set_timestamp(gboolean timestamp);
+void Set_paced_paste(gboolean paced_paste);
+void Set_line_mode(gboolean line_mode);
 gint send_serial(gchar *, gint);
 void Put_temp_message(const gchar *, gint);
 void Set_window_title(gchar *msg);
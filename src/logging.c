@@ -33,12 +33,148 @@
 #include <glib/gi18n.h>
 
 #define MAX_WRITE_ATTEMPTS 5
+#define LOG_QUEUE_MAX (16 * 1024 * 1024)	/* bytes waiting for the disk */
 
 static gboolean	  Logging;
 static gchar     *LoggingFileName;
 static FILE      *LoggingFile;
 static gchar     *logfile_default = NULL;
 
+/* Written to the file by a thread, the reception never waits on the disk */
+typedef struct
+{
+	guint size;
+	gint64 queued;
+	gchar data[];
+} log_chunk_t;
+
+static GThread *writer = NULL;
+static GMutex log_lock;
+static GCond log_cond;
+static GQueue log_queue = G_QUEUE_INIT;
+static gboolean log_writing = FALSE;
+static gboolean log_quit = FALSE;		/* the writer ends once the queue is written */
+static gint log_failed = 0;
+
+static struct {
+	guint64 chunks;
+	gsize queued;		/* bytes waiting */
+	gsize peak;
+	guint64 dropped;	/* bytes the disk could not keep up with */
+	gint64 latency;		/* logged to written, all chunks */
+	gint64 latency_max;
+} log_stats;
+
+static gboolean log_error(gpointer data)
+{
+	g_atomic_int_set(&log_failed, 0);
+	show_message(_("Failed to log data\n"), MSG_ERR);
+
+	return G_SOURCE_REMOVE;
+}
+
+static gboolean log_behind(gpointer data)
+{
+	show_message(_("The log file can't keep up, data is dropped\n"), MSG_WRN);
+
+	return G_SOURCE_REMOVE;
+}
+
+static void write_chunk(log_chunk_t *chunk)
+{
+	guint writeAttempts = 0;
+	guint bytesWritten = 0;
+
+	while (bytesWritten < chunk->size)
+	{
+		if (writeAttempts < MAX_WRITE_ATTEMPTS)
+		{
+			bytesWritten += fwrite(&chunk->data[bytesWritten], 1,
+			                       chunk->size-bytesWritten, LoggingFile);
+			writeAttempts++;
+		}
+		else
+		{
+			if(g_atomic_int_compare_and_exchange(&log_failed, 0, 1))
+				g_idle_add(log_error, NULL);
+			return;
+		}
+	}
+}
+
+static gpointer log_writer(gpointer data)
+{
+	log_chunk_t *chunk;
+	gint64 latency;
+	gboolean last;
+
+	while(TRUE)
+	{
+		g_mutex_lock(&log_lock);
+		while(g_queue_is_empty(&log_queue) && !log_quit)
+			g_cond_wait(&log_cond, &log_lock);
+		if(g_queue_is_empty(&log_queue))
+		{
+			g_mutex_unlock(&log_lock);
+			break;
+		}
+		chunk = g_queue_pop_head(&log_queue);
+		log_writing = TRUE;
+		g_mutex_unlock(&log_lock);
+
+		/* The file only changes once the queue is written, see log_sync() */
+		if(LoggingFile != NULL)
+		{
+			write_chunk(chunk);
+			g_mutex_lock(&log_lock);
+			last = g_queue_is_empty(&log_queue);
+			g_mutex_unlock(&log_lock);
+			/* Once a burst is written */
+			if(last)
+				fflush(LoggingFile);
+		}
+
+		latency = g_get_monotonic_time() - chunk->queued;
+		g_mutex_lock(&log_lock);
+		log_writing = FALSE;
+		log_stats.chunks++;
+		log_stats.queued -= chunk->size;
+		log_stats.latency += latency;
+		log_stats.latency_max = MAX(log_stats.latency_max, latency);
+		g_cond_broadcast(&log_cond);
+		g_mutex_unlock(&log_lock);
+
+		g_free(chunk);
+	}
+
+	return NULL;
+}
+
+/* Waits for what was logged to be in the file, before the file changes */
+static void log_sync(void)
+{
+	g_mutex_lock(&log_lock);
+	while(!g_queue_is_empty(&log_queue) || log_writing)
+		g_cond_wait(&log_cond, &log_lock);
+	g_mutex_unlock(&log_lock);
+}
+
+/* Everything logged is written, then the writer thread ends */
+static void log_writer_stop(void)
+{
+	if(writer == NULL)
+		return;
+
+	g_mutex_lock(&log_lock);
+	log_quit = TRUE;
+	g_cond_broadcast(&log_cond);
+	g_mutex_unlock(&log_lock);
+
+	g_thread_join(writer);
+	writer = NULL;
+	log_quit = FALSE;
+}
+
 static gint OpenLogFile(gchar *filename)
 {
 	gchar *str;
@@ -55,6 +191,7 @@ static gint OpenLogFile(gchar *filename)
 
 	if(LoggingFile != NULL)
 	{
+		log_sync();
 		fclose(LoggingFile);
 		LoggingFile = NULL;
 		Logging = FALSE;
@@ -108,6 +245,17 @@ void logging_start(GtkAction *action, gpointer data)
 	toggle_logging_pause_resume(Logging);
 }
 
+/* Without the file chooser, for the control socket */
+gboolean logging_start_file(const gchar *filename)
+{
+	OpenLogFile(g_strdup(filename));
+
+	toggle_logging_sensitivity(Logging);
+	toggle_logging_pause_resume(Logging);
+
+	return LoggingFile != NULL;
+}
+
 void logging_clear(void)
 {
 	if(LoggingFile == NULL)
@@ -115,6 +263,7 @@ void logging_clear(void)
 		return;
 	}
 
+	log_sync();
 	//Reopening with "w" will truncate the file
 	LoggingFile = freopen(LoggingFileName, "w", LoggingFile);
 
@@ -144,18 +293,29 @@ void logging_pause_resume(void)
 	toggle_logging_pause_resume(Logging);
 }
 
-void logging_stop(void)
+/* The log file is complete and closed, on quit as well */
+void logging_shutdown(void)
 {
+	log_writer_stop();
+
 	if(LoggingFile == NULL)
-	{
 		return;
-	}
 
 	fclose(LoggingFile);
 	LoggingFile = NULL;
 	Logging = FALSE;
 	g_free(LoggingFileName);
 	LoggingFileName = NULL;
+}
+
+void logging_stop(void)
+{
+	if(LoggingFile == NULL)
+	{
+		return;
+	}
+
+	logging_shutdown();
 
 	toggle_logging_sensitivity(Logging);
 	toggle_logging_pause_resume(Logging);
@@ -163,28 +323,61 @@ void logging_stop(void)
 
 void log_chars(gchar *chars, guint size)
 {
-	guint writeAttempts = 0;
-	guint bytesWritten = 0;
+	log_chunk_t *chunk;
 
 	/* if we are not logging exit */
-	if(LoggingFile == NULL || Logging == FALSE)
+	if(LoggingFile == NULL || Logging == FALSE || size == 0)
 	{
 		return;
 	}
 
-	while (bytesWritten < size)
+	if(writer == NULL)
+		writer = g_thread_new("log writer", log_writer, NULL);
+
+	g_mutex_lock(&log_lock);
+	/* The disk is behind: newer data is dropped, the window goes on */
+	if(log_stats.queued + size > LOG_QUEUE_MAX)
 	{
-		if (writeAttempts < MAX_WRITE_ATTEMPTS)
-		{
-			bytesWritten += fwrite(&chars[bytesWritten], 1,
-			                       size-bytesWritten, LoggingFile);
-		}
-		else
-		{
-			show_message(_("Failed to log data\n"), MSG_ERR);
-			return;
-		}
+		if(log_stats.dropped == 0)
+			g_idle_add(log_behind, NULL);
+		log_stats.dropped += size;
+		g_mutex_unlock(&log_lock);
+		return;
 	}
+	g_mutex_unlock(&log_lock);
+
+	chunk = g_malloc(sizeof(log_chunk_t) + size);
+	chunk->size = size;
+	chunk->queued = g_get_monotonic_time();
+	memcpy(chunk->data, chars, size);
+
+	g_mutex_lock(&log_lock);
+	g_queue_push_tail(&log_queue, chunk);
+	log_stats.queued += size;
+	log_stats.peak = MAX(log_stats.peak, log_stats.queued);
+	g_cond_broadcast(&log_cond);
+	g_mutex_unlock(&log_lock);
+}
+
+gchar *logging_statistics(void)
+{
+	gchar *queued, *peak, *dropped, *text;
+
+	if(log_stats.chunks == 0 && log_stats.dropped == 0)
+		return g_strdup("");
+
+	g_mutex_lock(&log_lock);
+	queued = g_format_size(log_stats.queued);
+	peak = g_format_size(log_stats.peak);
+	dropped = g_format_size(log_stats.dropped);
+	text = g_strdup_printf(_("Log queue: %s, peak %s, dropped %s, latency %.2f ms average, %.2f ms max\n"),
+	                       queued, peak, dropped,
+	                       log_stats.chunks ? log_stats.latency / 1000.0 / log_stats.chunks : 0,
+	                       log_stats.latency_max / 1000.0);
+	g_mutex_unlock(&log_lock);
+	g_free(queued);
+	g_free(peak);
+	g_free(dropped);
 
-	fflush(LoggingFile);
+	return text;
 }
@@ -15,9 +15,12 @@
 #define LOGGING_H_
 
 void logging_start(GtkAction *action, gpointer data);
+gboolean logging_start_file(const gchar *filename);
 void logging_pause_resume(void);
 void logging_stop(void);
+void logging_shutdown(void);
 void logging_clear(void);
 void log_chars(gchar *chars, guint size);
+gchar *logging_statistics(void);
 
 #endif /* LOGGING_H_ */
@@ -0,0 +1,207 @@
+/***********************************************************************/
+/* message_bar.c                                                       */
+/* -------------                                                       */
+/*                           GTKTerm Software                          */
+/*                                 (c)                                 */
+/*                                                                     */
+/* ------------------------------------------------------------------- */
+/*                                                                     */
+/*   Purpose                                                           */
+/*      Errors and warnings shown in the main window                   */
+/*      - Never waits for the user, the port keeps being read          */
+/*      - A repeated message is counted, not shown again               */
+/*      - At most one new message a second, a few more are queued      */
+/*                                                                     */
+/***********************************************************************/
+
+#include <gtk/gtk.h>
+#include <string.h>
+
+#include "interface.h"
+#include "message_bar.h"
+
+#include <config.h>
+#include <glib/gi18n.h>
+
+#define MESSAGE_INTERVAL 1000	/* ms before the next message replaces one */
+#define MESSAGE_QUEUE_MAX 8
+
+typedef struct
+{
+	gchar *text;
+	gint type;
+	guint count;
+} message_t;
+
+static GtkWidget *bar = NULL;
+static GtkWidget *text_label;
+static GtkWidget *more_label;
+
+static message_t *shown = NULL;
+static GQueue *queue = NULL;		/* of message_t, waiting their turn */
+static guint interval_timer = 0;
+
+static guint errors = 0, warnings = 0, dropped = 0;
+
+static void message_free(message_t *message)
+{
+	g_free(message->text);
+	g_free(message);
+}
+
+static void update_labels(void)
+{
+	gchar *text;
+
+	if(shown == NULL)
+		return;
+
+	if(shown->count > 1)
+		text = g_strdup_printf(_("%s (%u times)"), shown->text, shown->count);
+	else
+		text = g_strdup(shown->text);
+	gtk_label_set_text(GTK_LABEL(text_label), text);
+	g_free(text);
+
+	if(g_queue_get_length(queue) > 0)
+	{
+		text = g_strdup_printf(_("%u more"), g_queue_get_length(queue));
+		gtk_label_set_text(GTK_LABEL(more_label), text);
+		g_free(text);
+		gtk_widget_show(more_label);
+	}
+	else
+		gtk_widget_hide(more_label);
+}
+
+static gboolean interval_done(gpointer data);
+
+static void display(message_t *message)
+{
+	if(shown != NULL)
+		message_free(shown);
+	shown = message;
+
+	gtk_info_bar_set_message_type(GTK_INFO_BAR(bar),
+	                              message->type == MSG_ERR ? GTK_MESSAGE_ERROR : GTK_MESSAGE_WARNING);
+	update_labels();
+	gtk_widget_show(bar);
+
+	interval_timer = g_timeout_add(MESSAGE_INTERVAL, interval_done, NULL);
+}
+
+static gboolean interval_done(gpointer data)
+{
+	interval_timer = 0;
+	if(!g_queue_is_empty(queue))
+		display(g_queue_pop_head(queue));
+
+	return G_SOURCE_REMOVE;
+}
+
+static void bar_response(GtkInfoBar *info_bar, gint response, gpointer data)
+{
+	gtk_widget_hide(bar);
+	if(shown != NULL)
+		message_free(shown);
+	shown = NULL;
+
+	if(interval_timer == 0 && !g_queue_is_empty(queue))
+		display(g_queue_pop_head(queue));
+}
+
+GtkWidget *message_bar_new(void)
+{
+	GtkWidget *content;
+
+	queue = g_queue_new();
+
+	bar = gtk_info_bar_new();
+	gtk_info_bar_set_show_close_button(GTK_INFO_BAR(bar), TRUE);
+	g_signal_connect(bar, "response", G_CALLBACK(bar_response), NULL);
+
+	content = gtk_info_bar_get_content_area(GTK_INFO_BAR(bar));
+	text_label = gtk_label_new(NULL);
+	gtk_label_set_line_wrap(GTK_LABEL(text_label), TRUE);
+	gtk_label_set_xalign(GTK_LABEL(text_label), 0);
+	gtk_box_pack_start(GTK_BOX(content), text_label, TRUE, TRUE, 0);
+	more_label = gtk_label_new(NULL);
+	gtk_box_pack_end(GTK_BOX(content), more_label, FALSE, FALSE, 0);
+
+	/* Shown with a message only */
+	gtk_widget_show_all(content);
+	gtk_widget_set_no_show_all(bar, TRUE);
+
+	return bar;
+}
+
+static gboolean same_text(message_t *message, const gchar *text)
+{
+	return !strcmp(message->text, text);
+}
+
+void message_bar_show(const gchar *text, gint type)
+{
+	message_t *message;
+	GList *queued;
+	gchar *stripped;
+
+	if(type == MSG_ERR)
+		errors++;
+	else
+		warnings++;
+
+	stripped = g_strstrip(g_strdup(text));
+
+	/* Before the main window */
+	if(bar == NULL)
+	{
+		g_printerr("%s\n", stripped);
+		g_free(stripped);
+		return;
+	}
+
+	/* Repeated: only counted */
+	if(shown != NULL && same_text(shown, stripped))
+	{
+		shown->count++;
+		update_labels();
+		g_free(stripped);
+		return;
+	}
+	for(queued = g_queue_peek_head_link(queue); queued != NULL; queued = queued->next)
+	{
+		if(same_text(queued->data, stripped))
+		{
+			((message_t *)queued->data)->count++;
+			g_free(stripped);
+			return;
+		}
+	}
+
+	message = g_new0(message_t, 1);
+	message->text = stripped;
+	message->type = type;
+	message->count = 1;
+
+	if(interval_timer == 0)
+		display(message);
+	else if(g_queue_get_length(queue) < MESSAGE_QUEUE_MAX)
+	{
+		g_queue_push_tail(queue, message);
+		update_labels();
+	}
+	else
+	{
+		dropped++;
+		message_free(message);
+	}
+}
+
+gchar *message_bar_statistics(void)
+{
+	if(errors == 0 && warnings == 0)
+		return g_strdup("");
+
+	return g_strdup_printf(_("Messages: %u errors, %u warnings, %u not shown\n"), errors, warnings, dropped);
+}
@@ -0,0 +1,22 @@
+/***********************************************************************/
+/* message_bar.h                                                       */
+/* -------------                                                       */
+/*                           GTKTerm Software                          */
+/*                                 (c)                                 */
+/*                                                                     */
+/* ------------------------------------------------------------------- */
+/*                                                                     */
+/*   Purpose                                                           */
+/*      Errors and warnings shown in the main window                   */
+/*      - Header file -                                                */
+/*                                                                     */
+/***********************************************************************/
+
+#ifndef MESSAGE_BAR_H_
+#define MESSAGE_BAR_H_
+
+GtkWidget *message_bar_new(void);
+void message_bar_show(const gchar *, gint);
+gchar *message_bar_statistics(void);
+
+#endif
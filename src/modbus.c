@@ -0,0 +1,431 @@
+/***********************************************************************/
+/* modbus.c                                                            */
+/* --------                                                            */
+/*                           GTKTerm Software                          */
+/*                                 (c)                                 */
+/*                                                                     */
+/* ------------------------------------------------------------------- */
+/*                                                                     */
+/*   Purpose                                                           */
+/*      Modbus RTU decoder for the received data                       */
+/*      - Frames are split on the 3.5 character silence, measured      */
+/*        with the time each chunk was read from the port              */
+/*      - Frames merged by the driver are split again on their CRC     */
+/*                                                                     */
+/***********************************************************************/
+
+#include <gtk/gtk.h>
+#include <vte/vte.h>
+#include <string.h>
+
+#include "term_config.h"
+#include "serial.h"
+#include "logging.h"
+#include "modbus.h"
+
+#include <config.h>
+#include <glib/gi18n.h>
+
+#define SGR_ERROR "\033[31m"
+#define SGR_EXCEPTION "\033[33m"
+#define SGR_RESET "\033[0m"
+
+extern struct configuration_port config;
+extern GtkWidget *display;
+
+/* CRC-16/MODBUS, eight tables so the main loop eats eight bytes a turn */
+static guint16 crc_table[8][256];
+static gboolean crc_table_ready = FALSE;
+
+/* Frame being received */
+static guchar frame[MODBUS_MAX_FRAME];
+static guint frame_len = 0;
+static gint64 frame_start;	/* monotonic µs, first byte of the frame */
+static gint64 last_rx = 0;	/* monotonic µs, end of the last byte */
+static gint64 last_frame = 0;	/* start of the previous frame shown */
+static guint flush_timer = 0;
+
+static struct {
+	guint frames;
+	guint crc_errors;
+	guint exceptions;
+	guint merged;		/* frames found by CRC inside one silence */
+} modbus_stats;
+
+static void crc_table_init(void)
+{
+	guint i, j, k;
+	guint16 crc;
+
+	for(i = 0; i < 256; i++)
+	{
+		crc = i;
+		for(j = 0; j < 8; j++)
+			crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+		crc_table[0][i] = crc;
+	}
+
+	/* crc_table[k] is the effect of a byte followed by k zero bytes */
+	for(k = 1; k < 8; k++)
+		for(i = 0; i < 256; i++)
+			crc_table[k][i] = (crc_table[k - 1][i] >> 8) ^
+			                  crc_table[0][crc_table[k - 1][i] & 0xFF];
+
+	crc_table_ready = TRUE;
+}
+
+/* CRC over a whole frame, its two CRC bytes included, is 0 when it is good */
+guint16 modbus_crc16(const guchar *data, gsize len)
+{
+	guint16 crc = 0xFFFF;
+
+	if(!crc_table_ready)
+		crc_table_init();
+
+	while(len >= 8)
+	{
+		crc ^= data[0] | (data[1] << 8);
+		crc = crc_table[7][crc & 0xFF] ^ crc_table[6][crc >> 8] ^
+		      crc_table[5][data[2]] ^ crc_table[4][data[3]] ^
+		      crc_table[3][data[4]] ^ crc_table[2][data[5]] ^
+		      crc_table[1][data[6]] ^ crc_table[0][data[7]];
+		data += 8;
+		len -= 8;
+	}
+
+	while(len--)
+		crc = (crc >> 8) ^ crc_table[0][(crc ^ *data++) & 0xFF];
+
+	return crc;
+}
+
+/* Length of the first frame with a good CRC, or len if there is none */
+static guint frame_split(const guchar *data, guint len)
+{
+	guint16 crc = 0xFFFF;
+	guint i;
+
+	for(i = 0; i < len; i++)
+	{
+		crc = (crc >> 8) ^ crc_table[0][(crc ^ data[i]) & 0xFF];
+		if(i >= 3 && crc == 0)
+			return i + 1;
+	}
+
+	return len;
+}
+
+/* Silence ending a frame, in µs */
+static gint64 frame_gap(void)
+{
+	/* Fixed value of the specification above 19200 bauds */
+	if(config.vitesse > 19200)
+		return 1750;
+
+	return get_port_char_time() * 7 / 2;
+}
+
+static const gchar *function_name(guchar function)
+{
+	switch(function)
+	{
+	case 0x01:
+		return _("Read Coils");
+	case 0x02:
+		return _("Read Discrete Inputs");
+	case 0x03:
+		return _("Read Holding Registers");
+	case 0x04:
+		return _("Read Input Registers");
+	case 0x05:
+		return _("Write Single Coil");
+	case 0x06:
+		return _("Write Single Register");
+	case 0x07:
+		return _("Read Exception Status");
+	case 0x08:
+		return _("Diagnostics");
+	case 0x0F:
+		return _("Write Multiple Coils");
+	case 0x10:
+		return _("Write Multiple Registers");
+	case 0x11:
+		return _("Report Server ID");
+	case 0x16:
+		return _("Mask Write Register");
+	case 0x17:
+		return _("Read/Write Multiple Registers");
+	case 0x2B:
+		return _("Encapsulated Interface");
+	default:
+		return _("Unknown function");
+	}
+}
+
+static const gchar *exception_name(guchar code)
+{
+	switch(code)
+	{
+	case 0x01:
+		return _("Illegal function");
+	case 0x02:
+		return _("Illegal data address");
+	case 0x03:
+		return _("Illegal data value");
+	case 0x04:
+		return _("Server device failure");
+	case 0x05:
+		return _("Acknowledge");
+	case 0x06:
+		return _("Server device busy");
+	case 0x08:
+		return _("Memory parity error");
+	case 0x0A:
+		return _("Gateway path unavailable");
+	case 0x0B:
+		return _("Gateway target failed to respond");
+	default:
+		return _("Unknown exception");
+	}
+}
+
+#define WORD(p) (((p)[0] << 8) | (p)[1])
+
+/* Requests and responses of the register functions share a function code,
+   the length of the PDU tells them apart */
+static void decode_pdu(GString *line, const guchar *pdu, guint len)
+{
+	guint i;
+
+	switch(pdu[0])
+	{
+	case 0x01:
+	case 0x02:
+	case 0x03:
+	case 0x04:
+		if(len == 5)
+		{
+			g_string_append_printf(line, _("  start %u count %u"), WORD(pdu + 1), WORD(pdu + 3));
+			return;
+		}
+		if(len >= 2 && len == 2u + pdu[1])
+		{
+			g_string_append_printf(line, _("  %u bytes:"), pdu[1]);
+			if(pdu[0] >= 0x03)
+				for(i = 2; i + 1 < len; i += 2)
+					g_string_append_printf(line, " %04X", WORD(pdu + i));
+			else
+				for(i = 2; i < len; i++)
+					g_string_append_printf(line, " %02X", pdu[i]);
+			return;
+		}
+		break;
+	case 0x05:
+		if(len == 5)
+		{
+			g_string_append_printf(line, _("  coil %u %s"), WORD(pdu + 1),
+			                       WORD(pdu + 3) == 0xFF00 ? "ON" :
+			                       WORD(pdu + 3) == 0x0000 ? "OFF" : "?");
+			return;
+		}
+		break;
+	case 0x06:
+		if(len == 5)
+		{
+			g_string_append_printf(line, _("  register %u = %04X (%u)"),
+			                       WORD(pdu + 1), WORD(pdu + 3), WORD(pdu + 3));
+			return;
+		}
+		break;
+	case 0x0F:
+	case 0x10:
+		if(len == 5)
+		{
+			g_string_append_printf(line, _("  start %u count %u"), WORD(pdu + 1), WORD(pdu + 3));
+			return;
+		}
+		if(len >= 6 && len == 6u + pdu[5])
+		{
+			g_string_append_printf(line, _("  start %u count %u:"), WORD(pdu + 1), WORD(pdu + 3));
+			if(pdu[0] == 0x10)
+				for(i = 6; i + 1 < len; i += 2)
+					g_string_append_printf(line, " %04X", WORD(pdu + i));
+			else
+				for(i = 6; i < len; i++)
+					g_string_append_printf(line, " %02X", pdu[i]);
+			return;
+		}
+		break;
+	default:
+		break;
+	}
+
+	/* Anything else is shown as it is */
+	if(len > 1)
+	{
+		g_string_append(line, " ");
+		for(i = 1; i < len; i++)
+			g_string_append_printf(line, " %02X", pdu[i]);
+	}
+}
+
+static void show_frame(const guchar *data, guint len, gint64 start)
+{
+	GString *line;
+	GDateTime *now;
+	const gchar *colour = NULL;
+	gchar *time;
+	gint64 wall;
+	guint i;
+
+	line = g_string_sized_new(128);
+
+	/* Monotonic read time back to the wall clock */
+	wall = g_get_real_time() - g_get_monotonic_time() + start;
+	now = g_date_time_new_from_unix_local(wall / G_USEC_PER_SEC);
+	time = g_date_time_format(now, "%T");
+	g_string_append_printf(line, "%s.%03u ", time, (guint)(wall % G_USEC_PER_SEC / 1000));
+	g_free(time);
+	g_date_time_unref(now);
+
+	if(last_frame != 0)
+		g_string_append_printf(line, "%+9.1f ms  ", (start - last_frame) / 1000.0);
+	else
+		g_string_append(line, "             ");
+	last_frame = start;
+
+	modbus_stats.frames++;
+
+	if(len < 4)
+	{
+		colour = SGR_ERROR;
+		modbus_stats.crc_errors++;
+		g_string_append(line, _("short frame:"));
+		for(i = 0; i < len; i++)
+			g_string_append_printf(line, " %02X", data[i]);
+	}
+	else if(modbus_crc16(data, len) != 0)
+	{
+		colour = SGR_ERROR;
+		modbus_stats.crc_errors++;
+		g_string_append_printf(line, _("CRC error (%04X expected):"),
+		                       GUINT16_SWAP_LE_BE(modbus_crc16(data, len - 2)));
+		for(i = 0; i < len; i++)
+			g_string_append_printf(line, " %02X", data[i]);
+	}
+	else
+	{
+		g_string_append_printf(line, "%3u  %02X %s", data[0], data[1] & 0x7F, function_name(data[1] & 0x7F));
+
+		if(data[1] & 0x80)
+		{
+			colour = SGR_EXCEPTION;
+			modbus_stats.exceptions++;
+			g_string_append_printf(line, _("  exception %02X %s"), data[2], exception_name(data[2]));
+		}
+		else
+			decode_pdu(line, data + 1, len - 3);
+	}
+
+	g_string_append(line, "\r\n");
+	log_chars(line->str, line->len);
+
+	if(colour != NULL)
+		vte_terminal_feed(VTE_TERMINAL(display), colour, strlen(colour));
+	vte_terminal_feed(VTE_TERMINAL(display), line->str, line->len);
+	if(colour != NULL)
+		vte_terminal_feed(VTE_TERMINAL(display), SGR_RESET, strlen(SGR_RESET));
+
+	g_string_free(line, TRUE);
+}
+
+static void frame_flush(void)
+{
+	guint start = 0, len;
+	gint64 byte_time = get_port_char_time();
+
+	while(start < frame_len)
+	{
+		len = frame_len - start;
+		if(modbus_crc16(frame + start, len) != 0)
+		{
+			len = frame_split(frame + start, len);
+			if(len < frame_len - start)
+				modbus_stats.merged++;
+		}
+		show_frame(frame + start, len, frame_start + start * byte_time);
+		start += len;
+	}
+
+	frame_len = 0;
+}
+
+/* The last frame is only known to be complete after a silence */
+static gboolean frame_timeout(gpointer data)
+{
+	if(frame_len == 0)
+	{
+		flush_timer = 0;
+		return FALSE;
+	}
+
+	if(g_get_monotonic_time() - last_rx < frame_gap())
+		return TRUE;
+
+	frame_flush();
+	flush_timer = 0;
+	return FALSE;
+}
+
+void put_modbus(const gchar *string, guint size)
+{
+	gint64 byte_time, now, first;
+	guint i;
+
+	if(size == 0)
+		return;
+
+	if(!crc_table_ready)
+		crc_table_init();
+
+	/* Data read from the port is stamped by Lis_port(), local echo is not */
+	now = serial_rx_time ? serial_rx_time : g_get_monotonic_time();
+	byte_time = get_port_char_time();
+	first = now - size * byte_time;
+
+	if(frame_len > 0 && first - last_rx >= frame_gap())
+		frame_flush();
+
+	for(i = 0; i < size; i++)
+	{
+		if(frame_len == MODBUS_MAX_FRAME)
+			frame_flush();
+		if(frame_len == 0)
+			frame_start = first + i * byte_time;
+		frame[frame_len++] = string[i];
+	}
+	last_rx = now;
+
+	if(flush_timer == 0)
+		flush_timer = g_timeout_add(MAX(1, frame_gap() / 1000), frame_timeout, NULL);
+}
+
+void modbus_reset(void)
+{
+	if(flush_timer != 0)
+		g_source_remove(flush_timer);
+	flush_timer = 0;
+	frame_len = 0;
+	last_rx = 0;
+	last_frame = 0;
+}
+
+gchar *modbus_statistics(void)
+{
+	if(modbus_stats.frames == 0)
+		return g_strdup("");
+
+	return g_strdup_printf(_("Modbus frames: %u, CRC errors: %u, exceptions: %u, merged: %u\n"),
+	                       modbus_stats.frames, modbus_stats.crc_errors,
+	                       modbus_stats.exceptions, modbus_stats.merged);
+}
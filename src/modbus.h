@@ -0,0 +1,25 @@
+/***********************************************************************/
+/* modbus.h                                                            */
+/* --------                                                            */
+/*                           GTKTerm Software                          */
+/*                                 (c)                                 */
+/*                                                                     */
+/* ------------------------------------------------------------------- */
+/*                                                                     */
+/*   Purpose                                                           */
+/*      Modbus RTU decoder for the received data                       */
+/*      - Header file -                                                */
+/*                                                                     */
+/***********************************************************************/
+
+#ifndef MODBUS_H_
+#define MODBUS_H_
+
+#define MODBUS_MAX_FRAME 256
+
+guint16 modbus_crc16(const guchar *, gsize);
+void modbus_reset(void);
+void put_modbus(const gchar *, guint);
+gchar *modbus_statistics(void);
+
+#endif
@@ -34,6 +34,10 @@
 #include <limits.h>
 #include <errno.h>
 #include <locale.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 
 #include "parsecfg.h"
 #include "i18n.h"
@@ -52,6 +56,13 @@ static char *parse_word(char *ptr, char **word, cfgKeywordValue word_type);
 static int store_value(cfgStruct cfg[], const char *parameter, const char *value, cfgFileType type, int section);
 static int parse_ini(const char *file, FILE *fp, char *ptr, cfgStruct cfg[], int *line, int *section);
 static int alloc_for_new_section(cfgStruct cfg[], int *section);
+static void free_section_values(cfgStruct cfg[], int section);
+static void free_all_sections(cfgStruct cfg[]);
+
+static unsigned int section_hash(const char *name);
+static void section_index_reset(void);
+static void section_index_add(int num);
+static int section_index_lookup(const char *name);
 
 static char *get_single_line_without_first_spaces(FILE *fp, char **gotstr, int *line);
 static char *rm_first_spaces(char *ptr);
@@ -69,6 +80,13 @@ static int fetch_ini(const char *file, FILE *fp, char *parameter_name, void *res
 
 static char **parsecfg_section_name = NULL;
 static int parsecfg_maximum_section;
+static int parsecfg_section_capacity;
+
+/* open addressing table of section numbers (+1, 0 is empty),
+   hashed on the case folded section name */
+static int *parsecfg_section_index = NULL;
+static unsigned int parsecfg_section_index_size;
+static unsigned int parsecfg_section_index_used;
 
 
 /*************************************************************/
@@ -115,6 +133,11 @@ int cfgParse(const char *file, cfgStruct cfg[], cfgFileType type)
 		return (-1);
 	}
 
+	if (type == CFG_INI)
+	{
+		free_all_sections(cfg);
+	}
+
 	while ((ptr = get_single_line_without_first_spaces(fp, &line_buf, &line)) != NULL)
 	{
 		switch (type)
@@ -158,16 +181,53 @@ int cfgParse(const char *file, cfgStruct cfg[], cfgFileType type)
                           + CFG_INI ..... Windows INI-like file
               max_section ... the maximum number of sections
                               (if type is CFG_INI, this arg is ignored)
+              The data is written to a temporary file next to
+              the configuration file which then replaces it, so
+              a failed write never leaves a truncated file.
+              A symbolic link is followed and the file keeps
+              its mode.
    OUTPUT     0 on success and -1 on error
    -------------------------------------------------- */
 int cfgDump(const char *file, cfgStruct cfg[], cfgFileType type, int max_section)
 {
 	FILE *fp;
+	int fd;
 	int retcode;
+	char *tmp_file;
+	char *target;
+	struct stat st;
 
-	fp = fopen(file, "w");
-	if (fp == NULL)
+	/* The file a link points to is replaced, not the link */
+	if ((target = realpath(file, NULL)) == NULL && (target = strdup(file)) == NULL)
+	{
+		cfgFatal(CFG_MEM_ALLOC_FAIL, file, 0, NULL);
+		return (-1);
+	}
+
+	if ((tmp_file = malloc(strlen(target) + sizeof(".XXXXXX"))) == NULL)
+	{
+		free(target);
+		cfgFatal(CFG_MEM_ALLOC_FAIL, file, 0, NULL);
+		return (-1);
+	}
+	strcpy(tmp_file, target);
+	strcat(tmp_file, ".XXXXXX");
+
+	/* Created like a new file, under the umask; an existing file keeps its mode */
+	fd = g_mkstemp_full(tmp_file, O_WRONLY, 0666);
+	if (fd != -1 && stat(target, &st) == 0)
 	{
+		fchmod(fd, st.st_mode & 07777);
+	}
+	if (fd == -1 || (fp = fdopen(fd, "w")) == NULL)
+	{
+		if (fd != -1)
+		{
+			close(fd);
+			unlink(tmp_file);
+		}
+		free(tmp_file);
+		free(target);
 		cfgFatal(CFG_CREATE_FAIL, file, 0, NULL);
 		return (-1);
 	}
@@ -182,11 +242,32 @@ int cfgDump(const char *file, cfgStruct cfg[], cfgFileType type, int max_section
 		break;
 	default:
 		fclose(fp);
+		unlink(tmp_file);
+		free(tmp_file);
+		free(target);
 		cfgFatal(CFG_INTERNAL_ERROR, file, 0, NULL);
 		return (-1);
 	}
 
-	fclose(fp);
+	if (fflush(fp) != 0 || fsync(fileno(fp)) != 0)
+	{
+		retcode = -1;
+	}
+	if (fclose(fp) != 0)
+	{
+		retcode = -1;
+	}
+	if (retcode == 0 && rename(tmp_file, target) != 0)
+	{
+		retcode = -1;
+	}
+	if (retcode != 0)
+	{
+		unlink(tmp_file);
+		cfgFatal(CFG_CREATE_FAIL, file, 0, NULL);
+	}
+	free(tmp_file);
+	free(target);
 	return (retcode);
 }
 
@@ -251,16 +332,7 @@ int fetchVarFromCfgFile(const char *file, char *parameter_name, void *result_val
    -------------------------------------------------- */
 int cfgSectionNameToNumber(const char *name)
 {
-	int i;
-
-	for (i = 0; i < parsecfg_maximum_section; i++)
-	{
-		if (strcasecmp(name, parsecfg_section_name[i]) == 0)
-		{
-			return (i);
-		}
-	}
-	return (-1);
+	return (section_index_lookup(name));
 }
 
 
@@ -304,8 +376,78 @@ int cfgAllocForNewSection(cfgStruct cfg[], const char *name)
 	}
 	parsecfg_maximum_section = section + 1;
 
-	parsecfg_section_name = realloc(parsecfg_section_name, sizeof(char *) * parsecfg_maximum_section);
 	parsecfg_section_name[parsecfg_maximum_section - 1] = strdup(name);
+	section_index_add(parsecfg_maximum_section - 1);
+	return (parsecfg_maximum_section);
+}
+
+
+/* --------------------------------------------------
+   NAME       cfgRemoveSection
+   FUNCTION   remove a section from the parsed data,
+              following sections are renumbered
+   INPUT      cfg ... array of possible variables
+              name .. name of the section to remove
+   OUTPUT     the maximum number of sections
+              -1 if there is no such section
+   -------------------------------------------------- */
+int cfgRemoveSection(cfgStruct cfg[], const char *name)
+{
+	int num;
+	int section;
+	int count;
+	size_t size;
+	char *base;
+
+	if ((section = section_index_lookup(name)) == -1)
+	{
+		return (-1);
+	}
+	free_section_values(cfg, section);
+	count = parsecfg_maximum_section - section - 1;
+
+	for (num = 0; cfg[num].type != CFG_END; num++)
+	{
+		switch (cfg[num].type)
+		{
+		case CFG_BOOL:
+		case CFG_INT:
+		case CFG_UINT:
+			size = sizeof(int);
+			break;
+		case CFG_LONG:
+		case CFG_ULONG:
+			size = sizeof(long);
+			break;
+		case CFG_STRING:
+			size = sizeof(char *);
+			break;
+		case CFG_STRING_LIST:
+			size = sizeof(cfgList *);
+			break;
+		case CFG_FLOAT:
+			size = sizeof(float);
+			break;
+		case CFG_DOUBLE:
+			size = sizeof(double);
+			break;
+		default:
+			return (-1);
+		}
+		base = *(char **) (cfg[num].value);
+		memmove(base + section * size, base + (section + 1) * size, count * size);
+	}
+
+	free(parsecfg_section_name[section]);
+	memmove(&parsecfg_section_name[section], &parsecfg_section_name[section + 1], count * sizeof(char *));
+	parsecfg_maximum_section--;
+
+	/* section numbers have shifted, rebuild the index */
+	section_index_reset();
+	for (num = 0; num < parsecfg_maximum_section; num++)
+	{
+		section_index_add(num);
+	}
 	return (parsecfg_maximum_section);
 }
 
@@ -886,7 +1028,6 @@ static int parse_ini(const char *file, FILE *fp, char *ptr, cfgStruct cfg[], int
 	int parameter_line;
 	char *value;
 	int error_code;
-	int i;
 
 	if (*ptr == '[')
 	{
@@ -894,21 +1035,19 @@ static int parse_ini(const char *file, FILE *fp, char *ptr, cfgStruct cfg[], int
 		{
 			return (error_code);
 		}
+		parsecfg_maximum_section = *section;
 		ptr = rm_first_spaces(ptr + 1);
 
-		parsecfg_section_name = realloc(parsecfg_section_name, sizeof(char *) * (*section + 1));
-
 		if ((ptr = parse_word(ptr, &parsecfg_section_name[*section], CFG_SECTION)) == NULL)
 		{
 			return (CFG_SYNTAX_ERROR);
 		}
-		for (i = 0; i < *section; i++)
+		if (section_index_lookup(parsecfg_section_name[*section]) != -1)
 		{
-			if (strcasecmp(parsecfg_section_name[*section], parsecfg_section_name[i]) == 0)
-			{
-				return (CFG_USED_SECTION);
-			}
+			return (CFG_USED_SECTION);
 		}
+		section_index_add(*section);
+		parsecfg_maximum_section = *section + 1;
 		ptr = rm_first_spaces(ptr + 1);
 		if (*ptr != '\0' && *ptr != '#')
 		{
@@ -961,6 +1100,8 @@ static int parse_ini(const char *file, FILE *fp, char *ptr, cfgStruct cfg[], int
 /* --------------------------------------------------
    NAME       alloc_for_new_section
    FUNCTION   allocate memory for new section
+              (arrays grow geometrically, so adding
+              many sections stays linear)
    INPUT      cfg ....... array of possible variables
               section ... pointer to current section number
    OUTPUT     error code
@@ -968,9 +1109,33 @@ static int parse_ini(const char *file, FILE *fp, char *ptr, cfgStruct cfg[], int
 static int alloc_for_new_section(cfgStruct cfg[], int *section)
 {
 	int num;
+	int capacity;
+	int fresh;
 	void *ptr;
 
 	(*section)++;
+	fresh = (parsecfg_section_capacity == 0);
+	if (fresh)
+	{
+		parsecfg_section_name = NULL;
+		section_index_reset();
+	}
+
+	if (*section < parsecfg_section_capacity)
+	{
+		capacity = parsecfg_section_capacity;
+	}
+	else
+	{
+		capacity = parsecfg_section_capacity ? parsecfg_section_capacity * 2 : 16;
+		if ((ptr = realloc(parsecfg_section_name, sizeof(char *) * capacity)) == NULL)
+		{
+			return (CFG_MEM_ALLOC_FAIL);
+		}
+		parsecfg_section_name = ptr;
+	}
+	parsecfg_section_name[*section] = NULL;
+
 	for (num = 0; cfg[num].type != CFG_END; num++)
 	{
 		switch (cfg[num].type)
@@ -978,15 +1143,18 @@ static int alloc_for_new_section(cfgStruct cfg[], int *section)
 		case CFG_BOOL:
 		case CFG_INT:
 		case CFG_UINT:
-			if (*section == 0)
+			if (fresh)
 			{
 				*(int **) (cfg[num].value) = NULL;
 			}
-			if ((ptr = realloc(*(int **) (cfg[num].value), sizeof(int) * (*section + 1))) == NULL)
+			if (capacity != parsecfg_section_capacity)
 			{
-				return (CFG_MEM_ALLOC_FAIL);
+				if ((ptr = realloc(*(int **) (cfg[num].value), sizeof(int) * capacity)) == NULL)
+				{
+					return (CFG_MEM_ALLOC_FAIL);
+				}
+				*(int **) (cfg[num].value) = ptr;
 			}
-			*(int **) (cfg[num].value) = ptr;
 			if (cfg[num].type == CFG_BOOL)
 			{
 				*(*((int **) (cfg[num].value)) + *section) = -1;
@@ -999,67 +1167,82 @@ static int alloc_for_new_section(cfgStruct cfg[], int *section)
 
 		case CFG_LONG:
 		case CFG_ULONG:
-			if (*section == 0)
+			if (fresh)
 			{
 				*(long **) (cfg[num].value) = NULL;
 			}
-			if ((ptr = realloc(*(long **) (cfg[num].value), sizeof(long) * (*section + 1))) == NULL)
+			if (capacity != parsecfg_section_capacity)
 			{
-				return (CFG_MEM_ALLOC_FAIL);
+				if ((ptr = realloc(*(long **) (cfg[num].value), sizeof(long) * capacity)) == NULL)
+				{
+					return (CFG_MEM_ALLOC_FAIL);
+				}
+				*(long **) (cfg[num].value) = ptr;
 			}
-			*(long **) (cfg[num].value) = ptr;
 			*(*((long **) (cfg[num].value)) + *section) = 0;
 			break;
 
 		case CFG_STRING:
-			if (*section == 0)
+			if (fresh)
 			{
 				*(char ***) (cfg[num].value) = NULL;
 			}
-			if ((ptr = realloc(*(char ***) (cfg[num].value), sizeof(char *) * (*section + 1))) == NULL)
+			if (capacity != parsecfg_section_capacity)
 			{
-				return (CFG_MEM_ALLOC_FAIL);
+				if ((ptr = realloc(*(char ***) (cfg[num].value), sizeof(char *) * capacity)) == NULL)
+				{
+					return (CFG_MEM_ALLOC_FAIL);
+				}
+				*(char ***) (cfg[num].value) = ptr;
 			}
-			*(char ***) (cfg[num].value) = ptr;
 			*(*(char ***) (cfg[num].value) + *section) = NULL;
 			break;
 
 		case CFG_STRING_LIST:
-			if (*section == 0)
+			if (fresh)
 			{
 				*(cfgList ***) (cfg[num].value) = NULL;
 			}
-			if ((ptr = realloc(*(cfgList ***) (cfg[num].value), sizeof(cfgList *) * (*section + 1))) == NULL)
+			if (capacity != parsecfg_section_capacity)
 			{
-				return (CFG_MEM_ALLOC_FAIL);
+				if ((ptr = realloc(*(cfgList ***) (cfg[num].value), sizeof(cfgList *) * capacity)) == NULL)
+				{
+					return (CFG_MEM_ALLOC_FAIL);
+				}
+				*(cfgList ***) (cfg[num].value) = ptr;
 			}
-			*(cfgList ***) (cfg[num].value) = ptr;
 			*(*(cfgList ***) (cfg[num].value) + *section) = NULL;
 			break;
 
 		case CFG_FLOAT:
-			if (*section == 0)
+			if (fresh)
 			{
 				*(float **) (cfg[num].value) = NULL;
 			}
-			if ((ptr = realloc(*(float **) (cfg[num].value), sizeof(float) * (*section + 1))) == NULL)
+			if (capacity != parsecfg_section_capacity)
 			{
-				return (CFG_MEM_ALLOC_FAIL);
+				if ((ptr = realloc(*(float **) (cfg[num].value), sizeof(float) * capacity)) == NULL)
+				{
+					return (CFG_MEM_ALLOC_FAIL);
+				}
+				*(float **) (cfg[num].value) = ptr;
 			}
-			*(float **) (cfg[num].value) = ptr;
 			*(*((float **) (cfg[num].value)) + *section) = 0;
 			break;
 
 		case CFG_DOUBLE:
-			if (*section == 0)
+			if (fresh)
 			{
 				*(double **) (cfg[num].value) = NULL;
 			}
-			if ((ptr = realloc(*(double **) (cfg[num].value), sizeof(double) * (*section + 1))) == NULL)
+			if (capacity != parsecfg_section_capacity)
 			{
-				return (CFG_MEM_ALLOC_FAIL);
+				if ((ptr = realloc(*(double **) (cfg[num].value), sizeof(double) * capacity)) == NULL)
+				{
+					return (CFG_MEM_ALLOC_FAIL);
+				}
+				*(double **) (cfg[num].value) = ptr;
 			}
-			*(double **) (cfg[num].value) = ptr;
 			*(*((double **) (cfg[num].value)) + *section) = 0;
 			break;
 
@@ -1067,10 +1250,199 @@ static int alloc_for_new_section(cfgStruct cfg[], int *section)
 			return (CFG_INTERNAL_ERROR);
 		}
 	}
+	parsecfg_section_capacity = capacity;
 	return (CFG_NO_ERROR);
 }
 
 
+/* --------------------------------------------------
+   NAME       free_section_values
+   FUNCTION   free the strings and lists stored in a section
+   INPUT      cfg ....... array of possible variables
+              section ... section number
+   OUTPUT     none
+   -------------------------------------------------- */
+static void free_section_values(cfgStruct cfg[], int section)
+{
+	int num;
+	cfgList *l, *next;
+
+	for (num = 0; cfg[num].type != CFG_END; num++)
+	{
+		switch (cfg[num].type)
+		{
+		case CFG_STRING:
+			free((*(char ***) (cfg[num].value))[section]);
+			(*(char ***) (cfg[num].value))[section] = NULL;
+			break;
+		case CFG_STRING_LIST:
+			for (l = (*(cfgList ***) (cfg[num].value))[section]; l != NULL; l = next)
+			{
+				next = l->next;
+				free(l->str);
+				free(l);
+			}
+			(*(cfgList ***) (cfg[num].value))[section] = NULL;
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+
+/* --------------------------------------------------
+   NAME       free_all_sections
+   FUNCTION   release the data of a previous parse
+   INPUT      cfg ... array of possible variables
+   OUTPUT     none
+   -------------------------------------------------- */
+static void free_all_sections(cfgStruct cfg[])
+{
+	int num;
+	int section;
+
+	if (parsecfg_section_capacity == 0)
+	{
+		parsecfg_maximum_section = 0;
+		return;
+	}
+
+	for (section = 0; section < parsecfg_maximum_section; section++)
+	{
+		free_section_values(cfg, section);
+		free(parsecfg_section_name[section]);
+	}
+	for (num = 0; cfg[num].type != CFG_END; num++)
+	{
+		free(*(void **) (cfg[num].value));
+		*(void **) (cfg[num].value) = NULL;
+	}
+	free(parsecfg_section_name);
+	parsecfg_section_name = NULL;
+	parsecfg_section_capacity = 0;
+	parsecfg_maximum_section = 0;
+	section_index_reset();
+}
+
+
+/* --------------------------------------------------
+   NAME       section_hash
+   FUNCTION   case insensitive hash of a section name
+   INPUT      name ... section name
+   OUTPUT     hash value
+   -------------------------------------------------- */
+static unsigned int section_hash(const char *name)
+{
+	unsigned int hash = 2166136261u;
+
+	while (*name)
+	{
+		hash ^= (unsigned char)tolower((unsigned char)*name++);
+		hash *= 16777619u;
+	}
+	return (hash);
+}
+
+
+/* --------------------------------------------------
+   NAME       section_index_reset
+   FUNCTION   empty the section name index
+   INPUT      none
+   OUTPUT     none
+   -------------------------------------------------- */
+static void section_index_reset(void)
+{
+	free(parsecfg_section_index);
+	parsecfg_section_index = NULL;
+	parsecfg_section_index_size = 0;
+	parsecfg_section_index_used = 0;
+}
+
+
+/* --------------------------------------------------
+   NAME       section_index_add
+   FUNCTION   add a section to the section name index
+   INPUT      num ... section number, its name must be set
+   OUTPUT     none
+   -------------------------------------------------- */
+static void section_index_add(int num)
+{
+	unsigned int i, mask;
+	int *old_index;
+	unsigned int old_size;
+
+	/* keep the load factor under one half */
+	if ((parsecfg_section_index_used + 1) * 2 > parsecfg_section_index_size)
+	{
+		old_index = parsecfg_section_index;
+		old_size = parsecfg_section_index_size;
+
+		parsecfg_section_index_size = old_size ? old_size * 2 : 64;
+		parsecfg_section_index = calloc(parsecfg_section_index_size, sizeof(int));
+		parsecfg_section_index_used = 0;
+		if (parsecfg_section_index == NULL)
+		{
+			/* lookups fall back to a linear scan */
+			parsecfg_section_index_size = 0;
+			free(old_index);
+			return;
+		}
+		for (i = 0; i < old_size; i++)
+		{
+			if (old_index[i] != 0)
+			{
+				section_index_add(old_index[i] - 1);
+			}
+		}
+		free(old_index);
+	}
+
+	mask = parsecfg_section_index_size - 1;
+	for (i = section_hash(parsecfg_section_name[num]) & mask; parsecfg_section_index[i] != 0; i = (i + 1) & mask)
+		;
+	parsecfg_section_index[i] = num + 1;
+	parsecfg_section_index_used++;
+}
+
+
+/* --------------------------------------------------
+   NAME       section_index_lookup
+   FUNCTION   find a section number by its name
+   INPUT      name ... section name
+   OUTPUT     section number (0,1,2,...)
+              if no matching, return -1
+   -------------------------------------------------- */
+static int section_index_lookup(const char *name)
+{
+	unsigned int i, mask;
+	int num;
+
+	if (parsecfg_section_index == NULL)
+	{
+		for (num = 0; num < parsecfg_maximum_section; num++)
+		{
+			if (parsecfg_section_name[num] != NULL && strcasecmp(name, parsecfg_section_name[num]) == 0)
+			{
+				return (num);
+			}
+		}
+		return (-1);
+	}
+
+	mask = parsecfg_section_index_size - 1;
+	for (i = section_hash(name) & mask; parsecfg_section_index[i] != 0; i = (i + 1) & mask)
+	{
+		num = parsecfg_section_index[i] - 1;
+		if (strcasecmp(name, parsecfg_section_name[num]) == 0)
+		{
+			return (num);
+		}
+	}
+	return (-1);
+}
+
+
 /* --------------------------------------------------
    NAME       rm_first_spaces
    FUNCTION   remove lead-off spaces and tabs in the string
@@ -111,6 +111,7 @@ int fetchVarFromCfgFile(const char *file, char *parameter_name, void *result_val
 int cfgSectionNameToNumber(const char *name);
 char *cfgSectionNumberToName(int num);
 int cfgAllocForNewSection(cfgStruct cfg[], const char *name);
+int cfgRemoveSection(cfgStruct cfg[], const char *name);
 int cfgStoreValue(cfgStruct cfg[], const char *parameter, const char *value, cfgFileType type, int section);
 
 #ifdef __cplusplus
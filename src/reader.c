@@ -0,0 +1,317 @@
+/***********************************************************************/
+/* reader.c                                                            */
+/* --------                                                            */
+/*                           GTKTerm Software                          */
+/*                                 (c)                                 */
+/*                                                                     */
+/* ------------------------------------------------------------------- */
+/*                                                                     */
+/*   Purpose                                                           */
+/*      Reception of the serial port in a thread of its own            */
+/*      - The thread reads as soon as the port has data, whatever      */
+/*        the main loop is busy with, and stamps each read             */
+/*      - The reads are handed to the main loop in batches, through    */
+/*        a bounded queue: when full, the driver buffer and the flow   */
+/*        control hold the data back                                   */
+/*                                                                     */
+/***********************************************************************/
+
+#include <glib.h>
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "serial.h"
+#include "reader.h"
+
+#include <config.h>
+#include <glib/gi18n.h>
+
+#define READER_BATCH (64 * 1024)	/* bytes handed over at once at most */
+#define READER_READ_MIN 256		/* bytes handed over at once at least */
+#define READER_COALESCE_MAX 100000	/* us a batch may wait for more bytes */
+#define READER_READS 64			/* reads in a batch at most */
+#define READER_QUEUE_MAX 32		/* batches waiting for the main loop */
+#define READER_PRIORITY 10		/* as the port watch had */
+
+typedef struct
+{
+	guint size;
+	guint count;
+	guint sizes[READER_READS];	/* of each read, in order */
+	gint64 times[READER_READS];	/* when each read returned */
+	gchar data[];
+} reader_batch_t;
+
+static GThread *thread = NULL;
+static int port_fd = -1;
+static gchar *port_name = NULL;
+static int wake_pipe[2] = {-1, -1};	/* wakes the thread up to stop */
+static void (*consume_func)(gchar *, guint, gint64) = NULL;
+static gint64 coalesce = 0;		/* us, 0 to hand over at once */
+static gint expected = READER_READ_MIN;	/* bytes a batch brings, averaged */
+
+static GMutex lock;
+static GQueue batches = G_QUEUE_INIT;
+static GCond space;
+static gboolean stopping = FALSE;
+static gboolean scheduled = FALSE;	/* consume() is in the main loop */
+
+static struct {
+	guint64 batches;
+	guint64 bytes;
+	guint64 reads;
+	gint64 started;
+	guint queued_bytes;
+	guint peak;			/* most batches waiting */
+	gint64 latency;			/* read to consumed, all batches */
+	gint64 latency_max;
+	guint waits;			/* times the queue was full */
+} stats;
+
+static gboolean consume(gpointer data);
+
+static void hand_over(reader_batch_t *batch)
+{
+	g_mutex_lock(&lock);
+	if(batches.length >= READER_QUEUE_MAX && !stopping)
+	{
+		stats.waits++;
+		while(batches.length >= READER_QUEUE_MAX && !stopping)
+			g_cond_wait(&space, &lock);
+	}
+
+	g_queue_push_tail(&batches, batch);
+	stats.reads += batch->count;
+	stats.queued_bytes += batch->size;
+	stats.peak = MAX(stats.peak, batches.length);
+	if(!scheduled)
+	{
+		scheduled = TRUE;
+		g_idle_add_full(READER_PRIORITY, consume, NULL, NULL);
+	}
+	g_mutex_unlock(&lock);
+}
+
+/* Room for what the last batches brought, whatever the rate */
+static guint batch_capacity(void)
+{
+	return CLAMP(2 * g_atomic_int_get(&expected), READER_READ_MIN, READER_BATCH);
+}
+
+static gpointer reader_thread(gpointer data)
+{
+	struct pollfd fds[2];
+	reader_batch_t *batch;
+	gint bytes_read;
+	gint64 now, first, wait;
+	guint capacity;
+	gint average;
+	gboolean done = FALSE;
+
+	while(!done)
+	{
+		fds[0].fd = port_fd;
+		fds[0].events = POLLIN;
+		fds[1].fd = wake_pipe[0];
+		fds[1].events = POLLIN;
+		if(poll(fds, 2, -1) == -1)
+		{
+			if(errno == EINTR)
+				continue;
+			break;
+		}
+		if(fds[1].revents != 0)
+			break;
+		/* Closed by the error watch of the main loop */
+		if(fds[0].revents & (POLLERR | POLLHUP | POLLNVAL))
+			done = TRUE;
+
+		/* Everything the driver has, in one batch */
+		capacity = batch_capacity();
+		batch = g_malloc(sizeof(reader_batch_t) + capacity);
+		batch->size = 0;
+		batch->count = 0;
+		first = 0;
+		while(batch->size < capacity && batch->count < READER_READS)
+		{
+			bytes_read = read(port_fd, batch->data + batch->size,
+			                  MIN(BUFFER_RECEPTION, capacity - batch->size));
+			if(bytes_read > 0)
+			{
+				now = g_get_monotonic_time();
+				if(first == 0)
+					first = now;
+				batch->sizes[batch->count] = bytes_read;
+				batch->times[batch->count] = now;
+				batch->size += bytes_read;
+				batch->count++;
+				continue;
+			}
+			if(bytes_read == -1 && errno == EINTR)
+				continue;
+			if(bytes_read == -1 && errno == EAGAIN)
+			{
+				/* A bounded delay for fewer wakeups: let more come in */
+				wait = first + coalesce - g_get_monotonic_time();
+				if(coalesce > 0 && first != 0 && wait > 0)
+				{
+					fds[0].revents = fds[1].revents = 0;
+					if(poll(fds, 2, (wait + 999) / 1000) == -1 && errno != EINTR)
+						break;
+					/* Asked to stop: hand over what came in */
+					if(fds[1].revents != 0)
+					{
+						done = TRUE;
+						break;
+					}
+					if(fds[0].revents & (POLLERR | POLLHUP | POLLNVAL))
+						done = TRUE;
+					continue;
+				}
+				break;
+			}
+			if(bytes_read == -1)
+				perror(port_name);
+			done = TRUE;
+			break;
+		}
+
+		/* A full batch doubles the next one, others tend to their size */
+		if(batch->size >= capacity)
+			average = capacity;
+		else
+			average = (3 * g_atomic_int_get(&expected) + batch->size) / 4;
+		g_atomic_int_set(&expected, average);
+
+		if(batch->size > 0)
+			hand_over(batch);
+		else
+			g_free(batch);
+	}
+
+	return NULL;
+}
+
+/* One batch a run, the main loop gets its turn between batches */
+static gboolean consume(gpointer data)
+{
+	reader_batch_t *batch;
+	gint64 latency;
+	guint i, offset;
+
+	g_mutex_lock(&lock);
+	batch = g_queue_pop_head(&batches);
+	if(batch == NULL)
+	{
+		scheduled = FALSE;
+		g_mutex_unlock(&lock);
+		return G_SOURCE_REMOVE;
+	}
+	stats.queued_bytes -= batch->size;
+	g_cond_signal(&space);
+	g_mutex_unlock(&lock);
+
+	latency = g_get_monotonic_time() - batch->times[0];
+	stats.batches++;
+	stats.bytes += batch->size;
+	stats.latency += latency;
+	stats.latency_max = MAX(stats.latency_max, latency);
+
+	for(i = 0, offset = 0; i < batch->count; offset += batch->sizes[i], i++)
+		consume_func(batch->data + offset, batch->sizes[i], batch->times[i]);
+	g_free(batch);
+
+	return G_SOURCE_CONTINUE;
+}
+
+/*
+ * Reads fd (name for the errors) in a thread, consume(data, size, time)
+ * gets each read in the main loop. Once data comes, the thread waits
+ * up to gather us for more before handing it over.
+ */
+void reader_start(int fd, const gchar *name, gint gather, void (*consume)(gchar *, guint, gint64))
+{
+	if(thread != NULL)
+		return;
+
+	if(pipe(wake_pipe) == -1)
+	{
+		perror("pipe");
+		return;
+	}
+
+	port_fd = fd;
+	g_free(port_name);
+	port_name = g_strdup(name);
+	consume_func = consume;
+	coalesce = CLAMP(gather, 0, READER_COALESCE_MAX);
+	g_atomic_int_set(&expected, READER_READ_MIN);
+	memset(&stats, 0, sizeof(stats));
+	stats.started = g_get_monotonic_time();
+	stopping = FALSE;
+
+	thread = g_thread_new("reader", reader_thread, NULL);
+}
+
+/* Nothing is read any more, what was read is consumed before */
+void reader_stop(void)
+{
+	if(thread == NULL)
+		return;
+
+	g_mutex_lock(&lock);
+	stopping = TRUE;
+	g_cond_broadcast(&space);
+	g_mutex_unlock(&lock);
+
+	if(write(wake_pipe[1], "", 1) == -1)
+		perror("pipe");
+	g_thread_join(thread);
+	thread = NULL;
+	close(wake_pipe[0]);
+	close(wake_pipe[1]);
+	wake_pipe[0] = wake_pipe[1] = -1;
+
+	while(consume(NULL) == G_SOURCE_CONTINUE)
+		;
+}
+
+gchar *reader_statistics(void)
+{
+	gchar *queued, *average, *read_size, *buffer, *text;
+	gdouble latency, seconds;
+	guint64 reads;
+	guint length;
+
+	if(stats.batches == 0)
+		return g_strdup("");
+
+	g_mutex_lock(&lock);
+	length = batches.length;
+	reads = stats.reads;
+	queued = g_format_size(stats.queued_bytes);
+	g_mutex_unlock(&lock);
+
+	average = g_format_size(stats.bytes / stats.batches);
+	latency = stats.latency / 1000.0 / stats.batches;
+	seconds = (g_get_monotonic_time() - stats.started) / 1000000.0;
+	/* Reads are counted when handed over, bytes when consumed: close enough */
+	read_size = g_format_size(reads ? stats.bytes / reads : 0);
+	buffer = g_format_size(batch_capacity());
+
+	text = g_strdup_printf(_("Receive queue: %u batches (%s), peak %u, full %u times\n"
+	                         "Receive batches: %s average, latency %.2f ms average, %.2f ms max\n"
+	                         "Port reads: %.0f per second, %s average, batch buffer %s\n"),
+	                       length, queued, stats.peak, stats.waits,
+	                       average, latency, stats.latency_max / 1000.0,
+	                       seconds > 0 ? reads / seconds : 0, read_size, buffer);
+	g_free(queued);
+	g_free(average);
+	g_free(read_size);
+	g_free(buffer);
+
+	return text;
+}
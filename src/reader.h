@@ -0,0 +1,22 @@
+/***********************************************************************/
+/* reader.h                                                            */
+/* --------                                                            */
+/*                           GTKTerm Software                          */
+/*                                 (c)                                 */
+/*                                                                     */
+/* ------------------------------------------------------------------- */
+/*                                                                     */
+/*   Purpose                                                           */
+/*      Reception of the serial port in a thread of its own            */
+/*      - Header file -                                                */
+/*                                                                     */
+/***********************************************************************/
+
+#ifndef READER_H_
+#define READER_H_
+
+void reader_start(int, const gchar *, gint, void (*)(gchar *, guint, gint64));
+void reader_stop(void);
+gchar *reader_statistics(void);
+
+#endif
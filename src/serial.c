@@ -34,12 +34,20 @@
 #include <string.h>
 #include <errno.h>
 #include <pwd.h>
+#include <stdlib.h>
 
 #include "term_config.h"
 #include "serial.h"
 #include "interface.h"
 #include "files.h"
 #include "buffer.h"
+#include "capture.h"
+#include "share.h"
+#include "control.h"
+#include "data_store.h"
+#include "reader.h"
+#include "transfer.h"
+#include "sniffer.h"
 #include "i18n.h"
 
 #include <config.h>
@@ -52,51 +60,95 @@
 
 struct termios termios_save;
 int serial_port_fd = -1;
+/* When the chunk being displayed was read, 0 outside of Lis_port() */
+gint64 serial_rx_time = 0;
 static unsigned int serial_port_speed;
 
-guint callback_handler_in, callback_handler_err;
+guint callback_handler_err;
 gboolean callback_activated = FALSE;
+static gboolean input_paused = FALSE;
+
+/* Transmit queue, drained by a G_IO_OUT watch when the port pushes back */
+static GByteArray *tx_queue;
+static guint tx_head;
+static guint callback_handler_out;
+static GIOChannel *tx_channel;
+
+static struct {
+	guint64 queued;		/* bytes accepted by Send_chars() */
+	guint64 written;	/* bytes accepted by the driver */
+	guint64 received;
+	guint64 discarded;	/* dropped on close or error */
+	guint peak;		/* largest queue length */
+	gint64 blocked_since;	/* monotonic µs, 0 when not blocked */
+	gint64 blocked_time;	/* total time spent with a full driver buffer */
+	gint64 opened;		/* when the port was opened */
+	guint errors;
+} port_stats;
+
+/* Time from a write to the first byte received after it */
+#define RESPONSE_MAX 1000000	/* us, what comes later is not an answer */
+
+static struct {
+	gint64 sent;		/* first byte written, 0 once answered */
+	guint count[2];		/* by low latency off, on */
+	gint64 total[2];
+	gint64 last;
+} response;
+
+/* What the low latency mode changed, given back on close */
+static struct {
+	gboolean serial_set;
+	int serial_flags;
+	gchar *timer_path;
+	gint timer;
+} latency_saved;
 
 extern struct configuration_port config;
 
-gboolean Lis_port(GIOChannel* src, GIOCondition cond, gpointer data)
-{
-	gint bytes_read;
-	static gchar c[BUFFER_RECEPTION];
-	guint i;
+static gboolean tx_drain(GIOChannel *src, GIOCondition cond, gpointer data);
 
-	bytes_read = BUFFER_RECEPTION;
+/* A read of the reader thread, in the main loop */
+static void rx_chunk(gchar *c, guint size, gint64 time)
+{
+	guint i, captured;
 
-	while(bytes_read == BUFFER_RECEPTION)
+	port_stats.received += size;
+	if(response.sent != 0 && time >= response.sent)
 	{
-		bytes_read = read(serial_port_fd, c, BUFFER_RECEPTION);
-		if(bytes_read > 0)
+		response.last = time - response.sent;
+		if(response.last <= RESPONSE_MAX)
 		{
-			put_chars(c, bytes_read, config.crlfauto, config.esc_clear_screen);
+			response.count[config.low_latency ? 1 : 0]++;
+			response.total[config.low_latency ? 1 : 0] += response.last;
+		}
+		response.sent = 0;
+	}
+
+	serial_rx_time = time;
+	share_chars(c, size);
+	control_chars(c, size);
+	/* A capture to file takes the data before the display */
+	captured = capture_active() ? capture_chars(c, size) : 0;
+	if(captured < size)
+	{
+		data_store_append(c + captured, size - captured, serial_rx_time, DATA_RX);
+		put_chars(c + captured, size - captured, config.crlfauto, config.esc_clear_screen);
+	}
+	serial_rx_time = 0;
 
-			if(config.car != -1 && waiting_for_char == TRUE)
+	if(config.car != -1 && waiting_for_char == TRUE)
+	{
+		for(i = 0; i < size; i++)
+		{
+			if(c[i] == config.car)
 			{
-				i = 0;
-				while(i < bytes_read)
-				{
-					if(c[i] == config.car)
-					{
-						waiting_for_char = FALSE;
-						add_input();
-						i = bytes_read;
-					}
-					i++;
-				}
+				waiting_for_char = FALSE;
+				add_input();
+				break;
 			}
 		}
-		else if(bytes_read == -1)
-		{
-			if(errno != EAGAIN)
-				perror(config.port);
-		}
 	}
-
-	return TRUE;
 }
 
 gboolean io_err(GIOChannel* src, GIOCondition cond, gpointer data)
@@ -105,10 +157,120 @@ gboolean io_err(GIOChannel* src, GIOCondition cond, gpointer data)
 	return TRUE;
 }
 
-int Send_chars(char *string, int length)
+static void rs485_begin(void)
+{
+	/* set RTS (start to send) */
+	Set_signals( 1 );
+	if( config.rs485_rts_time_before_transmit>0 )
+		usleep(config.rs485_rts_time_before_transmit*1000);
+}
+
+static void rs485_end(void)
+{
+	/* wait all chars are send */
+	tcdrain( serial_port_fd );
+	if( config.rs485_rts_time_after_transmit>0 )
+		usleep(config.rs485_rts_time_after_transmit*1000);
+	/* reset RTS (end of send, now receiving back) */
+	Set_signals( 1 );
+}
+
+static void tx_discard(void)
+{
+	if(callback_handler_out)
+	{
+		g_source_remove(callback_handler_out);
+		callback_handler_out = 0;
+	}
+	if(tx_queue != NULL)
+	{
+		port_stats.discarded += tx_queue->len - tx_head;
+		g_byte_array_set_size(tx_queue, 0);
+	}
+	tx_head = 0;
+	if(port_stats.blocked_since)
+	{
+		port_stats.blocked_time += g_get_monotonic_time() - port_stats.blocked_since;
+		port_stats.blocked_since = 0;
+	}
+}
+
+/* Write as much of the queue as the driver takes, -1 on a real error */
+static int tx_write(void)
+{
+	gint bytes_written;
+
+	while(tx_head < tx_queue->len)
+	{
+		bytes_written = write(serial_port_fd, tx_queue->data + tx_head, tx_queue->len - tx_head);
+		if(bytes_written > 0)
+		{
+			tx_head += bytes_written;
+			port_stats.written += bytes_written;
+			/* Still waiting for an answer, unless that one never came */
+			if(response.sent == 0 || g_get_monotonic_time() - response.sent > RESPONSE_MAX)
+				response.sent = g_get_monotonic_time();
+			continue;
+		}
+		if(bytes_written == -1 && errno == EINTR)
+			continue;
+		if(bytes_written == -1 && errno != EAGAIN)
+		{
+			port_stats.errors++;
+			perror(config.port);
+			return -1;
+		}
+		/* Output buffer full: flow control or a slow link */
+		if(!port_stats.blocked_since)
+			port_stats.blocked_since = g_get_monotonic_time();
+		return 0;
+	}
+
+	g_byte_array_set_size(tx_queue, 0);
+	tx_head = 0;
+	if(port_stats.blocked_since)
+	{
+		port_stats.blocked_time += g_get_monotonic_time() - port_stats.blocked_since;
+		port_stats.blocked_since = 0;
+	}
+	if( config.flux==3 )
+		rs485_end();
+
+	return 0;
+}
+
+static gboolean tx_drain(GIOChannel *src, GIOCondition cond, gpointer data)
 {
-	int bytes_written = 0;
+	if(tx_write() == -1)
+	{
+		tx_discard();
+		if( config.flux==3 )
+			Set_signals( 1 );
+		return FALSE;
+	}
+
+	/* Reclaim the space of what has been sent */
+	if(tx_head > BUFFER_EMISSION && tx_head * 2 > tx_queue->len)
+	{
+		g_byte_array_remove_range(tx_queue, 0, tx_head);
+		tx_head = 0;
+	}
+
+	if(tx_head < tx_queue->len)
+		return TRUE;
+
+	callback_handler_out = 0;
+	return FALSE;
+}
 
+/*
+ * Queue data for the port. Everything is accepted and sent in order,
+ * whatever the flow control does; what the driver does not take right
+ * away is written from the main loop when the port becomes writable.
+ * Returns the number of bytes accepted, or -1 on a write error.
+ */
+int Send_chars(char *string, int length)
+{
 	if(serial_port_fd == -1)
 		return 0;
 
@@ -116,94 +278,185 @@ int Send_chars(char *string, int length)
 	if(length == 0)
 		return 0;
 
+	if(tx_queue == NULL)
+		tx_queue = g_byte_array_sized_new(BUFFER_EMISSION);
+
 	/* RS485 half-duplex mode ? */
-	if( config.flux==3 )
+	if( config.flux==3 && tx_head == tx_queue->len )
+		rs485_begin();
+
+	g_byte_array_append(tx_queue, (guint8 *)string, length);
+	port_stats.queued += length;
+
+	if(callback_handler_out)
 	{
-		/* set RTS (start to send) */
-		Set_signals( 1 );
-		if( config.rs485_rts_time_before_transmit>0 )
-			usleep(config.rs485_rts_time_before_transmit*1000);
+		/* Already waiting for the port, keep the order */
+		if(tx_queue->len - tx_head > port_stats.peak)
+			port_stats.peak = tx_queue->len - tx_head;
+		return length;
 	}
 
-	bytes_written = write(serial_port_fd, string, length);
+	if(tx_write() == -1)
+	{
+		tx_discard();
+		if( config.flux==3 )
+			Set_signals( 1 );
+		return -1;
+	}
 
-	/* RS485 half-duplex mode ? */
-	if( config.flux==3 )
+	if(tx_head < tx_queue->len)
 	{
-		/* wait all chars are send */
-		tcdrain( serial_port_fd );
-		if( config.rs485_rts_time_after_transmit>0 )
-			usleep(config.rs485_rts_time_after_transmit*1000);
-		/* reset RTS (end of send, now receiving back) */
-		Set_signals( 1 );
+		if(tx_queue->len - tx_head > port_stats.peak)
+			port_stats.peak = tx_queue->len - tx_head;
+		callback_handler_out = g_io_add_watch_full(tx_channel,
+		                       10,
+		                       G_IO_OUT,
+		                       (GIOFunc)tx_drain,
+		                       NULL, NULL);
 	}
 
-	return bytes_written;
+	return length;
 }
 
-gboolean Config_port(void)
+/* Bytes accepted by Send_chars() but not yet written to the port */
+guint Send_chars_pending(void)
+{
+	if(tx_queue == NULL)
+		return 0;
+	return tx_queue->len - tx_head;
+}
+
+void get_port_counters(guint64 *sent, guint64 *received)
+{
+	*sent = port_stats.written;
+	*received = port_stats.received;
+}
+
+static gchar *format_bytes(guint64 bytes)
+{
+	return g_format_size_full(bytes, G_FORMAT_SIZE_IEC_UNITS);
+}
+
+gchar *get_port_statistics_string(void)
+{
+	gint64 now = g_get_monotonic_time();
+	gint64 blocked = port_stats.blocked_time;
+	gdouble seconds;
+	gchar *tx, *rx, *rate, *pending, *peak, *discarded, *reception, *answers, *msg, *text;
+
+	if(port_stats.blocked_since)
+		blocked += now - port_stats.blocked_since;
+
+	seconds = port_stats.opened ? (now - port_stats.opened) / 1000000.0 : 0;
+
+	tx = format_bytes(port_stats.written);
+	rx = format_bytes(port_stats.received);
+	rate = format_bytes(seconds > 0 ? port_stats.written / seconds : 0);
+	pending = format_bytes(Send_chars_pending());
+	peak = format_bytes(port_stats.peak);
+	discarded = format_bytes(port_stats.discarded);
+
+	msg = g_strdup_printf(_("Sent: %s (%s/s)\n"
+	                        "Received: %s\n"
+	                        "Transmit queue: %s, peak %s\n"
+	                        "Blocked by flow control: %.2f s\n"
+	                        "Discarded: %s, write errors: %u\n"),
+	                      tx, rate, rx, pending, peak,
+	                      blocked / 1000000.0,
+	                      discarded, port_stats.errors);
+	/* The reader thread and its queue */
+	reception = reader_statistics();
+	if(response.count[0] + response.count[1] > 0)
+		answers = g_strdup_printf(_("Response time: %.2f ms average over %u, with low latency %.2f ms over %u, last %.2f ms\n"),
+		                          response.count[0] ? response.total[0] / 1000.0 / response.count[0] : 0, response.count[0],
+		                          response.count[1] ? response.total[1] / 1000.0 / response.count[1] : 0, response.count[1],
+		                          response.last / 1000.0);
+	else
+		answers = g_strdup("");
+	text = g_strconcat(msg, reception, answers, NULL);
+
+	g_free(tx);
+	g_free(rx);
+	g_free(rate);
+	g_free(pending);
+	g_free(peak);
+	g_free(discarded);
+	g_free(reception);
+	g_free(answers);
+	g_free(msg);
+
+	return text;
+}
+
+/*
+ * Open a device with the settings of the configuration, NULL speed for
+ * the speed set. A tap only listens to a line: its flow control would
+ * eat the XON/XOFF it should show, or hold RTS for nothing.
+ */
+int serial_open_device(const gchar *device, gboolean tap, struct termios *saved, unsigned int *speed)
 {
 	struct termios termios_p;
 	gchar *msg = NULL;
-	unsigned int speed_margin;
+	unsigned int speed_margin, speed_set;
+	int fd;
 
-	Close_port();
+	fd = open(device, O_RDWR | O_NOCTTY | O_NDELAY);
 
-	serial_port_fd = open(config.port, O_RDWR | O_NOCTTY | O_NDELAY);
-
-	if(serial_port_fd == -1)
+	if(fd == -1)
 	{
 		msg = g_strdup_printf(_("Cannot open %s: %s\n"),
-		                      config.port, strerror_utf8(errno));
+		                      device, strerror_utf8(errno));
 		show_message(msg, MSG_ERR);
 		g_free(msg);
 
-		return FALSE;
+		return -1;
 	}
 
-	if (!isatty(serial_port_fd))
+	if (!isatty(fd))
 	{
-		Close_port();
+		close(fd);
 		msg = g_strdup_printf(_("%s is not a valid serial port\n"),
-				      config.port);
+				      device);
 		show_message(msg, MSG_ERR);
 		g_free(msg);
 
-		return FALSE;
+		return -1;
 	}
 
 	if(! config.disable_port_lock)
 	{
-	    if(flock(serial_port_fd, LOCK_EX | LOCK_NB) == -1)
+	    if(flock(fd, LOCK_EX | LOCK_NB) == -1)
 	    {
-		Close_port();
+		close(fd);
 		msg = g_strdup_printf(_("Cannot lock port! The serial port may currently be in use by another program.\n"));
 		show_message(msg, MSG_ERR);
 		g_free(msg);
 
-		return FALSE;
+		return -1;
 		}
 	}
 
 	/* Allow 1/3 bit times wrong by the end of the first stop bit
 	   to avoid failing due to rounding. */
 	speed_margin = config.vitesse/(3*(2U+config.bits+!!config.parite));
-	serial_port_speed = set_port_baudrate(config.vitesse, serial_port_fd);
+	speed_set = set_port_baudrate(config.vitesse, fd);
 
 	/* These comparisons handle integer wraparound correctly. */
-	if (serial_port_speed < config.vitesse - speed_margin ||
-	    serial_port_speed - speed_margin > config.vitesse)
+	if (speed_set < config.vitesse - speed_margin ||
+	    speed_set - speed_margin > config.vitesse)
 	{
-		Close_port();
+		close(fd);
 		msg = g_strdup_printf(_("Unable to set baud rate %u"),
 					config.vitesse);
 		show_message(msg, MSG_ERR);
 		g_free(msg);
-		return FALSE;
+		return -1;
 	}
+	if(speed != NULL)
+		*speed = speed_set;
 
-	tcgetattr(serial_port_fd, &termios_p);
-	memcpy(&termios_save, &termios_p, sizeof(struct termios));
+	tcgetattr(fd, &termios_p);
+	memcpy(saved, &termios_p, sizeof(struct termios));
 
 	switch(config.bits)
 	{
@@ -235,7 +488,7 @@ gboolean Config_port(void)
 		termios_p.c_cflag |= CSTOPB;
 	termios_p.c_cflag |= CREAD;
 	termios_p.c_iflag = IGNPAR | IGNBRK;
-	switch(config.flux)
+	switch(tap ? 0 : config.flux)
 	{
 	case 1:
 		termios_p.c_iflag |= IXON | IXOFF;
@@ -259,15 +512,140 @@ gboolean Config_port(void)
 	termios_p.c_lflag = 0;
 	termios_p.c_cc[VTIME] = 0;
 	termios_p.c_cc[VMIN] = 1;
-	tcsetattr(serial_port_fd, TCSANOW, &termios_p);
-	tcflush(serial_port_fd, TCOFLUSH);
-	tcflush(serial_port_fd, TCIFLUSH);
+	tcsetattr(fd, TCSANOW, &termios_p);
+	tcflush(fd, TCOFLUSH);
+	tcflush(fd, TCIFLUSH);
+
+	return fd;
+}
+
+/* Give back a device opened by serial_open_device() as it was found */
+void serial_close_device(int fd, struct termios *saved)
+{
+	tcsetattr(fd, TCSANOW, saved);
+	tcflush(fd, TCOFLUSH);
+	tcflush(fd, TCIFLUSH);
+	if(! config.disable_port_lock)
+	{
+		flock(fd, LOCK_UN);
+	}
+	close(fd);
+}
+
+/*
+ * The driver wakes the reader up on each byte instead of deferring it,
+ * and a USB adapter passes on what it received after 1 ms instead of
+ * the 16 ms of an FTDI by default.
+ */
+static void latency_set(int fd, const gchar *device)
+{
+	gchar *real, *name, *text = NULL;
+	gchar *msg;
+	FILE *timer;
+#ifdef HAVE_LINUX_SERIAL_H
+	struct serial_struct serial;
 
-	callback_handler_in = g_io_add_watch_full(g_io_channel_unix_new(serial_port_fd),
-	                      10,
-	                      G_IO_IN,
-	                      (GIOFunc)Lis_port,
-	                      NULL, NULL);
+	if(ioctl(fd, TIOCGSERIAL, &serial) == 0 && !(serial.flags & ASYNC_LOW_LATENCY))
+	{
+		latency_saved.serial_flags = serial.flags;
+		serial.flags |= ASYNC_LOW_LATENCY;
+		if(ioctl(fd, TIOCSSERIAL, &serial) == 0)
+			latency_saved.serial_set = TRUE;
+	}
+#endif
+
+	real = realpath(device, NULL);
+	if(real == NULL)
+		return;
+	name = g_path_get_basename(real);
+	free(real);
+	latency_saved.timer_path = g_build_filename("/sys/bus/usb-serial/devices", name, "latency_timer", NULL);
+	g_free(name);
+
+	/* Not a USB adapter with a timer */
+	if(!g_file_get_contents(latency_saved.timer_path, &text, NULL, NULL))
+	{
+		g_free(latency_saved.timer_path);
+		latency_saved.timer_path = NULL;
+		return;
+	}
+	latency_saved.timer = atoi(text);
+	g_free(text);
+	if(latency_saved.timer <= 1)
+		return;
+
+	timer = fopen(latency_saved.timer_path, "w");
+	if(timer == NULL || fprintf(timer, "1") < 0 || fclose(timer) != 0)
+	{
+		msg = g_strdup_printf(_("Cannot set %s: %s\n"), latency_saved.timer_path, strerror_utf8(errno));
+		show_message(msg, MSG_WRN);
+		g_free(msg);
+		g_free(latency_saved.timer_path);
+		latency_saved.timer_path = NULL;
+	}
+}
+
+static void latency_restore(int fd)
+{
+	FILE *timer;
+#ifdef HAVE_LINUX_SERIAL_H
+	struct serial_struct serial;
+
+	if(latency_saved.serial_set && ioctl(fd, TIOCGSERIAL, &serial) == 0)
+	{
+		serial.flags = latency_saved.serial_flags;
+		ioctl(fd, TIOCSSERIAL, &serial);
+	}
+#endif
+	latency_saved.serial_set = FALSE;
+
+	if(latency_saved.timer_path != NULL)
+	{
+		if(latency_saved.timer > 1)
+		{
+			timer = fopen(latency_saved.timer_path, "w");
+			if(timer != NULL)
+			{
+				fprintf(timer, "%d", latency_saved.timer);
+				fclose(timer);
+			}
+		}
+		g_free(latency_saved.timer_path);
+		latency_saved.timer_path = NULL;
+	}
+}
+
+gboolean Config_port(void)
+{
+	/* The transfer thread reads the port itself, the reader stays paused */
+	if(transfer_running())
+	{
+		show_message(_("The port can't be opened again during a file transfer\n"), MSG_WRN);
+		return serial_port_fd != -1;
+	}
+
+	/* Read by the sniffer too, each reader would get part of the bytes */
+	if(sniffer_running())
+	{
+		show_message(_("The port can't be opened again while sniffing\n"), MSG_WRN);
+		return serial_port_fd != -1;
+	}
+
+	Close_port();
+
+	/* Clients of the shared port stay connected while it is opened again */
+	share_configure();
+
+	serial_port_fd = serial_open_device(config.port, FALSE, &termios_save, &serial_port_speed);
+	if(serial_port_fd == -1)
+		return FALSE;
+
+	if(config.low_latency)
+		latency_set(serial_port_fd, config.port);
+	response.sent = 0;
+
+	input_paused = FALSE;
+	reader_start(serial_port_fd, config.port, config.read_coalesce, rx_chunk);
 
 	callback_handler_err = g_io_add_watch_full(g_io_channel_unix_new(serial_port_fd),
 	                       10,
@@ -275,8 +653,13 @@ gboolean Config_port(void)
 	                       (GIOFunc)io_err,
 	                       NULL, NULL);
 
+	tx_channel = g_io_channel_unix_new(serial_port_fd);
+
 	callback_activated = TRUE;
 
+	memset(&port_stats, 0, sizeof(port_stats));
+	port_stats.opened = g_get_monotonic_time();
+
 	Set_local_echo(config.echo);
 
 	return TRUE;
@@ -302,24 +685,37 @@ void configure_esc_clear_screen(gboolean esc_clear_screen)
 	config.esc_clear_screen = esc_clear_screen;
 }
 
+/* While a file transfer reads the port itself */
+void serial_pause_input(gboolean pause)
+{
+	if(serial_port_fd == -1 || callback_activated == FALSE)
+		return;
+
+	if(pause && !input_paused)
+		reader_stop();
+	else if(!pause && input_paused)
+		reader_start(serial_port_fd, config.port, config.read_coalesce, rx_chunk);
+	input_paused = pause;
+}
+
 void Close_port(void)
 {
 	if(serial_port_fd != -1)
 	{
 		if(callback_activated == TRUE)
 		{
-			g_source_remove(callback_handler_in);
+			reader_stop();
 			g_source_remove(callback_handler_err);
 			callback_activated = FALSE;
 		}
-		tcsetattr(serial_port_fd, TCSANOW, &termios_save);
-		tcflush(serial_port_fd, TCOFLUSH);
-		tcflush(serial_port_fd, TCIFLUSH);
-		if(! config.disable_port_lock)
+		tx_discard();
+		if(tx_channel != NULL)
 		{
-			flock(serial_port_fd, LOCK_UN);
+			g_io_channel_unref(tx_channel);
+			tx_channel = NULL;
 		}
-		close(serial_port_fd);
+		latency_restore(serial_port_fd);
+		serial_close_device(serial_port_fd, &termios_save);
 		serial_port_fd = -1;
 	}
 }
@@ -404,6 +800,18 @@ void sendbreak(void)
 		tcsendbreak(serial_port_fd, 0);
 }
 
+/* Time taken by one character on the line, in µs */
+gint64 get_port_char_time(void)
+{
+	gint bits;
+
+	if(config.vitesse == 0)
+		return 0;
+
+	bits = 1 + config.bits + (config.parite ? 1 : 0) + config.stops;
+	return (gint64)bits * G_USEC_PER_SEC / config.vitesse;
+}
+
 gchar* get_port_string(void)
 {
 	gchar* msg;
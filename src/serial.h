@@ -20,12 +20,21 @@
 #endif
 
 extern int serial_port_fd;
+extern gint64 serial_rx_time;
 
 int Send_chars(char *, int);
+guint Send_chars_pending(void);
+gchar *get_port_statistics_string(void);
+void get_port_counters(guint64 *, guint64 *);
 gboolean Config_port(void);
+#ifndef NO_TERMIOS
+int serial_open_device(const gchar *, gboolean, struct termios *, unsigned int *);
+void serial_close_device(int, struct termios *);
+#endif
 void Set_signals(guint);
 int lis_sig(void);
 void Close_port(void);
+void serial_pause_input(gboolean);
 void configure_echo(gboolean);
 void configure_crlfauto(gboolean);
 void configure_autoreconnect_enable(gboolean);
@@ -33,6 +42,7 @@ void configure_esc_clear_screen(gboolean);
 void sendbreak(void);
 unsigned int set_port_baudrate(unsigned int, int);
 gchar* get_port_string(void);
+gint64 get_port_char_time(void);
 
 struct baudrate {
 	unsigned int baud;
@@ -0,0 +1,877 @@
+/***********************************************************************/
+/* share.c                                                             */
+/* -------                                                             */
+/*                           GTKTerm Software                          */
+/*                                 (c)                                 */
+/*                                                                     */
+/* ------------------------------------------------------------------- */
+/*                                                                     */
+/*   Purpose                                                           */
+/*      Sharing of the open port on a local TCP or Unix socket         */
+/*      - Raw data or RFC 2217 (telnet com port control)               */
+/*      - Received data is queued once and referenced by all clients   */
+/*                                                                     */
+/***********************************************************************/
+
+#include <gtk/gtk.h>
+#include <gio/gio.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "term_config.h"
+#include "serial.h"
+#include "interface.h"
+#include "transfer.h"
+#include "sniffer.h"
+#include "share.h"
+
+#include <config.h>
+#include <glib/gi18n.h>
+
+#define SHARE_MAX_QUEUE (1 << 20)	/* per client, newer data is dropped */
+#define SHARE_RECONFIGURE_RETRY 500	/* ms, while a transfer uses the port */
+#define SHARE_TX_LIMIT (64 * 1024)	/* stop reading clients above this */
+#define SHARE_VECTORS 16
+
+/* Telnet */
+#define IAC 255
+#define DONT 254
+#define DO 253
+#define WONT 252
+#define WILL 251
+#define SB 250
+#define SE 240
+#define TELOPT_BINARY 0
+#define TELOPT_ECHO 1
+#define TELOPT_SGA 3
+#define TELOPT_COMPORT 44
+
+/* RFC 2217 commands, the server answers with the command + 100 */
+#define CPO_SIGNATURE 0
+#define CPO_SET_BAUDRATE 1
+#define CPO_SET_DATASIZE 2
+#define CPO_SET_PARITY 3
+#define CPO_SET_STOPSIZE 4
+#define CPO_SET_CONTROL 5
+#define CPO_NOTIFY_LINESTATE 6
+#define CPO_NOTIFY_MODEMSTATE 7
+#define CPO_FLOWCONTROL_SUSPEND 8
+#define CPO_FLOWCONTROL_RESUME 9
+#define CPO_SET_LINESTATE_MASK 10
+#define CPO_SET_MODEMSTATE_MASK 11
+#define CPO_PURGE_DATA 12
+#define CPO_SERVER 100
+
+enum {
+	TELNET_DATA,
+	TELNET_IAC,
+	TELNET_OPTION,		/* after WILL, WONT, DO or DONT */
+	TELNET_SB,
+	TELNET_SB_IAC
+};
+
+typedef struct {
+	GSocketConnection *connection;
+	GSocket *socket;
+	GSource *in_source;
+	GSource *out_source;
+	gboolean rfc2217;
+	gboolean suspended;	/* RFC 2217 flow control from the client */
+
+	/* Data waiting for the client, shared GBytes */
+	GQueue pending;
+	gsize offset;		/* already sent from the head */
+	gsize queued;
+
+	/* Telnet */
+	gint state;
+	guchar command;
+	guchar sb[64];
+	guint sb_len;
+	guchar his[256];	/* options: 0 off, 1 asked, 2 on */
+	guchar modem_mask;
+
+	guint64 sent;
+	guint64 received;
+	guint64 dropped;
+} share_client_t;
+
+extern struct configuration_port config;
+
+static GSocketService *service = NULL;
+static gint service_port = 0;
+static gchar *service_socket = NULL;
+static gboolean socket_bound = FALSE;
+static GList *clients = NULL;
+static guint unthrottle_timer = 0;
+static guint reconfigure_source = 0;
+static guchar modem_state = 0;
+
+static struct {
+	guint connections;
+	guint64 sent;
+	guint64 received;
+	guint64 dropped;
+} share_stats;
+
+static gboolean client_readable(GSocket *, GIOCondition, gpointer);
+static gboolean client_writable(GSocket *, GIOCondition, gpointer);
+
+static void client_free(share_client_t *client)
+{
+	clients = g_list_remove(clients, client);
+
+	if(client->in_source != NULL)
+	{
+		g_source_destroy(client->in_source);
+		g_source_unref(client->in_source);
+	}
+	if(client->out_source != NULL)
+	{
+		g_source_destroy(client->out_source);
+		g_source_unref(client->out_source);
+	}
+	g_queue_foreach(&client->pending, (GFunc)g_bytes_unref, NULL);
+	g_queue_clear(&client->pending);
+
+	share_stats.sent += client->sent;
+	share_stats.received += client->received;
+	share_stats.dropped += client->dropped;
+
+	g_io_stream_close(G_IO_STREAM(client->connection), NULL, NULL);
+	g_object_unref(client->connection);
+	g_free(client);
+}
+
+static void client_watch(share_client_t *client, GSource **source, GIOCondition condition,
+                         gpointer callback)
+{
+	if(*source != NULL)
+		return;
+
+	*source = g_socket_create_source(client->socket, condition, NULL);
+	g_source_set_callback(*source, (GSourceFunc)callback, client, NULL);
+	g_source_attach(*source, NULL);
+}
+
+static void client_unwatch(GSource **source)
+{
+	if(*source == NULL)
+		return;
+
+	g_source_destroy(*source);
+	g_source_unref(*source);
+	*source = NULL;
+}
+
+/* Write what the socket takes, several chunks per call, FALSE if the client is gone */
+static gboolean client_flush(share_client_t *client)
+{
+	GOutputVector vectors[SHARE_VECTORS];
+	GError *error = NULL;
+	GList *l;
+	GBytes *bytes;
+	gsize size;
+	gssize written;
+	gint n;
+
+	while(!client->suspended && client->queued > 0)
+	{
+		n = 0;
+		for(l = client->pending.head; l != NULL && n < SHARE_VECTORS; l = l->next, n++)
+		{
+			vectors[n].buffer = g_bytes_get_data(l->data, &size);
+			vectors[n].size = size;
+		}
+		vectors[0].buffer = (const guchar *)vectors[0].buffer + client->offset;
+		vectors[0].size -= client->offset;
+
+		written = g_socket_send_message(client->socket, NULL, vectors, n, NULL, 0, 0, NULL, &error);
+		if(written < 0)
+		{
+			if(g_error_matches(error, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK))
+			{
+				g_error_free(error);
+				client_watch(client, &client->out_source, G_IO_OUT, client_writable);
+				return TRUE;
+			}
+			g_error_free(error);
+			return FALSE;
+		}
+
+		client->sent += written;
+		client->queued -= written;
+		written += client->offset;
+		while(!g_queue_is_empty(&client->pending))
+		{
+			bytes = g_queue_peek_head(&client->pending);
+			size = g_bytes_get_size(bytes);
+			if((gsize)written < size)
+				break;
+			written -= size;
+			g_bytes_unref(g_queue_pop_head(&client->pending));
+		}
+		client->offset = written;
+	}
+
+	client_unwatch(&client->out_source);
+	return TRUE;
+}
+
+static void client_queue(share_client_t *client, GBytes *bytes)
+{
+	gsize size = g_bytes_get_size(bytes);
+
+	/* A client that does not keep up loses data, the others do not wait */
+	if(client->queued + size > SHARE_MAX_QUEUE)
+	{
+		client->dropped += size;
+		return;
+	}
+
+	g_queue_push_tail(&client->pending, g_bytes_ref(bytes));
+	client->queued += size;
+}
+
+/* Telnet commands go in the data queue, behind what is already there */
+static void telnet_send(share_client_t *client, const guchar *data, guint len)
+{
+	GBytes *bytes;
+
+	bytes = g_bytes_new(data, len);
+	client_queue(client, bytes);
+	g_bytes_unref(bytes);
+}
+
+static void telnet_option(share_client_t *client, guchar command, guchar option)
+{
+	guchar reply[3] = {IAC, command, option};
+
+	telnet_send(client, reply, 3);
+}
+
+static void comport_reply(share_client_t *client, guchar command, const guchar *data, guint len)
+{
+	guchar reply[4 + 2 * 64 + 2];
+	guint i, n = 0;
+
+	reply[n++] = IAC;
+	reply[n++] = SB;
+	reply[n++] = TELOPT_COMPORT;
+	reply[n++] = command + CPO_SERVER;
+	for(i = 0; i < len && i < 64; i++)
+	{
+		reply[n++] = data[i];
+		if(data[i] == IAC)
+			reply[n++] = IAC;
+	}
+	reply[n++] = IAC;
+	reply[n++] = SE;
+
+	telnet_send(client, reply, n);
+}
+
+static gboolean share_reconfigure(gpointer data)
+{
+	gchar *message;
+
+	/* Applied once the transfer or the sniffing is over */
+	if(transfer_running() || sniffer_running())
+	{
+		reconfigure_source = g_timeout_add(SHARE_RECONFIGURE_RETRY, share_reconfigure, NULL);
+		return FALSE;
+	}
+
+	reconfigure_source = 0;
+
+	Config_port();
+	message = get_port_string();
+	Set_status_message(message);
+	Set_window_title(message);
+	g_free(message);
+
+	return FALSE;
+}
+
+/* Settings often come in a burst, the port is opened again once */
+static void reconfigure_later(void)
+{
+	if(reconfigure_source == 0)
+		reconfigure_source = g_idle_add(share_reconfigure, NULL);
+}
+
+static void set_modem_line(gint line, gboolean on)
+{
+	if(serial_port_fd != -1)
+		ioctl(serial_port_fd, on ? TIOCMBIS : TIOCMBIC, &line);
+}
+
+static gboolean modem_line(gint line)
+{
+	gint state = 0;
+
+	if(serial_port_fd != -1)
+		ioctl(serial_port_fd, TIOCMGET, &state);
+
+	return (state & line) != 0;
+}
+
+static guchar set_control(guchar value)
+{
+	switch(value)
+	{
+	case 1:
+	case 2:
+	case 3:
+		if(config.flux != value - 1)
+		{
+			config.flux = value - 1;
+			reconfigure_later();
+		}
+		return value;
+	case 0:
+		/* RS-485 has no RFC 2217 value */
+		return config.flux <= 2 ? config.flux + 1 : 1;
+	case 5:
+		sendbreak();
+		return 6;
+	case 4:
+	case 6:
+		return 6;
+	case 8:
+	case 9:
+		set_modem_line(TIOCM_DTR, value == 8);
+		return value;
+	case 7:
+		return modem_line(TIOCM_DTR) ? 8 : 9;
+	case 11:
+	case 12:
+		set_modem_line(TIOCM_RTS, value == 11);
+		return value;
+	case 10:
+		return modem_line(TIOCM_RTS) ? 11 : 12;
+	default:
+		return value;
+	}
+}
+
+static void comport_command(share_client_t *client)
+{
+	static const gchar signature[] = PACKAGE " " VERSION;
+	guchar command = client->sb[1];
+	guchar *data = client->sb + 2;
+	guint len = client->sb_len - 2;
+	guint32 baud;
+	guchar value;
+
+	switch(command)
+	{
+	case CPO_SIGNATURE:
+		if(len == 0)
+			comport_reply(client, command, (const guchar *)signature, strlen(signature));
+		return;
+	case CPO_SET_BAUDRATE:
+		if(len < 4)
+			return;
+		baud = (data[0] << 24) | (data[1] << 16) | (data[2] << 8) | data[3];
+		if(baud != 0 && baud != config.vitesse)
+		{
+			config.vitesse = baud;
+			reconfigure_later();
+		}
+		baud = config.vitesse;
+		data[0] = baud >> 24;
+		data[1] = baud >> 16;
+		data[2] = baud >> 8;
+		data[3] = baud;
+		comport_reply(client, command, data, 4);
+		return;
+	case CPO_SET_DATASIZE:
+		if(len < 1)
+			return;
+		if(data[0] >= 5 && data[0] <= 8 && data[0] != config.bits)
+		{
+			config.bits = data[0];
+			reconfigure_later();
+		}
+		value = config.bits;
+		comport_reply(client, command, &value, 1);
+		return;
+	case CPO_SET_PARITY:
+		/* 1 none, 2 odd, 3 even, mark and space are not supported */
+		if(len < 1)
+			return;
+		if(data[0] >= 1 && data[0] <= 3 && data[0] - 1 != config.parite)
+		{
+			config.parite = data[0] - 1;
+			reconfigure_later();
+		}
+		value = config.parite + 1;
+		comport_reply(client, command, &value, 1);
+		return;
+	case CPO_SET_STOPSIZE:
+		/* 1.5 stop bits (3) is not supported */
+		if(len < 1)
+			return;
+		if((data[0] == 1 || data[0] == 2) && data[0] != config.stops)
+		{
+			config.stops = data[0];
+			reconfigure_later();
+		}
+		value = config.stops;
+		comport_reply(client, command, &value, 1);
+		return;
+	case CPO_SET_CONTROL:
+		if(len < 1)
+			return;
+		value = set_control(data[0]);
+		comport_reply(client, command, &value, 1);
+		return;
+	case CPO_FLOWCONTROL_SUSPEND:
+		client->suspended = TRUE;
+		return;
+	case CPO_FLOWCONTROL_RESUME:
+		client->suspended = FALSE;
+		client_flush(client);
+		return;
+	case CPO_SET_LINESTATE_MASK:
+		/* No line state is reported, the mask is only acknowledged */
+		if(len >= 1)
+			comport_reply(client, command, data, 1);
+		return;
+	case CPO_SET_MODEMSTATE_MASK:
+		if(len < 1)
+			return;
+		client->modem_mask = data[0];
+		comport_reply(client, command, data, 1);
+		return;
+	case CPO_PURGE_DATA:
+		if(len < 1)
+			return;
+		if(serial_port_fd != -1 && data[0] >= 1 && data[0] <= 3)
+			tcflush(serial_port_fd, data[0] == 1 ? TCIFLUSH : data[0] == 2 ? TCOFLUSH : TCIOFLUSH);
+		comport_reply(client, command, data, 1);
+		return;
+	}
+}
+
+/* Answer an option only when its state changes, to avoid loops */
+static void telnet_negotiate(share_client_t *client, guchar command, guchar option)
+{
+	gboolean supported = (option == TELOPT_BINARY || option == TELOPT_SGA ||
+	                      (option == TELOPT_COMPORT && command == WILL));
+
+	switch(command)
+	{
+	case WILL:
+		if(!supported)
+			telnet_option(client, DONT, option);
+		else if(client->his[option] != 2)
+		{
+			if(client->his[option] != 1)
+				telnet_option(client, DO, option);
+			client->his[option] = 2;
+		}
+		break;
+	case WONT:
+		if(client->his[option] != 0)
+			telnet_option(client, DONT, option);
+		client->his[option] = 0;
+		break;
+	case DO:
+		/* We offered binary and SGA already */
+		if(!supported || option == TELOPT_COMPORT)
+			telnet_option(client, WONT, option);
+		break;
+	case DONT:
+		break;
+	}
+}
+
+/* Strip the telnet commands in place, returns the data length left */
+static gsize telnet_input(share_client_t *client, guchar *buf, gsize len)
+{
+	gsize i, n = 0;
+	guchar c;
+
+	for(i = 0; i < len; i++)
+	{
+		c = buf[i];
+		switch(client->state)
+		{
+		case TELNET_DATA:
+			if(c == IAC)
+				client->state = TELNET_IAC;
+			else
+				buf[n++] = c;
+			break;
+		case TELNET_IAC:
+			client->state = TELNET_DATA;
+			if(c == IAC)
+				buf[n++] = c;
+			else if(c >= WILL)
+			{
+				client->command = c;
+				client->state = TELNET_OPTION;
+			}
+			else if(c == SB)
+			{
+				client->sb_len = 0;
+				client->state = TELNET_SB;
+			}
+			break;
+		case TELNET_OPTION:
+			telnet_negotiate(client, client->command, c);
+			client->state = TELNET_DATA;
+			break;
+		case TELNET_SB:
+			if(c == IAC)
+				client->state = TELNET_SB_IAC;
+			else if(client->sb_len < sizeof(client->sb))
+				client->sb[client->sb_len++] = c;
+			break;
+		case TELNET_SB_IAC:
+			if(c == SE)
+			{
+				if(client->sb_len >= 2 && client->sb[0] == TELOPT_COMPORT)
+					comport_command(client);
+				client->state = TELNET_DATA;
+			}
+			else
+			{
+				if(client->sb_len < sizeof(client->sb))
+					client->sb[client->sb_len++] = c;
+				client->state = TELNET_SB;
+			}
+			break;
+		}
+	}
+
+	return n;
+}
+
+static gboolean share_unthrottle(gpointer data)
+{
+	GList *l;
+	share_client_t *client;
+
+	if(Send_chars_pending() > SHARE_TX_LIMIT)
+		return TRUE;
+
+	unthrottle_timer = 0;
+	for(l = clients; l != NULL; l = l->next)
+	{
+		client = l->data;
+		client_watch(client, &client->in_source, G_IO_IN, client_readable);
+	}
+
+	return FALSE;
+}
+
+static gboolean client_readable(GSocket *socket, GIOCondition condition, gpointer data)
+{
+	share_client_t *client = data;
+	guchar buf[BUFFER_EMISSION];
+	gssize len;
+
+	len = g_socket_receive(socket, (gchar *)buf, sizeof(buf), NULL, NULL);
+	if(len <= 0)
+	{
+		client_free(client);
+		return FALSE;
+	}
+	client->received += len;
+
+	if(client->rfc2217)
+	{
+		len = telnet_input(client, buf, len);
+		if(!client_flush(client))
+		{
+			client_free(client);
+			return FALSE;
+		}
+	}
+
+	/* A running file transfer owns the port */
+	if(len > 0 && !transfer_running())
+		Send_chars((gchar *)buf, len);
+
+	/* The port is slower than the network: stop reading until it drained */
+	if(Send_chars_pending() > SHARE_TX_LIMIT)
+	{
+		if(unthrottle_timer == 0)
+			unthrottle_timer = g_timeout_add(50, share_unthrottle, NULL);
+		g_source_unref(client->in_source);
+		client->in_source = NULL;
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static gboolean client_writable(GSocket *socket, GIOCondition condition, gpointer data)
+{
+	share_client_t *client = data;
+
+	g_source_unref(client->out_source);
+	client->out_source = NULL;
+
+	if(!client_flush(client))
+		client_free(client);
+
+	return FALSE;
+}
+
+static gboolean share_incoming(GSocketService *source, GSocketConnection *connection,
+                               GObject *source_object, gpointer data)
+{
+	static const guchar offer[] = {IAC, WILL, TELOPT_BINARY, IAC, DO, TELOPT_BINARY,
+	                               IAC, WILL, TELOPT_SGA, IAC, DO, TELOPT_COMPORT};
+	share_client_t *client;
+
+	client = g_new0(share_client_t, 1);
+	client->connection = g_object_ref(connection);
+	client->socket = g_socket_connection_get_socket(connection);
+	client->rfc2217 = config.share_rfc2217;
+	client->modem_mask = 0xFF;
+	g_queue_init(&client->pending);
+	g_socket_set_blocking(client->socket, FALSE);
+
+	clients = g_list_prepend(clients, client);
+	share_stats.connections++;
+
+	if(client->rfc2217)
+	{
+		client->his[TELOPT_BINARY] = 1;
+		client->his[TELOPT_COMPORT] = 1;
+		telnet_send(client, offer, sizeof(offer));
+		if(!client_flush(client))
+		{
+			client_free(client);
+			return TRUE;
+		}
+	}
+
+	if(unthrottle_timer == 0)
+		client_watch(client, &client->in_source, G_IO_IN, client_readable);
+
+	return TRUE;
+}
+
+void share_chars(const gchar *data, guint size)
+{
+	GBytes *raw, *escaped = NULL;
+	GByteArray *array;
+	GList *l, *next;
+	share_client_t *client;
+	guint i;
+
+	if(clients == NULL)
+		return;
+
+	/* One copy of the data, referenced by every client */
+	raw = g_bytes_new(data, size);
+
+	for(l = clients; l != NULL; l = next)
+	{
+		next = l->next;
+		client = l->data;
+
+		if(client->rfc2217 && memchr(data, IAC, size) != NULL)
+		{
+			/* Telnet clients share a second copy with IAC doubled */
+			if(escaped == NULL)
+			{
+				array = g_byte_array_sized_new(size + 16);
+				for(i = 0; i < size; i++)
+				{
+					g_byte_array_append(array, (const guint8 *)data + i, 1);
+					if((guchar)data[i] == IAC)
+						g_byte_array_append(array, (const guint8 *)data + i, 1);
+				}
+				escaped = g_byte_array_free_to_bytes(array);
+			}
+			client_queue(client, escaped);
+		}
+		else
+			client_queue(client, raw);
+
+		if(client->out_source == NULL && !client_flush(client))
+			client_free(client);
+	}
+
+	g_bytes_unref(raw);
+	if(escaped != NULL)
+		g_bytes_unref(escaped);
+}
+
+/* RFC 2217 modem state: CD, RI, DSR, CTS and their changes */
+void share_signals(gint state)
+{
+	guchar value = 0, masked;
+	GList *l;
+	share_client_t *client;
+
+	if(state & TIOCM_CD)
+		value |= 0x80;
+	if(state & TIOCM_RI)
+		value |= 0x40;
+	if(state & TIOCM_DSR)
+		value |= 0x20;
+	if(state & TIOCM_CTS)
+		value |= 0x10;
+	value |= ((value ^ modem_state) >> 4) & 0x0F;
+	modem_state = value & 0xF0;
+
+	for(l = clients; l != NULL; l = l->next)
+	{
+		client = l->data;
+		/* Only the changes the client asked for */
+		if(!client->rfc2217 || client->his[TELOPT_COMPORT] != 2 ||
+		   !(value & client->modem_mask & 0x0F))
+			continue;
+		masked = value & client->modem_mask;
+		comport_reply(client, CPO_NOTIFY_MODEMSTATE, &masked, 1);
+		if(client->out_source == NULL)
+			client_flush(client);
+	}
+}
+
+static GSocketAddress *unix_address(const gchar *path)
+{
+	struct sockaddr_un sun;
+
+	memset(&sun, 0, sizeof(sun));
+	sun.sun_family = AF_UNIX;
+	g_strlcpy(sun.sun_path, path, sizeof(sun.sun_path));
+
+	return g_socket_address_new_from_native(&sun, sizeof(sun));
+}
+
+static void unix_socket_remove(const gchar *path)
+{
+	struct stat st;
+
+	/* Only a socket left by a previous run */
+	if(lstat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+		unlink(path);
+}
+
+static gboolean share_listen(GSocketAddress *address)
+{
+	GError *error = NULL;
+	gchar *msg;
+
+	if(g_socket_listener_add_address(G_SOCKET_LISTENER(service), address, G_SOCKET_TYPE_STREAM,
+	                                 G_SOCKET_PROTOCOL_DEFAULT, NULL, NULL, &error))
+		return TRUE;
+
+	msg = g_strdup_printf(_("Cannot share the port: %s\n"), error->message);
+	show_message(msg, MSG_ERR);
+	g_free(msg);
+	g_error_free(error);
+
+	return FALSE;
+}
+
+void share_stop(void)
+{
+	if(service == NULL)
+		return;
+
+	g_socket_service_stop(service);
+	g_socket_listener_close(G_SOCKET_LISTENER(service));
+	g_object_unref(service);
+	service = NULL;
+
+	if(socket_bound)
+		unix_socket_remove(service_socket);
+	socket_bound = FALSE;
+	g_free(service_socket);
+	service_socket = NULL;
+	service_port = 0;
+}
+
+/*
+ * Called each time the port is configured. Clients stay connected
+ * when the port is opened again, only a change of the sharing
+ * settings restarts the listener.
+ */
+void share_configure(void)
+{
+	GInetAddress *loopback;
+	GSocketAddress *address;
+	gboolean listening = FALSE;
+	mode_t mask;
+
+	if(service != NULL && service_port == config.share_port &&
+	   !g_strcmp0(service_socket, config.share_socket))
+		return;
+
+	share_stop();
+	if(config.share_port == 0 && config.share_socket[0] == 0)
+		return;
+
+	service = g_socket_service_new();
+	g_signal_connect(service, "incoming", G_CALLBACK(share_incoming), NULL);
+
+	/* Local connections only */
+	if(config.share_port != 0)
+	{
+		loopback = g_inet_address_new_loopback(G_SOCKET_FAMILY_IPV4);
+		address = g_inet_socket_address_new(loopback, config.share_port);
+		listening |= share_listen(address);
+		g_object_unref(address);
+		g_object_unref(loopback);
+	}
+
+	if(config.share_socket[0] != 0)
+	{
+		unix_socket_remove(config.share_socket);
+		address = unix_address(config.share_socket);
+		/* Only the user can reach the port through it */
+		mask = umask(S_IRWXG | S_IRWXO);
+		socket_bound = share_listen(address);
+		umask(mask);
+		if(socket_bound)
+			chmod(config.share_socket, S_IRUSR | S_IWUSR);
+		listening |= socket_bound;
+		g_object_unref(address);
+	}
+
+	/* Not tried again before the settings change */
+	service_port = config.share_port;
+	service_socket = g_strdup(config.share_socket);
+
+	if(listening)
+		g_socket_service_start(service);
+}
+
+gchar *share_statistics(void)
+{
+	GList *l;
+	share_client_t *client;
+	guint64 sent = share_stats.sent, received = share_stats.received;
+	guint64 dropped = share_stats.dropped;
+
+	if(share_stats.connections == 0)
+		return g_strdup("");
+
+	for(l = clients; l != NULL; l = l->next)
+	{
+		client = l->data;
+		sent += client->sent;
+		received += client->received;
+		dropped += client->dropped;
+	}
+
+	return g_strdup_printf(_("Shared: %u clients (%u connections), sent: %" G_GUINT64_FORMAT
+	                         ", received: %" G_GUINT64_FORMAT ", dropped: %" G_GUINT64_FORMAT "\n"),
+	                       g_list_length(clients), share_stats.connections, sent, received, dropped);
+}
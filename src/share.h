@@ -0,0 +1,24 @@
+/***********************************************************************/
+/* share.h                                                             */
+/* -------                                                             */
+/*                           GTKTerm Software                          */
+/*                                 (c)                                 */
+/*                                                                     */
+/* ------------------------------------------------------------------- */
+/*                                                                     */
+/*   Purpose                                                           */
+/*      Sharing of the open port on a local TCP or Unix socket         */
+/*      - Header file -                                                */
+/*                                                                     */
+/***********************************************************************/
+
+#ifndef SHARE_H_
+#define SHARE_H_
+
+void share_configure(void);
+void share_stop(void);
+void share_chars(const gchar *, guint);
+void share_signals(gint);
+gchar *share_statistics(void);
+
+#endif
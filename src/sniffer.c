@@ -0,0 +1,633 @@
+/***********************************************************************/
+/* sniffer.c                                                           */
+/* ---------                                                           */
+/*                           GTKTerm Software                          */
+/*                                 (c)                                 */
+/*                                                                     */
+/* ------------------------------------------------------------------- */
+/*                                                                     */
+/*   Purpose                                                           */
+/*      Sniffer of a link between two devices, tapped on two ports     */
+/*      - One thread reads both ports and dates every read             */
+/*      - Both directions are shown on one timeline, with the time     */
+/*        the other side took to answer                                */
+/*                                                                     */
+/***********************************************************************/
+
+#include <gtk/gtk.h>
+#include <glib-unix.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include <sys/epoll.h>
+
+#include "term_config.h"
+#include "serial.h"
+#include "interface.h"
+#include "buffer.h"
+#include "device_monitor.h"
+#include "transfer.h"
+#include "sniffer.h"
+
+#include <config.h>
+#include <glib/gi18n.h>
+
+#define SNIFF_READ BUFFER_RECEPTION
+#define SNIFF_HEX_LINE 16	/* bytes per line in hexadecimal */
+#define SNIFF_FILE_BUFFER (1 << 20)
+#define SNIFF_REFRESH 500	/* ms */
+
+typedef struct {
+	gint64 time;		/* monotonic µs, right after the read */
+	guint side;		/* 0 : A, 1 : B */
+	guint len;		/* 0 : the port is gone */
+	guchar data[];
+} sniff_chunk_t;
+
+extern GtkWidget *Fenetre;
+extern struct configuration_port config;
+
+static const gchar side_name[2] = {'A', 'B'};
+static const gchar *side_colour[2] = {"\033[36m", "\033[33m"};
+
+static gchar *sniff_device[2] = {NULL, NULL};
+static int sniff_fd[2] = {-1, -1};
+static struct termios sniff_saved[2];
+static int sniff_wake[2] = {-1, -1};	/* pipe, stops the thread */
+static GThread *sniff_thread = NULL;
+static GAsyncQueue *sniff_queue = NULL;
+static gint sniff_drain_queued = 0;
+static GtkToggleAction *sniff_action = NULL;
+static guint sniff_timer = 0;
+static gboolean sniff_reopen;		/* the main port was open */
+static gboolean sniff_hex = FALSE;
+
+static FILE *sniff_file = NULL;
+static gchar *sniff_file_name = NULL;
+
+/* Timeline */
+static gint64 sniff_origin;
+static gint sniff_last_side;
+static gint64 sniff_last_time;
+static gboolean sniff_line_start;
+static guint sniff_line_bytes;
+
+/* Statistics, turnaround of side s: s answering the other side */
+static struct {
+	gboolean used;
+	guint64 bytes[2];
+	guint64 chunks[2];
+	guint turns[2];
+	gint64 turn_min[2];
+	gint64 turn_max[2];
+	gint64 turn_total[2];
+	gint64 turn_last[2];
+} sniff_stats;
+
+static gboolean sniff_drain(gpointer data);
+static void sniff_stop(const gchar *error);
+
+static void sniff_push(sniff_chunk_t *chunk)
+{
+	g_async_queue_push(sniff_queue, chunk);
+	if(g_atomic_int_compare_and_exchange(&sniff_drain_queued, 0, 1))
+		g_idle_add(sniff_drain, NULL);
+}
+
+/* Both ports in one thread: the reads are dated in the order they happen */
+static gpointer sniff_reader(gpointer data)
+{
+	struct epoll_event event, events[3];
+	guchar buf[SNIFF_READ];
+	sniff_chunk_t *chunk;
+	gssize len;
+	gint64 now;
+	int epfd, n, i;
+	guint side;
+
+	epfd = epoll_create1(EPOLL_CLOEXEC);
+	for(i = 0; i < 3; i++)
+	{
+		event.events = EPOLLIN;
+		event.data.u32 = i;
+		epoll_ctl(epfd, EPOLL_CTL_ADD, i < 2 ? sniff_fd[i] : sniff_wake[0], &event);
+	}
+
+	for(;;)
+	{
+		n = epoll_wait(epfd, events, 3, -1);
+		if(n < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			break;
+		}
+
+		for(i = 0; i < n; i++)
+		{
+			side = events[i].data.u32;
+			if(side == 2)
+				goto out;
+
+			len = read(sniff_fd[side], buf, sizeof(buf));
+			now = g_get_monotonic_time();
+			if(len < 0 && (errno == EAGAIN || errno == EINTR))
+				continue;
+
+			if(len <= 0)
+			{
+				/* Unplugged: tell the main loop and stop */
+				chunk = g_malloc(sizeof(sniff_chunk_t));
+				chunk->time = now;
+				chunk->side = side;
+				chunk->len = 0;
+				sniff_push(chunk);
+				goto out;
+			}
+
+			chunk = g_malloc(sizeof(sniff_chunk_t) + len);
+			chunk->time = now;
+			chunk->side = side;
+			chunk->len = len;
+			memcpy(chunk->data, buf, len);
+			sniff_push(chunk);
+		}
+	}
+
+out:
+	close(epfd);
+	return NULL;
+}
+
+static void line_header(GString *out, guint side, gint64 time, gint64 gap)
+{
+	if(!sniff_line_start)
+		g_string_append(out, "\033[0m\r\n");
+
+	g_string_append_printf(out, "\033[1m%s%c\033[0m [%12.6f] ", side_colour[side], side_name[side],
+	                       (time - sniff_origin) / (gdouble)G_USEC_PER_SEC);
+	if(gap >= 0)
+		g_string_append_printf(out, "\033[2m(+%.3f ms)\033[0m ", gap / 1000.0);
+	g_string_append(out, side_colour[side]);
+
+	sniff_line_start = FALSE;
+	sniff_line_bytes = 0;
+}
+
+/*
+ * Time from the end of the last data of one side to the start of the
+ * answer. A read returns when its last byte is in, so the start of the
+ * answer is its read time less the time its bytes took on the line.
+ */
+static gint64 turnaround(const sniff_chunk_t *chunk)
+{
+	gint64 gap;
+
+	gap = chunk->time - (gint64)chunk->len * get_port_char_time() - sniff_last_time;
+	if(gap < 0)
+		gap = 0;
+
+	sniff_stats.turns[chunk->side]++;
+	sniff_stats.turn_total[chunk->side] += gap;
+	sniff_stats.turn_last[chunk->side] = gap;
+	if(sniff_stats.turns[chunk->side] == 1 || gap < sniff_stats.turn_min[chunk->side])
+		sniff_stats.turn_min[chunk->side] = gap;
+	if(gap > sniff_stats.turn_max[chunk->side])
+		sniff_stats.turn_max[chunk->side] = gap;
+
+	return gap;
+}
+
+static void render_chunk(GString *out, const sniff_chunk_t *chunk)
+{
+	guint i;
+	guchar c;
+
+	for(i = 0; i < chunk->len; i++)
+	{
+		if(sniff_line_start || (sniff_hex && sniff_line_bytes == SNIFF_HEX_LINE))
+			line_header(out, chunk->side, chunk->time, -1);
+
+		c = chunk->data[i];
+		sniff_line_bytes++;
+		if(sniff_hex)
+			g_string_append_printf(out, "%02X ", c);
+		else if(c == '\n')
+		{
+			g_string_append(out, "\033[0m\r\n");
+			sniff_line_start = TRUE;
+		}
+		else if(c == '\\')
+			g_string_append(out, "\\\\");
+		else if(c >= 0x20 && c < 0x7F)
+			g_string_append_c(out, c);
+		else if(c != '\r')
+			g_string_append_printf(out, "\\x%02X", c);
+	}
+}
+
+/*
+ * One line per read in the file:
+ *   time (s) side gap (ms, "-" when the same side goes on) data (hex)
+ */
+static void record_chunk(const sniff_chunk_t *chunk, gint64 gap)
+{
+	guint i;
+
+	fprintf(sniff_file, "%.6f %c ", (chunk->time - sniff_origin) / (gdouble)G_USEC_PER_SEC,
+	        side_name[chunk->side]);
+	if(gap >= 0)
+		fprintf(sniff_file, "%.3f", gap / 1000.0);
+	else
+		fputc('-', sniff_file);
+	for(i = 0; i < chunk->len; i++)
+		fprintf(sniff_file, " %02X", chunk->data[i]);
+	fputc('\n', sniff_file);
+}
+
+static gboolean sniff_drain(gpointer data)
+{
+	sniff_chunk_t *chunk;
+	GString *out;
+	gint64 gap;
+	gint lost = -1;
+	gchar *msg;
+
+	g_atomic_int_set(&sniff_drain_queued, 0);
+	if(sniff_queue == NULL)
+		return FALSE;
+
+	out = g_string_new(NULL);
+	while((chunk = g_async_queue_try_pop(sniff_queue)) != NULL)
+	{
+		if(chunk->len == 0)
+		{
+			lost = chunk->side;
+			g_free(chunk);
+			continue;
+		}
+
+		gap = -1;
+		if((gint)chunk->side != sniff_last_side)
+		{
+			if(sniff_last_side != -1)
+				gap = turnaround(chunk);
+			line_header(out, chunk->side, chunk->time, gap);
+		}
+		render_chunk(out, chunk);
+		if(sniff_file != NULL)
+			record_chunk(chunk, gap);
+
+		sniff_stats.bytes[chunk->side] += chunk->len;
+		sniff_stats.chunks[chunk->side]++;
+		sniff_last_side = chunk->side;
+		sniff_last_time = chunk->time;
+		g_free(chunk);
+	}
+
+	if(out->len > 0)
+	{
+		g_string_append(out, "\033[0m");
+		put_chars(out->str, out->len, FALSE, FALSE);
+	}
+	g_string_free(out, TRUE);
+
+	if(lost != -1)
+	{
+		msg = g_strdup_printf(_("Sniffer: %s is gone\n"), sniff_device[lost]);
+		sniff_stop(msg);
+		g_free(msg);
+	}
+
+	return FALSE;
+}
+
+static gboolean sniff_refresh(gpointer data)
+{
+	gchar *msg, *last;
+
+	if(sniff_stats.turns[0] + sniff_stats.turns[1] > 0)
+		last = g_strdup_printf(_(", last answer %c after %.3f ms"), side_name[sniff_last_side],
+		                       sniff_stats.turn_last[sniff_last_side] / 1000.0);
+	else
+		last = g_strdup("");
+
+	msg = g_strdup_printf(_("Sniffing A: %s (%" G_GUINT64_FORMAT " bytes), B: %s (%" G_GUINT64_FORMAT " bytes)%s"),
+	                      sniff_device[0], sniff_stats.bytes[0], sniff_device[1], sniff_stats.bytes[1], last);
+	Set_status_message(msg);
+	g_free(msg);
+	g_free(last);
+
+	return TRUE;
+}
+
+/* Stop the thread and give the ports back, the errno of the file or 0 */
+static gint sniff_release(gboolean display)
+{
+	sniff_chunk_t *chunk;
+	gint i, error = 0;
+
+	if(write(sniff_wake[1], "", 1) < 0)
+		perror("sniffer");
+	g_thread_join(sniff_thread);
+	sniff_thread = NULL;
+
+	/* What was read before the stop still goes on the timeline */
+	if(display)
+		sniff_drain(NULL);
+	while((chunk = g_async_queue_try_pop(sniff_queue)) != NULL)
+	{
+		if(sniff_file != NULL && chunk->len > 0)
+			record_chunk(chunk, -1);
+		g_free(chunk);
+	}
+	g_async_queue_unref(sniff_queue);
+	sniff_queue = NULL;
+
+	for(i = 0; i < 2; i++)
+	{
+		serial_close_device(sniff_fd[i], &sniff_saved[i]);
+		sniff_fd[i] = -1;
+		close(sniff_wake[i]);
+		sniff_wake[i] = -1;
+	}
+
+	if(sniff_timer)
+		g_source_remove(sniff_timer);
+	sniff_timer = 0;
+
+	if(sniff_file != NULL && fclose(sniff_file) != 0)
+		error = errno;
+	sniff_file = NULL;
+
+	return error;
+}
+
+static void sniff_stop(const gchar *error)
+{
+	gchar *msg;
+	gint file_error;
+
+	if(sniff_thread == NULL)
+		return;
+
+	file_error = sniff_release(TRUE);
+	if(file_error && error == NULL)
+	{
+		msg = g_strdup_printf(_("Cannot write file %s: %s\n"), sniff_file_name, strerror(file_error));
+		show_message(msg, MSG_ERR);
+		g_free(msg);
+	}
+	g_free(sniff_file_name);
+	sniff_file_name = NULL;
+
+	if(sniff_action != NULL)
+		gtk_toggle_action_set_active(sniff_action, FALSE);
+
+	if(error != NULL)
+		show_message((gchar *)error, MSG_ERR);
+
+	if(sniff_reopen)
+		interface_open_port();
+	else
+		interface_close_port();
+}
+
+static gboolean sniff_start(gboolean save)
+{
+	GtkWidget *file_select;
+	gchar *msg;
+	gint i;
+
+	if(save)
+	{
+		file_select = gtk_file_chooser_dialog_new(_("Save the timeline"),
+		              GTK_WINDOW(Fenetre),
+		              GTK_FILE_CHOOSER_ACTION_SAVE,
+		              GTK_STOCK_CANCEL, GTK_RESPONSE_CANCEL,
+		              GTK_STOCK_SAVE, GTK_RESPONSE_ACCEPT,
+		              NULL);
+		gtk_file_chooser_set_do_overwrite_confirmation(GTK_FILE_CHOOSER(file_select), TRUE);
+		if(gtk_dialog_run(GTK_DIALOG(file_select)) == GTK_RESPONSE_ACCEPT)
+			sniff_file_name = gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(file_select));
+		gtk_widget_destroy(file_select);
+		if(sniff_file_name == NULL)
+			return FALSE;
+
+		sniff_file = fopen(sniff_file_name, "w");
+		if(sniff_file == NULL)
+		{
+			msg = g_strdup_printf(_("Cannot open file %s: %s\n"), sniff_file_name, strerror(errno));
+			show_message(msg, MSG_ERR);
+			g_free(msg);
+			g_free(sniff_file_name);
+			sniff_file_name = NULL;
+			return FALSE;
+		}
+		setvbuf(sniff_file, NULL, _IOFBF, SNIFF_FILE_BUFFER);
+	}
+
+	/* One of the taps is often the port of the terminal */
+	sniff_reopen = serial_port_fd != -1;
+	interface_close_port();
+
+	for(i = 0; i < 2; i++)
+	{
+		sniff_fd[i] = serial_open_device(sniff_device[i], TRUE, &sniff_saved[i], NULL);
+		if(sniff_fd[i] == -1)
+		{
+			if(i == 1)
+				serial_close_device(sniff_fd[0], &sniff_saved[0]);
+			sniff_fd[0] = -1;
+			if(sniff_file != NULL)
+				fclose(sniff_file);
+			sniff_file = NULL;
+			g_free(sniff_file_name);
+			sniff_file_name = NULL;
+			if(sniff_reopen)
+				interface_open_port();
+			return FALSE;
+		}
+	}
+	g_unix_open_pipe(sniff_wake, FD_CLOEXEC, NULL);
+
+	memset(&sniff_stats, 0, sizeof(sniff_stats));
+	sniff_stats.used = TRUE;
+	sniff_origin = g_get_monotonic_time();
+	sniff_last_side = -1;
+	sniff_last_time = 0;
+	sniff_line_start = TRUE;
+	sniff_line_bytes = 0;
+
+	if(sniff_file != NULL)
+		fprintf(sniff_file, "# A: %s, B: %s, %u-%d-%c-%d\n# time (s) side gap (ms) data\n",
+		        sniff_device[0], sniff_device[1], config.vitesse, config.bits,
+		        "NOE"[config.parite % 3], config.stops);
+
+	/* The timeline is escape sequences for colours, only text shows them */
+	set_view(ASCII_VIEW);
+
+	sniff_queue = g_async_queue_new();
+	sniff_thread = g_thread_new("sniffer", sniff_reader, NULL);
+
+	sniff_refresh(NULL);
+	sniff_timer = g_timeout_add(SNIFF_REFRESH, sniff_refresh, NULL);
+
+	return TRUE;
+}
+
+static GtkWidget *device_combo(const gchar *device)
+{
+	const GPtrArray *devices;
+	const serial_device_t *dev;
+	GtkWidget *combo;
+	guint i;
+
+	combo = gtk_combo_box_text_new_with_entry();
+	devices = device_registry_get();
+	for(i = 0; i < devices->len; i++)
+	{
+		dev = g_ptr_array_index(devices, i);
+		if(dev->accessible)
+			gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(combo), dev->path);
+	}
+	if(device != NULL)
+		gtk_entry_set_text(GTK_ENTRY(gtk_bin_get_child(GTK_BIN(combo))), device);
+
+	return combo;
+}
+
+static gboolean sniff_start_dialog(void)
+{
+	GtkWidget *dialog, *grid, *label, *combo[2], *hex, *save;
+	gboolean saving;
+	gchar *text;
+	gint i;
+
+	dialog = gtk_dialog_new_with_buttons(_("Sniff two ports"),
+	         GTK_WINDOW(Fenetre),
+	         GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT,
+	         GTK_STOCK_CANCEL, GTK_RESPONSE_CANCEL,
+	         GTK_STOCK_OK, GTK_RESPONSE_ACCEPT,
+	         NULL);
+
+	grid = gtk_grid_new();
+	gtk_grid_set_row_spacing(GTK_GRID(grid), 5);
+	gtk_grid_set_column_spacing(GTK_GRID(grid), 10);
+	gtk_container_set_border_width(GTK_CONTAINER(grid), 10);
+	gtk_container_add(GTK_CONTAINER(gtk_dialog_get_content_area(GTK_DIALOG(dialog))), grid);
+
+	for(i = 0; i < 2; i++)
+	{
+		text = g_strdup_printf(_("Side %c:"), side_name[i]);
+		label = gtk_label_new(text);
+		g_free(text);
+		gtk_widget_set_halign(label, GTK_ALIGN_START);
+		gtk_grid_attach(GTK_GRID(grid), label, 0, i, 1, 1);
+		combo[i] = device_combo(sniff_device[i] != NULL ? sniff_device[i] : (i == 0 ? config.port : NULL));
+		gtk_widget_set_hexpand(combo[i], TRUE);
+		gtk_grid_attach(GTK_GRID(grid), combo[i], 1, i, 1, 1);
+	}
+
+	label = gtk_label_new(_("Both ports use the speed and format of the configuration."));
+	gtk_widget_set_halign(label, GTK_ALIGN_START);
+	gtk_grid_attach(GTK_GRID(grid), label, 0, 2, 2, 1);
+
+	hex = gtk_check_button_new_with_label(_("Show the data in hexadecimal"));
+	gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(hex), sniff_hex);
+	gtk_grid_attach(GTK_GRID(grid), hex, 0, 3, 2, 1);
+
+	save = gtk_check_button_new_with_label(_("Save the timeline to a file"));
+	gtk_grid_attach(GTK_GRID(grid), save, 0, 4, 2, 1);
+
+	gtk_widget_show_all(dialog);
+
+	while(gtk_dialog_run(GTK_DIALOG(dialog)) == GTK_RESPONSE_ACCEPT)
+	{
+		for(i = 0; i < 2; i++)
+		{
+			g_free(sniff_device[i]);
+			sniff_device[i] = gtk_combo_box_text_get_active_text(GTK_COMBO_BOX_TEXT(combo[i]));
+			if(sniff_device[i] != NULL && sniff_device[i][0] == 0)
+			{
+				g_free(sniff_device[i]);
+				sniff_device[i] = NULL;
+			}
+		}
+		if(sniff_device[0] == NULL || sniff_device[1] == NULL || !strcmp(sniff_device[0], sniff_device[1]))
+		{
+			show_dialog_message(dialog, _("Choose two different ports"), MSG_ERR);
+			continue;
+		}
+
+		sniff_hex = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(hex));
+		saving = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(save));
+		gtk_widget_destroy(dialog);
+
+		return sniff_start(saving);
+	}
+
+	gtk_widget_destroy(dialog);
+	return FALSE;
+}
+
+void sniffer_callback(GtkAction *action, gpointer data)
+{
+	sniff_action = GTK_TOGGLE_ACTION(action);
+
+	if(gtk_toggle_action_get_active(sniff_action))
+	{
+		if(sniff_thread != NULL)
+			return;
+		if(transfer_running() || !sniff_start_dialog())
+			gtk_toggle_action_set_active(sniff_action, FALSE);
+		return;
+	}
+
+	sniff_stop(NULL);
+}
+
+/* On exit, the window may be gone already */
+void sniffer_stop(void)
+{
+	if(sniff_thread == NULL)
+		return;
+
+	sniff_release(FALSE);
+	g_free(sniff_file_name);
+	sniff_file_name = NULL;
+}
+
+/* The taps are held, one of them is often the port of the terminal */
+gboolean sniffer_running(void)
+{
+	return sniff_thread != NULL;
+}
+
+gchar *sniffer_statistics(void)
+{
+	GString *text;
+	gint i;
+
+	if(!sniff_stats.used)
+		return g_strdup("");
+
+	text = g_string_new(NULL);
+	for(i = 0; i < 2; i++)
+	{
+		g_string_append_printf(text, _("Sniffer %c: %" G_GUINT64_FORMAT " bytes in %" G_GUINT64_FORMAT " reads"),
+		                       side_name[i], sniff_stats.bytes[i], sniff_stats.chunks[i]);
+		if(sniff_stats.turns[i] > 0)
+			g_string_append_printf(text, _(", answered %u times in %.3f / %.3f / %.3f ms (min / avg / max)"),
+			                       sniff_stats.turns[i], sniff_stats.turn_min[i] / 1000.0,
+			                       sniff_stats.turn_total[i] / 1000.0 / sniff_stats.turns[i],
+			                       sniff_stats.turn_max[i] / 1000.0);
+		g_string_append_c(text, '\n');
+	}
+
+	return g_string_free(text, FALSE);
+}
@@ -0,0 +1,23 @@
+/***********************************************************************/
+/* sniffer.h                                                           */
+/* ---------                                                           */
+/*                           GTKTerm Software                          */
+/*                                 (c)                                 */
+/*                                                                     */
+/* ------------------------------------------------------------------- */
+/*                                                                     */
+/*   Purpose                                                           */
+/*      Sniffer of a link between two devices, tapped on two ports     */
+/*      - Header file -                                                */
+/*                                                                     */
+/***********************************************************************/
+
+#ifndef SNIFFER_H_
+#define SNIFFER_H_
+
+void sniffer_callback(GtkAction *, gpointer);
+void sniffer_stop(void);
+gboolean sniffer_running(void);
+gchar *sniffer_statistics(void);
+
+#endif
@@ -50,8 +50,11 @@
 #include "interface.h"
 #include "parsecfg.h"
 #include "macros.h"
+#include "highlight.h"
 #include "i18n.h"
 #include "config.h"
+#include "device_monitor.h"
+#include "data_store.h"
 
 #ifdef HAVE_SYS_SYSMACROS_H
 #include <sys/sysmacros.h>
@@ -75,13 +78,24 @@ gint *crlfauto;
 gint *autoreconnect_enabled;
 gint *esc_clear_screen;
 gint *timestamp;
+gint *paced_paste;
+gint *line_mode;
+gint *frame_idle;
+gchar **frame_delimiter;
+gint *share_port;
+gchar **share_socket;
+gint *share_rfc2217;
+gint *low_latency;
+gint *read_coalesce;
 cfgList **macro_list = NULL;
+cfgList **highlight_list = NULL;
 gchar **font;
 
 gint *block_cursor;
 gint *rows;
 gint *columns;
 gint *scrollback;
+gint *scrollback_memory;
 gint *visual_bell;
 gfloat *foreground_red;
 gfloat *foreground_blue;
@@ -110,12 +124,23 @@ cfgStruct cfg[] =
 	{"autoreconnect_enabled", CFG_BOOL, &autoreconnect_enabled},
 	{"esc_clear_screen", CFG_BOOL, &esc_clear_screen},
 	{"timestamp", CFG_BOOL, &timestamp},
+	{"paced_paste", CFG_BOOL, &paced_paste},
+	{"line_mode", CFG_BOOL, &line_mode},
+	{"frame_idle", CFG_INT, &frame_idle},
+	{"frame_delimiter", CFG_STRING, &frame_delimiter},
+	{"share_port", CFG_INT, &share_port},
+	{"share_socket", CFG_STRING, &share_socket},
+	{"share_rfc2217", CFG_BOOL, &share_rfc2217},
+	{"low_latency", CFG_BOOL, &low_latency},
+	{"read_coalesce", CFG_INT, &read_coalesce},
 	{"font", CFG_STRING, &font},
 	{"macros", CFG_STRING_LIST, &macro_list},
+	{"highlights", CFG_STRING_LIST, &highlight_list},
 	{"term_block_cursor", CFG_BOOL, &block_cursor},
 	{"term_rows", CFG_INT, &rows},
 	{"term_columns", CFG_INT, &columns},
 	{"term_scrollback", CFG_INT, &scrollback},
+	{"term_scrollback_memory", CFG_INT, &scrollback_memory},
 	{"term_visual_bell", CFG_BOOL, &visual_bell},
 	{"term_foreground_red", CFG_FLOAT, &foreground_red},
 	{"term_foreground_blue", CFG_FLOAT, &foreground_blue},
@@ -130,6 +155,12 @@ cfgStruct cfg[] =
 
 GFile *config_file;
 
+/* Parsed configuration file, kept between dialogs and only reparsed
+   when the file on disk has changed */
+static gchar *config_file_path;
+static gint config_sections = -1;
+static struct stat config_file_stat;
+
 struct configuration_port config;
 display_config_t term_conf;
 
@@ -146,12 +177,16 @@ static void load_config(GtkDialog *, gint, GtkTreeSelection *);
 static void delete_config(GtkDialog *, gint, GtkTreeSelection *);
 static void save_config(GtkDialog *, gint, GtkWidget *);
 static void really_save_config(GtkDialog *, gint, gpointer);
-static gint remove_section(gchar *, gchar *);
+static gint config_model_load(void);
+static gint config_model_save(gint);
 static gboolean cursor_block(GtkSwitch *, gboolean, gpointer);
 static void Selec_couleur(GdkRGBA *, gfloat, gfloat, gfloat, gfloat);
 void config_fg_color(GtkWidget *button, gpointer data);
 void config_bg_color(GtkWidget *button, gpointer data);
 static void scrollback_set(GtkAdjustment *, gpointer);
+static void scrollback_memory_set(GtkAdjustment *, gpointer);
+static gint parse_frame_delimiter(const gchar *);
+static gboolean confirm_tcp_share(GtkWidget *, gint);
 
 extern GtkWidget *display;
 
@@ -166,9 +201,56 @@ void config_file_init(void)
 	 */
 	GFile *config_file_old = g_file_new_build_filename(getenv("HOME"), CONFIGURATION_FILENAME, NULL);
 	config_file = g_file_new_build_filename(g_get_user_config_dir(), CONFIGURATION_FILENAME, NULL);
+	config_file_path = g_file_get_path(config_file);
 
 	if (!g_file_query_exists(config_file, NULL) && g_file_query_exists(config_file_old, NULL))
 		g_file_move(config_file_old, config_file, G_FILE_COPY_NONE, NULL, NULL, NULL, NULL);
+	g_object_unref(config_file_old);
+}
+
+/*
+ * Return the number of sections of the configuration file, parsing it
+ * only if it has not been parsed yet or was modified by someone else
+ * since (-1 on error).
+ */
+static gint config_model_load(void)
+{
+	struct stat my_stat;
+
+	if(stat(config_file_path, &my_stat) != 0)
+	{
+		config_sections = -1;
+		return -1;
+	}
+
+	if(config_sections != -1 &&
+	   my_stat.st_mtim.tv_sec == config_file_stat.st_mtim.tv_sec &&
+	   my_stat.st_mtim.tv_nsec == config_file_stat.st_mtim.tv_nsec &&
+	   my_stat.st_size == config_file_stat.st_size &&
+	   my_stat.st_ino == config_file_stat.st_ino)
+		return config_sections;
+
+	config_sections = cfgParse(config_file_path, cfg, CFG_INI);
+	config_file_stat = my_stat;
+
+	return config_sections;
+}
+
+/*
+ * Write the in-memory configuration back to disk. cfgDump() replaces the
+ * file atomically, so a crash never leaves a truncated file behind.
+ */
+static gint config_model_save(gint max)
+{
+	config_sections = max;
+
+	if(cfgDump(config_file_path, cfg, CFG_INI, max) == -1 ||
+	   stat(config_file_path, &config_file_stat) != 0)
+	{
+		config_sections = -1;
+		return -1;
+	}
+	return 0;
 }
 
 void ConfigFlags(void)
@@ -177,6 +259,8 @@ void ConfigFlags(void)
 	Set_autoreconnect_enabled(config.autoreconnect_enabled);
 	Set_esc_clear_screen(config.esc_clear_screen);
 	Set_timestamp(config.timestamp);
+	Set_paced_paste(config.paced_paste);
+	Set_line_mode(config.line_mode);
 }
 
 /* This list should perhaps be added to the configuration? */
@@ -294,7 +378,7 @@ static void free_device_paths(const struct device_path *paths)
 }
 
 /* Compare strings with digit sequences treated in groups */
-static int compare_seminum(const void *a, const void *b)
+int compare_seminum(const void *a, const void *b)
 {
 	const char *sa = a;
 	const char *sb = b;
@@ -426,6 +510,39 @@ static gchar *dlist_to_string(const struct device_path *dlist)
 	return str;
 }
 
+/* Show what the registry knows about the device typed in the port box */
+static void port_info_update(GtkComboBox *Combo, GtkLabel *Label)
+{
+	const serial_device_t *dev;
+	const gchar *text;
+	GString *info;
+
+	text = gtk_entry_get_text(GTK_ENTRY(gtk_bin_get_child(GTK_BIN(Combo))));
+	dev = device_registry_lookup(text);
+	if (dev == NULL)
+	{
+		gtk_label_set_text(Label, "");
+		return;
+	}
+
+	info = g_string_new(NULL);
+	if (dev->vendor)
+		g_string_append_printf(info, "%s ", dev->vendor);
+	if (dev->model)
+		g_string_append_printf(info, "%s ", dev->model);
+	if (dev->serial)
+		g_string_append_printf(info, _("(serial %s) "), dev->serial);
+	if (dev->driver)
+		g_string_append_printf(info, "[%s]", dev->driver);
+	if (strcmp(text, dev->path))
+		g_string_append_printf(info, "\n%s", dev->path);
+	else if (dev->by_id)
+		g_string_append_printf(info, "\n%s", dev->by_id);
+
+	gtk_label_set_text(Label, info->str);
+	g_string_free(info, TRUE);
+}
+
 void Config_Port_Fenetre(GtkAction *action, gpointer data)
 {
 	GtkWidget *Table, *Label, *Bouton_OK, *Bouton_annule,
@@ -433,32 +550,55 @@ void Config_Port_Fenetre(GtkAction *action, gpointer data)
 	          *Spin, *Expander, *ExpanderVbox,
 	          *content_area, *action_area;
 
-	static GtkWidget *Combos[10];
+	static GtkWidget *Combos[18];
 	GtkAdjustment *adj;
 	gchar *string;
 	char *prev;
 	int i;
 	const struct device_path *device_paths;
+	const GPtrArray *devices;
+	const serial_device_t *dev;
 	GPtrArray *ports;
 	int speed_index;
 
-	device_paths = get_device_paths();
-	ports = find_serial_ports(device_paths);
+	/* The registry is filled from udev once and then kept up to date,
+	   so this costs nothing. Fall back to scanning /dev without udev. */
+	devices = device_registry_get();
+	ports = g_ptr_array_new();
+	for (i = 0; i < devices->len; i++)
+	{
+		dev = g_ptr_array_index(devices, i);
+		if (dev->accessible)
+			g_ptr_array_add(ports, g_strdup(dev->path));
+	}
+	for (i = 0; i < devices->len; i++)
+	{
+		dev = g_ptr_array_index(devices, i);
+		if (dev->accessible && dev->by_id)
+			g_ptr_array_add(ports, g_strdup(dev->by_id));
+	}
 
 	if (!ports->len)
 	{
-		gchar *patterns = dlist_to_string(device_paths);
-		string = g_strdup_printf(_("No serial devices found!\n"
-					   "\n"
-					   "Searched the following device path patterns:\n"
-					   "%s\n"
-					   "Enter a different device path in the 'Port' box.\n"), patterns);
-		g_free(patterns);
-		show_message(string, MSG_WRN);
-		g_free(string);
-	}
+		g_ptr_array_free(ports, TRUE);
+		device_paths = get_device_paths();
+		ports = find_serial_ports(device_paths);
 
-	free_device_paths(device_paths);
+		if (!ports->len)
+		{
+			gchar *patterns = dlist_to_string(device_paths);
+			string = g_strdup_printf(_("No serial devices found!\n"
+						   "\n"
+						   "Searched the following device path patterns:\n"
+						   "%s\n"
+						   "Enter a different device path in the 'Port' box.\n"), patterns);
+			g_free(patterns);
+			show_message(string, MSG_WRN);
+			g_free(string);
+		}
+
+		free_device_paths(device_paths);
+	}
 
 	Dialogue = gtk_dialog_new();
 	content_area = gtk_dialog_get_content_area(GTK_DIALOG(Dialogue));
@@ -470,7 +610,7 @@ void Config_Port_Fenetre(GtkAction *action, gpointer data)
 	Frame = gtk_frame_new(_("Serial port"));
 	gtk_box_pack_start(GTK_BOX(content_area), Frame, FALSE, TRUE, 5);
 
-	Table = gtk_table_new(4, 3, FALSE);
+	Table = gtk_table_new(5, 3, FALSE);
 	gtk_container_add(GTK_CONTAINER(Frame), Table);
 
 	Label = gtk_label_new(_("Port:"));
@@ -514,6 +654,14 @@ void Config_Port_Fenetre(GtkAction *action, gpointer data)
 	gtk_table_attach(GTK_TABLE(Table), Combo, 0, 1, 1, 2, GTK_FILL | GTK_EXPAND, GTK_FILL | GTK_EXPAND, 5, 5);
 	Combos[0] = Combo;
 
+	/* Vendor, model and serial number of the selected device */
+	Label = gtk_label_new("");
+	gtk_label_set_selectable(GTK_LABEL(Label), TRUE);
+	gtk_label_set_ellipsize(GTK_LABEL(Label), PANGO_ELLIPSIZE_MIDDLE);
+	gtk_table_attach(GTK_TABLE(Table), Label, 0, 3, 4, 5, GTK_FILL | GTK_EXPAND, 0, 10, 5);
+	g_signal_connect(GTK_COMBO_BOX(Combo), "changed", G_CALLBACK(port_info_update), Label);
+	port_info_update(GTK_COMBO_BOX(Combo), GTK_LABEL(Label));
+
 	Combo = gtk_combo_box_text_new_with_entry();
 	gtk_entry_set_max_length(GTK_ENTRY(gtk_bin_get_child (GTK_BIN (Combo))), 10);
 
@@ -690,6 +838,92 @@ void Config_Port_Fenetre(GtkAction *action, gpointer data)
 	gtk_table_attach(GTK_TABLE(Table), Spin, 1, 2, 1, 2, GTK_FILL | GTK_EXPAND, GTK_FILL | GTK_EXPAND, 5, 5);
 	Combos[9] = Spin;
 
+	Frame = gtk_frame_new(_("Hexadecimal view framing"));
+	gtk_container_add(GTK_CONTAINER(ExpanderVbox), Frame);
+
+	Table = gtk_table_new(2, 2, FALSE);
+	gtk_container_add(GTK_CONTAINER(Frame), Table);
+
+	Label = gtk_label_new(_("New line after this idle time (characters, 0 for never):"));
+	gtk_table_attach_defaults(GTK_TABLE(Table), Label, 0, 1, 0, 1);
+
+	adj = gtk_adjustment_new(0.0, 0.0, 10000.0, 1.0, 10.0, 0.0);
+	Spin = gtk_spin_button_new(GTK_ADJUSTMENT(adj), 0, 0);
+	gtk_spin_button_set_numeric(GTK_SPIN_BUTTON(Spin), TRUE);
+	gtk_spin_button_set_value(GTK_SPIN_BUTTON(Spin), (gfloat)config.frame_idle);
+	gtk_table_attach(GTK_TABLE(Table), Spin, 1, 2, 0, 1, GTK_FILL | GTK_EXPAND, GTK_FILL | GTK_EXPAND, 5, 5);
+	Combos[10] = Spin;
+
+	CheckBouton = gtk_check_button_new_with_label(_("New line after this byte (hexadecimal):"));
+	gtk_table_attach_defaults(GTK_TABLE(Table), CheckBouton, 0, 1, 1, 2);
+	Combos[11] = CheckBouton;
+
+	Combo = gtk_entry_new();
+	gtk_entry_set_max_length(GTK_ENTRY(Combo), 2);
+	gtk_entry_set_width_chars(GTK_ENTRY(Combo), 2);
+	if(config.frame_delimiter != -1)
+	{
+		string = g_strdup_printf("%02X", config.frame_delimiter);
+		gtk_entry_set_text(GTK_ENTRY(Combo), string);
+		g_free(string);
+		gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(CheckBouton), TRUE);
+	}
+	gtk_table_attach(GTK_TABLE(Table), Combo, 1, 2, 1, 2, GTK_FILL | GTK_EXPAND, GTK_FILL | GTK_EXPAND, 5, 5);
+	Combos[12] = Combo;
+
+	Frame = gtk_frame_new(_("Port sharing (local connections only)"));
+	gtk_container_add(GTK_CONTAINER(ExpanderVbox), Frame);
+
+	Table = gtk_table_new(3, 2, FALSE);
+	gtk_container_add(GTK_CONTAINER(Frame), Table);
+
+	Label = gtk_label_new(_("TCP port (0 for none):"));
+	gtk_table_attach_defaults(GTK_TABLE(Table), Label, 0, 1, 0, 1);
+
+	adj = gtk_adjustment_new(0.0, 0.0, 65535.0, 1.0, 10.0, 0.0);
+	Spin = gtk_spin_button_new(GTK_ADJUSTMENT(adj), 0, 0);
+	gtk_spin_button_set_numeric(GTK_SPIN_BUTTON(Spin), TRUE);
+	gtk_spin_button_set_value(GTK_SPIN_BUTTON(Spin), (gfloat)config.share_port);
+	gtk_widget_set_tooltip_text(Spin, _("Any user of this computer can connect to it, without authentication"));
+	gtk_table_attach(GTK_TABLE(Table), Spin, 1, 2, 0, 1, GTK_FILL | GTK_EXPAND, GTK_FILL | GTK_EXPAND, 5, 5);
+	Combos[13] = Spin;
+
+	Label = gtk_label_new(_("Unix socket (empty for none):"));
+	gtk_table_attach_defaults(GTK_TABLE(Table), Label, 0, 1, 1, 2);
+
+	Combo = gtk_entry_new();
+	gtk_entry_set_max_length(GTK_ENTRY(Combo), sizeof(config.share_socket) - 1);
+	gtk_entry_set_text(GTK_ENTRY(Combo), config.share_socket);
+	gtk_widget_set_tooltip_text(Combo, _("Only you can connect to it"));
+	gtk_table_attach(GTK_TABLE(Table), Combo, 1, 2, 1, 2, GTK_FILL | GTK_EXPAND, GTK_FILL | GTK_EXPAND, 5, 5);
+	Combos[14] = Combo;
+
+	CheckBouton = gtk_check_button_new_with_label(_("RFC 2217 (telnet com port control) instead of raw data"));
+	gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(CheckBouton), config.share_rfc2217);
+	gtk_table_attach_defaults(GTK_TABLE(Table), CheckBouton, 0, 2, 2, 3);
+	Combos[15] = CheckBouton;
+
+	Frame = gtk_frame_new(_("Latency"));
+	gtk_container_add(GTK_CONTAINER(ExpanderVbox), Frame);
+
+	Table = gtk_table_new(2, 2, FALSE);
+	gtk_container_add(GTK_CONTAINER(Frame), Table);
+
+	CheckBouton = gtk_check_button_new_with_label(_("Low latency (driver wakes up on each byte, USB adapter timer at 1 ms)"));
+	gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(CheckBouton), config.low_latency);
+	gtk_table_attach_defaults(GTK_TABLE(Table), CheckBouton, 0, 2, 0, 1);
+	Combos[16] = CheckBouton;
+
+	Label = gtk_label_new(_("Gather received bytes for (microseconds, 0 for none):"));
+	gtk_table_attach_defaults(GTK_TABLE(Table), Label, 0, 1, 1, 2);
+
+	adj = gtk_adjustment_new(0.0, 0.0, 100000.0, 100.0, 1000.0, 0.0);
+	Spin = gtk_spin_button_new(GTK_ADJUSTMENT(adj), 0, 0);
+	gtk_spin_button_set_numeric(GTK_SPIN_BUTTON(Spin), TRUE);
+	gtk_spin_button_set_value(GTK_SPIN_BUTTON(Spin), (gfloat)config.read_coalesce);
+	gtk_table_attach(GTK_TABLE(Table), Spin, 1, 2, 1, 2, GTK_FILL | GTK_EXPAND, GTK_FILL | GTK_EXPAND, 5, 5);
+	Combos[17] = Spin;
+
 
 	Bouton_OK = gtk_button_new_with_label(_("OK"));
 	gtk_box_pack_start(GTK_BOX(action_area), Bouton_OK, FALSE, TRUE, 0);
@@ -702,9 +936,39 @@ void Config_Port_Fenetre(GtkAction *action, gpointer data)
 	gtk_widget_show_all(Dialogue);
 }
 
+/* Nothing stops another local user on TCP: only shared when confirmed */
+static gboolean confirm_tcp_share(GtkWidget *parent, gint port)
+{
+	GtkWidget *message_dialog;
+	gboolean accepted;
+
+	message_dialog = gtk_message_dialog_new_with_markup(GTK_WINDOW(parent),
+	                 GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT,
+	                 GTK_MESSAGE_WARNING,
+	                 GTK_BUTTONS_NONE,
+	                 _("<b>Share the port on TCP port %d?</b>\n\n"
+	                   "Any user of this computer can connect to it without a password, "
+	                   "send data to the device and, with RFC 2217, change the speed and "
+	                   "the control signals. A Unix socket is restricted to you."),
+	                 port);
+
+	gtk_dialog_add_buttons(GTK_DIALOG(message_dialog),
+	                       "_Cancel",
+	                       GTK_RESPONSE_NONE,
+	                       _("_Share"),
+	                       GTK_RESPONSE_ACCEPT,
+	                       NULL);
+
+	accepted = gtk_dialog_run(GTK_DIALOG(message_dialog)) == GTK_RESPONSE_ACCEPT;
+	gtk_widget_destroy(message_dialog);
+
+	return accepted;
+}
+
 gint Lis_Config(GtkWidget *bouton, GtkWidget **Combos)
 {
 	gchar *message;
+	gint tcp_port;
 
 	message = gtk_combo_box_text_get_active_text(GTK_COMBO_BOX_TEXT(Combos[0]));
 	strcpy(config.port, message);
@@ -755,6 +1019,21 @@ gint Lis_Config(GtkWidget *bouton, GtkWidget **Combos)
 	else
 		config.car = -1;
 
+	config.frame_idle = gtk_spin_button_get_value_as_int(GTK_SPIN_BUTTON(Combos[10]));
+	if(gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(Combos[11])))
+		config.frame_delimiter = parse_frame_delimiter(gtk_entry_get_text(GTK_ENTRY(Combos[12])));
+	else
+		config.frame_delimiter = -1;
+
+	tcp_port = gtk_spin_button_get_value_as_int(GTK_SPIN_BUTTON(Combos[13]));
+	if(tcp_port == 0 || tcp_port == config.share_port ||
+	   confirm_tcp_share(gtk_widget_get_toplevel(bouton), tcp_port))
+		config.share_port = tcp_port;
+	g_strlcpy(config.share_socket, gtk_entry_get_text(GTK_ENTRY(Combos[14])), sizeof(config.share_socket));
+	config.share_rfc2217 = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(Combos[15]));
+	config.low_latency = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(Combos[16]));
+	config.read_coalesce = gtk_spin_button_get_value_as_int(GTK_SPIN_BUTTON(Combos[17]));
+
 	Config_port();
 	ConfigFlags();
 
@@ -834,7 +1113,7 @@ void Select_config(gchar *title, void *callback)
 
 	/* Parse the config file */
 
-	max = cfgParse(g_file_get_path(config_file), cfg, CFG_INI);
+	max = config_model_load();
 
 	if(max == -1)
 	{
@@ -946,14 +1225,12 @@ void Save_config_file(void)
 
 void really_save_config(GtkDialog *Fenetre, gint id, gpointer data)
 {
-	int max, cfg_num, i;
+	int max;
 	gchar *string = NULL;
 
-	cfg_num = -1;
-
 	if(id == GTK_RESPONSE_ACCEPT)
 	{
-		max = cfgParse(g_file_get_path(config_file), cfg, CFG_INI);
+		max = config_model_load();
 
 		if(max == -1)
 		{
@@ -961,37 +1238,24 @@ void really_save_config(GtkDialog *Fenetre, gint id, gpointer data)
 			return;
 		}
 
-		for(i = 0; i < max; i++)
-		{
-			if(!strcmp((char *)data, cfgSectionNumberToName(i)))
-				cfg_num = i;
-		}
+		/* overwriting: the new section is appended at the end */
+		if(cfgSectionNameToNumber((char *)data) != -1)
+			cfgRemoveSection(cfg, (char *)data);
 
-		/* not overwriting */
-		if(cfg_num == -1)
+		max = cfgAllocForNewSection(cfg, (char *)data);
+		if(max == -1)
 		{
-			max = cfgAllocForNewSection(cfg, (char *)data);
-			cfg_num = max - 1;
+			show_message(_("Cannot overwrite section!"), MSG_ERR);
+			return;
 		}
-		else
+
+		Copy_configuration(max - 1);
+		if(config_model_save(max) == -1)
 		{
-			if(remove_section(g_file_get_path(config_file), (char *)data) == -1)
-			{
-				show_message(_("Cannot overwrite section!"), MSG_ERR);
-				return;
-			}
-			if(max == cfgParse(g_file_get_path(config_file), cfg, CFG_INI))
-			{
-				show_message(_("Cannot read configuration file!"), MSG_ERR);
-				return;
-			}
-			max = cfgAllocForNewSection(cfg, (char *)data);
-			cfg_num = max - 1;
+			show_message(_("Cannot save configuration file!\n"), MSG_ERR);
+			return;
 		}
 
-		Copy_configuration(cfg_num);
-		cfgDump(g_file_get_path(config_file), cfg, CFG_INI, max);
-
 		string = g_strdup_printf(_("Configuration [%s] saved\n"), (char *)data);
 		show_message(string, MSG_WRN);
 		g_free(string);
@@ -1002,12 +1266,12 @@ void really_save_config(GtkDialog *Fenetre, gint id, gpointer data)
 
 void save_config(GtkDialog *Fenetre, gint id, GtkWidget *edit)
 {
-	int max, i;
+	int max;
 	const gchar *config_name;
 
 	if(id == GTK_RESPONSE_ACCEPT)
 	{
-		max = cfgParse(g_file_get_path(config_file), cfg, CFG_INI);
+		max = config_model_load();
 
 		if(max == -1)
 		{
@@ -1017,34 +1281,29 @@ void save_config(GtkDialog *Fenetre, gint id, GtkWidget *edit)
 
 		config_name = gtk_entry_get_text(GTK_ENTRY(edit));
 
-		for(i = 0; i < max; i++)
+		if(cfgSectionNameToNumber(config_name) != -1)
 		{
-			if(!strcmp(config_name, cfgSectionNumberToName(i)))
-			{
-				GtkWidget *message_dialog;
-				message_dialog = gtk_message_dialog_new_with_markup(GTK_WINDOW(Fenetre),
-				                 GTK_DIALOG_DESTROY_WITH_PARENT,
-				                 GTK_MESSAGE_QUESTION,
-				                 GTK_BUTTONS_NONE,
-				                 _("<b>Section [%s] already exists.</b>\n\nDo you want to overwrite it ?"),
-				                 config_name);
-
-				gtk_dialog_add_buttons(GTK_DIALOG(message_dialog),
-				                       "_Cancel",
-				                       GTK_RESPONSE_NONE,
-				                       "_Yes",
-				                       GTK_RESPONSE_ACCEPT,
-				                       NULL);
-
-				if (gtk_dialog_run(GTK_DIALOG(message_dialog)) == GTK_RESPONSE_ACCEPT)
-					really_save_config(Fenetre, GTK_RESPONSE_ACCEPT, (gpointer)config_name);
-
-				gtk_widget_destroy(message_dialog);
-
-				i = max + 1;
-			}
+			GtkWidget *message_dialog;
+			message_dialog = gtk_message_dialog_new_with_markup(GTK_WINDOW(Fenetre),
+			                 GTK_DIALOG_DESTROY_WITH_PARENT,
+			                 GTK_MESSAGE_QUESTION,
+			                 GTK_BUTTONS_NONE,
+			                 _("<b>Section [%s] already exists.</b>\n\nDo you want to overwrite it ?"),
+			                 config_name);
+
+			gtk_dialog_add_buttons(GTK_DIALOG(message_dialog),
+			                       "_Cancel",
+			                       GTK_RESPONSE_NONE,
+			                       "_Yes",
+			                       GTK_RESPONSE_ACCEPT,
+			                       NULL);
+
+			if (gtk_dialog_run(GTK_DIALOG(message_dialog)) == GTK_RESPONSE_ACCEPT)
+				really_save_config(Fenetre, GTK_RESPONSE_ACCEPT, (gpointer)config_name);
+
+			gtk_widget_destroy(message_dialog);
 		}
-		if(i == max) /* Section does not exist */
+		else /* Section does not exist */
 			really_save_config(Fenetre, GTK_RESPONSE_ACCEPT, (gpointer)config_name);
 	}
 }
@@ -1079,27 +1338,49 @@ void delete_config(GtkDialog *Fenetre, gint id, GtkTreeSelection *Selection_List
 	GtkTreeIter iter;
 	GtkTreeModel *Modele;
 	gchar *txt;
+	gint max;
 
 	if(id == GTK_RESPONSE_ACCEPT)
 	{
 		if(gtk_tree_selection_get_selected(Selection_Liste, &Modele, &iter))
 		{
 			gtk_tree_model_get(GTK_TREE_MODEL(Modele), &iter, 0, (gint *)&txt, -1);
-			if(remove_section(g_file_get_path(config_file), txt) == -1)
+			if(config_model_load() == -1 ||
+			   (max = cfgRemoveSection(cfg, txt)) == -1 ||
+			   config_model_save(max) == -1)
 				show_message(_("Cannot delete section!"), MSG_ERR);
 		}
 	}
 }
 
+/* Frame delimiter byte as written in the configuration, -1 for none */
+static gint parse_frame_delimiter(const gchar *text)
+{
+	gchar *end;
+	glong value;
+
+	if(text == NULL || *text == 0 || !g_ascii_strcasecmp(text, "none"))
+		return -1;
+
+	value = strtol(text, &end, 16);
+	if(*end != 0 || value < 0 || value > 0xFF)
+		return -1;
+
+	return value;
+}
+
 gint Load_configuration_from_file(gchar *config_name)
 {
 	int max, i, j, k, size;
 	gchar *string = NULL;
 	gchar *str;
 	macro_t *macros = NULL;
+	GArray *rules;
+	highlight_rule_t rule;
+	gchar **fields;
 	cfgList *t;
 
-	max = cfgParse(g_file_get_path(config_file), cfg, CFG_INI);
+	max = config_model_load();
 
 	if(max == -1)
 	{
@@ -1107,187 +1388,236 @@ gint Load_configuration_from_file(gchar *config_name)
 		return -1;
 	}
 
+	i = cfgSectionNameToNumber(config_name);
+	if(i == -1)
+	{
+		string = g_strdup_printf(_("No section \"%s\" in configuration file\n"), config_name);
+		show_message(string, MSG_ERR);
+		g_free(string);
+		return -1;
+	}
+
+	Hard_default_configuration();
+
+	if(port[i] != NULL)
+		strcpy(config.port, port[i]);
+	if(speed[i] != 0)
+		config.vitesse = speed[i];
+	if(bits[i] != 0)
+		config.bits = bits[i];
+	if(stopbits[i] != 0)
+		config.stops = stopbits[i];
+	if(parity[i] != NULL)
+	{
+		if(!g_ascii_strcasecmp(parity[i], "none"))
+			config.parite = 0;
+		else if(!g_ascii_strcasecmp(parity[i], "odd"))
+			config.parite = 1;
+		else if(!g_ascii_strcasecmp(parity[i], "even"))
+			config.parite = 2;
+	}
+	if(flow[i] != NULL)
+	{
+		if(!g_ascii_strcasecmp(flow[i], "none"))
+			config.flux = 0;
+		else if(!g_ascii_strcasecmp(flow[i], "xon"))
+			config.flux = 1;
+		else if(!g_ascii_strcasecmp(flow[i], "rts"))
+			config.flux = 2;
+		else if(!g_ascii_strcasecmp(flow[i], "rs485"))
+			config.flux = 3;
+	}
+
+	config.delai = wait_delay[i];
+
+	if(wait_char[i] != 0)
+		config.car = (signed char)wait_char[i];
 	else
+		config.car = -1;
+
+	config.rs485_rts_time_before_transmit = rts_time_before_tx[i];
+	config.rs485_rts_time_after_transmit = rts_time_after_tx[i];
+
+	if(echo[i] != -1)
+		config.echo = (gboolean)echo[i];
+	else
+		config.echo = FALSE;
+
+	if(crlfauto[i] != -1)
+		config.crlfauto = (gboolean)crlfauto[i];
+	else
+		config.crlfauto = FALSE;
+
+	if(autoreconnect_enabled[i] != -1)
+		config.autoreconnect_enabled = (gboolean)autoreconnect_enabled[i];
+	else
+		config.autoreconnect_enabled = FALSE;
+
+	if(esc_clear_screen[i] != -1)
+		config.esc_clear_screen = (gboolean)esc_clear_screen[i];
+	else
+		config.esc_clear_screen = FALSE;
+
+	if(timestamp[i] != -1)
+		config.timestamp = (gboolean)timestamp[i];
+	else
+		config.timestamp = FALSE;
+
+	if(paced_paste[i] != -1)
+		config.paced_paste = (gboolean)paced_paste[i];
+	else
+		config.paced_paste = FALSE;
+
+	if(line_mode[i] != -1)
+		config.line_mode = (gboolean)line_mode[i];
+	else
+		config.line_mode = FALSE;
+
+	config.frame_idle = frame_idle[i];
+	config.frame_delimiter = parse_frame_delimiter(frame_delimiter[i]);
+
+	config.share_port = share_port[i];
+	if(share_socket[i] != NULL)
+		g_strlcpy(config.share_socket, share_socket[i], sizeof(config.share_socket));
+	else
+		config.share_socket[0] = 0;
+	if(share_rfc2217[i] != -1)
+		config.share_rfc2217 = (gboolean)share_rfc2217[i];
+	else
+		config.share_rfc2217 = FALSE;
+	if(low_latency[i] != -1)
+		config.low_latency = (gboolean)low_latency[i];
+	else
+		config.low_latency = FALSE;
+	config.read_coalesce = read_coalesce[i];
+
+	g_free(term_conf.font);
+	term_conf.font = g_strdup(font[i]);
+
+	t = macro_list[i];
+	size = 0;
+	if(t != NULL)
 	{
-		for(i = 0; i < max; i++)
+		size++;
+		while(t->next != NULL)
 		{
-			if(!strcmp(config_name, cfgSectionNumberToName(i)))
+			t = t->next;
+			size++;
+		}
+	}
+
+	if(size != 0)
+	{
+		t = macro_list[i];
+		macros = g_malloc(size * sizeof(macro_t));
+		if(macros == NULL)
+		{
+			perror("malloc");
+			return -1;
+		}
+		for(j = 0; j < size; j++)
+		{
+			for(k = 0; k < (strlen(t->str) - 1); k++)
 			{
-				Hard_default_configuration();
-
-				if(port[i] != NULL)
-					strcpy(config.port, port[i]);
-				if(speed[i] != 0)
-					config.vitesse = speed[i];
-				if(bits[i] != 0)
-					config.bits = bits[i];
-				if(stopbits[i] != 0)
-					config.stops = stopbits[i];
-				if(parity[i] != NULL)
-				{
-					if(!g_ascii_strcasecmp(parity[i], "none"))
-						config.parite = 0;
-					else if(!g_ascii_strcasecmp(parity[i], "odd"))
-						config.parite = 1;
-					else if(!g_ascii_strcasecmp(parity[i], "even"))
-						config.parite = 2;
-				}
-				if(flow[i] != NULL)
-				{
-					if(!g_ascii_strcasecmp(flow[i], "none"))
-						config.flux = 0;
-					else if(!g_ascii_strcasecmp(flow[i], "xon"))
-						config.flux = 1;
-					else if(!g_ascii_strcasecmp(flow[i], "rts"))
-						config.flux = 2;
-					else if(!g_ascii_strcasecmp(flow[i], "rs485"))
-						config.flux = 3;
-				}
-
-				config.delai = wait_delay[i];
-
-				if(wait_char[i] != 0)
-					config.car = (signed char)wait_char[i];
-				else
-					config.car = -1;
-
-				config.rs485_rts_time_before_transmit = rts_time_before_tx[i];
-				config.rs485_rts_time_after_transmit = rts_time_after_tx[i];
-
-				if(echo[i] != -1)
-					config.echo = (gboolean)echo[i];
-				else
-					config.echo = FALSE;
-
-				if(crlfauto[i] != -1)
-					config.crlfauto = (gboolean)crlfauto[i];
-				else
-					config.crlfauto = FALSE;
-
-				if(autoreconnect_enabled[i] != -1)
-					config.autoreconnect_enabled = (gboolean)autoreconnect_enabled[i];
-				else
-					config.autoreconnect_enabled = FALSE;
-
-				if(esc_clear_screen[i] != -1)
-					config.esc_clear_screen = (gboolean)esc_clear_screen[i];
-				else
-					config.esc_clear_screen = FALSE;
-
-				if(timestamp[i] != -1)
-					config.timestamp = (gboolean)timestamp[i];
-				else
-					config.timestamp = FALSE;
-
-				g_free(term_conf.font);
-				term_conf.font = g_strdup(font[i]);
-
-				t = macro_list[i];
-				size = 0;
-				if(t != NULL)
-				{
-					size++;
-					while(t->next != NULL)
-					{
-						t = t->next;
-						size++;
-					}
-				}
-
-				if(size != 0)
-				{
-					t = macro_list[i];
-					macros = g_malloc(size * sizeof(macro_t));
-					if(macros == NULL)
-					{
-						perror("malloc");
-						return -1;
-					}
-					for(j = 0; j < size; j++)
-					{
-						for(k = 0; k < (strlen(t->str) - 1); k++)
-						{
-							if((t->str[k] == ':') && (t->str[k + 1] == ':'))
-								break;
-						}
-						macros[j].shortcut = g_strndup(t->str, k);
-						str = &(t->str[k + 2]);
-						macros[j].action = g_strdup(str);
-
-						t = t->next;
-					}
-				}
-
-				remove_shortcuts();
-				create_shortcuts(macros, size);
-				g_free(macros);
-
-				if(block_cursor[i] != -1)
-					term_conf.block_cursor = (gboolean)block_cursor[i];
-				else
-					term_conf.block_cursor = TRUE;
-
-				if(rows[i] != 0)
-					term_conf.rows = rows[i];
-
-				if(columns[i] != 0)
-					term_conf.columns = columns[i];
-
-				if(scrollback[i] != 0)
-					term_conf.scrollback = scrollback[i];
-
-				if(visual_bell[i] != -1)
-					term_conf.visual_bell = (gboolean)visual_bell[i];
-				else
-					term_conf.visual_bell = FALSE;
-
-				term_conf.foreground_color.red = foreground_red[i];
-				term_conf.foreground_color.green = foreground_green[i];
-				term_conf.foreground_color.blue = foreground_blue[i];
-				term_conf.foreground_color.alpha = foreground_alpha[i];
-
-				term_conf.background_color.red = background_red[i];
-				term_conf.background_color.green = background_green[i];
-				term_conf.background_color.blue = background_blue[i];
-				term_conf.background_color.alpha = background_alpha[i];
-
-				/* rows and columns are empty when the conf is autogenerate in the
-				   first save; so set term to default */
-				if(rows[i] == 0 || columns[i] == 0)
-				{
-					term_conf.block_cursor = TRUE;
-					term_conf.rows = 80;
-					term_conf.columns = 25;
-					term_conf.scrollback = DEFAULT_SCROLLBACK;
-					term_conf.visual_bell = FALSE;
-
-					term_conf.foreground_color.red = 0.66;
-					term_conf.foreground_color.green = 0.66;
-					term_conf.foreground_color.blue = 0.66;
-					term_conf.foreground_color.alpha = 1;
-
-					term_conf.background_color.red = 0;
-					term_conf.background_color.green = 0;
-					term_conf.background_color.blue = 0;
-					term_conf.background_color.alpha = 1;
-				}
-
-				i = max + 1;
+				if((t->str[k] == ':') && (t->str[k + 1] == ':'))
+					break;
 			}
+			macros[j].shortcut = g_strndup(t->str, k);
+			str = &(t->str[k + 2]);
+			macros[j].action = g_strdup(str);
+
+			t = t->next;
 		}
-		if(i == max)
+	}
+
+	remove_shortcuts();
+	create_shortcuts(macros, size);
+	g_free(macros);
+
+	/* regex or literal::text colour::background::text */
+	rules = g_array_new(FALSE, FALSE, sizeof(highlight_rule_t));
+	for(t = highlight_list[i]; t != NULL; t = t->next)
+	{
+		fields = g_strsplit(t->str, "::", 4);
+		if(g_strv_length(fields) == 4)
 		{
-			string = g_strdup_printf(_("No section \"%s\" in configuration file\n"), config_name);
-			show_message(string, MSG_ERR);
-			g_free(string);
-			return -1;
+			rule.regex = (fields[0][0] == 'r');
+			rule.foreground = fields[1][0] ? g_strdup(fields[1]) : NULL;
+			rule.background = fields[2][0] ? g_strdup(fields[2]) : NULL;
+			rule.pattern = g_strdup(fields[3]);
+			g_array_append_val(rules, rule);
 		}
+		g_strfreev(fields);
+	}
+	highlight_set_rules((highlight_rule_t *)rules->data, rules->len);
+	for(j = 0; j < rules->len; j++)
+	{
+		rule = g_array_index(rules, highlight_rule_t, j);
+		g_free(rule.pattern);
+		g_free(rule.foreground);
+		g_free(rule.background);
+	}
+	g_array_free(rules, TRUE);
+
+	if(block_cursor[i] != -1)
+		term_conf.block_cursor = (gboolean)block_cursor[i];
+	else
+		term_conf.block_cursor = TRUE;
+
+	if(rows[i] != 0)
+		term_conf.rows = rows[i];
+
+	if(columns[i] != 0)
+		term_conf.columns = columns[i];
+
+	if(scrollback[i] != 0)
+		term_conf.scrollback = scrollback[i];
+
+	if(scrollback_memory[i] != 0)
+		term_conf.scrollback_memory = scrollback_memory[i];
+
+	if(visual_bell[i] != -1)
+		term_conf.visual_bell = (gboolean)visual_bell[i];
+	else
+		term_conf.visual_bell = FALSE;
+
+	term_conf.foreground_color.red = foreground_red[i];
+	term_conf.foreground_color.green = foreground_green[i];
+	term_conf.foreground_color.blue = foreground_blue[i];
+	term_conf.foreground_color.alpha = foreground_alpha[i];
+
+	term_conf.background_color.red = background_red[i];
+	term_conf.background_color.green = background_green[i];
+	term_conf.background_color.blue = background_blue[i];
+	term_conf.background_color.alpha = background_alpha[i];
+
+	/* rows and columns are empty when the conf is autogenerate in the
+	   first save; so set term to default */
+	if(rows[i] == 0 || columns[i] == 0)
+	{
+		term_conf.block_cursor = TRUE;
+		term_conf.rows = 80;
+		term_conf.columns = 25;
+		term_conf.scrollback = DEFAULT_SCROLLBACK;
+		term_conf.scrollback_memory = DEFAULT_SCROLLBACK_MEMORY;
+		term_conf.visual_bell = FALSE;
+
+		term_conf.foreground_color.red = 0.66;
+		term_conf.foreground_color.green = 0.66;
+		term_conf.foreground_color.blue = 0.66;
+		term_conf.foreground_color.alpha = 1;
+
+		term_conf.background_color.red = 0;
+		term_conf.background_color.green = 0;
+		term_conf.background_color.blue = 0;
+		term_conf.background_color.alpha = 1;
 	}
 
 	vte_terminal_set_font(VTE_TERMINAL(display), pango_font_description_from_string(term_conf.font));
 
 	vte_terminal_set_size (VTE_TERMINAL(display), term_conf.rows, term_conf.columns);
 	vte_terminal_set_scrollback_lines (VTE_TERMINAL(display), term_conf.scrollback);
+	data_store_set_budget((gsize)term_conf.scrollback_memory << 20);
 	vte_terminal_set_color_foreground (VTE_TERMINAL(display), &term_conf.foreground_color);
 	vte_terminal_set_color_background (VTE_TERMINAL(display), &term_conf.background_color);
 	vte_terminal_set_color_background (VTE_TERMINAL(display), &term_conf.background_color);
@@ -1326,6 +1656,15 @@ void Verify_configuration(void)
 		g_free(string);
 	}
 
+	if(config.frame_idle < 0)
+		config.frame_idle = 0;
+
+	if(config.share_port < 0 || config.share_port > 65535)
+		config.share_port = 0;
+
+	if(config.read_coalesce < 0 || config.read_coalesce > 100000)
+		config.read_coalesce = 0;
+
 	if(config.delai < 0 || config.delai > 500)
 	{
 		string = g_strdup_printf(_("Invalid delay: %d ms\nFalling back to default delay: %d ms\n"), config.delai, DEFAULT_DELAY);
@@ -1345,7 +1684,7 @@ gint Check_configuration_file(void)
 	gchar *string = NULL;
 
 	/* is configuration file present ? */
-	if(stat(g_file_get_path(config_file), &my_stat) == 0)
+	if(stat(config_file_path, &my_stat) == 0)
 	{
 		/* If bad configuration file, fallback to _hardcoded_ defaults! */
 		if(Load_configuration_from_file("default") == -1)
@@ -1358,12 +1697,12 @@ gint Check_configuration_file(void)
 	/* if not, create it, with the [default] section */
 	else
 	{
-		string = g_strdup_printf(_("Configuration file (%s) with\n[default] configuration has been created.\n"), g_file_get_path(config_file));
+		string = g_strdup_printf(_("Configuration file (%s) with\n[default] configuration has been created.\n"), config_file_path);
 		show_message(string, MSG_WRN);
 		cfgAllocForNewSection(cfg, "default");
 		Hard_default_configuration();
 		Copy_configuration(0);
-		cfgDump(g_file_get_path(config_file), cfg, CFG_INI, 1);
+		config_model_save(1);
 		g_free(string);
 	}
 	return 0;
@@ -1386,7 +1725,16 @@ void Hard_default_configuration(void)
 	config.autoreconnect_enabled = FALSE;
 	config.esc_clear_screen = FALSE;
 	config.timestamp = FALSE;
+	config.paced_paste = FALSE;
+	config.line_mode = FALSE;
+	config.frame_idle = 0;
+	config.frame_delimiter = -1;
+	config.share_port = 0;
+	config.share_socket[0] = 0;
+	config.share_rfc2217 = FALSE;
   config.disable_port_lock = FALSE;
+	config.low_latency = FALSE;
+	config.read_coalesce = 0;
 
 	term_conf.font = g_strdup_printf(DEFAULT_FONT);
 
@@ -1394,7 +1742,9 @@ void Hard_default_configuration(void)
 	term_conf.rows = 80;
 	term_conf.columns = 25;
 	term_conf.scrollback = DEFAULT_SCROLLBACK;
+	term_conf.scrollback_memory = DEFAULT_SCROLLBACK_MEMORY;
 	term_conf.visual_bell = TRUE;
+	data_store_set_budget((gsize)term_conf.scrollback_memory << 20);
 
 	Selec_couleur(&term_conf.foreground_color, 0.66, 0.66, 0.66, 1.0);
 	Selec_couleur(&term_conf.background_color, 0, 0, 0, 1.0);
@@ -1404,6 +1754,7 @@ void Copy_configuration(int pos)
 {
 	gchar *string = NULL;
 	macro_t *macros = NULL;
+	const highlight_rule_t *rules;
 	gint size, i;
 
 	string = g_strdup(config.port);
@@ -1515,6 +1866,59 @@ void Copy_configuration(int pos)
 	cfgStoreValue(cfg, "timestamp", string, CFG_INI, pos);
 	g_free(string);
 
+	if(config.paced_paste == FALSE)
+		string = g_strdup_printf("False");
+	else
+		string = g_strdup_printf("True");
+
+	cfgStoreValue(cfg, "paced_paste", string, CFG_INI, pos);
+	g_free(string);
+
+	if(config.line_mode == FALSE)
+		string = g_strdup_printf("False");
+	else
+		string = g_strdup_printf("True");
+
+	cfgStoreValue(cfg, "line_mode", string, CFG_INI, pos);
+	g_free(string);
+
+	string = g_strdup_printf("%d", config.frame_idle);
+	cfgStoreValue(cfg, "frame_idle", string, CFG_INI, pos);
+	g_free(string);
+
+	if(config.frame_delimiter == -1)
+		string = g_strdup_printf("none");
+	else
+		string = g_strdup_printf("%02X", config.frame_delimiter);
+	cfgStoreValue(cfg, "frame_delimiter", string, CFG_INI, pos);
+	g_free(string);
+
+	string = g_strdup_printf("%d", config.share_port);
+	cfgStoreValue(cfg, "share_port", string, CFG_INI, pos);
+	g_free(string);
+
+	string = g_strdup(config.share_socket);
+	cfgStoreValue(cfg, "share_socket", string, CFG_INI, pos);
+	g_free(string);
+
+	if(config.share_rfc2217 == FALSE)
+		string = g_strdup_printf("False");
+	else
+		string = g_strdup_printf("True");
+	cfgStoreValue(cfg, "share_rfc2217", string, CFG_INI, pos);
+	g_free(string);
+
+	if(config.low_latency == FALSE)
+		string = g_strdup_printf("False");
+	else
+		string = g_strdup_printf("True");
+	cfgStoreValue(cfg, "low_latency", string, CFG_INI, pos);
+	g_free(string);
+
+	string = g_strdup_printf("%d", config.read_coalesce);
+	cfgStoreValue(cfg, "read_coalesce", string, CFG_INI, pos);
+	g_free(string);
+
 	string = g_strdup(term_conf.font);
 	cfgStoreValue(cfg, "font", string, CFG_INI, pos);
 	g_free(string);
@@ -1527,6 +1931,17 @@ void Copy_configuration(int pos)
 		g_free(string);
 	}
 
+	rules = highlight_get_rules(&size);
+	for(i = 0; i < size; i++)
+	{
+		string = g_strdup_printf("%s::%s::%s::%s", rules[i].regex ? "regex" : "literal",
+		                         rules[i].foreground ? rules[i].foreground : "",
+		                         rules[i].background ? rules[i].background : "",
+		                         rules[i].pattern);
+		cfgStoreValue(cfg, "highlights", string, CFG_INI, pos);
+		g_free(string);
+	}
+
 	if(term_conf.block_cursor == FALSE)
 		string = g_strdup_printf("False");
 	else
@@ -1546,6 +1961,10 @@ void Copy_configuration(int pos)
 	cfgStoreValue(cfg, "term_scrollback", string, CFG_INI, pos);
 	g_free(string);
 
+	string = g_strdup_printf("%d", term_conf.scrollback_memory);
+	cfgStoreValue(cfg, "term_scrollback_memory", string, CFG_INI, pos);
+	g_free(string);
+
 	if(term_conf.visual_bell == FALSE)
 		string = g_strdup_printf("False");
 	else
@@ -1581,89 +2000,6 @@ void Copy_configuration(int pos)
 }
 
 
-gint remove_section(gchar *cfg_file, gchar *section)
-{
-	FILE *f = NULL;
-	char *buffer = NULL;
-	char *buf;
-	long size;
-	gchar *to_search;
-	long i, j, length, sect;
-
-	f = fopen(cfg_file, "r");
-	if(f == NULL)
-	{
-		perror(cfg_file);
-		return -1;
-	}
-
-	fseek(f, 0L, SEEK_END);
-	size = ftell(f);
-	rewind(f);
-
-	buffer = g_malloc(size);
-	if(buffer == NULL)
-	{
-		perror("malloc");
-		return -1;
-	}
-
-	if(fread(buffer, 1, size, f) != size)
-	{
-		perror(cfg_file);
-		fclose(f);
-		return -1;
-	}
-
-	to_search = g_strdup_printf("[%s]", section);
-	length = strlen(to_search);
-
-	/* Search section */
-	for(i = 0; i < size - length; i++)
-	{
-		for(j = 0; j < length; j++)
-		{
-			if(to_search[j] != buffer[i + j])
-				break;
-		}
-		if(j == length)
-			break;
-	}
-
-	if(i == size - length)
-	{
-		i18n_printf(_("Cannot find section %s\n"), to_search);
-		return -1;
-	}
-
-	sect = i;
-
-	/* Search for next section */
-	for(i = sect + length; i < size; i++)
-	{
-		if(buffer[i] == '[')
-			break;
-	}
-
-	f = fopen(cfg_file, "w");
-	if(f == NULL)
-	{
-		perror(cfg_file);
-		return -1;
-	}
-
-	fwrite(buffer, 1, sect, f);
-	buf = buffer + i;
-	fwrite(buf, 1, size - i, f);
-	fclose(f);
-
-	g_free(to_search);
-	g_free(buffer);
-
-	return 0;
-}
-
-
 void Config_Terminal(GtkAction *action, gpointer data)
 {
 	GtkBuilder *builder;
@@ -1687,6 +2023,12 @@ void Config_Terminal(GtkAction *action, gpointer data)
 	gtk_adjustment_set_value(cfg_scrollback_lines, term_conf.scrollback);
 	g_signal_connect(G_OBJECT(cfg_scrollback_lines), "value_changed", G_CALLBACK(scrollback_set), 0);
 
+	// Scrollback Memory
+	GtkAdjustment *cfg_scrollback_memory;
+	cfg_scrollback_memory = GTK_ADJUSTMENT(gtk_builder_get_object(builder, "cfg_scrollback_memory"));
+	gtk_adjustment_set_value(cfg_scrollback_memory, term_conf.scrollback_memory);
+	g_signal_connect(G_OBJECT(cfg_scrollback_memory), "value_changed", G_CALLBACK(scrollback_memory_set), 0);
+
 	// Show cursor
 	GtkWidget *cfg_block_cursor;
 	cfg_block_cursor = GTK_WIDGET(gtk_builder_get_object(builder, "cfg_block_cursor"));
@@ -1730,48 +2072,18 @@ void Selec_couleur(GdkRGBA *color, gfloat R, gfloat G, gfloat B, gfloat A)
 
 void config_fg_color(GtkWidget *button, gpointer data)
 {
-	gchar *string;
-
 	gtk_color_chooser_get_rgba(GTK_COLOR_CHOOSER(button), &term_conf.foreground_color);
 
 	vte_terminal_set_color_foreground (VTE_TERMINAL(display), &term_conf.foreground_color);
 	gtk_widget_queue_draw (display);
-
-	string = g_strdup_printf ("%d", (gint)term_conf.foreground_color.red);
-	cfgStoreValue (cfg, "term_foreground_red", string, CFG_INI, 0);
-	g_free (string);
-	string = g_strdup_printf ("%d", (gint)term_conf.foreground_color.green);
-	cfgStoreValue (cfg, "term_foreground_green", string, CFG_INI, 0);
-	g_free (string);
-	string = g_strdup_printf ("%d", (gint)term_conf.foreground_color.blue);
-	cfgStoreValue (cfg, "term_foreground_blue", string, CFG_INI, 0);
-	g_free (string);
-	string = g_strdup_printf ("%d", (gint)term_conf.foreground_color.alpha);
-	cfgStoreValue (cfg, "term_foreground_alpha", string, CFG_INI, 0);
-	g_free (string);
 }
 
 void config_bg_color(GtkWidget *button, gpointer data)
 {
-	gchar *string;
-
 	gtk_color_chooser_get_rgba(GTK_COLOR_CHOOSER(button), &term_conf.background_color);
 
 	vte_terminal_set_color_background (VTE_TERMINAL(display), &term_conf.background_color);
 	gtk_widget_queue_draw (display);
-
-	string = g_strdup_printf ("%d", (gint)term_conf.background_color.red);
-	cfgStoreValue (cfg, "term_background_red", string, CFG_INI, 0);
-	g_free (string);
-	string = g_strdup_printf ("%d", (gint)term_conf.background_color.green);
-	cfgStoreValue (cfg, "term_background_green", string, CFG_INI, 0);
-	g_free (string);
-	string = g_strdup_printf ("%d", (gint)term_conf.background_color.blue);
-	cfgStoreValue (cfg, "term_background_blue", string, CFG_INI, 0);
-	g_free (string);
-	string = g_strdup_printf ("%d", (gint)term_conf.background_color.alpha);
-	cfgStoreValue (cfg, "term_background_alpha", string, CFG_INI, 0);
-	g_free (string);
 }
 
 void scrollback_set(GtkAdjustment *Adjustment, gpointer data)
@@ -1781,6 +2093,12 @@ void scrollback_set(GtkAdjustment *Adjustment, gpointer data)
 	vte_terminal_set_scrollback_lines (VTE_TERMINAL(display), term_conf.scrollback);
 }
 
+void scrollback_memory_set(GtkAdjustment *Adjustment, gpointer data)
+{
+	term_conf.scrollback_memory = gtk_adjustment_get_value(Adjustment);
+	data_store_set_budget((gsize)term_conf.scrollback_memory << 20);
+}
+
 /**
  *  Filter user data entry on a GTK entry
  *
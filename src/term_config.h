@@ -32,6 +32,7 @@ void check_text_input(GtkEditable *editable,
                       gint        *position,
                       gpointer     user_data);
 void clear_scrollback(void);
+int compare_seminum(const void *a, const void *b);
 
 struct configuration_port
 {
@@ -50,7 +51,16 @@ struct configuration_port
 	gboolean autoreconnect_enabled;	// enable autoreconnect
 	gboolean esc_clear_screen;   // clear screen when receive ESC char ('\x1b' - 27)
 	gboolean timestamp;
+	gboolean paced_paste;        // send pasted text line by line
+	gboolean line_mode;          // edit lines locally, send them on Enter
+	gint frame_idle;             // hex view: new line after this idle time, in chars (0 : off)
+	gint frame_delimiter;        // hex view: new line after this byte (-1 : off)
+	gint share_port;             // share the port on this local TCP port (0 : off)
+	gchar share_socket[108];     // and/or on this Unix socket ("" : off)
+	gboolean share_rfc2217;      // RFC 2217 clients instead of raw data
 	gboolean disable_port_lock;
+	gboolean low_latency;        // driver and USB adapter tuned for latency
+	gint read_coalesce;          // us to gather received bytes before handing them over (0 : off)
 };
 
 typedef struct
@@ -59,6 +69,7 @@ typedef struct
 	gint rows;
 	gint columns;
 	gint scrollback;
+	gint scrollback_memory;	/* MiB of history for the data view */
 	gboolean visual_bell;
 	GdkRGBA foreground_color;
 	GdkRGBA background_color;
@@ -68,6 +79,7 @@ typedef struct
 
 #define DEFAULT_FONT "Monospace 12"
 #define DEFAULT_SCROLLBACK 10000
+#define DEFAULT_SCROLLBACK_MEMORY 64
 
 #define DEFAULT_PORT "/dev/ttyS0"
 #define DEFAULT_SPEED 115200
@@ -0,0 +1,1934 @@
+/***********************************************************************/
+/* transfer.c                                                          */
+/* ----------                                                          */
+/*                           GTKTerm Software                          */
+/*                                 (c)                                 */
+/*                                                                     */
+/* ------------------------------------------------------------------- */
+/*                                                                     */
+/*   Purpose                                                           */
+/*      XMODEM / YMODEM / ZMODEM file transfers                        */
+/*      - The transfer runs in a thread of its own, on a copy of the   */
+/*        port descriptor, while the main loop stops reading the port  */
+/*      - Files sent are mapped, XMODEM blocks go out of the mapping   */
+/*                                                                     */
+/***********************************************************************/
+
+#include <gtk/gtk.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <termios.h>
+#include <sys/uio.h>
+#include <sys/stat.h>
+
+#include "term_config.h"
+#include "serial.h"
+#include "interface.h"
+#include "transfer.h"
+
+#include <config.h>
+#include <glib/gi18n.h>
+
+/* XMODEM / YMODEM */
+#define SOH 0x01
+#define STX 0x02
+#define EOT 0x04
+#define ACK 0x06
+#define NAK 0x15
+#define CAN 0x18
+#define CPMEOF 0x1A
+
+/* ZMODEM */
+#define ZPAD '*'
+#define ZDLE 0x18
+#define ZBIN 'A'
+#define ZHEX 'B'
+#define ZBIN32 'C'
+#define XON 0x11
+#define XOFF 0x13
+
+#define ZRQINIT 0
+#define ZRINIT 1
+#define ZSINIT 2
+#define ZACK 3
+#define ZFILE 4
+#define ZSKIP 5
+#define ZNAK 6
+#define ZABORT 7
+#define ZFIN 8
+#define ZRPOS 9
+#define ZDATA 10
+#define ZEOF 11
+#define ZFERR 12
+#define ZCRC 13
+#define ZCHALLENGE 14
+#define ZCAN 16
+
+#define ZCRCE 'h'
+#define ZCRCG 'i'
+#define ZCRCQ 'j'
+#define ZCRCW 'k'
+#define ZRUB0 'l'
+#define ZRUB1 'm'
+#define GOT_END 0x100		/* or'ed with the end of a data subpacket */
+
+#define CANFDX 0x01
+#define CANOVIO 0x02
+#define CANFC32 0x20
+#define ESCCTL 0x40
+#define ZCBIN 1
+
+#define ZTX_SUBPACKET 1024
+#define ZRX_SUBPACKET 8192
+#define ZWINDOW (64 * 1024)	/* data sent ahead of the last ZACK */
+
+/* Results of the worker functions, 0 or a byte when all is well */
+#define T_OK 0
+#define T_TIMEOUT -1
+#define T_ERROR -2		/* the port failed */
+#define T_CANCEL -3		/* cancelled here */
+#define T_REMOTE -4		/* cancelled by the other side */
+#define T_BAD -5		/* damaged data */
+
+#define RETRIES 10
+#define TIMEOUT_START 60000	/* ms, for the other side to start */
+#define TIMEOUT_BLOCK 10000
+#define TIMEOUT_CHAR 1000
+
+typedef struct {
+	gint protocol;
+	gboolean sending;
+	gint fd;		/* copy of the port descriptor */
+	gchar **files;		/* to send */
+	gchar *destination;	/* folder, or file for XMODEM */
+	GThread *thread;
+	gint cancel;
+
+	/* Progress, shared with the main thread */
+	GMutex lock;
+	gchar *current;
+	guint64 done;		/* bytes of the current file */
+	guint64 total;
+	guint64 previous;	/* bytes of the files already transferred */
+	guint files_done;
+	gint64 start;
+	gchar *error;
+
+	/* Used by the worker only */
+	guchar rx[4096];
+	gint rx_pos, rx_len;
+	gboolean crc32;		/* ZMODEM frames we send */
+	gboolean rx_crc32;	/* ZMODEM frame being received */
+	gboolean escctl;
+	guchar last_sent;
+	guchar out[2 * ZTX_SUBPACKET + 64];
+	guchar in[ZRX_SUBPACKET + 16];
+} transfer_t;
+
+extern GtkWidget *Fenetre;
+extern struct configuration_port config;
+
+static transfer_t *transfer = NULL;
+static GtkWidget *progress_dialog, *progress_file, *progress_bar, *progress_rate;
+static guint progress_timer;
+
+static guint16 crc16_table[256];
+static guint32 crc32_table[256];
+
+static void crc_tables_init(void)
+{
+	guint i, j;
+	guint16 c16;
+	guint32 c32;
+
+	for(i = 0; i < 256; i++)
+	{
+		c16 = i << 8;
+		c32 = i;
+		for(j = 0; j < 8; j++)
+		{
+			c16 = (c16 & 0x8000) ? (c16 << 1) ^ 0x1021 : c16 << 1;
+			c32 = (c32 & 1) ? (c32 >> 1) ^ 0xEDB88320 : c32 >> 1;
+		}
+		crc16_table[i] = c16;
+		crc32_table[i] = c32;
+	}
+}
+
+/* CRC-16/XMODEM, also used by ZMODEM */
+static guint16 crc16(guint16 crc, const guchar *data, gsize len)
+{
+	while(len--)
+		crc = (crc << 8) ^ crc16_table[(crc >> 8) ^ *data++];
+	return crc;
+}
+
+/* Running CRC-32, start with 0xFFFFFFFF and invert at the end */
+static guint32 crc32(guint32 crc, const guchar *data, gsize len)
+{
+	while(len--)
+		crc = (crc >> 8) ^ crc32_table[(crc ^ *data++) & 0xFF];
+	return crc;
+}
+
+static void fail(transfer_t *t, const gchar *message)
+{
+	g_mutex_lock(&t->lock);
+	if(t->error == NULL)
+		t->error = g_strdup(message);
+	g_mutex_unlock(&t->lock);
+}
+
+static void progress_start(transfer_t *t, const gchar *name, guint64 total)
+{
+	g_mutex_lock(&t->lock);
+	g_free(t->current);
+	t->current = g_strdup(name);
+	t->previous += t->done;
+	t->done = 0;
+	t->total = total;
+	g_mutex_unlock(&t->lock);
+}
+
+static void progress_set(transfer_t *t, guint64 done)
+{
+	g_mutex_lock(&t->lock);
+	t->done = done;
+	g_mutex_unlock(&t->lock);
+}
+
+static void progress_file_done(transfer_t *t)
+{
+	g_mutex_lock(&t->lock);
+	t->files_done++;
+	g_mutex_unlock(&t->lock);
+}
+
+/* Next byte from the port, or T_TIMEOUT, T_ERROR, T_CANCEL */
+static gint port_getc(transfer_t *t, gint timeout)
+{
+	struct pollfd p;
+	gint64 end;
+	gint left, n;
+
+	if(t->rx_pos < t->rx_len)
+		return t->rx[t->rx_pos++];
+
+	end = g_get_monotonic_time() + (gint64)timeout * 1000;
+	p.fd = t->fd;
+	p.events = POLLIN;
+
+	while(!g_atomic_int_get(&t->cancel))
+	{
+		left = (end - g_get_monotonic_time()) / 1000;
+		if(left < 0)
+			return T_TIMEOUT;
+
+		/* Short slices to see a cancel quickly */
+		n = poll(&p, 1, MIN(left, 100));
+		if(n < 0 && errno != EINTR)
+			break;
+		if(n <= 0)
+			continue;
+		if(p.revents & (POLLERR | POLLHUP | POLLNVAL))
+			break;
+
+		n = read(t->fd, t->rx, sizeof(t->rx));
+		if(n > 0)
+		{
+			t->rx_len = n;
+			t->rx_pos = 1;
+			return t->rx[0];
+		}
+		if(n == 0 || (errno != EAGAIN && errno != EINTR))
+			break;
+	}
+
+	if(g_atomic_int_get(&t->cancel))
+		return T_CANCEL;
+
+	fail(t, _("Read error on the port"));
+	return T_ERROR;
+}
+
+static gboolean port_has_data(transfer_t *t)
+{
+	struct pollfd p;
+
+	if(t->rx_pos < t->rx_len)
+		return TRUE;
+
+	p.fd = t->fd;
+	p.events = POLLIN;
+	return poll(&p, 1, 0) > 0;
+}
+
+/* Throw away what the other side has sent, up to a short silence */
+static void port_purge(transfer_t *t)
+{
+	gint64 end = g_get_monotonic_time() + 3 * G_USEC_PER_SEC;
+
+	t->rx_pos = t->rx_len = 0;
+	while(port_getc(t, 200) >= 0 && g_get_monotonic_time() < end)
+		t->rx_pos = t->rx_len;
+}
+
+static gint port_writev(transfer_t *t, struct iovec *iov, gint count)
+{
+	struct pollfd p;
+	gssize n;
+
+	p.fd = t->fd;
+	p.events = POLLOUT;
+
+	while(count > 0)
+	{
+		if(g_atomic_int_get(&t->cancel))
+			return T_CANCEL;
+
+		n = writev(t->fd, iov, count);
+		if(n < 0)
+		{
+			if(errno == EAGAIN)
+				poll(&p, 1, 100);
+			else if(errno != EINTR)
+			{
+				fail(t, _("Write error on the port"));
+				return T_ERROR;
+			}
+			continue;
+		}
+
+		while(count > 0 && (gsize)n >= iov->iov_len)
+		{
+			n -= iov->iov_len;
+			iov++;
+			count--;
+		}
+		if(count > 0)
+		{
+			iov->iov_base = (guchar *)iov->iov_base + n;
+			iov->iov_len -= n;
+		}
+	}
+
+	return T_OK;
+}
+
+static gint port_write(transfer_t *t, const void *data, gsize len)
+{
+	struct iovec iov;
+
+	iov.iov_base = (void *)data;
+	iov.iov_len = len;
+	return port_writev(t, &iov, 1);
+}
+
+/* Abort sequence understood by all three protocols */
+static void send_cancel(transfer_t *t)
+{
+	static const guchar cancel[] = {CAN, CAN, CAN, CAN, CAN, CAN, CAN, CAN,
+	                                8, 8, 8, 8, 8, 8, 8, 8};
+	gint saved = g_atomic_int_get(&t->cancel);
+
+	g_atomic_int_set(&t->cancel, 0);
+	port_write(t, cancel, sizeof(cancel));
+	g_atomic_int_set(&t->cancel, saved);
+}
+
+/* Second CAN of a cancel from the other side */
+static gint check_remote_cancel(transfer_t *t)
+{
+	if(port_getc(t, TIMEOUT_CHAR) == CAN)
+	{
+		fail(t, _("Cancelled by the other side"));
+		return T_REMOTE;
+	}
+	return T_OK;
+}
+
+/*
+ * XMODEM / YMODEM
+ */
+
+/* The receiver asks for CRC with 'C', for a checksum with NAK */
+static gint xmodem_wait_start(transfer_t *t, gboolean *crc)
+{
+	gint64 end = g_get_monotonic_time() + (gint64)TIMEOUT_START * 1000;
+	gint c;
+
+	while(g_get_monotonic_time() < end)
+	{
+		c = port_getc(t, TIMEOUT_START);
+		if(c == 'C' || c == NAK)
+		{
+			*crc = (c == 'C');
+			return T_OK;
+		}
+		if(c == CAN && check_remote_cancel(t) != T_OK)
+			return T_REMOTE;
+		if(c < 0 && c != T_TIMEOUT)
+			return c;
+	}
+
+	fail(t, _("The receiver did not start"));
+	return T_TIMEOUT;
+}
+
+static gint xmodem_send_block(transfer_t *t, guint8 number, const guchar *data, gsize len,
+                              gsize size, guchar pad_byte, gboolean crc)
+{
+	guchar head[3], tail[2], pad[1024];
+	struct iovec iov[4];
+	guint16 sum;
+	gsize i;
+	gint retry, c, r;
+
+	memset(pad, pad_byte, size - len);
+	head[0] = (size == 1024) ? STX : SOH;
+	head[1] = number;
+	head[2] = 255 - number;
+
+	if(crc)
+	{
+		sum = crc16(crc16(0, data, len), pad, size - len);
+		tail[0] = sum >> 8;
+		tail[1] = sum & 0xFF;
+	}
+	else
+	{
+		sum = 0;
+		for(i = 0; i < len; i++)
+			sum += data[i];
+		sum += pad_byte * (size - len);
+		tail[0] = sum & 0xFF;
+	}
+
+	for(retry = 0; retry < RETRIES; retry++)
+	{
+		/* Data straight from the mapped file */
+		iov[0].iov_base = head;
+		iov[0].iov_len = 3;
+		iov[1].iov_base = (void *)data;
+		iov[1].iov_len = len;
+		iov[2].iov_base = pad;
+		iov[2].iov_len = size - len;
+		iov[3].iov_base = tail;
+		iov[3].iov_len = crc ? 2 : 1;
+		if((r = port_writev(t, iov, 4)) != T_OK)
+			return r;
+
+		do
+		{
+			c = port_getc(t, TIMEOUT_BLOCK);
+			if(c == ACK)
+				return T_OK;
+			if(c == CAN && check_remote_cancel(t) != T_OK)
+				return T_REMOTE;
+			if(c == T_ERROR || c == T_CANCEL)
+				return c;
+		}
+		while(c != NAK && c != T_TIMEOUT);
+	}
+
+	fail(t, _("Too many retries"));
+	return T_BAD;
+}
+
+static gint xmodem_send_eot(transfer_t *t)
+{
+	guchar eot = EOT;
+	gint retry, c, r;
+
+	/* YMODEM receivers answer the first EOT with a NAK */
+	for(retry = 0; retry < RETRIES; retry++)
+	{
+		if((r = port_write(t, &eot, 1)) != T_OK)
+			return r;
+		c = port_getc(t, TIMEOUT_BLOCK);
+		if(c == ACK)
+			return T_OK;
+		if(c == T_ERROR || c == T_CANCEL)
+			return c;
+	}
+
+	fail(t, _("End of file not acknowledged"));
+	return T_BAD;
+}
+
+static gint xmodem_send_data(transfer_t *t, const guchar *data, gsize len, gboolean crc)
+{
+	guint8 number = 1;
+	gsize pos = 0, size, chunk;
+	gint r;
+
+	while(pos < len)
+	{
+		/* 1K blocks need CRC, old checksum receivers only take 128 bytes */
+		size = (crc && len - pos > 128) ? 1024 : 128;
+		chunk = MIN(size, len - pos);
+		if((r = xmodem_send_block(t, number++, data + pos, chunk, size, CPMEOF, crc)) != T_OK)
+			return r;
+		pos += chunk;
+		progress_set(t, pos);
+	}
+
+	return xmodem_send_eot(t);
+}
+
+/* Name, size, time and mode of the file, or all zeros at the end */
+static gint ymodem_send_header(transfer_t *t, const gchar *path, gsize len)
+{
+	guchar block[1024];
+	struct stat st;
+	gchar *name;
+	gboolean crc;
+	gint n = 0, r;
+
+	if((r = xmodem_wait_start(t, &crc)) != T_OK)
+		return r;
+
+	memset(block, 0, sizeof(block));
+	if(path != NULL)
+	{
+		name = g_path_get_basename(path);
+		if(g_stat(path, &st) != 0)
+			st.st_mtime = 0, st.st_mode = 0644;
+		n = g_snprintf((gchar *)block, sizeof(block) - 1, "%s", name);
+		n += 1 + g_snprintf((gchar *)block + n + 1, sizeof(block) - n - 1,
+		                    "%" G_GSIZE_FORMAT " %lo %o", len,
+		                    (gulong)st.st_mtime, (guint)(st.st_mode & 0777));
+		g_free(name);
+	}
+
+	return xmodem_send_block(t, 0, block, n < 128 ? 128 : 1024, n < 128 ? 128 : 1024, 0, TRUE);
+}
+
+static GMappedFile *map_file(transfer_t *t, const gchar *path)
+{
+	GMappedFile *map;
+	GError *error = NULL;
+	gchar *msg;
+
+	map = g_mapped_file_new(path, FALSE, &error);
+	if(map == NULL)
+	{
+		msg = g_strdup_printf(_("Cannot open file %s: %s"), path, error->message);
+		fail(t, msg);
+		g_free(msg);
+		g_error_free(error);
+	}
+	return map;
+}
+
+static gint xmodem_send(transfer_t *t)
+{
+	GMappedFile *map;
+	gchar *name;
+	gboolean crc;
+	gint r, i;
+
+	for(i = 0; t->files[i] != NULL; i++)
+	{
+		if((map = map_file(t, t->files[i])) == NULL)
+			return T_ERROR;
+
+		name = g_path_get_basename(t->files[i]);
+		progress_start(t, name, g_mapped_file_get_length(map));
+		g_free(name);
+
+		if(t->protocol == TRANSFER_YMODEM)
+		{
+			r = ymodem_send_header(t, t->files[i], g_mapped_file_get_length(map));
+			if(r == T_OK)
+				r = xmodem_wait_start(t, &crc);
+		}
+		else
+			r = xmodem_wait_start(t, &crc);
+
+		if(r == T_OK)
+			r = xmodem_send_data(t, (const guchar *)g_mapped_file_get_contents(map),
+			                     g_mapped_file_get_length(map), crc);
+		g_mapped_file_unref(map);
+		if(r != T_OK)
+			return r;
+		progress_file_done(t);
+
+		/* XMODEM has no batch */
+		if(t->protocol == TRANSFER_XMODEM)
+			return T_OK;
+	}
+
+	return ymodem_send_header(t, NULL, 0);
+}
+
+/* Rest of a block once its first byte is known, returns its number */
+static gint xmodem_read_block(transfer_t *t, gint first, guchar *data, gsize *size, gboolean crc)
+{
+	guchar head[2], tail[2];
+	guint16 sum;
+	gsize i, n;
+	gint c;
+
+	*size = (first == STX) ? 1024 : 128;
+	n = 2 + *size + (crc ? 2 : 1);
+
+	for(i = 0; i < n; i++)
+	{
+		c = port_getc(t, TIMEOUT_CHAR);
+		if(c < 0)
+			return (c == T_TIMEOUT) ? T_BAD : c;
+		if(i < 2)
+			head[i] = c;
+		else if(i < 2 + *size)
+			data[i - 2] = c;
+		else
+			tail[i - 2 - *size] = c;
+	}
+
+	if(head[0] != 255 - head[1])
+		return T_BAD;
+
+	if(crc)
+	{
+		sum = crc16(0, data, *size);
+		if(tail[0] != sum >> 8 || tail[1] != (sum & 0xFF))
+			return T_BAD;
+	}
+	else
+	{
+		sum = 0;
+		for(i = 0; i < *size; i++)
+			sum += data[i];
+		if(tail[0] != (sum & 0xFF))
+			return T_BAD;
+	}
+
+	return head[0];
+}
+
+/*
+ * Receive blocks into out, from block number first. A YMODEM size
+ * (or -1) cuts the padding of the last block, XMODEM loses its
+ * trailing CPMEOF bytes instead. With first == 0 the YMODEM header
+ * block is returned in header.
+ */
+static gint xmodem_receive_data(transfer_t *t, FILE *out, gint64 size, guint8 first, guchar *header)
+{
+	guchar data[1024], held[1024];
+	gsize len, held_len = 0;
+	guint64 written = 0;
+	guint8 expected = first;
+	gboolean crc = TRUE, eot = FALSE;
+	guchar reply;
+	gint c, number, tries = 0;
+
+	reply = 'C';
+	port_write(t, &reply, 1);
+
+	for(;;)
+	{
+		c = port_getc(t, (expected == first) ? 3000 : TIMEOUT_BLOCK);
+		if(c == T_TIMEOUT)
+		{
+			if(++tries > RETRIES)
+			{
+				fail(t, _("The sender stopped"));
+				return T_TIMEOUT;
+			}
+			/* Old senders only know the checksum */
+			if(expected == first && first == 1 && tries == 4)
+				crc = FALSE;
+			reply = (expected == first) ? (crc ? 'C' : NAK) : NAK;
+			port_write(t, &reply, 1);
+			continue;
+		}
+		if(c < 0)
+			return c;
+
+		if(c == CAN)
+		{
+			if(check_remote_cancel(t) != T_OK)
+				return T_REMOTE;
+			continue;
+		}
+
+		if(c == EOT && first != 0)
+		{
+			/* YMODEM wants the first EOT refused */
+			if(size >= 0 && !eot)
+			{
+				eot = TRUE;
+				reply = NAK;
+				port_write(t, &reply, 1);
+				continue;
+			}
+			if(size < 0)
+				while(held_len > 0 && held[held_len - 1] == CPMEOF)
+					held_len--;
+			if(held_len > 0 && fwrite(held, 1, held_len, out) != held_len)
+			{
+				fail(t, _("Cannot write the received file"));
+				return T_ERROR;
+			}
+			progress_set(t, written + held_len);
+			reply = ACK;
+			return port_write(t, &reply, 1);
+		}
+
+		if(c != SOH && c != STX)
+			continue;
+
+		number = xmodem_read_block(t, c, data, &len, crc);
+		if(number == T_BAD)
+		{
+			port_purge(t);
+			reply = NAK;
+			port_write(t, &reply, 1);
+			continue;
+		}
+		if(number < 0)
+			return number;
+
+		tries = 0;
+		if(number == expected)
+		{
+			if(first == 0 && header != NULL)
+			{
+				memcpy(header, data, len);
+				reply = ACK;
+				return port_write(t, &reply, 1);
+			}
+
+			/* Only the last block has padding, keep one block back */
+			if(held_len > 0 && fwrite(held, 1, held_len, out) != held_len)
+			{
+				fail(t, _("Cannot write the received file"));
+				return T_ERROR;
+			}
+			written += held_len;
+			if(size >= 0 && written + len > (guint64)size)
+				len = (written > (guint64)size) ? 0 : size - written;
+			memcpy(held, data, len);
+			held_len = len;
+			expected++;
+			progress_set(t, written + held_len);
+		}
+		else if(number != (guint8)(expected - 1))
+		{
+			fail(t, _("Blocks out of sequence"));
+			return T_BAD;
+		}
+
+		/* A repeated block is acknowledged again */
+		reply = ACK;
+		port_write(t, &reply, 1);
+	}
+}
+
+static FILE *open_destination(transfer_t *t, const gchar *path, const gchar *mode)
+{
+	FILE *out;
+	gchar *msg;
+
+	out = g_fopen(path, mode);
+	if(out == NULL)
+	{
+		msg = g_strdup_printf(_("Cannot open file %s: %s"), path, strerror(errno));
+		fail(t, msg);
+		g_free(msg);
+		return NULL;
+	}
+	setvbuf(out, NULL, _IOFBF, 1 << 16);
+	return out;
+}
+
+/* Name sent by the other side, kept inside the destination folder */
+static gchar *destination_path(transfer_t *t, const gchar *remote)
+{
+	gchar *name, *path;
+
+	name = g_path_get_basename(remote);
+	if(*name == 0 || !strcmp(name, ".") || !strcmp(name, "..") || !strcmp(name, G_DIR_SEPARATOR_S))
+	{
+		g_free(name);
+		name = g_strdup("received.bin");
+	}
+	path = g_build_filename(t->destination, name, NULL);
+	g_free(name);
+	return path;
+}
+
+static gint xmodem_receive(transfer_t *t)
+{
+	guchar header[1024];
+	gchar *path, *name;
+	gint64 size;
+	FILE *out;
+	gint r;
+
+	if(t->protocol == TRANSFER_XMODEM)
+	{
+		name = g_path_get_basename(t->destination);
+		progress_start(t, name, 0);
+		g_free(name);
+		if((out = open_destination(t, t->destination, "wb")) == NULL)
+			return T_ERROR;
+		r = xmodem_receive_data(t, out, -1, 1, NULL);
+		if(fclose(out) != 0 && r == T_OK)
+		{
+			fail(t, _("Cannot write the received file"));
+			r = T_ERROR;
+		}
+		if(r == T_OK)
+			progress_file_done(t);
+		return r;
+	}
+
+	for(;;)
+	{
+		memset(header, 0, sizeof(header));
+		if((r = xmodem_receive_data(t, NULL, -1, 0, header)) != T_OK)
+			return r;
+
+		/* Empty name: end of the batch */
+		if(header[0] == 0)
+			return T_OK;
+
+		header[sizeof(header) - 1] = 0;
+		size = g_ascii_strtoll((gchar *)header + strlen((gchar *)header) + 1, NULL, 10);
+		path = destination_path(t, (gchar *)header);
+		name = g_path_get_basename(path);
+		progress_start(t, name, size > 0 ? size : 0);
+		g_free(name);
+
+		out = open_destination(t, path, "wb");
+		g_free(path);
+		if(out == NULL)
+			return T_ERROR;
+		r = xmodem_receive_data(t, out, size > 0 ? size : -1, 1, NULL);
+		if(fclose(out) != 0 && r == T_OK)
+		{
+			fail(t, _("Cannot write the received file"));
+			r = T_ERROR;
+		}
+		if(r != T_OK)
+			return r;
+		progress_file_done(t);
+	}
+}
+
+/*
+ * ZMODEM
+ */
+
+static void zpos(guchar hdr[4], guint32 pos)
+{
+	hdr[0] = pos & 0xFF;
+	hdr[1] = (pos >> 8) & 0xFF;
+	hdr[2] = (pos >> 16) & 0xFF;
+	hdr[3] = pos >> 24;
+}
+
+static guint32 zgetpos(const guchar hdr[4])
+{
+	return hdr[0] | (hdr[1] << 8) | (hdr[2] << 16) | ((guint32)hdr[3] << 24);
+}
+
+static gsize zescape(transfer_t *t, guchar *out, const guchar *in, gsize len)
+{
+	gsize i, n = 0;
+	guchar c;
+
+	for(i = 0; i < len; i++)
+	{
+		c = in[i];
+		switch(c)
+		{
+		case ZDLE:
+		case 0x10:
+		case XON:
+		case XOFF:
+		case 0x90:
+		case XON | 0x80:
+		case XOFF | 0x80:
+			out[n++] = ZDLE;
+			c ^= 0x40;
+			break;
+		case '\r':
+		case '\r' | 0x80:
+			/* Telnet escapes "@\r" */
+			if((t->last_sent & 0x7F) == '@')
+			{
+				out[n++] = ZDLE;
+				c ^= 0x40;
+			}
+			break;
+		default:
+			if(t->escctl && (c & 0x60) == 0)
+			{
+				out[n++] = ZDLE;
+				c ^= 0x40;
+			}
+			break;
+		}
+		out[n++] = c;
+		t->last_sent = c;
+	}
+
+	return n;
+}
+
+static gint zput_hex_header(transfer_t *t, guchar type, const guchar hdr[4])
+{
+	gchar buf[32];
+	guchar raw[5];
+	gint len;
+
+	raw[0] = type;
+	memcpy(raw + 1, hdr, 4);
+	len = g_snprintf(buf, sizeof(buf), "%c%c%cB%02x%02x%02x%02x%02x%04x\r\212",
+	                 ZPAD, ZPAD, ZDLE, type, hdr[0], hdr[1], hdr[2], hdr[3], crc16(0, raw, 5));
+	if(type != ZFIN && type != ZACK)
+		buf[len++] = XON;
+
+	return port_write(t, buf, len);
+}
+
+static gint zput_bin_header(transfer_t *t, guchar type, const guchar hdr[4])
+{
+	guchar raw[9];
+	guint32 crc;
+	gsize n;
+
+	raw[0] = type;
+	memcpy(raw + 1, hdr, 4);
+
+	t->out[0] = ZPAD;
+	t->out[1] = ZDLE;
+	if(t->crc32)
+	{
+		t->out[2] = ZBIN32;
+		crc = ~crc32(0xFFFFFFFF, raw, 5);
+		raw[5] = crc & 0xFF;
+		raw[6] = (crc >> 8) & 0xFF;
+		raw[7] = (crc >> 16) & 0xFF;
+		raw[8] = crc >> 24;
+		n = 3 + zescape(t, t->out + 3, raw, 9);
+	}
+	else
+	{
+		t->out[2] = ZBIN;
+		crc = crc16(0, raw, 5);
+		raw[5] = crc >> 8;
+		raw[6] = crc & 0xFF;
+		n = 3 + zescape(t, t->out + 3, raw, 7);
+	}
+
+	return port_write(t, t->out, n);
+}
+
+static gint zput_data(transfer_t *t, const guchar *data, gsize len, guchar end)
+{
+	guchar tail[4];
+	guint32 crc;
+	gsize n;
+
+	n = zescape(t, t->out, data, len);
+	t->out[n++] = ZDLE;
+	t->out[n++] = end;
+
+	if(t->crc32)
+	{
+		crc = ~crc32(crc32(0xFFFFFFFF, data, len), &end, 1);
+		tail[0] = crc & 0xFF;
+		tail[1] = (crc >> 8) & 0xFF;
+		tail[2] = (crc >> 16) & 0xFF;
+		tail[3] = crc >> 24;
+		n += zescape(t, t->out + n, tail, 4);
+	}
+	else
+	{
+		crc = crc16(crc16(0, data, len), &end, 1);
+		tail[0] = crc >> 8;
+		tail[1] = crc & 0xFF;
+		n += zescape(t, t->out + n, tail, 2);
+	}
+
+	if(end == ZCRCW)
+		t->out[n++] = XON;
+
+	return port_write(t, t->out, n);
+}
+
+/* Byte with the ZDLE escape removed, or GOT_END | end of a subpacket */
+static gint zgetc(transfer_t *t, gint timeout)
+{
+	gint c, cancels;
+
+	for(;;)
+	{
+		c = port_getc(t, timeout);
+		if(c < 0)
+			return c;
+		if(c == XON || c == XOFF || c == (XON | 0x80) || c == (XOFF | 0x80))
+			continue;
+		if(c != ZDLE)
+			return c;
+
+		for(cancels = 1; ; cancels++)
+		{
+			c = port_getc(t, timeout);
+			if(c < 0)
+				return c;
+			if(c != CAN)
+				break;
+			if(cancels == 4)
+			{
+				fail(t, _("Cancelled by the other side"));
+				return T_REMOTE;
+			}
+		}
+
+		switch(c)
+		{
+		case ZCRCE:
+		case ZCRCG:
+		case ZCRCQ:
+		case ZCRCW:
+			return GOT_END | c;
+		case ZRUB0:
+			return 0x7F;
+		case ZRUB1:
+			return 0xFF;
+		case XON:
+		case XOFF:
+		case XON | 0x80:
+		case XOFF | 0x80:
+			continue;
+		default:
+			if((c & 0x60) == 0x40)
+				return c ^ 0x40;
+			return T_BAD;
+		}
+	}
+}
+
+static gint zget_hex(transfer_t *t)
+{
+	gint c, i, value = 0;
+
+	for(i = 0; i < 2; i++)
+	{
+		c = port_getc(t, TIMEOUT_CHAR);
+		if(c < 0)
+			return c;
+		c &= 0x7F;
+		if(c >= '0' && c <= '9')
+			value = (value << 4) | (c - '0');
+		else if(c >= 'a' && c <= 'f')
+			value = (value << 4) | (c - 'a' + 10);
+		else
+			return T_BAD;
+	}
+	return value;
+}
+
+/* Next header, its type is returned and its four bytes stored in hdr */
+static gint zget_header(transfer_t *t, guchar hdr[4], gint timeout)
+{
+	guchar raw[9];
+	guint32 crc;
+	gint c, i, n, garbage = 0, cancels = 0;
+
+	for(;;)
+	{
+		c = port_getc(t, timeout);
+		if(c < 0)
+			return c;
+		if(c == CAN)
+		{
+			if(++cancels == 5)
+			{
+				fail(t, _("Cancelled by the other side"));
+				return T_REMOTE;
+			}
+			continue;
+		}
+		cancels = 0;
+		if((c & 0x7F) != ZPAD)
+		{
+			if(++garbage > 4096)
+				return T_BAD;
+			continue;
+		}
+
+		do
+			c = port_getc(t, TIMEOUT_CHAR);
+		while((c & 0x7F) == ZPAD);
+		if(c < 0)
+			return c;
+		if(c != ZDLE)
+			continue;
+
+		c = port_getc(t, TIMEOUT_CHAR);
+		if(c < 0)
+			return c;
+
+		switch(c)
+		{
+		case ZHEX:
+			for(i = 0; i < 7; i++)
+			{
+				if((n = zget_hex(t)) < 0)
+					break;
+				raw[i] = n;
+			}
+			if(i < 7 || crc16(0, raw, 7) != 0)
+				continue;
+			/* CR LF after the header */
+			if((port_getc(t, TIMEOUT_CHAR) & 0x7F) == '\r')
+				port_getc(t, TIMEOUT_CHAR);
+			t->rx_crc32 = FALSE;
+			break;
+		case ZBIN:
+		case ZBIN32:
+			n = (c == ZBIN32) ? 9 : 7;
+			for(i = 0; i < n; i++)
+			{
+				if((c = zgetc(t, TIMEOUT_CHAR)) < 0 || (c & GOT_END))
+					break;
+				raw[i] = c;
+			}
+			if(i < n)
+			{
+				if(c == T_REMOTE || c == T_CANCEL || c == T_ERROR)
+					return c;
+				continue;
+			}
+			if(n == 9)
+			{
+				crc = ~crc32(0xFFFFFFFF, raw, 5);
+				if(raw[5] != (crc & 0xFF) || raw[6] != ((crc >> 8) & 0xFF) ||
+				   raw[7] != ((crc >> 16) & 0xFF) || raw[8] != (crc >> 24))
+					continue;
+			}
+			else if(crc16(0, raw, 7) != 0)
+				continue;
+			t->rx_crc32 = (n == 9);
+			break;
+		default:
+			continue;
+		}
+
+		memcpy(hdr, raw + 1, 4);
+		return raw[0];
+	}
+}
+
+/* Data subpacket into t->in, its end (ZCRCE...) is returned */
+static gint zget_data(transfer_t *t, gsize *len)
+{
+	guchar tail[4];
+	guint32 crc32_sum = 0xFFFFFFFF;
+	guint16 crc16_sum = 0;
+	guchar end;
+	gint c, i, n;
+
+	*len = 0;
+	for(;;)
+	{
+		c = zgetc(t, TIMEOUT_BLOCK);
+		if(c < 0)
+			return c;
+		if(c & GOT_END)
+			break;
+		if(*len >= ZRX_SUBPACKET)
+			return T_BAD;
+		t->in[(*len)++] = c;
+	}
+
+	end = c & 0xFF;
+	n = t->rx_crc32 ? 4 : 2;
+	for(i = 0; i < n; i++)
+	{
+		c = zgetc(t, TIMEOUT_CHAR);
+		if(c < 0)
+			return c;
+		if(c & GOT_END)
+			return T_BAD;
+		tail[i] = c;
+	}
+
+	if(t->rx_crc32)
+	{
+		crc32_sum = ~crc32(crc32(crc32_sum, t->in, *len), &end, 1);
+		if(tail[0] != (crc32_sum & 0xFF) || tail[1] != ((crc32_sum >> 8) & 0xFF) ||
+		   tail[2] != ((crc32_sum >> 16) & 0xFF) || tail[3] != (crc32_sum >> 24))
+			return T_BAD;
+	}
+	else
+	{
+		crc16_sum = crc16(crc16(crc16_sum, t->in, *len), &end, 1);
+		if(tail[0] != (crc16_sum >> 8) || tail[1] != (crc16_sum & 0xFF))
+			return T_BAD;
+	}
+
+	return end;
+}
+
+static gint zmodem_send_file(transfer_t *t, const gchar *path, guint files_left, guint64 bytes_left)
+{
+	GMappedFile *map;
+	const guchar *data;
+	guchar hdr[4], info[1024];
+	struct stat st;
+	gchar *name;
+	guint32 pos = 0, acked = 0, asked = 0, crc;
+	gsize len, n, info_len;
+	guchar end;
+	gboolean full;
+	gint type, tries, r = T_OK;
+
+	if((map = map_file(t, path)) == NULL)
+		return T_ERROR;
+	data = (const guchar *)g_mapped_file_get_contents(map);
+	len = g_mapped_file_get_length(map);
+
+	name = g_path_get_basename(path);
+	progress_start(t, name, len);
+	if(g_stat(path, &st) != 0)
+		st.st_mtime = 0, st.st_mode = 0644;
+	memset(info, 0, sizeof(info));
+	info_len = g_snprintf((gchar *)info, sizeof(info) - 2, "%s", name) + 1;
+	info_len += g_snprintf((gchar *)info + info_len, sizeof(info) - info_len - 1,
+	                       "%" G_GSIZE_FORMAT " %lo %o 0 %u %" G_GUINT64_FORMAT,
+	                       len, (gulong)st.st_mtime, (guint)(st.st_mode & 0777),
+	                       files_left, bytes_left) + 1;
+	g_free(name);
+
+	/* Offer the file, the receiver answers where to start from */
+	for(tries = 0; ; tries++)
+	{
+		if(tries == RETRIES)
+		{
+			fail(t, _("The receiver does not accept the file"));
+			r = T_TIMEOUT;
+			goto out;
+		}
+
+		memset(hdr, 0, 4);
+		hdr[3] = ZCBIN;
+		if((r = zput_bin_header(t, ZFILE, hdr)) != T_OK ||
+		   (r = zput_data(t, info, info_len, ZCRCW)) != T_OK)
+			goto out;
+
+	answer:
+		type = zget_header(t, hdr, TIMEOUT_BLOCK);
+		if(type == ZRPOS)
+		{
+			pos = acked = asked = zgetpos(hdr);
+			break;
+		}
+		if(type == ZSKIP)
+			goto out;
+		/* Repeated ZRINIT from the start, the ZFILE is on its way */
+		if(type == ZRINIT)
+			goto answer;
+		if(type == ZCRC)
+		{
+			/* Crash recovery: CRC of what the receiver already has */
+			n = zgetpos(hdr);
+			if(n == 0 || n > len)
+				n = len;
+			crc = ~crc32(0xFFFFFFFF, data, n);
+			zpos(hdr, crc);
+			if((r = zput_hex_header(t, ZCRC, hdr)) != T_OK)
+				goto out;
+			goto answer;
+		}
+		if(type == T_CANCEL || type == T_ERROR || type == T_REMOTE)
+		{
+			r = type;
+			goto out;
+		}
+	}
+
+data:
+	if(pos >= len)
+		goto eof;
+	zpos(hdr, pos);
+	if((r = zput_bin_header(t, ZDATA, hdr)) != T_OK)
+		goto out;
+
+	while(pos < len)
+	{
+		n = MIN(ZTX_SUBPACKET, len - pos);
+		end = ZCRCG;
+		/* Ask for an acknowledge now and then to bound what is in flight */
+		if(pos + n - asked >= ZWINDOW / 2)
+		{
+			end = ZCRCQ;
+			asked = pos + n;
+		}
+		if(pos + n == len)
+			end = ZCRCE;
+
+		if((r = zput_data(t, data + pos, n, end)) != T_OK)
+			goto out;
+		pos += n;
+		progress_set(t, pos);
+
+		/* Listen to the receiver between subpackets, wait when too far ahead */
+		while(port_has_data(t) || pos - acked > ZWINDOW)
+		{
+			full = pos - acked > ZWINDOW;
+			type = zget_header(t, hdr, full ? TIMEOUT_BLOCK : 100);
+			switch(type)
+			{
+			case ZACK:
+				if(zgetpos(hdr) > acked)
+					acked = zgetpos(hdr);
+				break;
+			case ZRPOS:
+				/* Data lost, go back to where the receiver is */
+				pos = acked = asked = zgetpos(hdr);
+				port_purge(t);
+				goto data;
+			case ZSKIP:
+				goto out;
+			case ZABORT:
+			case ZFERR:
+			case ZCAN:
+				fail(t, _("Cancelled by the other side"));
+				r = T_REMOTE;
+				goto out;
+			case T_TIMEOUT:
+				if(!full)
+					break;
+				fail(t, _("The receiver stopped"));
+				r = T_TIMEOUT;
+				goto out;
+			case T_BAD:
+				break;
+			default:
+				if(type < 0)
+				{
+					r = type;
+					goto out;
+				}
+				break;
+			}
+			/* Only line noise */
+			if((type == T_TIMEOUT || type == T_BAD) && !full)
+				break;
+		}
+	}
+
+eof:
+	for(tries = 0; tries < RETRIES; tries++)
+	{
+		zpos(hdr, len);
+		if((r = zput_bin_header(t, ZEOF, hdr)) != T_OK)
+			goto out;
+
+		do
+			type = zget_header(t, hdr, TIMEOUT_BLOCK);
+		while(type == ZACK);
+
+		if(type == ZRINIT || type == ZSKIP)
+		{
+			r = T_OK;
+			goto out;
+		}
+		if(type == ZRPOS)
+		{
+			pos = acked = asked = zgetpos(hdr);
+			goto data;
+		}
+		if(type == T_CANCEL || type == T_ERROR || type == T_REMOTE)
+		{
+			r = type;
+			goto out;
+		}
+	}
+	fail(t, _("End of file not acknowledged"));
+	r = T_TIMEOUT;
+
+out:
+	g_mapped_file_unref(map);
+	if(r == T_OK)
+		progress_file_done(t);
+	return r;
+}
+
+static gint zmodem_send(transfer_t *t)
+{
+	guchar hdr[4] = {0, 0, 0, 0};
+	struct stat st;
+	guint64 bytes_left = 0;
+	guint files;
+	gint type, tries, r, i;
+
+	for(files = 0; t->files[files] != NULL; files++)
+		if(g_stat(t->files[files], &st) == 0)
+			bytes_left += st.st_size;
+
+	if((r = port_write(t, "rz\r", 3)) != T_OK ||
+	   (r = zput_hex_header(t, ZRQINIT, hdr)) != T_OK)
+		return r;
+
+	for(tries = 0; ; )
+	{
+		type = zget_header(t, hdr, TIMEOUT_BLOCK);
+		if(type == ZRINIT)
+			break;
+		if(type == ZCHALLENGE)
+			zput_hex_header(t, ZACK, hdr);
+		else if(type == T_TIMEOUT)
+		{
+			if(++tries == RETRIES)
+			{
+				fail(t, _("The receiver did not start"));
+				return T_TIMEOUT;
+			}
+			memset(hdr, 0, 4);
+			zput_hex_header(t, ZRQINIT, hdr);
+		}
+		else if(type == T_CANCEL || type == T_ERROR || type == T_REMOTE)
+			return type;
+	}
+
+	t->crc32 = (hdr[3] & CANFC32) != 0;
+	t->escctl = (hdr[3] & ESCCTL) != 0;
+
+	for(i = 0; t->files[i] != NULL; i++)
+	{
+		if(g_stat(t->files[i], &st) == 0)
+			bytes_left -= MIN((guint64)st.st_size, bytes_left);
+		if((r = zmodem_send_file(t, t->files[i], files - i, bytes_left)) != T_OK)
+			return r;
+	}
+
+	for(tries = 0; tries < 3; tries++)
+	{
+		memset(hdr, 0, 4);
+		if((r = zput_hex_header(t, ZFIN, hdr)) != T_OK)
+			return r;
+		type = zget_header(t, hdr, 5000);
+		if(type == ZFIN)
+			return port_write(t, "OO", 2);
+		if(type == T_CANCEL || type == T_ERROR || type == T_REMOTE)
+			return type;
+	}
+
+	/* All files made it, a lost ZFIN is not worth a failure */
+	return T_OK;
+}
+
+/* Resume an interrupted file if its beginning matches the one offered */
+static FILE *zmodem_open(transfer_t *t, const gchar *path, guint64 size, guint32 *pos)
+{
+	guchar hdr[4], buf[4096];
+	struct stat st;
+	guint32 crc = 0xFFFFFFFF;
+	FILE *in;
+	gsize n;
+	gint type;
+
+	*pos = 0;
+	if(g_stat(path, &st) != 0 || st.st_size == 0 || (guint64)st.st_size >= size ||
+	   st.st_size > G_MAXUINT32)
+		return open_destination(t, path, "wb");
+
+	zpos(hdr, st.st_size);
+	if(zput_hex_header(t, ZCRC, hdr) != T_OK)
+		return NULL;
+	do
+		type = zget_header(t, hdr, TIMEOUT_BLOCK);
+	while(type == ZFILE);
+	if(type != ZCRC)
+		return open_destination(t, path, "wb");
+
+	if((in = g_fopen(path, "rb")) == NULL)
+		return open_destination(t, path, "wb");
+	while((n = fread(buf, 1, sizeof(buf), in)) > 0)
+		crc = crc32(crc, buf, n);
+	fclose(in);
+
+	if(~crc != zgetpos(hdr))
+		return open_destination(t, path, "wb");
+
+	*pos = st.st_size;
+	return open_destination(t, path, "ab");
+}
+
+static gint zmodem_receive(transfer_t *t)
+{
+	guchar hdr[4], init[4] = {0, 0, 0, CANFDX | CANOVIO | CANFC32};
+	guint32 pos = 0;
+	guint64 size;
+	FILE *out = NULL;
+	gchar *path, *name;
+	gsize len;
+	gint type, end, tries = 0, r = T_OK;
+
+	if((r = zput_hex_header(t, ZRINIT, init)) != T_OK)
+		return r;
+
+	for(;;)
+	{
+		type = zget_header(t, hdr, TIMEOUT_BLOCK);
+		switch(type)
+		{
+		case T_TIMEOUT:
+		case T_BAD:
+			if(++tries > RETRIES)
+			{
+				fail(t, _("The sender stopped"));
+				r = T_TIMEOUT;
+				goto out;
+			}
+			if(out != NULL)
+			{
+				zpos(hdr, pos);
+				zput_hex_header(t, ZRPOS, hdr);
+			}
+			else
+				zput_hex_header(t, ZRINIT, init);
+			break;
+		case ZRQINIT:
+			zput_hex_header(t, ZRINIT, init);
+			break;
+		case ZSINIT:
+			zget_data(t, &len);
+			memset(hdr, 0, 4);
+			zput_hex_header(t, ZACK, hdr);
+			break;
+		case ZFILE:
+			if(zget_data(t, &len) < 0 || len == 0)
+			{
+				zput_hex_header(t, ZRINIT, init);
+				break;
+			}
+			t->in[MIN(len, ZRX_SUBPACKET - 1)] = 0;
+			path = destination_path(t, (gchar *)t->in);
+			size = 0;
+			if(strlen((gchar *)t->in) + 1 < len)
+				size = g_ascii_strtoull((gchar *)t->in + strlen((gchar *)t->in) + 1, NULL, 10);
+
+			name = g_path_get_basename(path);
+			progress_start(t, name, size);
+			g_free(name);
+
+			if(out != NULL)
+				fclose(out);
+			out = zmodem_open(t, path, size, &pos);
+			g_free(path);
+			if(out == NULL)
+			{
+				r = T_ERROR;
+				goto out;
+			}
+			progress_set(t, pos);
+			zpos(hdr, pos);
+			zput_hex_header(t, ZRPOS, hdr);
+			break;
+		case ZDATA:
+			if(out == NULL)
+			{
+				zput_hex_header(t, ZRINIT, init);
+				break;
+			}
+			if(zgetpos(hdr) != pos)
+			{
+				port_purge(t);
+				zpos(hdr, pos);
+				zput_hex_header(t, ZRPOS, hdr);
+				break;
+			}
+			do
+			{
+				end = zget_data(t, &len);
+				if(end < 0)
+				{
+					if(end == T_CANCEL || end == T_ERROR || end == T_REMOTE)
+					{
+						r = end;
+						goto out;
+					}
+					/* Damaged: ask again from where we are */
+					port_purge(t);
+					zpos(hdr, pos);
+					zput_hex_header(t, ZRPOS, hdr);
+					break;
+				}
+				if(fwrite(t->in, 1, len, out) != len)
+				{
+					fail(t, _("Cannot write the received file"));
+					memset(hdr, 0, 4);
+					zput_hex_header(t, ZFERR, hdr);
+					r = T_ERROR;
+					goto out;
+				}
+				pos += len;
+				tries = 0;
+				progress_set(t, pos);
+				if(end == ZCRCW || end == ZCRCQ)
+				{
+					zpos(hdr, pos);
+					zput_hex_header(t, ZACK, hdr);
+				}
+			}
+			while(end == ZCRCG || end == ZCRCQ);
+			break;
+		case ZEOF:
+			/* An early ZEOF is for data still on its way */
+			if(out == NULL || zgetpos(hdr) != pos)
+				break;
+			if(fclose(out) != 0)
+			{
+				out = NULL;
+				fail(t, _("Cannot write the received file"));
+				r = T_ERROR;
+				goto out;
+			}
+			out = NULL;
+			progress_file_done(t);
+			zput_hex_header(t, ZRINIT, init);
+			break;
+		case ZFIN:
+			memset(hdr, 0, 4);
+			zput_hex_header(t, ZFIN, hdr);
+			port_getc(t, TIMEOUT_CHAR);
+			port_getc(t, TIMEOUT_CHAR);
+			goto out;
+		case ZCAN:
+		case ZABORT:
+			fail(t, _("Cancelled by the other side"));
+			r = T_REMOTE;
+			goto out;
+		default:
+			if(type < 0)
+			{
+				r = type;
+				goto out;
+			}
+			break;
+		}
+	}
+
+out:
+	if(out != NULL)
+		fclose(out);
+	return r;
+}
+
+/*
+ * Thread and progress window
+ */
+
+static gboolean transfer_finished(gpointer data);
+
+static gpointer transfer_thread(gpointer data)
+{
+	transfer_t *t = data;
+	gint r;
+
+	if(t->protocol == TRANSFER_ZMODEM)
+		r = t->sending ? zmodem_send(t) : zmodem_receive(t);
+	else
+		r = t->sending ? xmodem_send(t) : xmodem_receive(t);
+
+	if(r != T_OK && r != T_REMOTE)
+	{
+		send_cancel(t);
+		if(r == T_CANCEL)
+			fail(t, _("Cancelled"));
+		else
+			fail(t, _("Transfer failed"));
+	}
+
+	/* Let the other side see the end before the terminal reads again */
+	tcdrain(t->fd);
+	g_idle_add(transfer_finished, t);
+	return NULL;
+}
+
+static gboolean progress_refresh(gpointer data)
+{
+	transfer_t *t = transfer;
+	gdouble seconds, rate, line_rate;
+	gchar *text, *done, *total, *speed;
+
+	if(t == NULL)
+		return FALSE;
+
+	g_mutex_lock(&t->lock);
+	seconds = (g_get_monotonic_time() - t->start) / 1000000.0;
+	rate = seconds > 0 ? (t->previous + t->done) / seconds : 0;
+	done = g_format_size_full(t->done, G_FORMAT_SIZE_IEC_UNITS);
+	total = g_format_size_full(t->total, G_FORMAT_SIZE_IEC_UNITS);
+	speed = g_format_size_full(rate, G_FORMAT_SIZE_IEC_UNITS);
+	gtk_label_set_text(GTK_LABEL(progress_file), t->current ? t->current : _("Waiting for the other side..."));
+	if(t->total > 0)
+		gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(progress_bar), MIN(1.0, (gdouble)t->done / t->total));
+	else
+		gtk_progress_bar_pulse(GTK_PROGRESS_BAR(progress_bar));
+	g_mutex_unlock(&t->lock);
+
+	/* Against the bytes per second the line can carry at most */
+	line_rate = get_port_char_time() ? (gdouble)G_USEC_PER_SEC / get_port_char_time() : 0;
+	if(line_rate > 0)
+		text = g_strdup_printf(_("%s of %s, %s/s (%.0f%% of the line)"), done, total, speed,
+		                       100.0 * rate / line_rate);
+	else
+		text = g_strdup_printf(_("%s of %s, %s/s"), done, total, speed);
+	gtk_label_set_text(GTK_LABEL(progress_rate), text);
+
+	g_free(text);
+	g_free(speed);
+	g_free(total);
+	g_free(done);
+	return TRUE;
+}
+
+static void progress_response(GtkDialog *dialog, gint response, gpointer data)
+{
+	if(transfer != NULL)
+		g_atomic_int_set(&transfer->cancel, 1);
+}
+
+static gboolean transfer_finished(gpointer data)
+{
+	transfer_t *t = data;
+	gdouble seconds;
+	gchar *msg, *bytes;
+
+	g_thread_join(t->thread);
+	g_source_remove(progress_timer);
+	gtk_widget_destroy(progress_dialog);
+	progress_dialog = NULL;
+	transfer = NULL;
+
+	close(t->fd);
+	serial_pause_input(FALSE);
+
+	if(t->error != NULL)
+	{
+		msg = g_strdup_printf(_("File transfer: %s\n"), t->error);
+		show_message(msg, MSG_ERR);
+	}
+	else
+	{
+		seconds = (g_get_monotonic_time() - t->start) / 1000000.0;
+		bytes = g_format_size_full(t->previous + t->done, G_FORMAT_SIZE_IEC_UNITS);
+		msg = g_strdup_printf(_("%u file(s), %s in %.1f s"), t->files_done, bytes, seconds);
+		Put_temp_message(msg, 5000);
+		g_free(bytes);
+	}
+	g_free(msg);
+
+	g_strfreev(t->files);
+	g_free(t->destination);
+	g_free(t->current);
+	g_free(t->error);
+	g_mutex_clear(&t->lock);
+	g_free(t);
+
+	return FALSE;
+}
+
+static gboolean transfer_possible(void)
+{
+	if(transfer != NULL)
+		return FALSE;
+
+	if(serial_port_fd == -1)
+	{
+		show_message(_("The port is not open\n"), MSG_ERR);
+		return FALSE;
+	}
+
+	if(Send_chars_pending() > 0)
+	{
+		show_message(_("Data is still being sent, try again later\n"), MSG_WRN);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static void transfer_start(gint protocol, gboolean sending, gchar **files, gchar *destination)
+{
+	transfer_t *t;
+	GtkWidget *content_area, *vbox;
+	gchar *msg;
+	gint fd;
+
+	/* The port may have been closed while the file chooser was open */
+	if(!transfer_possible())
+	{
+		g_strfreev(files);
+		g_free(destination);
+		return;
+	}
+	fd = dup(serial_port_fd);
+	if(fd == -1)
+	{
+		msg = g_strdup_printf(_("Cannot start the transfer: %s\n"), strerror(errno));
+		show_message(msg, MSG_ERR);
+		g_free(msg);
+		g_strfreev(files);
+		g_free(destination);
+		return;
+	}
+
+	t = g_new0(transfer_t, 1);
+	t->protocol = protocol;
+	t->sending = sending;
+	t->files = files;
+	t->destination = destination;
+	t->fd = fd;
+	t->start = g_get_monotonic_time();
+	g_mutex_init(&t->lock);
+
+	if(crc16_table[1] == 0)
+		crc_tables_init();
+
+	/* The thread has the port to itself until it is done */
+	serial_pause_input(TRUE);
+	transfer = t;
+
+	progress_dialog = gtk_dialog_new_with_buttons(sending ? _("Sending files") : _("Receiving files"),
+	                  GTK_WINDOW(Fenetre),
+	                  GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT,
+	                  GTK_STOCK_CANCEL, GTK_RESPONSE_CANCEL,
+	                  NULL);
+	content_area = gtk_dialog_get_content_area(GTK_DIALOG(progress_dialog));
+	vbox = gtk_box_new(GTK_ORIENTATION_VERTICAL, 5);
+	gtk_container_set_border_width(GTK_CONTAINER(vbox), 10);
+	gtk_container_add(GTK_CONTAINER(content_area), vbox);
+
+	progress_file = gtk_label_new(NULL);
+	gtk_label_set_ellipsize(GTK_LABEL(progress_file), PANGO_ELLIPSIZE_MIDDLE);
+	gtk_box_pack_start(GTK_BOX(vbox), progress_file, FALSE, FALSE, 0);
+	progress_bar = gtk_progress_bar_new();
+	gtk_box_pack_start(GTK_BOX(vbox), progress_bar, FALSE, FALSE, 0);
+	progress_rate = gtk_label_new(NULL);
+	gtk_box_pack_start(GTK_BOX(vbox), progress_rate, FALSE, FALSE, 0);
+	gtk_window_set_default_size(GTK_WINDOW(progress_dialog), 350, -1);
+
+	/* Closing the window only asks the thread to stop */
+	g_signal_connect(progress_dialog, "response", G_CALLBACK(progress_response), NULL);
+	g_signal_connect(progress_dialog, "delete-event", G_CALLBACK(gtk_true), NULL);
+
+	progress_refresh(NULL);
+	progress_timer = g_timeout_add(250, progress_refresh, NULL);
+	gtk_widget_show_all(progress_dialog);
+
+	t->thread = g_thread_new("transfer", transfer_thread, t);
+}
+
+static gint action_protocol(GtkAction *action)
+{
+	const gchar *name = gtk_action_get_name(action);
+
+	if(g_str_has_suffix(name, "Ymodem"))
+		return TRANSFER_YMODEM;
+	if(g_str_has_suffix(name, "Zmodem"))
+		return TRANSFER_ZMODEM;
+	return TRANSFER_XMODEM;
+}
+
+void transfer_send_callback(GtkAction *action, gpointer data)
+{
+	GtkWidget *file_select;
+	GSList *list, *l;
+	gchar **files;
+	gint protocol, i;
+
+	if(!transfer_possible())
+		return;
+
+	protocol = action_protocol(action);
+	file_select = gtk_file_chooser_dialog_new(_("Send files"),
+	              GTK_WINDOW(Fenetre),
+	              GTK_FILE_CHOOSER_ACTION_OPEN,
+	              GTK_STOCK_CANCEL, GTK_RESPONSE_CANCEL,
+	              GTK_STOCK_OK, GTK_RESPONSE_ACCEPT,
+	              NULL);
+	/* XMODEM sends a single file, the others a batch */
+	gtk_file_chooser_set_select_multiple(GTK_FILE_CHOOSER(file_select), protocol != TRANSFER_XMODEM);
+
+	if(gtk_dialog_run(GTK_DIALOG(file_select)) != GTK_RESPONSE_ACCEPT)
+	{
+		gtk_widget_destroy(file_select);
+		return;
+	}
+
+	list = gtk_file_chooser_get_filenames(GTK_FILE_CHOOSER(file_select));
+	gtk_widget_destroy(file_select);
+	if(list == NULL)
+		return;
+
+	files = g_new0(gchar *, g_slist_length(list) + 1);
+	for(l = list, i = 0; l != NULL; l = l->next, i++)
+		files[i] = l->data;
+	g_slist_free(list);
+
+	transfer_start(protocol, TRUE, files, NULL);
+}
+
+void transfer_receive_callback(GtkAction *action, gpointer data)
+{
+	GtkWidget *file_select;
+	gchar *destination;
+	gint protocol;
+
+	if(!transfer_possible())
+		return;
+
+	protocol = action_protocol(action);
+	/* XMODEM does not send the name of the file */
+	if(protocol == TRANSFER_XMODEM)
+	{
+		file_select = gtk_file_chooser_dialog_new(_("Receive file"),
+		              GTK_WINDOW(Fenetre),
+		              GTK_FILE_CHOOSER_ACTION_SAVE,
+		              GTK_STOCK_CANCEL, GTK_RESPONSE_CANCEL,
+		              GTK_STOCK_SAVE, GTK_RESPONSE_ACCEPT,
+		              NULL);
+		gtk_file_chooser_set_do_overwrite_confirmation(GTK_FILE_CHOOSER(file_select), TRUE);
+	}
+	else
+		file_select = gtk_file_chooser_dialog_new(_("Receive files in folder"),
+		              GTK_WINDOW(Fenetre),
+		              GTK_FILE_CHOOSER_ACTION_SELECT_FOLDER,
+		              GTK_STOCK_CANCEL, GTK_RESPONSE_CANCEL,
+		              GTK_STOCK_OK, GTK_RESPONSE_ACCEPT,
+		              NULL);
+
+	if(gtk_dialog_run(GTK_DIALOG(file_select)) != GTK_RESPONSE_ACCEPT)
+	{
+		gtk_widget_destroy(file_select);
+		return;
+	}
+
+	destination = gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(file_select));
+	gtk_widget_destroy(file_select);
+	if(destination == NULL)
+		return;
+
+	transfer_start(protocol, FALSE, NULL, destination);
+}
+
+gboolean transfer_running(void)
+{
+	return transfer != NULL;
+}
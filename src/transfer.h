@@ -0,0 +1,26 @@
+/***********************************************************************/
+/* transfer.h                                                          */
+/* ----------                                                          */
+/*                           GTKTerm Software                          */
+/*                                 (c)                                 */
+/*                                                                     */
+/* ------------------------------------------------------------------- */
+/*                                                                     */
+/*   Purpose                                                           */
+/*      XMODEM / YMODEM / ZMODEM file transfers                        */
+/*      - Header file -                                                */
+/*                                                                     */
+/***********************************************************************/
+
+#ifndef TRANSFER_H_
+#define TRANSFER_H_
+
+#define TRANSFER_XMODEM 0
+#define TRANSFER_YMODEM 1
+#define TRANSFER_ZMODEM 2
+
+void transfer_send_callback(GtkAction *, gpointer);
+void transfer_receive_callback(GtkAction *, gpointer);
+gboolean transfer_running(void);
+
+#endif